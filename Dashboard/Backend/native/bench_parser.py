@@ -0,0 +1,133 @@
+"""
+Telemetry parser benchmark: the native parser against the Python path
+
+Writes a synthetic telemetry file of --size-mb megabytes, 16 columns as
+TELEMETRY_FIELDS lists them, and parses it with the native parser. The
+Python path builds a dict per sample and needs many times the file's size
+in memory, so it parses only the first --python-mb megabytes; its
+throughput is what it would keep up over the whole file. Both parse that
+prefix and their values are compared first.
+
+Each parse runs in its own process, so the peak memory is its own.
+
+    python native/bench_parser.py --size-mb 4096
+"""
+import argparse
+import json
+import os
+import random
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+BACKEND_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, BACKEND_DIR)
+
+import native_parser  # noqa: E402
+from server import TELEMETRY_FIELDS, iter_sensor_data  # noqa: E402
+
+BLOCK_ROWS = 10000
+
+
+def write_telemetry(path, size_mb, seed):
+    """A header, then rows of a flight-like trace repeated to size_mb"""
+    rng = random.Random(seed)
+    rows = []
+    for i in range(BLOCK_ROWS):
+        rows.append(','.join([
+            f'{i * 0.001:.3f}',
+            f'{rng.uniform(0, 3000):.2f}',
+            f'{rng.uniform(-50, 250):.2f}',
+            f'{rng.uniform(0, 30):.2f}',
+            *[f'{rng.gauss(0, 20):.3f}' for _ in range(4)],
+            f'{rng.uniform(-10, 30):.1f}',
+            f'{rng.uniform(70, 101.3):.3f}',
+            f'{rng.uniform(20, 60):.0f}',
+            f'{37.7749 + rng.uniform(-0.01, 0.01):.6f}',
+            f'{-122.4194 + rng.uniform(-0.01, 0.01):.6f}',
+            *[f'{rng.uniform(-180, 180):.2f}' for _ in range(3)],
+        ]))
+    block = ('\n'.join(rows) + '\n').encode()
+    target = size_mb << 20
+    with open(path, 'wb') as f:
+        f.write((','.join(name for name, _ in TELEMETRY_FIELDS) + '\n').encode())
+        written = 0
+        while written < target:
+            f.write(block)
+            written += len(block)
+
+
+def run_parser(kind, path):
+    """Parse in this process; prints rows, seconds and peak memory as JSON"""
+    start = time.perf_counter()
+    if kind == 'native':
+        rows = len(native_parser.read_columns(path, TELEMETRY_FIELDS)['time'])
+    else:
+        rows = len(list(iter_sensor_data(path)))
+    seconds = time.perf_counter() - start
+    peak_kb = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    print(json.dumps({'rows': rows, 'seconds': seconds, 'peak_mb': peak_kb / 1024}))
+
+
+def measure(kind, path):
+    output = subprocess.run([sys.executable, __file__, '--run', kind, path],
+                            check=True, capture_output=True, text=True).stdout
+    return json.loads(output.splitlines()[-1])
+
+
+def check_equal(path):
+    """Whether both parsers read the same values from path"""
+    columns = native_parser.read_columns(path, TELEMETRY_FIELDS)
+    count = 0
+    for i, data_point in enumerate(iter_sensor_data(path)):
+        if any(columns[name][i] != value for name, value in data_point.items()):
+            return False
+        count += 1
+    return count == len(columns['time'])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--size-mb', type=int, default=2048, help='synthetic file size (default 2048)')
+    parser.add_argument('--python-mb', type=int, default=64, help='prefix the Python path parses (default 64)')
+    parser.add_argument('--dir', default=tempfile.gettempdir(), help='where to write the files')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--run', nargs=2, metavar=('KIND', 'PATH'), help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.run:
+        run_parser(*args.run)
+        return 0
+    if not native_parser.available:
+        print("Native parser not built: cmake -S native -B native/build && cmake --build native/build")
+        return 1
+
+    full_path = os.path.join(args.dir, 'telemetry_bench_full.csv')
+    prefix_path = os.path.join(args.dir, 'telemetry_bench_prefix.csv')
+    try:
+        write_telemetry(full_path, args.size_mb, args.seed)
+        write_telemetry(prefix_path, min(args.python_mb, args.size_mb), args.seed)
+        if not check_equal(prefix_path):
+            print("Native and Python parsers disagree")
+            return 1
+
+        print(f"{'parser':<8} {'MB':>7} {'rows':>12} {'seconds':>9} {'MB/s':>8} {'rows/s':>12} {'peak MB':>9}")
+        results = {}
+        for kind, path in (('python', prefix_path), ('native', full_path)):
+            result = measure(kind, path)
+            mb = os.path.getsize(path) / (1 << 20)
+            results[kind] = mb / result['seconds']
+            print(f"{kind:<8} {mb:7.0f} {result['rows']:12d} {result['seconds']:9.2f} {results[kind]:8.1f} "
+                  f"{result['rows'] / result['seconds']:12.0f} {result['peak_mb']:9.0f}")
+        print(f"native parser {results['native'] / results['python']:.1f}x the Python path's throughput")
+    finally:
+        for path in (full_path, prefix_path):
+            if os.path.exists(path):
+                os.remove(path)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
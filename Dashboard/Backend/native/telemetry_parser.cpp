@@ -0,0 +1,483 @@
+/**
+ * Native telemetry parser
+ *
+ * Streams a telemetry text file in blocks and fills caller-owned columns of
+ * doubles with the rules of iter_sensor_data in ../server.py:
+ *
+ *   - The delimiter is the first of ',', ';' and tab on the first line;
+ *     without one, fields are separated by runs of whitespace.
+ *   - A first line whose first field is not a number is a header.
+ *   - Blank lines are skipped. Only the first `columns` fields of a line
+ *     are parsed, missing ones taking their column's default, and a line
+ *     with one that is not a number is skipped and counted.
+ *   - Lines end at "\n", "\r\n" or "\r", as in Python's text mode.
+ *   - Numbers are read as float() reads them: surrounding whitespace, a
+ *     sign, and inf, infinity or nan in any case. Digit separators
+ *     ("1_000") are the one form float() takes that this does not.
+ *
+ * Delimiters and line ends are found 16 bytes at a time with SSE2 or NEON,
+ * and numbers converted with std::from_chars, correctly rounded as float()
+ * rounds them. A plain C ABI, for ctypes: see ../native_parser.py.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TP_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 4 << 20;
+
+enum class Line {
+    ROW,
+    BLANK,
+    BAD,
+    MORE,       // Runs past the bytes read so far
+};
+
+/** Whitespace as str.strip() and str.split() see it in ASCII */
+inline bool is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r') || (c >= 0x1c && c <= 0x1f);
+}
+
+inline bool is_line_end(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+/** Ends a field: the delimiter or a line end, or any whitespace without a delimiter */
+inline bool is_stop(char c, char delimiter)
+{
+    return delimiter ? (c == delimiter || is_line_end(c)) : is_space(c);
+}
+
+#if defined(__SSE2__)
+/** Offset of the first stop in 16 bytes, 16 if none */
+inline int first_stop16(const char *p, char delimiter)
+{
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i stops;
+    if (delimiter) {
+        stops = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(delimiter)),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    } else {
+        // Unsigned ranges '\t'..'\r' and 0x1c..0x1f: x - low is at most span
+        __m128i controls = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        __m128i separators = _mm_sub_epi8(v, _mm_set1_epi8(0x1c));
+        stops = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(controls, _mm_set1_epi8(4)), controls),
+                                          _mm_cmpeq_epi8(_mm_min_epu8(separators, _mm_set1_epi8(3)), separators)));
+    }
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(stops));
+    return mask ? __builtin_ctz(mask) : 16;
+}
+#elif defined(__ARM_NEON)
+inline int first_stop16(const char *p, char delimiter)
+{
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+    uint8x16_t stops;
+    if (delimiter) {
+        stops = vorrq_u8(vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(delimiter))),
+                         vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+    } else {
+        stops = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                         vorrq_u8(vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4)),
+                                  vcleq_u8(vsubq_u8(v, vdupq_n_u8(0x1c)), vdupq_n_u8(3))));
+    }
+    // Four bits per byte
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stops), 4)), 0);
+    return mask ? __builtin_ctzll(mask) / 4 : 16;
+}
+#endif
+
+/** The first stop in [p, end), or end */
+inline const char *find_stop(const char *p, const char *end, char delimiter)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    while (end - p >= 16) {
+        int offset = first_stop16(p, delimiter);
+        if (offset < 16) {
+            return p + offset;
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && !is_stop(*p, delimiter)) {
+        p++;
+    }
+    return p;
+}
+
+inline void trim(const char *&p, const char *&end)
+{
+    while (p < end && is_space(static_cast<unsigned char>(*p))) {
+        p++;
+    }
+    while (end > p && is_space(static_cast<unsigned char>(end[-1]))) {
+        end--;
+    }
+}
+
+/** float() of a field */
+bool parse_number(const char *p, const char *end, double *out)
+{
+    trim(p, end);
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '+' || *p == '-')) {
+        p++;
+    }
+    if (p == end || *p == '+' || *p == '-' || std::memchr(p, '(', end - p)) {
+        return false;
+    }
+
+    double value;
+    auto [stop, ec] = std::from_chars(p, end, value);
+    if (stop != end) {
+        return false;
+    }
+    if (ec == std::errc::result_out_of_range) {
+        // float() overflows to inf and underflows to 0, as strtod does
+        std::string copy(p, end);
+        value = std::strtod(copy.c_str(), nullptr);
+    } else if (ec != std::errc()) {
+        return false;
+    }
+    *out = negative ? -value : value;
+    return true;
+}
+
+}  // namespace
+
+struct tp_parser {
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t begin = 0;           // Bytes not yet parsed
+    size_t end = 0;
+    uint64_t offset = 0;        // Of the buffer in the file
+    bool eof = false;
+    int error = 0;
+
+    char delimiter = 0;         // 0: runs of whitespace
+    bool header = false;
+    std::vector<double> defaults;
+
+    uint64_t line = 0;          // Lines consumed
+    uint64_t bad_lines = 0;
+    uint64_t first_bad_line = 0;
+};
+
+namespace {
+
+/** Read more of the file behind the unparsed bytes; false at the end */
+bool fill(tp_parser *parser)
+{
+    if (parser->eof) {
+        return false;
+    }
+    char *data = parser->buffer.data();
+    if (parser->begin > 0) {
+        std::memmove(data, data + parser->begin, parser->end - parser->begin);
+        parser->offset += parser->begin;
+        parser->end -= parser->begin;
+        parser->begin = 0;
+    }
+    if (parser->end == parser->buffer.size()) {
+        // A line longer than the buffer
+        parser->buffer.resize(parser->buffer.size() * 2);
+        data = parser->buffer.data();
+    }
+
+    ssize_t n;
+    do {
+        n = read(parser->fd, data + parser->end, parser->buffer.size() - parser->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        parser->error = (n < 0) ? errno : 0;
+        parser->eof = true;
+        return false;
+    }
+    parser->end += n;
+    return true;
+}
+
+/**
+ * Where the line ending at `stop` continues, or nullptr if that is past
+ * the bytes read so far
+ */
+inline const char *after_line_end(const char *stop, const char *end, bool final)
+{
+    if (stop == end) {
+        return final ? end : nullptr;
+    }
+    if (*stop == '\r') {
+        if (stop + 1 == end) {
+            return final ? end : nullptr;
+        }
+        return (stop[1] == '\n') ? stop + 2 : stop + 1;
+    }
+    return stop + 1;
+}
+
+/**
+ * Parse the line at p into row `index` of the columns; `final` when the
+ * bytes up to end are all the file has left
+ */
+Line parse_line(const tp_parser *parser, const char *p, const char *end, bool final,
+                double *const *columns, size_t index, const char **next)
+{
+    const size_t count = parser->defaults.size();
+    const char delimiter = parser->delimiter;
+    size_t fields = 0;
+    bool bad = false;
+    bool blank = false;
+
+    if (delimiter) {
+        // The line is stripped before it is split, which matters for tabs
+        while (p < end && !is_line_end(*p) && is_space(static_cast<unsigned char>(*p))) {
+            p++;
+        }
+        for (;;) {
+            const char *stop = find_stop(p, end, delimiter);
+            if (stop == end && !final) {
+                return Line::MORE;
+            }
+            if (stop != end && *stop == '\t' && delimiter == '\t') {
+                const char *rest = stop;
+                while (rest < end && !is_line_end(*rest) && is_space(static_cast<unsigned char>(*rest))) {
+                    rest++;
+                }
+                if (rest == end && !final) {
+                    return Line::MORE;
+                }
+                if (rest == end || is_line_end(*rest)) {
+                    stop = rest;
+                }
+            }
+            if (fields < count) {
+                bad |= !parse_number(p, stop, &columns[fields][index]);
+            }
+            if (fields == 0 && (stop == end || *stop != delimiter)) {
+                // A line of one field: blank if only whitespace
+                const char *q = p, *e = stop;
+                trim(q, e);
+                blank = (q == e);
+            }
+            fields++;
+            if (stop == end || *stop != delimiter) {
+                *next = after_line_end(stop, end, final);
+                break;
+            }
+            p = stop + 1;
+        }
+    } else {
+        for (;;) {
+            while (p < end && !is_line_end(*p) && is_space(static_cast<unsigned char>(*p))) {
+                p++;
+            }
+            if (p == end || is_line_end(*p)) {
+                *next = after_line_end(p, end, final);
+                break;
+            }
+            const char *stop = find_stop(p, end, 0);
+            if (stop == end && !final) {
+                return Line::MORE;
+            }
+            if (fields < count) {
+                bad |= !parse_number(p, stop, &columns[fields][index]);
+            }
+            fields++;
+            p = stop;
+        }
+        blank = (fields == 0);
+    }
+
+    if (*next == nullptr) {
+        return Line::MORE;
+    }
+    if (blank) {
+        return Line::BLANK;
+    }
+    if (bad) {
+        return Line::BAD;
+    }
+    for (size_t k = fields; k < count; k++) {
+        columns[k][index] = parser->defaults[k];
+    }
+    return Line::ROW;
+}
+
+/** Delimiter and header from the first line, skipping it if a header */
+void detect_format(tp_parser *parser)
+{
+    const char *line, *stop, *end;
+    for (;;) {
+        line = parser->buffer.data() + parser->begin;
+        end = parser->buffer.data() + parser->end;
+        stop = std::find_if(line, end, is_line_end);
+        bool complete = stop != end && !(*stop == '\r' && stop + 1 == end);
+        if (complete || !fill(parser)) {
+            break;
+        }
+    }
+    const char *next = after_line_end(stop, end, true);
+
+    const char *first = line, *last = stop;
+    trim(first, last);
+    for (char delimiter : { ',', ';', '\t' }) {
+        if (std::memchr(first, delimiter, last - first)) {
+            parser->delimiter = delimiter;
+            break;
+        }
+    }
+
+    const char *field_end = first;
+    while (field_end < last && !is_stop(*field_end, parser->delimiter)) {
+        field_end++;
+    }
+    double value;
+    if (first < last && !parse_number(first, field_end, &value)) {
+        parser->header = true;
+        parser->begin = next - parser->buffer.data();
+        parser->line = 1;
+    }
+}
+
+}  // namespace
+
+/**
+ * Open a telemetry file with `columns` columns, missing fields taking the
+ * given defaults. Returns NULL with errno set on failure.
+ */
+TP_EXPORT tp_parser *tp_open(const char *path, size_t columns, const double *defaults)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    tp_parser *parser = new (std::nothrow) tp_parser;
+    try {
+        if (parser == nullptr) {
+            throw std::bad_alloc();
+        }
+        parser->fd = fd;
+        parser->buffer.resize(BLOCK_SIZE);
+        parser->defaults.assign(defaults, defaults + columns);
+        detect_format(parser);
+    } catch (const std::bad_alloc &) {
+        delete parser;
+        close(fd);
+        errno = ENOMEM;
+        return nullptr;
+    }
+    if (parser->error) {
+        errno = parser->error;
+        delete parser;
+        close(fd);
+        return nullptr;
+    }
+    return parser;
+}
+
+/**
+ * Parse up to max_rows rows into columns[0..columns - 1], each with room
+ * for max_rows values. Returns the rows parsed, 0 at the end of the file.
+ */
+TP_EXPORT size_t tp_read(tp_parser *parser, double *const *columns, size_t max_rows)
+{
+    size_t rows = 0;
+    try {
+        while (rows < max_rows) {
+            const char *data = parser->buffer.data();
+            const char *p = data + parser->begin, *end = data + parser->end;
+            if (p == end && (parser->eof || !fill(parser))) {
+                break;
+            }
+            data = parser->buffer.data();
+            p = data + parser->begin;
+            end = data + parser->end;
+
+            const char *next = nullptr;
+            Line line = parse_line(parser, p, end, parser->eof, columns, rows, &next);
+            if (line == Line::MORE) {
+                fill(parser);       // At the end of the file, the line is parsed as final next time
+                continue;
+            }
+            parser->begin = next - data;
+            parser->line++;
+            if (line == Line::ROW) {
+                rows++;
+            } else if (line == Line::BAD) {
+                if (parser->bad_lines++ == 0) {
+                    parser->first_bad_line = parser->line;
+                }
+            }
+        }
+    } catch (const std::bad_alloc &) {
+        parser->error = ENOMEM;
+        parser->eof = true;
+    }
+    return rows;
+}
+
+/** The delimiter detected, 0 for runs of whitespace */
+TP_EXPORT int tp_delimiter(const tp_parser *parser)
+{
+    return parser->delimiter;
+}
+
+TP_EXPORT int tp_has_header(const tp_parser *parser)
+{
+    return parser->header;
+}
+
+/** Lines skipped for a field that is not a number */
+TP_EXPORT uint64_t tp_bad_lines(const tp_parser *parser)
+{
+    return parser->bad_lines;
+}
+
+/** Line number, from 1, of the first of them */
+TP_EXPORT uint64_t tp_first_bad_line(const tp_parser *parser)
+{
+    return parser->first_bad_line;
+}
+
+/** Bytes of the file parsed so far */
+TP_EXPORT uint64_t tp_offset(const tp_parser *parser)
+{
+    return parser->offset + parser->begin;
+}
+
+/** errno of a failed read, 0 if none */
+TP_EXPORT int tp_error(const tp_parser *parser)
+{
+    return parser->error;
+}
+
+TP_EXPORT void tp_close(tp_parser *parser)
+{
+    if (parser) {
+        close(parser->fd);
+        delete parser;
+    }
+}
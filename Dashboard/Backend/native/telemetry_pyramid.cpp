@@ -0,0 +1,231 @@
+/**
+ * Peak-preserving downsampling kernels
+ *
+ * A pyramid over a column of n samples holds, for each level l from
+ * `first` to `last`, the index of the minimum and of the maximum of every
+ * bucket of 2^l samples, bucket j covering [j * 2^l, (j + 1) * 2^l). Each
+ * level is built from the one below, so the pyramid costs O(n) to build
+ * and holds about n / 2^(first - 1) indices of each kind.
+ *
+ * tp_m4 answers a chart request with it: the range is split into one
+ * bucket per pixel column, and each keeps its first, last, minimum and
+ * maximum sample (M4, Jugel et al. 2014), which draws the same line at
+ * that width as every sample would. A column's minimum and maximum come
+ * from O(log n) pyramid buckets instead of a scan of its samples.
+ *
+ * tp_lttb thins such a selection further to a number of points with
+ * Largest-Triangle-Three-Buckets (Steinarsson 2013); run on the M4 points
+ * this is MinMaxLTTB (Van Der Donckt et al. 2023).
+ */
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#define TP_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace {
+
+struct Pyramid {
+    const double *values;
+    uint64_t n;
+    uint32_t first;
+    uint32_t last;
+    const uint32_t *const *mins;    // Level first + k at [k]; nullptr: no pyramid
+    const uint32_t *const *maxs;
+};
+
+struct Extremes {
+    uint64_t min;
+    uint64_t max;
+};
+
+/** Fold candidates into the extremes, the earlier sample winning a tie */
+inline void take(const double *values, uint64_t min, uint64_t max, Extremes &e)
+{
+    if (values[min] < values[e.min] || (values[min] == values[e.min] && min < e.min)) {
+        e.min = min;
+    }
+    if (values[max] > values[e.max] || (values[max] == values[e.max] && max < e.max)) {
+        e.max = max;
+    }
+}
+
+/** Indices of the minimum and maximum of [a, b), a < b */
+Extremes range_extremes(const Pyramid &p, uint64_t a, uint64_t b)
+{
+    Extremes e = { a, a };
+    if (p.mins == nullptr) {
+        for (uint64_t i = a + 1; i < b; i++) {
+            take(p.values, i, i, e);
+        }
+        return e;
+    }
+
+    // Samples up to the first level's bucket edges, then whole buckets,
+    // climbing a level whenever the ends are aligned to it
+    const uint64_t mask = (uint64_t(1) << p.first) - 1;
+    while (a < b && (a & mask)) {
+        take(p.values, a, a, e);
+        a++;
+    }
+    while (b > a && (b & mask)) {
+        b--;
+        take(p.values, b, b, e);
+    }
+    uint64_t lo = a >> p.first, hi = b >> p.first;
+    for (uint32_t level = p.first; lo < hi; level++) {
+        const uint32_t *mins = p.mins[level - p.first], *maxs = p.maxs[level - p.first];
+        if (level == p.last) {
+            for (uint64_t j = lo; j < hi; j++) {
+                take(p.values, mins[j], maxs[j], e);
+            }
+            break;
+        }
+        if (lo & 1) {
+            take(p.values, mins[lo], maxs[lo], e);
+            lo++;
+        }
+        if (hi & 1) {
+            hi--;
+            take(p.values, mins[hi], maxs[hi], e);
+        }
+        lo >>= 1;
+        hi >>= 1;
+    }
+    return e;
+}
+
+}  // namespace
+
+/**
+ * Build the pyramid of values[0..n - 1] into mins[k] and maxs[k], each
+ * with room for ceil(n / 2^(first + k)) indices, for levels first..last.
+ * n must be below 2^32.
+ */
+TP_EXPORT void tp_pyramid_build(const double *values, uint64_t n, uint32_t first, uint32_t last,
+                                uint32_t *const *mins, uint32_t *const *maxs)
+{
+    const uint64_t size = uint64_t(1) << first;
+    const uint64_t buckets = (n + size - 1) >> first;
+    for (uint64_t j = 0; j < buckets; j++) {
+        uint64_t begin = j << first, end = std::min(begin + size, n);
+        Extremes e = { begin, begin };
+        for (uint64_t i = begin + 1; i < end; i++) {
+            take(values, i, i, e);
+        }
+        mins[0][j] = static_cast<uint32_t>(e.min);
+        maxs[0][j] = static_cast<uint32_t>(e.max);
+    }
+
+    for (uint32_t level = first + 1; level <= last; level++) {
+        const uint32_t *min_below = mins[level - 1 - first], *max_below = maxs[level - 1 - first];
+        uint32_t *min_out = mins[level - first], *max_out = maxs[level - first];
+        const uint64_t below = (n + (uint64_t(1) << (level - 1)) - 1) >> (level - 1);
+        const uint64_t count = (n + (uint64_t(1) << level) - 1) >> level;
+        for (uint64_t j = 0; j < count; j++) {
+            Extremes e = { min_below[2 * j], max_below[2 * j] };
+            if (2 * j + 1 < below) {
+                take(values, min_below[2 * j + 1], max_below[2 * j + 1], e);
+            }
+            min_out[j] = static_cast<uint32_t>(e.min);
+            max_out[j] = static_cast<uint32_t>(e.max);
+        }
+    }
+}
+
+/**
+ * M4 of samples [low, high) at `width` pixel columns into out, which needs
+ * room for 4 * width indices, or all of the range if it is smaller:
+ * ascending, without repeats. With no more than 4 * width samples in the
+ * range, all of them. mins and maxs may be
+ * NULL to scan the samples instead of a pyramid. Returns the count.
+ */
+TP_EXPORT size_t tp_m4(const double *values, uint64_t n, uint32_t first, uint32_t last,
+                       const uint32_t *const *mins, const uint32_t *const *maxs,
+                       uint64_t low, uint64_t high, uint32_t width, uint64_t *out)
+{
+    high = std::min(high, n);
+    if (low >= high || width == 0) {
+        return 0;
+    }
+    const uint64_t count = high - low;
+    size_t k = 0;
+    if (count <= 4 * uint64_t(width)) {
+        for (uint64_t i = low; i < high; i++) {
+            out[k++] = i;
+        }
+        return k;
+    }
+
+    const Pyramid pyramid = { values, n, first, last, mins, maxs };
+    for (uint32_t column = 0; column < width; column++) {
+        uint64_t a = low + count * column / width, b = low + count * (column + 1) / width;
+        Extremes e = range_extremes(pyramid, a, b);
+        uint64_t picks[4] = { a, e.min, e.max, b - 1 };
+        std::sort(picks, picks + 4);
+        for (uint64_t pick : picks) {
+            if (k == 0 || out[k - 1] != pick) {
+                out[k++] = pick;
+            }
+        }
+    }
+    return k;
+}
+
+/**
+ * Largest-Triangle-Three-Buckets over the samples at indices[0..count - 1],
+ * ascending: the indices of `target` of them into out, the first and last
+ * always among them. Returns the count.
+ */
+TP_EXPORT size_t tp_lttb(const double *time, const double *values, const uint64_t *indices,
+                         size_t count, size_t target, uint64_t *out)
+{
+    if (target >= count || count <= 2) {
+        std::copy(indices, indices + count, out);
+        return count;
+    }
+    if (target < 3) {
+        out[0] = indices[0];
+        out[1] = indices[count - 1];
+        return std::min<size_t>(target, 2);
+    }
+
+    // The first and last points are kept; the rest are split into buckets
+    // and each keeps the point making the largest triangle with the point
+    // kept before it and the average of the next bucket
+    const double every = double(count - 2) / double(target - 2);
+    size_t k = 0, kept = 0;
+    out[k++] = indices[0];
+    for (size_t bucket = 0; bucket < target - 2; bucket++) {
+        size_t next_begin = size_t(std::floor((bucket + 1) * every)) + 1;
+        size_t next_end = std::min(size_t(std::floor((bucket + 2) * every)) + 1, count);
+        double avg_time = 0, avg_value = 0;
+        for (size_t j = next_begin; j < next_end; j++) {
+            avg_time += time[indices[j]];
+            avg_value += values[indices[j]];
+        }
+        if (next_end > next_begin) {
+            avg_time /= double(next_end - next_begin);
+            avg_value /= double(next_end - next_begin);
+        }
+
+        size_t begin = size_t(std::floor(bucket * every)) + 1;
+        size_t end = size_t(std::floor((bucket + 1) * every)) + 1;
+        const double kept_time = time[indices[kept]], kept_value = values[indices[kept]];
+        double largest = -1;
+        size_t best = begin;
+        for (size_t j = begin; j < end; j++) {
+            double area = std::fabs((kept_time - avg_time) * (values[indices[j]] - kept_value) -
+                                    (kept_time - time[indices[j]]) * (avg_value - kept_value));
+            if (area > largest) {
+                largest = area;
+                best = j;
+            }
+        }
+        out[k++] = indices[best];
+        kept = best;
+    }
+    out[k++] = indices[count - 1];
+    return k;
+}
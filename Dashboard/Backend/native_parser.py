@@ -0,0 +1,226 @@
+"""
+Native telemetry parser and downsampling kernels (native/) through ctypes
+
+Build them with:
+    cmake -S native -B native/build && cmake --build native/build
+
+Without the library `available` is False and the server does the same in
+Python. The parser reads the file in blocks and hands back columns, one
+array('d') per field, so no Python object is made per sample.
+"""
+import array
+import contextlib
+import ctypes
+import os
+
+BASE_DIR = os.path.dirname(os.path.abspath(__file__))
+LIBRARY_PATHS = [
+    os.environ.get('TELEMETRY_PARSER_LIBRARY', ''),
+    os.path.join(BASE_DIR, 'native', 'build', 'libtelemetry_parser.so'),
+    os.path.join(BASE_DIR, 'native', 'build', 'libtelemetry_parser.dylib'),
+]
+CHUNK_ROWS = 65536
+
+
+def _load_library():
+    """The first parser library that loads, or None"""
+    for path in LIBRARY_PATHS:
+        if not path or not os.path.exists(path):
+            continue
+        try:
+            lib = ctypes.CDLL(path, use_errno=True)
+        except OSError as e:
+            print(f"Warning: Could not load native parser {path}: {e}")
+            continue
+        lib.tp_open.restype = ctypes.c_void_p
+        lib.tp_open.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double)]
+        lib.tp_read.restype = ctypes.c_size_t
+        lib.tp_read.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.POINTER(ctypes.c_double)),
+                                ctypes.c_size_t]
+        for name in ('tp_bad_lines', 'tp_first_bad_line', 'tp_offset'):
+            getattr(lib, name).restype = ctypes.c_uint64
+            getattr(lib, name).argtypes = [ctypes.c_void_p]
+        lib.tp_error.restype = ctypes.c_int
+        lib.tp_error.argtypes = [ctypes.c_void_p]
+        lib.tp_close.restype = None
+        lib.tp_close.argtypes = [ctypes.c_void_p]
+
+        indices = ctypes.POINTER(ctypes.POINTER(ctypes.c_uint32))
+        lib.tp_pyramid_build.restype = None
+        lib.tp_pyramid_build.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint32, ctypes.c_uint32,
+                                         indices, indices]
+        lib.tp_m4.restype = ctypes.c_size_t
+        lib.tp_m4.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint32, ctypes.c_uint32,
+                              indices, indices, ctypes.c_uint64, ctypes.c_uint64, ctypes.c_uint32,
+                              ctypes.c_void_p]
+        lib.tp_lttb.restype = ctypes.c_size_t
+        lib.tp_lttb.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                                ctypes.c_size_t, ctypes.c_void_p]
+        return lib
+    return None
+
+
+_lib = _load_library()
+available = _lib is not None
+
+
+@contextlib.contextmanager
+def _open(file_path, fields):
+    """A parser of file_path; read errors raise and bad lines warn on closing"""
+    count = len(fields)
+    defaults = (ctypes.c_double * count)(*[default for _, default in fields])
+    parser = _lib.tp_open(os.fsencode(file_path), count, defaults)
+    if not parser:
+        errno = ctypes.get_errno()
+        raise OSError(errno, os.strerror(errno), file_path)
+    try:
+        yield parser
+
+        error = _lib.tp_error(parser)
+        if error:
+            raise OSError(error, os.strerror(error), file_path)
+        bad_lines = _lib.tp_bad_lines(parser)
+        if bad_lines:
+            print(f"Warning: Could not parse {bad_lines} lines of {file_path}, "
+                  f"the first line {_lib.tp_first_bad_line(parser)}")
+    finally:
+        _lib.tp_close(parser)
+
+
+def _pointers(addresses):
+    return (ctypes.POINTER(ctypes.c_double) * len(addresses))(
+        *[ctypes.cast(address, ctypes.POINTER(ctypes.c_double)) for address in addresses])
+
+
+def iter_columns(file_path, fields):
+    """
+    Parse a telemetry file in chunks of up to CHUNK_ROWS rows, yielding one
+    memoryview of doubles per field for each. fields lists (name, default)
+    in file order, as TELEMETRY_FIELDS does. The views are only valid until
+    the next chunk is read.
+    """
+    chunks = [(ctypes.c_double * CHUNK_ROWS)() for _ in fields]
+    pointers = _pointers([ctypes.addressof(chunk) for chunk in chunks])
+    views = [memoryview(chunk).cast('B').cast('d') for chunk in chunks]
+    with _open(file_path, fields) as parser:
+        while True:
+            rows = _lib.tp_read(parser, pointers, CHUNK_ROWS)
+            if rows == 0:
+                break
+            yield [view[:rows] for view in views]
+
+
+def read_columns(file_path, fields):
+    """
+    Parse a telemetry file into one array('d') per field, keyed by name.
+    The parser writes into the arrays themselves, sized from the file once
+    the first rows show how long a row is.
+    """
+    columns = [array.array('d') for _ in fields]
+    rows = 0
+    file_size = os.path.getsize(file_path)
+    with _open(file_path, fields) as parser:
+        while True:
+            capacity = len(columns[0])
+            if rows == capacity:
+                if rows:
+                    expected = rows * file_size // max(_lib.tp_offset(parser), 1)
+                    grow = max(expected + expected // 64 - rows, CHUNK_ROWS)
+                else:
+                    grow = CHUNK_ROWS
+                room = bytes(8 * grow)
+                for column in columns:
+                    column.frombytes(room)
+                capacity = len(columns[0])
+            # The arrays do not move until they grow again
+            pointers = _pointers([column.buffer_info()[0] + 8 * rows for column in columns])
+            read = _lib.tp_read(parser, pointers, capacity - rows)
+            if read == 0:
+                break
+            rows += read
+    for column in columns:
+        del column[rows:]
+    return {name: column for (name, _), column in zip(fields, columns)}
+
+
+# ============================================================================
+# DOWNSAMPLING
+# ============================================================================
+
+PYRAMID_FIRST_LEVEL = 3         # Buckets of 8 samples and up
+
+
+def _address(buffer):
+    """Address of a buffer: an array, or a writable memoryview"""
+    if isinstance(buffer, array.array):
+        return buffer.buffer_info()[0]
+    return ctypes.addressof(ctypes.c_char.from_buffer(buffer))
+
+
+def _index_pointers(levels, which):
+    return (ctypes.POINTER(ctypes.c_uint32) * len(levels))(
+        *[ctypes.cast(_address(level[which]), ctypes.POINTER(ctypes.c_uint32)) for level in levels])
+
+
+def pyramid_levels(rows):
+    """First and last level of a pyramid over rows samples, None if too few"""
+    last = min(rows.bit_length() - 1, 31)
+    if rows >= 1 << 32 or last < PYRAMID_FIRST_LEVEL:
+        return None
+    return PYRAMID_FIRST_LEVEL, last
+
+
+def pyramid_level_sizes(rows):
+    """Buckets in each level of the pyramid over rows samples"""
+    levels = pyramid_levels(rows)
+    if levels is None:
+        return []
+    return [-(-rows >> level) for level in range(levels[0], levels[1] + 1)]
+
+
+def build_pyramid(values):
+    """
+    Index of the minimum and maximum of each bucket of every level, as a
+    list of (mins, maxs) pairs of array('I'), or None for a short column
+    """
+    sizes = pyramid_level_sizes(len(values))
+    if not sizes:
+        return None
+    first, last = pyramid_levels(len(values))
+    levels = [(array.array('I', bytes(4 * size)), array.array('I', bytes(4 * size))) for size in sizes]
+    _lib.tp_pyramid_build(_address(values), len(values), first, last,
+                          _index_pointers(levels, 0), _index_pointers(levels, 1))
+    return levels
+
+
+def m4(values, pyramid, low, high, width):
+    """
+    Indices of the first, last, minimum and maximum sample of each of width
+    columns of [low, high), ascending, from the pyramid when there is one
+    """
+    high = min(high, len(values))
+    if high <= low:
+        return array.array('Q')
+    # More columns than samples keep every sample anyway
+    width = min(width, high - low)
+    out = array.array('Q', bytes(8 * min(4 * width, high - low)))
+    if pyramid:
+        first, last = pyramid_levels(len(values))
+        mins, maxs = _index_pointers(pyramid, 0), _index_pointers(pyramid, 1)
+    else:
+        first = last = 0
+        mins = maxs = None
+    count = _lib.tp_m4(_address(values), len(values), first, last, mins, maxs, low, high, width, _address(out))
+    del out[count:]
+    return out
+
+
+def lttb(time, values, indices, target):
+    """target of the indices (an array('Q')) by Largest-Triangle-Three-Buckets"""
+    if not indices:
+        return indices
+    out = array.array('Q', bytes(8 * len(indices)))
+    count = _lib.tp_lttb(_address(time), _address(values), _address(indices), len(indices), target,
+                         _address(out))
+    del out[count:]
+    return out
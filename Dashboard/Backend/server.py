@@ -3,14 +3,47 @@ from flask_cors import CORS
 from werkzeug.utils import secure_filename
 from datetime import datetime
 import os
+import sys
 import json
 import re
+import array
+import bisect
+import collections
+import itertools
+import math
+import mmap
+import struct
+import threading
+
+import native_parser
 
 # Configuration
 BASE_DIR = os.path.dirname(os.path.abspath(__file__))
 DATA_DIR = os.path.join(BASE_DIR, 'data')
 ALLOWED_VIDEO_EXTENSIONS = {'mp4', 'avi', 'mov', 'mkv'}
 ALLOWED_DATA_EXTENSIONS = {'txt', 'csv', 'log'}
+INDEX_PATH = os.path.join(DATA_DIR, '.flight_index.json')
+CACHE_NAME = '.telemetry.columns'
+
+# Telemetry columns in file order, with the value of a column a line lacks
+TELEMETRY_FIELDS = [
+    ('time', 0),
+    ('altitude', 0),
+    ('velocity', 0),
+    ('horizontalVelocity', 0),
+    ('acceleration', 0),
+    ('accelerationX', 0),
+    ('accelerationY', 0),
+    ('accelerationZ', 0),
+    ('temperature', 20),
+    ('pressure', 101.3),
+    ('humidity', 50),
+    ('gpsLat', 0),
+    ('gpsLon', 0),
+    ('pitch', 0),
+    ('roll', 0),
+    ('yaw', 0),
+]
 
 app = Flask(__name__, static_folder='../Frontend/Figma/dist')
 CORS(app)
@@ -52,25 +85,28 @@ def get_or_create_flight_folder(date_str=None):
     return folder_path
 
 
-def parse_sensor_data(file_path):
+def iter_sensor_data(file_path):
     """
-    Parse sensor data from a TXT file.
+    Parse sensor data from a TXT file, one data point at a time, reading
+    the file as it goes.
     Expected format (one reading per line, comma or space separated):
     timestamp,altitude,velocity,acceleration,temperature,pressure,humidity,gps_lat,gps_lon,pitch,roll,yaw
     
     Or with headers in first line.
     """
-    telemetry = []
-    
     with open(file_path, 'r') as f:
-        lines = f.readlines()
-    
-    if not lines:
-        return telemetry
+        first_line = f.readline()
+        if not first_line:
+            return
+        yield from _parse_lines(first_line, f)
+
+
+def _parse_lines(first_line, lines):
+    """Data points of an open file, its first line already read"""
+    rows = itertools.chain([first_line], lines)
     
     # Check if first line is a header
-    first_line = lines[0].strip()
-    start_idx = 0
+    first_line = first_line.strip()
     
     # Detect delimiter (comma, semicolon, tab, or space)
     if ',' in first_line:
@@ -84,12 +120,14 @@ def parse_sensor_data(file_path):
     
     # Check if first line contains non-numeric values (header)
     parts = first_line.split(delimiter) if delimiter else first_line.split()
+    start_idx = 0
     try:
         float(parts[0])
     except ValueError:
         start_idx = 1  # Skip header
+        rows = lines
     
-    for i, line in enumerate(lines[start_idx:]):
+    for i, line in enumerate(rows):
         line = line.strip()
         if not line:
             continue
@@ -98,31 +136,13 @@ def parse_sensor_data(file_path):
         
         try:
             # Map data to telemetry structure
-            # Adapt this based on your actual sensor data format
-            data_point = {
-                'time': float(parts[0]) if len(parts) > 0 else i * 0.1,
-                'altitude': float(parts[1]) if len(parts) > 1 else 0,
-                'velocity': float(parts[2]) if len(parts) > 2 else 0,
-                'horizontalVelocity': float(parts[3]) if len(parts) > 3 else 0,
-                'acceleration': float(parts[4]) if len(parts) > 4 else 0,
-                'accelerationX': float(parts[5]) if len(parts) > 5 else 0,
-                'accelerationY': float(parts[6]) if len(parts) > 6 else 0,
-                'accelerationZ': float(parts[7]) if len(parts) > 7 else 0,
-                'temperature': float(parts[8]) if len(parts) > 8 else 20,
-                'pressure': float(parts[9]) if len(parts) > 9 else 101.3,
-                'humidity': float(parts[10]) if len(parts) > 10 else 50,
-                'gpsLat': float(parts[11]) if len(parts) > 11 else 0,
-                'gpsLon': float(parts[12]) if len(parts) > 12 else 0,
-                'pitch': float(parts[13]) if len(parts) > 13 else 0,
-                'roll': float(parts[14]) if len(parts) > 14 else 0,
-                'yaw': float(parts[15]) if len(parts) > 15 else 0,
-            }
-            telemetry.append(data_point)
+            # Adapt TELEMETRY_FIELDS to your actual sensor data format
+            data_point = {name: float(parts[k]) if len(parts) > k else default
+                          for k, (name, default) in enumerate(TELEMETRY_FIELDS)}
+            yield data_point
         except (ValueError, IndexError) as e:
             print(f"Warning: Could not parse line {i + start_idx + 1}: {line}")
             continue
-    
-    return telemetry
 
 
 def get_flight_info(flight_folder):
@@ -145,19 +165,25 @@ def get_flight_info(flight_folder):
                           if allowed_file(f, ALLOWED_DATA_EXTENSIONS)]
         has_telemetry = len(telemetry_files) > 0
     
-    # Calculate duration from telemetry if available
+    # Duration, sample count and channel ranges from the flight index
     duration = 0
-    if has_telemetry:
-        for tf in telemetry_files:
-            telemetry_path = os.path.join(telemetry_dir, tf)
-            data = parse_sensor_data(telemetry_path)
-            if data:
-                duration = max(duration, data[-1].get('time', 0))
+    samples = 0
+    channels = {}
+    summaries = flight_index.telemetry_summaries(folder_name, telemetry_dir, telemetry_files)
+    for summary in summaries.values():
+        duration = max(duration, summary['duration'])
+        samples += summary['samples']
+        for name, (low, high) in summary['channels'].items():
+            merged = channels.setdefault(name, {'min': low, 'max': high})
+            merged['min'] = min(merged['min'], low)
+            merged['max'] = max(merged['max'], high)
     
     return {
         'id': folder_name,
         'date': folder_name,
         'duration': duration,
+        'samples': samples,
+        'channels': channels,
         'status': 'success' if has_telemetry and videos else 'partial' if has_telemetry or videos else 'pending',
         'cameras': len(videos),
         'videos': videos,
@@ -166,6 +192,494 @@ def get_flight_info(flight_folder):
     }
 
 
+# ============================================================================
+# FLIGHT INDEX
+# ============================================================================
+
+def summarize_telemetry(file_path):
+    """
+    Summarize a telemetry file in one streaming pass: the number of data
+    points, the time of the last one, and each channel's [min, max]
+    """
+    samples = 0
+    duration = 0
+    channels = {}
+    if native_parser.available:
+        for chunk in native_parser.iter_columns(file_path, TELEMETRY_FIELDS):
+            for (name, _), values in zip(TELEMETRY_FIELDS, chunk):
+                low, high = min(values), max(values)
+                bounds = channels.setdefault(name, [low, high])
+                bounds[0] = min(bounds[0], low)
+                bounds[1] = max(bounds[1], high)
+            samples += len(chunk[0])
+            duration = chunk[0][-1]
+        return {'samples': samples, 'duration': duration, 'channels': channels}
+    
+    for data_point in iter_sensor_data(file_path):
+        samples += 1
+        duration = data_point['time']
+        for name, value in data_point.items():
+            bounds = channels.get(name)
+            if bounds is None:
+                channels[name] = [value, value]
+            elif value < bounds[0]:
+                bounds[0] = value
+            elif value > bounds[1]:
+                bounds[1] = value
+    return {'samples': samples, 'duration': duration, 'channels': channels}
+
+
+def _file_stat(file_path):
+    """[size, mtime_ns] of a file, None if it is gone"""
+    try:
+        stat = os.stat(file_path)
+    except OSError:
+        return None
+    return [stat.st_size, stat.st_mtime_ns]
+
+
+class FlightIndex:
+    """
+    Telemetry file summaries persisted in a JSON manifest, keyed by flight
+    and file name. A file is parsed again only when its size or modification
+    time changes, so listing flights costs one stat per file instead of a
+    parse of everything ever recorded.
+    """
+
+    VERSION = 1
+
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.flights = self._load()
+
+    def _load(self):
+        try:
+            with open(self.path, 'r') as f:
+                manifest = json.load(f)
+            if manifest.get('version') == self.VERSION:
+                return manifest['flights']
+        except (OSError, ValueError, KeyError, AttributeError):
+            pass
+        return {}
+
+    def _save(self):
+        # Replace the manifest whole, so a crash never leaves half of one
+        temp_path = self.path + '.tmp'
+        try:
+            with open(temp_path, 'w') as f:
+                json.dump({'version': self.VERSION, 'flights': self.flights}, f)
+            os.replace(temp_path, self.path)
+        except OSError as e:
+            print(f"Warning: Could not save flight index: {e}")
+
+    def telemetry_summaries(self, flight_id, telemetry_dir, filenames):
+        """
+        Summaries of a flight's telemetry files, parsing only those that
+        changed. The parsing runs outside the lock, so a large file does not
+        hold up every other request; a file that changed again meanwhile is
+        returned but not indexed, and parsed again next time.
+        """
+        summaries = {}
+        stale = {}
+        with self.lock:
+            indexed = self.flights.get(flight_id, {})
+            for filename in filenames:
+                stat = _file_stat(os.path.join(telemetry_dir, filename))
+                if stat is None:
+                    continue
+                summary = indexed.get(filename)
+                if summary is None or [summary['size'], summary['mtime_ns']] != stat:
+                    stale[filename] = stat
+                else:
+                    summaries[filename] = summary
+
+        parsed = {}
+        for filename, stat in stale.items():
+            # Stat first: a file written while it is parsed is parsed again next time
+            summary = summarize_telemetry(os.path.join(telemetry_dir, filename))
+            summary['size'], summary['mtime_ns'] = stat
+            parsed[filename] = summary
+
+        with self.lock:
+            indexed = self.flights.get(flight_id, {})
+            merged = {}
+            changed = False
+            for filename in filenames:
+                if filename in summaries:
+                    merged[filename] = summaries[filename]
+                elif filename in parsed:
+                    summary = parsed[filename]
+                    summaries[filename] = summary
+                    if _file_stat(os.path.join(telemetry_dir, filename)) == [summary['size'], summary['mtime_ns']]:
+                        merged[filename] = summary
+                        changed = True
+            if not os.path.isdir(telemetry_dir):
+                # Deleted while it was parsed
+                merged = {}
+            if changed or merged.keys() != indexed.keys():
+                if merged:
+                    self.flights[flight_id] = merged
+                else:
+                    self.flights.pop(flight_id, None)
+                self._save()
+        return {filename: summaries[filename] for filename in filenames if filename in summaries}
+
+    def retain(self, flight_ids):
+        """Drop the flights not in flight_ids, whose folders are gone"""
+        with self.lock:
+            stale = [flight_id for flight_id in self.flights if flight_id not in flight_ids]
+            for flight_id in stale:
+                del self.flights[flight_id]
+            if stale:
+                self._save()
+
+    def forget(self, flight_id):
+        with self.lock:
+            if self.flights.pop(flight_id, None) is not None:
+                self._save()
+
+
+flight_index = FlightIndex(INDEX_PATH)
+
+
+# ============================================================================
+# TELEMETRY CACHE
+# ============================================================================
+
+def read_telemetry_columns(file_path):
+    """One array('d') per TELEMETRY_FIELDS name, parsed natively when built"""
+    if native_parser.available:
+        return native_parser.read_columns(file_path, TELEMETRY_FIELDS)
+    columns = {name: array.array('d') for name, _ in TELEMETRY_FIELDS}
+    for data_point in iter_sensor_data(file_path):
+        for name, value in data_point.items():
+            columns[name].append(value)
+    return columns
+
+
+def telemetry_sources(telemetry_dir):
+    """[size, mtime_ns] of each telemetry file, by name"""
+    sources = {}
+    if os.path.isdir(telemetry_dir):
+        for filename in sorted(os.listdir(telemetry_dir)):
+            if allowed_file(filename, ALLOWED_DATA_EXTENSIONS):
+                stat = _file_stat(os.path.join(telemetry_dir, filename))
+                if stat is not None:
+                    sources[filename] = stat
+    return sources
+
+
+CachedTelemetry = collections.namedtuple('CachedTelemetry', ['columns', 'pyramids'])
+
+
+class TelemetryCache:
+    """
+    Each flight's telemetry, merged and sorted by time, kept in one file of
+    columns in the flight folder:
+
+        magic           8 bytes, MAGIC
+        header length   u64, little-endian
+        header          JSON: rows, column names, byte order, whether there
+                        are pyramids, and the size and mtime of every
+                        telemetry file it was built from
+        padding         to a multiple of 8 bytes
+        columns         rows doubles per column, one column after another
+        pyramids        for each column but time, each level's minimum and
+                        maximum indices as u32 (see native_parser.py)
+
+    The file is built the first time a flight's telemetry is asked for, and
+    again when a telemetry file's size or mtime changes. Otherwise it is
+    memory-mapped and its columns served without parsing anything. The
+    pyramids need the native library; without it, charts are downsampled
+    from the columns alone.
+    """
+
+    MAGIC = b'STPICOL1'
+    VERSION = 2
+
+    def __init__(self):
+        self.lock = threading.Lock()    # Guards the two dicts, never held for I/O
+        self.mapped = {}    # Flight folder -> (sources, CachedTelemetry)
+        self.flight_locks = {}  # Flight folder -> lock held while its file is checked or built
+
+    def load(self, flight_folder):
+        """
+        The flight's columns by name, as memoryviews of doubles, and the
+        pyramids of all but time by name, None without them
+        """
+        telemetry_dir = os.path.join(flight_folder, 'telemetry')
+        cache_path = os.path.join(flight_folder, CACHE_NAME)
+        # A flight being built only holds up requests for that flight
+        with self.lock:
+            flight_lock = self.flight_locks.setdefault(flight_folder, threading.Lock())
+        with flight_lock:
+            sources = telemetry_sources(telemetry_dir)
+            with self.lock:
+                mapped = self.mapped.get(flight_folder)
+            if mapped is not None and mapped[0] == sources:
+                return mapped[1]
+            if not sources:
+                self.forget(flight_folder)
+                return CachedTelemetry({}, None)
+            
+            cached = self._map(cache_path, sources)
+            if cached is None:
+                cached = self._build(cache_path, telemetry_dir, sources)
+                cached = self._map(cache_path, sources) or cached
+            with self.lock:
+                self.mapped[flight_folder] = (sources, cached)
+            return cached
+
+    def forget(self, flight_folder):
+        with self.lock:
+            self.mapped.pop(flight_folder, None)
+
+    def _map(self, cache_path, sources):
+        """The cache file's contents if it was built from these sources, else None"""
+        names = [name for name, _ in TELEMETRY_FIELDS]
+        try:
+            with open(cache_path, 'rb') as f:
+                if f.read(len(self.MAGIC)) != self.MAGIC:
+                    return None
+                header_length, = struct.unpack('<Q', f.read(8))
+                header = json.loads(f.read(header_length))
+                if (header.get('version') != self.VERSION or header.get('sources') != sources
+                        or header.get('byteorder') != sys.byteorder or header.get('columns') != names
+                        or header.get('pyramids') != native_parser.available):
+                    return None
+                # Private and writable, so ctypes can take the columns' addresses
+                data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_COPY)
+        except (OSError, ValueError, struct.error):
+            return None
+        
+        rows = header['rows']
+        sizes = native_parser.pyramid_level_sizes(rows) if header['pyramids'] else []
+        offset = self._data_offset(header_length)
+        if len(data) < offset + 8 * rows * len(names) + 8 * sum(sizes) * (len(names) - 1):
+            return None
+        view = memoryview(data)
+        columns = {}
+        for name in names:
+            columns[name] = view[offset:offset + 8 * rows].cast('d')
+            offset += 8 * rows
+        
+        pyramids = None
+        if sizes:
+            pyramids = {}
+            for name in names[1:]:
+                levels = []
+                for size in sizes:
+                    mins = view[offset:offset + 4 * size].cast('I')
+                    maxs = view[offset + 4 * size:offset + 8 * size].cast('I')
+                    levels.append((mins, maxs))
+                    offset += 8 * size
+                pyramids[name] = levels
+        return CachedTelemetry(columns, pyramids)
+
+    def _build(self, cache_path, telemetry_dir, sources):
+        """Parse, merge and sort the telemetry files, and write the cache file"""
+        columns = {name: array.array('d') for name, _ in TELEMETRY_FIELDS}
+        for filename in sources:
+            parsed = read_telemetry_columns(os.path.join(telemetry_dir, filename))
+            for name, column in columns.items():
+                column.extend(parsed[name])
+        
+        # Sort by time, keeping the order of equal times
+        time = columns['time']
+        if any(a > b for a, b in zip(time, itertools.islice(time, 1, None))):
+            order = sorted(range(len(time)), key=time.__getitem__)
+            for name, column in columns.items():
+                columns[name] = array.array('d', [column[i] for i in order])
+        
+        pyramids = None
+        if native_parser.available and native_parser.pyramid_levels(len(time)):
+            pyramids = {name: native_parser.build_pyramid(column)
+                        for name, column in itertools.islice(columns.items(), 1, None)}
+        
+        header = json.dumps({
+            'version': self.VERSION,
+            'rows': len(time),
+            'columns': list(columns),
+            'byteorder': sys.byteorder,
+            'pyramids': native_parser.available,
+            'sources': sources,
+        }).encode()
+        temp_path = cache_path + '.tmp'
+        try:
+            with open(temp_path, 'wb') as f:
+                f.write(self.MAGIC)
+                f.write(struct.pack('<Q', len(header)))
+                f.write(header)
+                f.write(bytes(self._data_offset(len(header)) - f.tell()))
+                for column in columns.values():
+                    column.tofile(f)
+                for levels in (pyramids or {}).values():
+                    for mins, maxs in levels:
+                        mins.tofile(f)
+                        maxs.tofile(f)
+            os.replace(temp_path, cache_path)
+        except OSError as e:
+            print(f"Warning: Could not write telemetry cache {cache_path}: {e}")
+        return CachedTelemetry(columns, pyramids)
+
+    def _data_offset(self, header_length):
+        return (len(self.MAGIC) + 8 + header_length + 7) // 8 * 8
+
+
+telemetry_cache = TelemetryCache()
+
+
+# ============================================================================
+# TELEMETRY QUERIES
+# ============================================================================
+
+DOWNSAMPLE_METHODS = ('m4', 'lttb')
+MAX_CHART_WIDTH = 100000    # Pixel columns a width request may ask for
+
+
+def parse_telemetry_query(args):
+    """
+    start, end, channels, points, width and downsample of a telemetry
+    request's query string, None where absent. Raises ValueError for a
+    malformed one.
+    """
+    names = [name for name, _ in TELEMETRY_FIELDS]
+    query = {'start': None, 'end': None, 'channels': None, 'points': None, 'width': None, 'downsample': None}
+    for key in ('start', 'end'):
+        if args.get(key):
+            try:
+                query[key] = float(args[key])
+            except ValueError:
+                raise ValueError(f"{key} must be a time in seconds")
+            if math.isnan(query[key]):
+                raise ValueError(f"{key} must be a time in seconds")
+    if args.get('channels'):
+        channels = [channel for channel in args['channels'].split(',') if channel]
+        unknown = [channel for channel in channels if channel not in names]
+        if unknown:
+            raise ValueError(f"Unknown channels: {', '.join(unknown)}")
+        query['channels'] = ['time'] + [name for name in names if name in channels and name != 'time']
+    for key in ('points', 'width'):
+        if args.get(key):
+            try:
+                query[key] = int(args[key])
+            except ValueError:
+                query[key] = 0
+            if query[key] < 1:
+                raise ValueError(f"{key} must be a positive integer")
+    if query['width'] is not None and query['width'] > MAX_CHART_WIDTH:
+        raise ValueError(f"width must be at most {MAX_CHART_WIDTH}")
+    if args.get('downsample'):
+        if args['downsample'] not in DOWNSAMPLE_METHODS:
+            raise ValueError(f"downsample must be one of {', '.join(DOWNSAMPLE_METHODS)}")
+        if query['width'] is None and query['points'] is None:
+            raise ValueError("downsample needs width or points")
+        query['downsample'] = args['downsample']
+    elif query['width'] is not None:
+        query['downsample'] = 'm4'
+    return query
+
+
+def m4_indices(values, pyramid, low, high, width):
+    """
+    Indices of the first, last, minimum and maximum sample of each of width
+    pixel columns of [low, high), ascending: drawn at that width, the same
+    line as every sample (M4). All of them if there are no more than 4 * width.
+    """
+    if native_parser.available:
+        return native_parser.m4(values, pyramid, low, high, width)
+    count = high - low
+    if count <= 4 * width:
+        return list(range(low, max(high, low)))
+    indices = []
+    for column in range(width):
+        a, b = low + count * column // width, low + count * (column + 1) // width
+        samples = values[a:b].tolist()
+        picks = {a, a + samples.index(min(samples)), a + samples.index(max(samples)), b - 1}
+        indices.extend(sorted(picks))
+    return indices
+
+
+def lttb_indices(time, values, indices, target):
+    """
+    target of the ascending indices by Largest-Triangle-Three-Buckets: the
+    first and last, and from each bucket between them the sample making the
+    largest triangle with the one kept before it and the next bucket's mean
+    """
+    if native_parser.available:
+        return native_parser.lttb(time, values, array.array('Q', indices), target)
+    count = len(indices)
+    if target >= count or count <= 2:
+        return list(indices)
+    if target < 3:
+        return [indices[0], indices[-1]][:target]
+    
+    every = (count - 2) / (target - 2)
+    kept = 0
+    out = [indices[0]]
+    for bucket in range(target - 2):
+        next_begin = int((bucket + 1) * every) + 1
+        next_end = min(int((bucket + 2) * every) + 1, count)
+        following = indices[next_begin:next_end]
+        avg_time = sum(time[i] for i in following) / len(following) if following else 0.0
+        avg_value = sum(values[i] for i in following) / len(following) if following else 0.0
+        
+        kept_time, kept_value = time[indices[kept]], values[indices[kept]]
+        begin, end = int(bucket * every) + 1, int((bucket + 1) * every) + 1
+        best = max(range(begin, end), key=lambda j: (
+            abs((kept_time - avg_time) * (values[indices[j]] - kept_value)
+                - (kept_time - time[indices[j]]) * (avg_value - kept_value)), -j))
+        out.append(indices[best])
+        kept = best
+    out.append(indices[-1])
+    return out
+
+
+def select_telemetry(cached, start=None, end=None, channels=None, points=None, width=None, downsample=None):
+    """
+    Data points of the cached telemetry with start <= time <= end, projected
+    onto the channels and thinned to fit a chart. The columns are sorted by
+    time, so the range is found by binary search. Thinning is either
+    - even: at most `points` samples, evenly spaced; O(log n + k)
+    - m4: per channel, M4 at `width` pixel columns (points / 4 without
+      width), found in the channel's pyramid; O(width log n)
+    - lttb: per channel, LTTB down to `points` (width without points) of
+      the M4 samples at `width` columns (points without width), which
+      keeps the peaks M4 finds (MinMaxLTTB)
+    A data point is kept if any channel keeps it. Returns the data points
+    and how many samples the range holds.
+    """
+    columns, pyramids = cached
+    time = columns.get('time')
+    if time is None:
+        return [], 0
+    low = 0 if start is None else bisect.bisect_left(time, start)
+    high = len(time) if end is None else bisect.bisect_right(time, end)
+    total = max(high - low, 0)
+    names = channels or list(columns)
+    
+    values = [name for name in names if name != 'time']
+    if downsample is None or not values or total == 0:
+        step = 1 if points is None or total <= points else -(-total // points)
+        selected = [columns[name][low:high:step] for name in names]
+        return [dict(zip(names, row)) for row in zip(*selected)], total
+    
+    target = points or width
+    if width is None:
+        # M4 at points / 4 columns already keeps about points samples, which
+        # would leave LTTB nothing to choose; give it a column per point
+        width = points if downsample == 'lttb' else max(points // 4, 1)
+    kept = set()
+    for name in values:
+        pyramid = pyramids.get(name) if pyramids else None
+        indices = m4_indices(columns[name], pyramid, low, high, width)
+        if downsample == 'lttb':
+            indices = lttb_indices(time, columns[name], indices, target)
+        kept.update(indices)
+    return [{name: columns[name][i] for name in names} for i in sorted(kept)], total
+
+
 # ============================================================================
 # SERVE REACT APP
 # ============================================================================
@@ -201,6 +715,7 @@ def get_flights():
                 except ValueError:
                     continue
     
+    flight_index.retain({flight['id'] for flight in flights})
     return jsonify({'flights': flights})
 
 
@@ -243,6 +758,8 @@ def delete_flight(flight_id):
     
     try:
         shutil.rmtree(folder_path)
+        flight_index.forget(flight_id)
+        telemetry_cache.forget(folder_path)
         return jsonify({'success': True, 'message': f'Flight {flight_id} deleted'})
     except Exception as e:
         return jsonify({'success': False, 'error': str(e)}), 500
@@ -351,26 +868,34 @@ def upload_telemetry(flight_id):
 
 @app.route('/api/flights/<flight_id>/telemetry', methods=['GET'])
 def get_telemetry(flight_id):
-    """Get parsed telemetry data for a flight"""
-    telemetry_dir = os.path.join(DATA_DIR, flight_id, 'telemetry')
+    """
+    Get parsed telemetry data for a flight
+    Optional query parameters:
+      start, end    time range in seconds, both inclusive
+      channels      comma-separated channel names; time is always included
+      points        at most this many samples, evenly spaced over the range
+      width         chart width in pixels: M4-downsample each channel to it
+      downsample    m4 or lttb (see select_telemetry); m4 with width
+    """
+    try:
+        query = parse_telemetry_query(request.args)
+    except ValueError as e:
+        return jsonify({'error': str(e)}), 400
     
-    if not os.path.exists(telemetry_dir):
-        return jsonify({'flight_id': flight_id, 'data': []})
+    folder_path = os.path.join(DATA_DIR, flight_id)
+    telemetry_dir = os.path.join(folder_path, 'telemetry')
     
-    # Combine all telemetry files
-    all_data = []
-    for filename in os.listdir(telemetry_dir):
-        if allowed_file(filename, ALLOWED_DATA_EXTENSIONS):
-            file_path = os.path.join(telemetry_dir, filename)
-            data = parse_sensor_data(file_path)
-            all_data.extend(data)
+    if not os.path.exists(telemetry_dir):
+        return jsonify({'flight_id': flight_id, 'data': [], 'total': 0})
     
-    # Sort by time
-    all_data.sort(key=lambda x: x.get('time', 0))
+    # All telemetry files, merged and sorted by time, from the cache
+    cached = telemetry_cache.load(folder_path)
+    data, total = select_telemetry(cached, **query)
     
     return jsonify({
         'flight_id': flight_id,
-        'data': all_data
+        'data': data,
+        'total': total
     })
 
 
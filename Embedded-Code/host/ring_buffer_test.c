@@ -0,0 +1,356 @@
+/**
+ * Host tests of ring_buffer.h: the zero-copy and copying APIs at their
+ * boundaries, indices crossing the wraparound of size_t (UINT32_MAX on the
+ * ESP32), and a producer and consumer thread checking every byte they pass.
+ *
+ *   build/ring_buffer_test [--records N]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring_buffer.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * Start both indices at index, as if that many bytes had already passed
+ */
+static void ring_set_index(RingBuffer_t *rb, size_t index)
+{
+    atomic_store(&rb->write_index, index);
+    atomic_store(&rb->read_index, index);
+}
+
+static void test_init(void)
+{
+    RingBuffer_t rb;
+    uint8_t storage[64];
+
+    CHECK(!ring_buffer_init(&rb, storage, 0));
+    CHECK(!ring_buffer_init(&rb, storage, 48));
+    CHECK(ring_buffer_init(&rb, storage, 64));
+    CHECK(rb.mask == 63);
+    CHECK(ring_buffer_free_space(&rb) == 64);
+    CHECK(ring_buffer_available(&rb) == 0);
+}
+
+static void test_reserve_commit_peek_release(void)
+{
+    RingBuffer_t rb;
+    uint8_t storage[64];
+    RingSpan_t span;
+    ring_buffer_init(&rb, storage, sizeof(storage));
+
+    CHECK(ring_buffer_reserve(&rb, 10, &span));
+    CHECK(span.ptr[0] == storage && span.len[0] == 10 && span.len[1] == 0);
+    memcpy(span.ptr[0], "0123456789", 10);
+
+    // Nothing is readable until the commit
+    CHECK(ring_buffer_available(&rb) == 0);
+    CHECK(ring_buffer_peek(&rb, &span) == 0);
+    ring_buffer_commit(&rb, 10);
+    CHECK(ring_buffer_available(&rb) == 10);
+    CHECK(ring_buffer_free_space(&rb) == 54);
+
+    CHECK(ring_buffer_peek(&rb, &span) == 10);
+    CHECK(span.ptr[0] == storage && span.len[0] == 10 && span.len[1] == 0);
+    CHECK(memcmp(span.ptr[0], "0123456789", 10) == 0);
+
+    // Releasing part of it leaves the rest in place
+    ring_buffer_release(&rb, 4);
+    CHECK(ring_buffer_peek(&rb, &span) == 6);
+    CHECK(span.ptr[0] == storage + 4 && memcmp(span.ptr[0], "456789", 6) == 0);
+    ring_buffer_release(&rb, 6);
+    CHECK(ring_buffer_available(&rb) == 0);
+    CHECK(ring_buffer_free_space(&rb) == 64);
+}
+
+static void test_full_and_empty(void)
+{
+    RingBuffer_t rb;
+    uint8_t storage[64], data[64], out[64];
+    RingSpan_t span;
+    ring_buffer_init(&rb, storage, sizeof(storage));
+    for (int i = 0; i < 64; i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+
+    // Empty: nothing to read, a read copies nothing
+    CHECK(ring_buffer_read(&rb, out, sizeof(out)) == 0);
+
+    // Exactly full, then not one byte more
+    CHECK(ring_buffer_write(&rb, data, 64) == 64);
+    CHECK(ring_buffer_free_space(&rb) == 0);
+    CHECK(ring_buffer_available(&rb) == 64);
+    CHECK(ring_buffer_write(&rb, data, 1) == 0);
+
+    // A failed reserve leaves the span untouched
+    memset(&span, 0xA5, sizeof(span));
+    RingSpan_t before = span;
+    CHECK(!ring_buffer_reserve(&rb, 1, &span));
+    CHECK(memcmp(&span, &before, sizeof(span)) == 0);
+    CHECK(ring_buffer_reserve(&rb, 0, &span));
+
+    CHECK(ring_buffer_read(&rb, out, sizeof(out)) == 64);
+    CHECK(memcmp(out, data, 64) == 0);
+    CHECK(ring_buffer_available(&rb) == 0);
+    CHECK(ring_buffer_free_space(&rb) == 64);
+
+    // A write larger than the free space is all or nothing
+    CHECK(ring_buffer_write(&rb, data, 40) == 40);
+    CHECK(ring_buffer_write(&rb, data, 25) == 0);
+    CHECK(ring_buffer_available(&rb) == 40);
+    CHECK(ring_buffer_read(&rb, out, 10) == 10);
+    CHECK(ring_buffer_available(&rb) == 30);
+}
+
+static void test_wrap(void)
+{
+    RingBuffer_t rb;
+    uint8_t storage[64], out[32];
+    RingSpan_t span;
+    ring_buffer_init(&rb, storage, sizeof(storage));
+    ring_set_index(&rb, 50);
+
+    // 20 bytes from offset 50 wrap into two spans of 14 and 6
+    CHECK(ring_buffer_reserve(&rb, 20, &span));
+    CHECK(span.ptr[0] == storage + 50 && span.len[0] == 14);
+    CHECK(span.ptr[1] == storage && span.len[1] == 6);
+    const char *text = "abcdefghijklmnopqrst";
+    ring_span_write(&span, 0, text, 20);
+    CHECK(memcmp(storage + 50, text, 14) == 0 && memcmp(storage, text + 14, 6) == 0);
+
+    // Contiguous only when the range stays on one side of the wrap
+    CHECK(ring_span_contiguous(&span, 0, 14) == storage + 50);
+    CHECK(ring_span_contiguous(&span, 14, 6) == storage);
+    CHECK(ring_span_contiguous(&span, 16, 2) == storage + 2);
+    CHECK(ring_span_contiguous(&span, 10, 8) == NULL);
+    ring_buffer_commit(&rb, 20);
+
+    // Reads across the wrap, from any offset
+    CHECK(ring_buffer_peek(&rb, &span) == 20);
+    CHECK(span.len[0] == 14 && span.len[1] == 6);
+    memset(out, 0, sizeof(out));
+    ring_span_read(&span, 10, out, 8);
+    CHECK(memcmp(out, "klmnopqr", 8) == 0);
+    ring_span_read(&span, 16, out, 4);
+    CHECK(memcmp(out, "qrst", 4) == 0);
+    ring_buffer_release(&rb, 20);
+
+    // A region ending exactly at the end of the storage does not wrap
+    ring_set_index(&rb, 48);
+    CHECK(ring_buffer_reserve(&rb, 16, &span));
+    CHECK(span.ptr[0] == storage + 48 && span.len[0] == 16 && span.len[1] == 0);
+}
+
+static void test_index_wraparound(void)
+{
+    RingBuffer_t rb;
+    uint8_t storage[64], data[48], out[48];
+    RingSpan_t span;
+    ring_buffer_init(&rb, storage, sizeof(storage));
+    for (int i = 0; i < 48; i++) {
+        data[i] = (uint8_t)(0x80 + i);
+    }
+
+    // Indices 10 bytes short of wrapping: the write index wraps to a small
+    // value while the read index has not, and the masks still agree
+    ring_set_index(&rb, SIZE_MAX - 9);
+    CHECK(ring_buffer_write(&rb, data, 48) == 48);
+    CHECK(atomic_load(&rb.write_index) == 38);
+    CHECK(ring_buffer_available(&rb) == 48);
+    CHECK(ring_buffer_free_space(&rb) == 16);
+
+    // The data starts 10 bytes before the end of the storage
+    CHECK(ring_buffer_peek(&rb, &span) == 48);
+    CHECK(span.ptr[0] == storage + 54 && span.len[0] == 10 && span.len[1] == 38);
+    CHECK(ring_buffer_write(&rb, data, 17) == 0);
+    CHECK(ring_buffer_read(&rb, out, 48) == 48);
+    CHECK(memcmp(out, data, 48) == 0);
+    CHECK(ring_buffer_available(&rb) == 0 && ring_buffer_free_space(&rb) == 64);
+
+    // Full with the read index on one side of the wrap and the write index
+    // on the other
+    ring_set_index(&rb, SIZE_MAX - 31);
+    CHECK(ring_buffer_write(&rb, data, 32) == 32);
+    CHECK(ring_buffer_write(&rb, data, 32) == 32);
+    CHECK(ring_buffer_free_space(&rb) == 0 && ring_buffer_available(&rb) == 64);
+    CHECK(ring_buffer_read(&rb, out, 32) == 32);
+    CHECK(ring_buffer_free_space(&rb) == 32);
+
+    // The 32-bit index of the device wrapping, on a host whose size_t may
+    // be wider: only the low bits select the position
+    ring_set_index(&rb, (size_t)UINT32_MAX - 3);
+    CHECK(ring_buffer_reserve(&rb, 8, &span));
+    CHECK(span.ptr[0] == storage + 60 && span.len[0] == 4 && span.len[1] == 4);
+}
+
+// ============================================================================
+// SPSC STRESS
+// ============================================================================
+
+/*
+ * The producer writes records of a sequence number, a length and that many
+ * bytes derived from both, 1 to 40 bytes at a time, through reserve/commit
+ * and the copying write in turn. The consumer peeks and releases records,
+ * sometimes several at once, and checks every byte. The ring is small and
+ * its indices start just short of wrapping, so records wrap constantly.
+ */
+
+#define STRESS_RING_SIZE 256
+#define RECORD_HEADER_LEN 5
+#define RECORD_MAX_PAYLOAD 40
+
+typedef struct {
+    RingBuffer_t rb;
+    uint32_t records;
+    atomic_uint errors;             // Set by the consumer; stops the producer
+} Stress_t;
+
+static inline uint8_t payload_byte(uint32_t seq, size_t i)
+{
+    return (uint8_t)(seq * 31 + i * 7 + (seq >> 8));
+}
+
+static inline size_t payload_len(uint32_t seq)
+{
+    return 1 + (seq * 2654435761u >> 16) % RECORD_MAX_PAYLOAD;
+}
+
+static void *stress_producer(void *arg)
+{
+    Stress_t *s = arg;
+    uint8_t record[RECORD_HEADER_LEN + RECORD_MAX_PAYLOAD];
+
+    for (uint32_t seq = 0; seq < s->records; seq++) {
+        size_t len = payload_len(seq);
+        memcpy(record, &seq, 4);
+        record[4] = (uint8_t)len;
+        for (size_t i = 0; i < len; i++) {
+            record[RECORD_HEADER_LEN + i] = payload_byte(seq, i);
+        }
+
+        size_t total = RECORD_HEADER_LEN + len;
+        if (seq & 1) {
+            while (ring_buffer_write(&s->rb, record, total) == 0) {
+                if (atomic_load(&s->errors)) {
+                    return NULL;
+                }
+                sched_yield();
+            }
+        } else {
+            RingSpan_t span;
+            while (!ring_buffer_reserve(&s->rb, total, &span)) {
+                if (atomic_load(&s->errors)) {
+                    return NULL;
+                }
+                sched_yield();
+            }
+            ring_span_write(&span, 0, record, total);
+            ring_buffer_commit(&s->rb, total);
+        }
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+    Stress_t *s = arg;
+    uint32_t expected = 0;
+
+    while (expected < s->records) {
+        RingSpan_t span;
+        size_t available = ring_buffer_peek(&s->rb, &span);
+        size_t offset = 0;
+
+        // Every whole record in view, released together
+        while (offset + RECORD_HEADER_LEN <= available) {
+            uint8_t header[RECORD_HEADER_LEN];
+            ring_span_read(&span, offset, header, RECORD_HEADER_LEN);
+            uint32_t seq;
+            memcpy(&seq, header, 4);
+            size_t len = header[4];
+            if (offset + RECORD_HEADER_LEN + len > available) {
+                break;
+            }
+
+            uint8_t payload[RECORD_MAX_PAYLOAD];
+            ring_span_read(&span, offset + RECORD_HEADER_LEN, payload, len);
+            bool ok = (seq == expected && len == payload_len(seq));
+            for (size_t i = 0; ok && i < len; i++) {
+                ok = (payload[i] == payload_byte(seq, i));
+            }
+            if (!ok) {
+                fprintf(stderr, "stress: record %u: got sequence %u, %zu bytes\n",
+                        (unsigned)expected, (unsigned)seq, len);
+                atomic_store(&s->errors, 1);
+                return NULL;
+            }
+            expected++;
+            offset += RECORD_HEADER_LEN + len;
+        }
+
+        if (offset > 0) {
+            ring_buffer_release(&s->rb, offset);
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_spsc_stress(uint32_t records)
+{
+    static uint8_t storage[STRESS_RING_SIZE];
+    Stress_t s = { .records = records };
+    ring_buffer_init(&s.rb, storage, sizeof(storage));
+    ring_set_index(&s.rb, SIZE_MAX - 1000);
+
+    pthread_t producer, consumer;
+    CHECK(pthread_create(&consumer, NULL, stress_consumer, &s) == 0);
+    CHECK(pthread_create(&producer, NULL, stress_producer, &s) == 0);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    CHECK(atomic_load(&s.errors) == 0);
+    CHECK(ring_buffer_available(&s.rb) == 0);
+    printf("stress: %u records through a %d-byte ring\n", (unsigned)records, STRESS_RING_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = 2000000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+            records = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--records N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    test_init();
+    test_reserve_commit_peek_release();
+    test_full_and_empty();
+    test_wrap();
+    test_index_wraparound();
+    test_spsc_stress(records);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("ring_buffer: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "ff.h"
+#include "sdmmc_cmd.h"
+
+/**
+ * FatFs drive number of a mounted card, 0xFF if it is not mounted
+ */
+BYTE ff_diskio_get_pdrv_card(const sdmmc_card_t *card);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#define SDMMC_HOST_SLOT_0               0
+#define SDMMC_HOST_SLOT_1               1
+#define SDMMC_FREQ_DEFAULT              20000
+#define SDMMC_FREQ_HIGHSPEED            40000
+#define SDMMC_SLOT_FLAG_INTERNAL_PULLUP (1 << 0)
+#define SDMMC_SLOT_WIDTH_DEFAULT        0
+
+typedef struct {
+    uint32_t flags;
+    int slot;
+    int max_freq_khz;
+} sdmmc_host_t;
+
+typedef struct {
+    gpio_num_t clk;
+    gpio_num_t cmd;
+    gpio_num_t d0;
+    gpio_num_t d1;
+    gpio_num_t d2;
+    gpio_num_t d3;
+    gpio_num_t cd;
+    gpio_num_t wp;
+    uint8_t width;
+    uint32_t flags;
+} sdmmc_slot_config_t;
+
+#define SDMMC_HOST_DEFAULT() { \
+        .flags = 0, \
+        .slot = SDMMC_HOST_SLOT_1, \
+        .max_freq_khz = SDMMC_FREQ_DEFAULT, \
+    }
+
+#define SDMMC_SLOT_CONFIG_DEFAULT() { \
+        .clk = GPIO_NUM_NC, .cmd = GPIO_NUM_NC, \
+        .d0 = GPIO_NUM_NC, .d1 = GPIO_NUM_NC, .d2 = GPIO_NUM_NC, .d3 = GPIO_NUM_NC, \
+        .cd = GPIO_NUM_NC, .wp = GPIO_NUM_NC, \
+        .width = SDMMC_SLOT_WIDTH_DEFAULT, \
+        .flags = 0, \
+    }
@@ -0,0 +1,7 @@
+#pragma once
+
+// Memory placement only matters on the device
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define WORD_ALIGNED_ATTR   __attribute__((aligned(4)))
+#define DMA_ATTR            WORD_ALIGNED_ATTR DRAM_ATTR
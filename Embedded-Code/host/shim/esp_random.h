@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/random.h>
+
+static inline uint32_t esp_random(void)
+{
+    uint32_t value = 0;
+    getrandom(&value, sizeof(value), 0);
+    return value;
+}
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "sim.h"
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    pthread_t thread;
+    uint64_t period_us;
+    atomic_bool running;
+};
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (args == NULL || args->callback == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->args = *args;
+    *out = timer;
+    return ESP_OK;
+}
+
+/**
+ * Fires on absolute deadlines, so a late callback does not shift the ones
+ * after it, as with the real esp_timer
+ */
+static void *timer_thread(void *arg)
+{
+    struct esp_timer *timer = arg;
+    int64_t next_us = sim_now_us() + timer->period_us;
+
+    while (atomic_load(&timer->running) && !sim_stopped()) {
+        sim_sleep_until_us(next_us);
+        if (!atomic_load(&timer->running) || sim_stopped()) {
+            break;
+        }
+        timer->args.callback(timer->args.arg);
+        next_us += timer->period_us;
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (period_us == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (atomic_exchange(&timer->running, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = period_us;
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0) {
+        atomic_store(&timer->running, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!atomic_exchange(&timer->running, false)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_join(timer->thread, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (atomic_load(&timer->running)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
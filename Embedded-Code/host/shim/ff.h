@@ -0,0 +1,49 @@
+/**
+ * The part of FatFs the firmware reaches into directly (see sd_raw.c). The
+ * simulated card has no FAT; each file opened here is given its own run of
+ * sectors, see sim_fs_extent().
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t LBA_t;
+typedef uint64_t FSIZE_t;
+typedef char TCHAR;
+
+#define FF_MIN_SS       512
+#define FF_MAX_SS       4096        // CONFIG_FATFS_SECTOR_4096
+
+#define FA_READ         0x01
+
+typedef enum {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+} FRESULT;
+
+typedef struct {
+    LBA_t database;             // First sector of cluster 2
+    WORD csize;                 // Sectors per cluster
+    WORD ssize;                 // Bytes per sector
+} FATFS;
+
+typedef struct {
+    FATFS *fs;
+    DWORD sclust;               // First cluster
+    FSIZE_t objsize;
+} FFOBJID;
+
+typedef struct {
+    FFOBJID obj;
+} FIL;
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "sim.h"
+
+struct SimTask {
+    pthread_t thread;
+    char name[16];
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t value;             // Notification value
+    bool pending;               // Notification not yet taken
+};
+
+struct SimQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t item_size;           // 0 for semaphores
+    size_t length;
+    size_t count;
+    size_t head;
+    uint8_t *items;
+};
+
+static __thread struct SimTask *current_task;
+
+/**
+ * Condition variables wait on CLOCK_MONOTONIC to match sim_deadline()
+ */
+static void init_sync(pthread_mutex_t *lock, pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(lock, NULL);
+}
+
+static int64_t ticks_to_us(TickType_t ticks)
+{
+    return (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+}
+
+/**
+ * Wait on cond for at most timeout ticks. Returns false once the timeout
+ * has passed; the caller re-checks its predicate either way.
+ */
+static bool wait_ticks(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static const struct timespec *make_deadline(struct timespec *ts, TickType_t timeout)
+{
+    if (timeout == portMAX_DELAY) {
+        return NULL;
+    }
+    sim_deadline(ts, ticks_to_us(timeout));
+    return ts;
+}
+
+// --- Tasks -------------------------------------------------------------------
+
+static struct SimTask *new_task(const char *name)
+{
+    struct SimTask *task = calloc(1, sizeof(*task));
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    init_sync(&task->lock, &task->cond);
+    return task;
+}
+
+static void *task_entry(void *arg)
+{
+    struct SimTask *task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *out,
+                                   BaseType_t core_id)
+{
+    struct SimTask *task = new_task(name);
+    task->fn = fn;
+    task->arg = arg;
+
+    // Publish the handle before the task can run and use it
+    if (out != NULL) {
+        *out = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, out, 0);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // Threads not created through xTaskCreate get a handle on first use
+    if (current_task == NULL) {
+        current_task = new_task("native");
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_now_us() * configTICK_RATE_HZ / 1000000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_sleep_us(ticks_to_us(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    *previous_wake += increment;
+    int64_t wake_us = ticks_to_us(*previous_wake);
+    if (wake_us <= sim_now_us()) {
+        return pdFALSE;
+    }
+    sim_sleep_until_us(wake_us);
+    return pdTRUE;
+}
+
+// --- Notifications -------------------------------------------------------------
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    BaseType_t ret = pdPASS;
+
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+    case eSetBits:
+        task->value |= value;
+        break;
+    case eIncrement:
+        task->value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->pending) {
+            ret = pdFAIL;
+        } else {
+            task->value = value;
+        }
+        break;
+    case eNoAction:
+        break;
+    }
+    task->pending = true;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdTRUE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t timeout)
+{
+    struct SimTask *task = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    const struct timespec *deadline = make_deadline(&ts, timeout);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&task->lock);
+    if (!task->pending) {
+        task->value &= ~clear_on_entry;
+    }
+    while (!task->pending && wait_ticks(&task->cond, &task->lock, deadline)) {
+    }
+    if (value != NULL) {
+        *value = task->value;
+    }
+    if (task->pending) {
+        task->value &= ~clear_on_exit;
+        task->pending = false;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout)
+{
+    struct SimTask *task = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    const struct timespec *deadline = make_deadline(&ts, timeout);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->value == 0 && wait_ticks(&task->cond, &task->lock, deadline)) {
+    }
+    uint32_t value = task->value;
+    if (value > 0) {
+        task->value = clear_on_exit ? 0 : value - 1;
+    }
+    task->pending = false;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+// --- Queues and semaphores -----------------------------------------------------
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct SimQueue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    init_sync(&queue->lock, &queue->changed);
+    queue->item_size = item_size;
+    queue->length = length;
+    if (item_size > 0) {
+        queue->items = calloc(length, item_size);
+    }
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout)
+{
+    struct timespec ts;
+    const struct timespec *deadline = make_deadline(&ts, timeout);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (timeout == 0 || !wait_ticks(&queue->changed, &queue->lock, deadline)) {
+            if (queue->count == queue->length) {
+                pthread_mutex_unlock(&queue->lock);
+                return errQUEUE_FULL;
+            }
+        }
+    }
+    if (queue->item_size > 0) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdTRUE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout)
+{
+    struct timespec ts;
+    const struct timespec *deadline = make_deadline(&ts, timeout);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (timeout == 0 || !wait_ticks(&queue->changed, &queue->lock, deadline)) {
+            if (queue->count == 0) {
+                pthread_mutex_unlock(&queue->lock);
+                return errQUEUE_EMPTY;
+            }
+        }
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem != NULL) {
+        sem->count = initial_count;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
@@ -0,0 +1,62 @@
+#include <pthread.h>
+#include "driver/gpio.h"
+#include "sim.h"
+
+typedef struct {
+    gpio_isr_t handler;
+    void *arg;
+} GpioHandler_t;
+
+static GpioHandler_t handlers[GPIO_NUM_MAX];
+static pthread_mutex_t handlers_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool isr_service_installed = false;
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (config->pin_bit_mask == 0 || config->pin_bit_mask >= (1ULL << GPIO_NUM_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    if (isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void *arg)
+{
+    if (!isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&handlers_lock);
+    handlers[pin] = (GpioHandler_t){ handler, arg };
+    pthread_mutex_unlock(&handlers_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    return gpio_isr_handler_add(pin, NULL, NULL);
+}
+
+void sim_gpio_fire(int pin)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&handlers_lock);
+    GpioHandler_t h = handlers[pin];
+    pthread_mutex_unlock(&handlers_lock);
+
+    if (h.handler != NULL) {
+        h.handler(h.arg);
+    }
+}
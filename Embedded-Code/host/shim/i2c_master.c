@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "driver/i2c_master.h"
+#include "sim.h"
+
+#define MAX_WRITE_LEN   32
+
+typedef struct {
+    struct i2c_master_dev_t *dev;
+    uint8_t write[MAX_WRITE_LEN];
+    size_t write_len;
+    uint8_t *read;
+    size_t read_len;
+} Transaction_t;
+
+struct i2c_master_bus_t {
+    pthread_mutex_t wire;           // Held for the duration of one transaction
+    pthread_mutex_t lock;           // Guards the transaction queue
+    pthread_cond_t changed;
+    pthread_t worker;
+    Transaction_t *queue;
+    size_t depth;
+    size_t head;
+    size_t count;
+    bool busy;                      // Worker has a transaction on the wire
+};
+
+struct i2c_master_dev_t {
+    struct i2c_master_bus_t *bus;
+    uint16_t address;
+    uint32_t scl_hz;
+    i2c_master_callback_t on_trans_done;
+    void *arg;
+};
+
+/**
+ * Wire time of a write-then-read: 9 clocks per byte including ACK, an
+ * address byte for each direction, plus start, repeated start and stop
+ */
+static int64_t bus_time_us(const struct i2c_master_dev_t *dev, size_t write_len, size_t read_len)
+{
+    uint32_t bits = 9 * (1 + write_len) + (read_len ? 9 * (1 + read_len) : 0) + 3;
+    return (int64_t)bits * 1000000 / dev->scl_hz;
+}
+
+static esp_err_t run_transaction(struct i2c_master_dev_t *dev, const uint8_t *write, size_t write_len,
+                                 uint8_t *read, size_t read_len)
+{
+    pthread_mutex_lock(&dev->bus->wire);
+    sim_sleep_us(bus_time_us(dev, write_len, read_len));
+    esp_err_t ret = sim_i2c_transfer(dev->address, write, write_len, read, read_len);
+    pthread_mutex_unlock(&dev->bus->wire);
+    return ret;
+}
+
+/**
+ * Plays the role of the I2C interrupt: runs queued transactions back to
+ * back and reports each through its device's callback
+ */
+static void *bus_worker(void *arg)
+{
+    struct i2c_master_bus_t *bus = arg;
+
+    while (1) {
+        pthread_mutex_lock(&bus->lock);
+        while (bus->count == 0) {
+            pthread_cond_wait(&bus->changed, &bus->lock);
+        }
+        Transaction_t t = bus->queue[bus->head];
+        bus->head = (bus->head + 1) % bus->depth;
+        bus->count--;
+        bus->busy = true;
+        pthread_mutex_unlock(&bus->lock);
+
+        esp_err_t ret = run_transaction(t.dev, t.write, t.write_len, t.read, t.read_len);
+        i2c_master_event_data_t evt = {
+            .event = (ret == ESP_OK) ? I2C_EVENT_DONE : I2C_EVENT_NACK,
+        };
+        t.dev->on_trans_done(t.dev, &evt, t.dev->arg);
+
+        pthread_mutex_lock(&bus->lock);
+        bus->busy = false;
+        pthread_cond_broadcast(&bus->changed);
+        pthread_mutex_unlock(&bus->lock);
+    }
+    return NULL;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *out)
+{
+    struct i2c_master_bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&bus->wire, NULL);
+    pthread_mutex_init(&bus->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);     // sim_deadline() is monotonic
+    pthread_cond_init(&bus->changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    bus->depth = config->trans_queue_depth;
+    if (bus->depth > 0) {
+        bus->queue = calloc(bus->depth, sizeof(Transaction_t));
+        if (bus->queue == NULL || pthread_create(&bus->worker, NULL, bus_worker, bus) != 0) {
+            free(bus->queue);
+            free(bus);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    *out = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *out)
+{
+    if (config->scl_speed_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->bus = bus;
+    dev->address = config->device_address;
+    dev->scl_hz = config->scl_speed_hz;
+    *out = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t dev,
+                                              const i2c_master_event_callbacks_t *cbs, void *arg)
+{
+    if (dev->bus->depth == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    dev->on_trans_done = cbs->on_trans_done;
+    dev->arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *write, size_t write_len,
+                                      uint8_t *read, size_t read_len, int timeout_ms)
+{
+    struct i2c_master_bus_t *bus = dev->bus;
+
+    if (dev->on_trans_done == NULL) {
+        esp_err_t ret = run_transaction(dev, write, write_len, read, read_len);
+        return (ret == ESP_OK) ? ESP_OK : ESP_FAIL;
+    }
+    if (write_len > MAX_WRITE_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Asynchronous: queue it and return, the callback reports the outcome
+    pthread_mutex_lock(&bus->lock);
+    if (bus->count == bus->depth) {
+        pthread_mutex_unlock(&bus->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    Transaction_t *t = &bus->queue[(bus->head + bus->count) % bus->depth];
+    t->dev = dev;
+    memcpy(t->write, write, write_len);
+    t->write_len = write_len;
+    t->read = read;
+    t->read_len = read_len;
+    bus->count++;
+    pthread_cond_broadcast(&bus->changed);
+    pthread_mutex_unlock(&bus->lock);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *write, size_t write_len,
+                              int timeout_ms)
+{
+    return i2c_master_transmit_receive(dev, write, write_len, NULL, 0, timeout_ms);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *read, size_t read_len, int timeout_ms)
+{
+    return i2c_master_transmit_receive(dev, NULL, 0, read, read_len, timeout_ms);
+}
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus, int timeout_ms)
+{
+    struct timespec deadline;
+    esp_err_t ret = ESP_OK;
+
+    sim_deadline(&deadline, (int64_t)timeout_ms * 1000);
+    pthread_mutex_lock(&bus->lock);
+    while (ret == ESP_OK && (bus->count > 0 || bus->busy)) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&bus->changed, &bus->lock);
+        } else if (pthread_cond_timedwait(&bus->changed, &bus->lock, &deadline) != 0) {
+            ret = ESP_ERR_TIMEOUT;
+        }
+    }
+    pthread_mutex_unlock(&bus->lock);
+    return ret;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus, uint16_t address, int timeout_ms)
+{
+    return sim_i2c_present(address) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
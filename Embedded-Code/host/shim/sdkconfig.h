@@ -0,0 +1,109 @@
+/**
+ * Host build configuration
+ *
+ * Mirrors the "Star PI Logger Configuration" section of ../../sdkconfig.
+ * Every option can be overridden per simulation target from CMakeLists.txt;
+ * bool options use 0/1 so they work in #if.
+ */
+#pragma once
+
+#define CONFIG_FREERTOS_HZ                  100
+#define CONFIG_IDF_TARGET_LINUX             1
+
+#ifndef CONFIG_SAMPLER_BASE_RATE_HZ
+#define CONFIG_SAMPLER_BASE_RATE_HZ         1000
+#endif
+#ifndef CONFIG_SENSOR_I2C_ASYNC
+#define CONFIG_SENSOR_I2C_ASYNC             1
+#endif
+#ifndef CONFIG_SENSOR_IMU_FIFO
+#define CONFIG_SENSOR_IMU_FIFO              1
+#endif
+#ifndef CONFIG_SENSOR_IMU_FIFO_DRAIN_HZ
+#define CONFIG_SENSOR_IMU_FIFO_DRAIN_HZ     100
+#endif
+#ifndef CONFIG_SENSOR_IMU_DRDY_GPIO
+#define CONFIG_SENSOR_IMU_DRDY_GPIO         -1
+#endif
+#ifndef CONFIG_SENSOR_MAG_DRDY_GPIO
+#define CONFIG_SENSOR_MAG_DRDY_GPIO         -1
+#endif
+
+// Off unlike sdkconfig: the benchmark configs log from power-on, and
+// async_fifo_launch flies the sensors to trigger it
+#ifndef CONFIG_FLIGHT_LAUNCH_TRIGGER
+#define CONFIG_FLIGHT_LAUNCH_TRIGGER        0
+#endif
+#ifndef CONFIG_FLIGHT_PRETRIGGER_MS
+#define CONFIG_FLIGHT_PRETRIGGER_MS         2000
+#endif
+#ifndef CONFIG_FLIGHT_PAD_RATE_DIVIDER
+#define CONFIG_FLIGHT_PAD_RATE_DIVIDER      10
+#endif
+#ifndef CONFIG_FLIGHT_LAUNCH_MG
+#define CONFIG_FLIGHT_LAUNCH_MG             2500
+#endif
+#ifndef CONFIG_FLIGHT_LAUNCH_MS
+#define CONFIG_FLIGHT_LAUNCH_MS             100
+#endif
+#ifndef CONFIG_FLIGHT_LAUNCH_ALTITUDE_M
+#define CONFIG_FLIGHT_LAUNCH_ALTITUDE_M     30
+#endif
+
+#ifndef CONFIG_FUSION_RATE_HZ
+#define CONFIG_FUSION_RATE_HZ               100
+#endif
+
+#ifndef CONFIG_LOGGER_FLUSH_LATENCY_MS
+#define CONFIG_LOGGER_FLUSH_LATENCY_MS      1000
+#endif
+#ifndef CONFIG_LOGGER_CHECKPOINT_MS
+#define CONFIG_LOGGER_CHECKPOINT_MS         1000
+#endif
+
+// LOGGER_OVERFLOW_POLICY choice: define one of the other two to switch
+#ifndef CONFIG_LOGGER_OVERFLOW_OVERWRITE_OLDEST
+#define CONFIG_LOGGER_OVERFLOW_OVERWRITE_OLDEST 0
+#endif
+#ifndef CONFIG_LOGGER_OVERFLOW_DECIMATE
+#define CONFIG_LOGGER_OVERFLOW_DECIMATE     0
+#endif
+#define CONFIG_LOGGER_OVERFLOW_DROP_NEWEST  (!CONFIG_LOGGER_OVERFLOW_OVERWRITE_OLDEST && !CONFIG_LOGGER_OVERFLOW_DECIMATE)
+
+#ifndef CONFIG_LOGGER_RING_BUFFER_KB
+#define CONFIG_LOGGER_RING_BUFFER_KB        32
+#endif
+
+// LOGGER_RING_PLACEMENT choice: define one of the other two to switch
+#ifndef CONFIG_LOGGER_RING_DMA
+#define CONFIG_LOGGER_RING_DMA              0
+#endif
+#ifndef CONFIG_LOGGER_RING_PSRAM
+#define CONFIG_LOGGER_RING_PSRAM            0
+#endif
+#define CONFIG_LOGGER_RING_INTERNAL         (!CONFIG_LOGGER_RING_DMA && !CONFIG_LOGGER_RING_PSRAM)
+
+#ifndef CONFIG_LOGGER_SEGMENT_MB
+#define CONFIG_LOGGER_SEGMENT_MB            256
+#endif
+#ifndef CONFIG_LOGGER_SEGMENT_SECONDS
+#define CONFIG_LOGGER_SEGMENT_SECONDS       600
+#endif
+
+#ifndef CONFIG_LOGGER_PREALLOC_MB
+#define CONFIG_LOGGER_PREALLOC_MB           256
+#endif
+
+#ifndef CONFIG_LOGGER_RAW_SECTORS
+#define CONFIG_LOGGER_RAW_SECTORS           0
+#endif
+
+// LOGGER_SD_BUS_WIDTH choice: define CONFIG_LOGGER_SD_BUS_WIDTH_4 to switch
+#ifndef CONFIG_LOGGER_SD_BUS_WIDTH_4
+#define CONFIG_LOGGER_SD_BUS_WIDTH_4        0
+#endif
+#define CONFIG_LOGGER_SD_BUS_WIDTH_1        (!CONFIG_LOGGER_SD_BUS_WIDTH_4)
+
+#ifndef CONFIG_LOGGER_SD_FREQ_KHZ
+#define CONFIG_LOGGER_SD_FREQ_KHZ           40000
+#endif
@@ -0,0 +1,136 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
+#include "sim.h"
+
+static sdmmc_card_t card = {
+    .csd = { .sector_size = 512, .capacity = 8 * 1024 * 1024 * 2 },    // 8 GiB
+    .cid = { .name = "SIMSD" },
+};
+static bool mounted = false;
+static FATFS fatfs = {
+    .database = SIM_DATA_SECTOR,
+    .csize = SIM_CLUSTER_SIZE / SIM_SECTOR_SIZE,
+    .ssize = SIM_SECTOR_SIZE,
+};
+
+esp_err_t esp_vfs_fat_sdmmc_mount(const char *base_path, const sdmmc_host_t *host,
+                                  const void *slot_config, const esp_vfs_fat_mount_config_t *mount_config,
+                                  sdmmc_card_t **out_card)
+{
+    const sdmmc_slot_config_t *slot = slot_config;
+
+    if (strcmp(base_path, SIM_MOUNT_POINT) != 0 || sim_fs_root() == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The simulated card does high speed and the slot has all four data
+    // lines; width 0 asks for as many as the slot has
+    card.max_freq_khz = (host->max_freq_khz < SDMMC_FREQ_HIGHSPEED) ? host->max_freq_khz : SDMMC_FREQ_HIGHSPEED;
+    card.real_freq_khz = card.max_freq_khz;
+    card.log_bus_width = (slot->width == 1) ? 0 : 2;
+    sim_fs_set_bus(1 << card.log_bus_width, card.real_freq_khz);
+    mounted = true;
+    *out_card = &card;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_sdcard_unmount(const char *base_path, sdmmc_card_t *out_card)
+{
+    if (!mounted || out_card != &card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mounted = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_create_contiguous_file(const char *base_path, const char *full_path,
+                                             uint64_t size, bool alloc_now)
+{
+    char buf[256];
+    struct stat st;
+
+    if (!mounted || strcmp(base_path, SIM_MOUNT_POINT) != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Like f_expand, only a new or empty file can be expanded
+    const char *path = sim_fs_path(full_path, buf, sizeof(buf));
+    if (stat(path, &st) == 0 && st.st_size != 0) {
+        return ESP_FAIL;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    int ret = ftruncate(fd, size);
+    close(fd);
+    if (ret != 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    sim_fs_commit(full_path);
+    return ESP_OK;
+}
+
+void sdmmc_card_print_info(FILE *stream, const sdmmc_card_t *info)
+{
+    fprintf(stream, "Name: %s\n", info->cid.name);
+    fprintf(stream, "Speed: %d kHz, %d-bit\n", info->real_freq_khz, 1 << info->log_bus_width);
+    fprintf(stream, "Size: %lluMB (host directory %s)\n",
+            (unsigned long long)info->csd.capacity * info->csd.sector_size / (1024 * 1024), sim_fs_root());
+}
+
+BYTE ff_diskio_get_pdrv_card(const sdmmc_card_t *out_card)
+{
+    return (mounted && out_card == &card) ? 0 : 0xFF;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    char buf[256];
+    uint32_t first_sector;
+    uint64_t size;
+
+    // Only drive 0, the mounted card
+    if (!mounted) {
+        return FR_NOT_READY;
+    }
+    if (strncmp(path, "0:/", 3) != 0) {
+        return FR_INVALID_NAME;
+    }
+    snprintf(buf, sizeof(buf), SIM_MOUNT_POINT "/%s", path + 3);
+    if (sim_fs_extent(buf, &first_sector, &size) != ESP_OK) {
+        return FR_NO_FILE;
+    }
+    fp->obj.fs = &fatfs;
+    fp->obj.sclust = 2 + (first_sector - fatfs.database) / fatfs.csize;
+    fp->obj.objsize = size;
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    return FR_OK;
+}
+
+esp_err_t sdmmc_write_sectors(sdmmc_card_t *out_card, const void *src, size_t start_sector, size_t sector_count)
+{
+    if (!mounted || out_card != &card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return sim_fs_write_sectors(start_sector, src, sector_count);
+}
+
+esp_err_t sdmmc_read_sectors(sdmmc_card_t *out_card, void *dst, size_t start_sector, size_t sector_count)
+{
+    if (!mounted || out_card != &card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return sim_fs_read_sectors(start_sector, dst, sector_count);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t sector_size;
+    uint32_t capacity;          // Sectors
+} sdmmc_csd_t;
+
+typedef struct {
+    char name[8];
+} sdmmc_cid_t;
+
+typedef struct {
+    sdmmc_csd_t csd;
+    sdmmc_cid_t cid;
+    uint32_t max_freq_khz;
+    int real_freq_khz;
+    uint32_t log_bus_width;     // Data lines = 1 << log_bus_width
+} sdmmc_card_t;
+
+void sdmmc_card_print_info(FILE *stream, const sdmmc_card_t *card);
+esp_err_t sdmmc_write_sectors(sdmmc_card_t *card, const void *src, size_t start_sector, size_t sector_count);
+esp_err_t sdmmc_read_sectors(sdmmc_card_t *card, void *dst, size_t start_sector, size_t sector_count);
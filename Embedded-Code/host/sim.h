@@ -0,0 +1,183 @@
+/**
+ * Host simulation of the Star PI logger
+ *
+ * The firmware in ../main builds unchanged against the ESP-IDF shims in
+ * shim/. Around it the simulation provides:
+ *
+ *   - a clock running sim_speed() times faster than the wall clock, which
+ *     esp_timer, FreeRTOS delays and I2C bus timing all follow, so the
+ *     pipeline can be loaded beyond what the real sensors produce
+ *   - deterministic fake sensors behind the I2C bus (sim_sensors.c), which
+ *     can fly a simple trajectory
+ *   - an SD card backed by a host directory, with write latency and
+ *     periodic stalls injected in simulated time (sim_fs.c); raw sector
+ *     access reaches the same files through the extents they are given,
+ *     and power can be cut at a chosen time
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+// --- Clock -----------------------------------------------------------------
+
+/**
+ * Start simulated time at 0. speed > 1 runs it faster than real time.
+ */
+void sim_clock_init(double speed);
+double sim_speed(void);
+int64_t sim_now_us(void);
+
+/**
+ * Real CLOCK_MONOTONIC deadline sim_us of simulated time from now
+ */
+void sim_deadline(struct timespec *ts, int64_t sim_us);
+void sim_sleep_us(int64_t sim_us);
+void sim_sleep_until_us(int64_t sim_time_us);
+
+/**
+ * Stop all periodic timers and sensor interrupts, ending acquisition
+ */
+void sim_stop(void);
+bool sim_stopped(void);
+
+// --- SD card -----------------------------------------------------------------
+
+#define SIM_MOUNT_POINT     "/sdcard"
+#define SIM_CLUSTER_SIZE    (16 * 1024)     // allocation_unit_size the firmware mounts with
+#define SIM_SECTOR_SIZE     512
+#define SIM_DATA_SECTOR     8192            // First sector of cluster 2, past the FATs
+
+typedef struct {
+    uint32_t write_us_per_kib;  // Card programming time per KiB written
+    uint32_t alloc_us;          // FAT update for each cluster a write adds to a file
+    uint32_t fs_us;             // VFS, stdio and FATFS time per file write
+    uint32_t stall_ms;          // Extra latency of a stalled write...
+    uint32_t stall_every_ms;    // ...once per this interval, 0 = never
+    uint32_t fail_every;        // Every Nth block written to a file fails, 0 = never
+} SimDiskConfig_t;
+
+typedef struct {
+    long offset;                // File offset of the write
+    size_t len;
+    int64_t start_us;           // Simulated time the write was issued
+    int64_t done_us;            // Simulated time the write returned
+} SimWrite_t;
+
+/**
+ * Serve SIM_MOUNT_POINT from the host directory root
+ */
+void sim_fs_init(const char *root, const SimDiskConfig_t *config);
+const char *sim_fs_root(void);
+
+/**
+ * Bus the firmware mounted the card with. A write takes at least as long as
+ * its data needs on the bus, however fast the card programs.
+ */
+void sim_fs_set_bus(int width, uint32_t freq_khz);
+void sim_fs_get_bus(int *width, uint32_t *freq_khz);
+
+/**
+ * Host path for a path on the simulated card. Paths outside the mount
+ * point are returned unchanged.
+ */
+const char *sim_fs_path(const char *path, char *buf, size_t len);
+
+/**
+ * Card sectors of path, which must exist: the first time it is asked for,
+ * the file gets the next free run of sectors, as many as it is long then.
+ * Sector writes inside the run land in the file.
+ */
+esp_err_t sim_fs_extent(const char *path, uint32_t *first_sector, uint64_t *size);
+
+/**
+ * Raw access to sectors handed out by sim_fs_extent(). Writes are timed
+ * and logged like file writes, without the file system's share.
+ */
+esp_err_t sim_fs_write_sectors(uint32_t sector, const void *data, size_t count);
+esp_err_t sim_fs_read_sectors(uint32_t sector, void *data, size_t count);
+
+/**
+ * Writes made to path so far, in order, file and sector writes alike
+ */
+size_t sim_fs_writes(const char *path, SimWrite_t *out, size_t max);
+
+/**
+ * Record the size path has now as written back to its directory entry, as
+ * FATFS does on f_sync and f_expand. A file is first committed at the
+ * size it has when opened; sim_fsync() commits it too.
+ */
+void sim_fs_commit(const char *path);
+
+#define SIM_POWER_CUT_EXIT  3       // Exit status of a process whose power was cut
+
+/**
+ * Cut the card's power at simulated time cut_us: every write in progress
+ * keeps its new data only for the whole sectors the card got through, each
+ * card file goes back to its committed size, and the process exits with
+ * SIM_POWER_CUT_EXIT.
+ */
+void sim_fs_power_cut_at(int64_t cut_us);
+
+FILE *sim_fopen(const char *path, const char *mode);
+int sim_stat(const char *path, struct stat *st);
+size_t sim_fwrite(const void *data, size_t size, size_t count, FILE *f);
+size_t sim_fread(void *data, size_t size, size_t count, FILE *f);
+
+/**
+ * POSIX access to the card, timed like sim_fwrite() and sim_fread(). fsync
+ * costs the metadata update FATFS makes, not a host sync.
+ */
+int sim_open(const char *path, int flags, ...);
+ssize_t sim_write(int fd, const void *data, size_t len);
+ssize_t sim_read(int fd, void *data, size_t len);
+int sim_fsync(int fd);
+int sim_unlink(const char *path);
+DIR *sim_opendir(const char *path);
+
+// --- Sensors ---------------------------------------------------------------
+
+/**
+ * Start the fake sensors. A pin >= 0 routes that sensor's data-ready
+ * output to the GPIO shim.
+ */
+void sim_sensors_start(int imu_drdy_gpio, int mag_drdy_gpio);
+
+typedef struct {
+    int64_t launch_us;          // Ignition
+    int64_t burnout_us;
+    int64_t apogee_us;
+    int64_t landing_us;
+    double apogee_m;
+} SimFlight_t;
+
+/**
+ * Fly the sensors straight up from launch_us: a short boost, coasting to
+ * apogee, then down under a parachute. *flight receives when it passes
+ * each point. Without this the board stays on the pad.
+ */
+void sim_sensors_fly(int64_t launch_us, SimFlight_t *flight);
+
+/**
+ * Take the barometer off the bus, as if it had failed
+ */
+void sim_sensors_unplug_baro(void);
+
+/**
+ * Run one bus transaction against the fake device at address
+ */
+esp_err_t sim_i2c_transfer(uint16_t address, const uint8_t *write, size_t write_len,
+                           uint8_t *read, size_t read_len);
+bool sim_i2c_present(uint16_t address);
+
+/**
+ * Deliver an edge on pin to its GPIO ISR handler, if any
+ */
+void sim_gpio_fire(int pin);
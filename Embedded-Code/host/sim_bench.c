@@ -0,0 +1,984 @@
+/**
+ * Pipeline benchmark on the host simulation
+ *
+ * Runs the unmodified firmware against the fake sensors and SD card, then
+ * reads back the log it wrote and reports per sensor how many samples made
+ * it to the card, how many are missing from the sample sequence, and the
+ * latency from sampling to the block being written.
+ *
+ * With --sweep the simulated clock is sped up (or slowed down) step by step
+ * until the pipeline no longer keeps up. The highest speed that kept up
+ * times the nominal sample rate is the throughput this pipeline
+ * configuration sustains on this host.
+ *
+ * With --power-cuts the card loses power at a random time in each run.
+ * The firmware then boots again on the same card, and the log it leaves
+ * must be intact up to where it was recovered, with no more samples lost
+ * than the flush latency and checkpoint interval allow.
+ *
+ * With --launch the sensors fly a simulated flight, and the log must show
+ * every flight state close to when the flight passed it. Firmware that holds
+ * logging until launch must keep the pre-trigger window before it, and
+ * samples only count as missing between launch and landing.
+ *
+ * Every run happens in a child process, as the firmware never returns from
+ * its tasks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "log_format.h"
+#include "log_index.h"
+#include "flight_state.h"
+#include "sampler.h"
+#include "sensor_driver.h"
+
+#ifndef SIM_CONFIG_NAME
+#define SIM_CONFIG_NAME     "default"
+#endif
+
+#define MAX_WRITES          65536
+#define MAX_SEGMENTS        256
+#define MAX_LATENCIES       (1 << 20)
+#define MIN_SWEEP_SPEED     (1.0 / 16)
+#define REBOOT_SECONDS      1.0     // Acquisition after a power cut
+#define CUT_SLACK_MS        250     // Host wake-up jitter allowed on top of the loss bound
+#define LAUNCH_TOLERANCE_MS 50      // Launch and burnout, several IMU periods at pad rates
+#define APOGEE_TOLERANCE_MS 500     // Apogee, from smoothed barometer readings
+#define LANDED_TOLERANCE_MS FLIGHT_LANDED_MS // Stillness restarts on drift while the reading settles
+#define PRETRIGGER_SLACK_MS 100
+
+extern void app_main(void);
+
+typedef struct {
+    double seconds;             // Simulated acquisition time per run
+    double speed;
+    double max_speed;
+    bool sweep;
+    double max_loss_pct;        // Losses a sustainable run may have
+    int power_cuts;             // Power-cut runs, 0 = normal runs
+    double launch_s;            // When the sensors launch, < 0 = they stay on the pad
+    bool no_baro;               // Run without the barometer
+    unsigned seed;              // Picks the power-cut times
+    const char *disk_base;
+    SimDiskConfig_t disk;
+    bool csv;
+    bool verbose;
+} BenchOptions_t;
+
+typedef struct {
+    char name[LOG_SENSOR_NAME_LEN];
+    char driver[LOG_DRIVER_NAME_LEN];
+    uint16_t rate_hz;
+    uint32_t records;
+    uint32_t missing;           // Sample periods without a record
+    uint32_t reported;          // Samples the firmware logged as lost in gap records
+    uint32_t gaps;              // Gap records it lost samples in
+    bool by_tick;               // Missing counted from ticks, not timestamps
+} SensorResult_t;
+
+typedef struct {
+    bool ok;
+    char error[96];
+    uint8_t sensor_count;
+    SensorResult_t sensors[LOG_MAX_SENSORS];
+    uint32_t blocks;
+    uint32_t bad_blocks;        // Bad magic or CRC, or out of place
+    uint32_t earlier_blocks;    // Blocks a previous boot left on the card
+    int64_t earlier_last_us;    // Newest sample in them, -1 if none
+    uint32_t segments;          // Segment files, of every flight
+    uint32_t index_errors;      // Closed segments the index or their header gets wrong,
+                                // open ones other than the newest
+    int64_t latency_p50_us;
+    int64_t latency_p99_us;
+    int64_t latency_max_us;
+    uint32_t card_writes;       // Writes to the log, including header updates
+    int64_t card_p50_us;        // Time the card took per write
+    int64_t card_p99_us;
+    int64_t card_max_us;
+    uint32_t card_kib_s;        // Throughput while the card was busy
+    int bus_width;              // Bus the firmware mounted the card with
+    uint32_t bus_khz;
+    bool flown;                 // The sensors flew flight
+    SimFlight_t flight;
+    int64_t state_us[LOG_FLIGHT_LANDED + 1];   // When the log says each state began, -1 = never
+    int64_t first_sample_us;    // Oldest sample on the card, -1 if none
+} RunResult_t;
+
+// --- Log analysis --------------------------------------------------------------
+
+typedef struct {
+    uint32_t tick;              // sample_num of the record
+    int64_t t_us;
+} Sample_t;
+
+typedef struct {
+    Sample_t *samples;
+    size_t count;
+    size_t capacity;
+} SampleList_t;
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t write_done_us(const SimWrite_t *writes, size_t count, long offset)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (offset >= writes[i].offset && offset < writes[i].offset + (long)writes[i].len) {
+            return writes[i].done_us;
+        }
+    }
+    return -1;
+}
+
+static void add_sample(SampleList_t *list, uint32_t tick, int64_t t_us)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->samples = realloc(list->samples, list->capacity * sizeof(Sample_t));
+    }
+    list->samples[list->count++] = (Sample_t){ tick, t_us };
+}
+
+/**
+ * Polled sensors are read on every divider-th sampler tick, so gaps in the
+ * tick sequence are exact. Interrupt, FIFO and fusion samples only have
+ * their timestamps, which the simulated devices put on multiples of their
+ * period: the period a stamp falls in is the sample. Stamps are off by a
+ * varying amount, interrupts serviced late and FIFO batches timed from
+ * when their count was read, but a stamp too late is followed by one too
+ * early, so over the run the errors cancel out.
+ */
+static void count_missing(SensorResult_t *sensor, const SampleList_t *list)
+{
+    const SensorDriver_t *driver = sensor_driver_find(sensor->driver);
+    uint32_t divider = sampler_divider(sensor->rate_hz);
+    int64_t period_us = 1000000 / sensor->rate_hz;
+    bool polled = driver != NULL && !driver->fifo;
+    int64_t missing = 0;
+
+    for (size_t i = 0; polled && i < list->count; i++) {
+        polled = list->samples[i].tick % divider == 0 &&
+                 (i == 0 || list->samples[i].tick > list->samples[i - 1].tick);
+    }
+
+    for (size_t i = 1; i < list->count; i++) {
+        const Sample_t *prev = &list->samples[i - 1];
+        const Sample_t *cur = &list->samples[i];
+        if (polled) {
+            missing += (cur->tick - prev->tick) / divider - 1;
+        } else {
+            missing += cur->t_us / period_us - prev->t_us / period_us - 1;
+        }
+    }
+    sensor->missing = (missing > 0) ? (uint32_t)missing : 0;
+    sensor->by_tick = polled;
+}
+
+/**
+ * Samples a sensor missed that no gap record accounts for. Timestamps
+ * either side of a gap may each be a period off, so a gap counted from them
+ * can come out one sample longer.
+ */
+static uint32_t unreported(const SensorResult_t *sensor)
+{
+    uint32_t accounted = sensor->reported + (sensor->by_tick ? 0 : sensor->gaps);
+    return (sensor->missing > accounted) ? sensor->missing - accounted : 0;
+}
+
+typedef struct {
+    char name[LOG_SEGMENT_NAME_LEN];
+    log_segment_t segment;
+    uint32_t bytes;
+} IndexEntry_t;
+
+typedef struct {
+    SimWrite_t *writes;         // Of every segment, in segment order
+    size_t write_count;
+    int64_t *latencies;
+    size_t latency_count;
+    SampleList_t lists[LOG_MAX_SENSORS];
+    uint8_t *block;
+    IndexEntry_t index[MAX_SEGMENTS];
+    size_t index_count;
+    size_t flight_start[LOG_MAX_SENSORS];   // Sample list positions at the launch and
+    size_t flight_end[LOG_MAX_SENSORS];     // landing events
+} LogScan_t;
+
+/**
+ * Read INDEX.CSV, keeping the last line of every segment
+ */
+static void read_index(LogScan_t *scan)
+{
+    char path_buf[256];
+    char line[160];
+    FILE *f = fopen(sim_fs_path(SIM_MOUNT_POINT "/" LOG_INDEX_FILE_NAME, path_buf, sizeof(path_buf)), "r");
+    if (f == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        IndexEntry_t e = { 0 };
+        unsigned flight, seg;
+        long long first_us, last_us;
+        unsigned long samples, bytes;
+        if (sscanf(line, "%13[^,],%u,%u,%lld,%lld,%lu,%lu", e.name, &flight, &seg, &first_us, &last_us,
+                   &samples, &bytes) != 7) {
+            continue;   // Column names
+        }
+        e.segment = (log_segment_t){ flight, seg, samples, first_us, last_us };
+        e.bytes = bytes;
+
+        size_t i;
+        for (i = 0; i < scan->index_count && strcmp(scan->index[i].name, e.name) != 0; i++) {
+        }
+        if (i < MAX_SEGMENTS) {
+            scan->index[i] = e;
+            scan->index_count += (i == scan->index_count);
+        }
+    }
+    fclose(f);
+}
+
+static const IndexEntry_t *find_index(const LogScan_t *scan, const char *name)
+{
+    for (size_t i = 0; i < scan->index_count; i++) {
+        if (strcmp(scan->index[i].name, name) == 0) {
+            return &scan->index[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Read one segment's blocks into the result. A closed segment must match
+ * its header and index line; only the newest segment may still be open.
+ */
+static bool analyze_segment(LogScan_t *scan, const char *name, bool newest, RunResult_t *result)
+{
+    char card_path[64];
+    char path_buf[256];
+    snprintf(card_path, sizeof(card_path), SIM_MOUNT_POINT "/%s", name);
+    const char *path = sim_fs_path(card_path, path_buf, sizeof(path_buf));
+    SimWrite_t *writes = scan->writes + scan->write_count;
+    size_t write_count = sim_fs_writes(card_path, writes, MAX_WRITES - scan->write_count);
+    scan->write_count += write_count;
+    uint8_t *block = scan->block;
+    FILE *f = fopen(path, "rb");
+    bool ok = false;
+
+    log_file_header_t header;
+    if (f == NULL || fread(&header, sizeof(header), 1, f) != 1 || header.magic != LOG_FILE_MAGIC ||
+        header.sensor_count > LOG_MAX_SENSORS) {
+        snprintf(result->error, sizeof(result->error), "no valid log at %s", path);
+        goto out;
+    }
+
+    log_sensor_desc_t desc[LOG_MAX_SENSORS];
+    if (fread(desc, sizeof(desc[0]), header.sensor_count, f) != header.sensor_count) {
+        snprintf(result->error, sizeof(result->error), "truncated sensor table in %s", name);
+        goto out;
+    }
+    result->sensor_count = header.sensor_count;
+    for (int i = 0; i < header.sensor_count; i++) {
+        SensorResult_t *sensor = &result->sensors[i];
+        memcpy(sensor->name, desc[i].name, LOG_SENSOR_NAME_LEN);
+        memcpy(sensor->driver, desc[i].driver, LOG_DRIVER_NAME_LEN);
+        sensor->name[LOG_SENSOR_NAME_LEN - 1] = '\0';
+        sensor->driver[LOG_DRIVER_NAME_LEN - 1] = '\0';
+        sensor->rate_hz = desc[i].rate_hz ? desc[i].rate_hz : 1;
+    }
+
+    long offset = header.header_len;
+    log_segment_t counted = { 0 };
+    fseek(f, offset, SEEK_SET);
+    // Past data_end the log goes on while blocks carry the number of their
+    // position; what follows is unused pre-allocated space
+    while (fread(block, 1, LOG_BLOCK_SIZE, f) == LOG_BLOCK_SIZE) {
+        log_block_header_t bh;
+        bool valid = log_format_check_block(block, LOG_BLOCK_SIZE, header.file_id, &bh) &&
+                     bh.seq == (offset - header.header_len) / LOG_BLOCK_SIZE;
+        if (header.data_end != 0 && offset >= (long)header.data_end && !valid) {
+            break;
+        }
+        result->blocks++;
+        if (!valid) {
+            result->bad_blocks++;
+            offset += LOG_BLOCK_SIZE;
+            continue;
+        }
+        log_format_count_block(block, &counted);
+
+        // Blocks this process did not write are from before a power cut
+        const uint8_t *payload = block + sizeof(bh);
+        int64_t done_us = write_done_us(writes, write_count, offset);
+        result->earlier_blocks += (done_us < 0);
+        for (size_t pos = 0; pos + sizeof(log_record_header_t) <= bh.payload_len;) {
+            log_record_header_t rec;
+            memcpy(&rec, payload + pos, sizeof(rec));
+            if (rec.len < sizeof(rec) || pos + rec.len > bh.payload_len) {
+                break;
+            }
+            if (rec.type == LOG_RECORD_SAMPLE) {
+                for (int i = 0; i < header.sensor_count; i++) {
+                    if (rec.sensor_mask & (1 << i)) {
+                        add_sample(&scan->lists[i], rec.sample_num, rec.timestamp_us);
+                    }
+                }
+                if (done_us >= 0 && scan->latency_count < MAX_LATENCIES) {
+                    scan->latencies[scan->latency_count++] = done_us - rec.timestamp_us;
+                }
+                if (done_us < 0 && rec.timestamp_us > result->earlier_last_us) {
+                    result->earlier_last_us = rec.timestamp_us;
+                }
+                if (result->first_sample_us < 0 || rec.timestamp_us < result->first_sample_us) {
+                    result->first_sample_us = rec.timestamp_us;
+                }
+            } else if (rec.type == LOG_RECORD_EVENT && rec.len >= sizeof(rec) + sizeof(log_flight_event_t)) {
+                log_flight_event_t event;
+                memcpy(&event, payload + pos + sizeof(rec), sizeof(event));
+                if (event.state <= LOG_FLIGHT_LANDED && result->state_us[event.state] < 0) {
+                    result->state_us[event.state] = rec.timestamp_us;
+                    for (int i = 0; i < LOG_MAX_SENSORS; i++) {
+                        if (event.state == LOG_FLIGHT_BOOST) {
+                            scan->flight_start[i] = scan->lists[i].count;
+                        } else if (event.state == LOG_FLIGHT_LANDED) {
+                            scan->flight_end[i] = scan->lists[i].count;
+                        }
+                    }
+                }
+            } else if (rec.type == LOG_RECORD_GAP && rec.len >= sizeof(rec) + sizeof(log_gap_t)) {
+                log_gap_t gap;
+                memcpy(&gap, payload + pos + sizeof(rec), sizeof(gap));
+                size_t lost_pos = pos + sizeof(rec) + sizeof(log_gap_t);
+                // Pad samples from before the pre-trigger window were not lost
+                for (int i = 0; i < header.sensor_count && lost_pos + sizeof(uint32_t) <= pos + rec.len &&
+                                (gap.reason & ~LOG_GAP_STANDBY); i++) {
+                    if (rec.sensor_mask & (1 << i)) {
+                        uint32_t lost;
+                        memcpy(&lost, payload + lost_pos, sizeof(lost));
+                        result->sensors[i].reported += lost;
+                        result->sensors[i].gaps++;
+                        lost_pos += sizeof(lost);
+                    }
+                }
+            }
+            pos += rec.len;
+        }
+        offset += LOG_BLOCK_SIZE;
+    }
+
+    result->segments++;
+    if (header.flags & LOG_FILE_CLOSED) {
+        struct stat st;
+        const IndexEntry_t *entry = find_index(scan, name);
+        bool consistent = entry != NULL && fstat(fileno(f), &st) == 0 && st.st_size == header.data_end &&
+                          entry->bytes == header.data_end && header.segment.samples == counted.samples &&
+                          memcmp(&entry->segment, &header.segment, sizeof(header.segment)) == 0 &&
+                          (counted.samples == 0 || (header.segment.first_us == counted.first_us &&
+                                                    header.segment.last_us == counted.last_us));
+        result->index_errors += !consistent;
+    } else {
+        result->index_errors += !newest;
+    }
+    ok = true;
+
+out:
+    if (f != NULL) {
+        fclose(f);
+    }
+    return ok;
+}
+
+/**
+ * Read back every segment on the card, flight by flight
+ */
+static void analyze_log(RunResult_t *result)
+{
+    LogScan_t *scan = calloc(1, sizeof(*scan));
+    scan->writes = malloc(MAX_WRITES * sizeof(*scan->writes));
+    scan->latencies = malloc(MAX_LATENCIES * sizeof(*scan->latencies));
+    scan->block = malloc(LOG_BLOCK_SIZE);
+    result->earlier_last_us = -1;
+    result->first_sample_us = -1;
+    for (int i = 0; i <= LOG_FLIGHT_LANDED; i++) {
+        result->state_us[i] = -1;
+    }
+    for (int i = 0; i < LOG_MAX_SENSORS; i++) {
+        scan->flight_end[i] = SIZE_MAX;
+    }
+    read_index(scan);
+
+    uint16_t last_flight, last_segment;
+    if (log_index_find_last(SIM_MOUNT_POINT, &last_flight, &last_segment) != ESP_OK) {
+        snprintf(result->error, sizeof(result->error), "no log segment on the card");
+        goto out;
+    }
+    for (uint16_t flight = 1; flight <= last_flight; flight++) {
+        for (uint16_t seg = 0; seg <= LOG_MAX_SEGMENT; seg++) {
+            char name[LOG_SEGMENT_NAME_LEN];
+            char card_path[64];
+            struct stat st;
+            log_index_segment_name(name, flight, seg);
+            snprintf(card_path, sizeof(card_path), SIM_MOUNT_POINT "/%s", name);
+            if (sim_stat(card_path, &st) != 0) {
+                break;
+            }
+            if (!analyze_segment(scan, name, flight == last_flight && seg == last_segment, result)) {
+                goto out;
+            }
+        }
+    }
+
+    for (int i = 0; i < result->sensor_count; i++) {
+        SampleList_t *list = &scan->lists[i];
+        result->sensors[i].records = list->count;
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+        // Only the flight is sampled at full rate
+        size_t end = (scan->flight_end[i] < list->count) ? scan->flight_end[i] : list->count;
+        size_t start = (result->state_us[LOG_FLIGHT_BOOST] >= 0) ? scan->flight_start[i] : end;
+        SampleList_t flight = { list->samples + start, end - start, 0 };
+        list = &flight;
+#endif
+        count_missing(&result->sensors[i], list);
+    }
+    int64_t *latencies = scan->latencies;
+    size_t latency_count = scan->latency_count;
+    if (latency_count > 0) {
+        qsort(latencies, latency_count, sizeof(latencies[0]), compare_i64);
+        result->latency_p50_us = latencies[latency_count / 2];
+        result->latency_p99_us = latencies[latency_count * 99 / 100];
+        result->latency_max_us = latencies[latency_count - 1];
+    }
+    const SimWrite_t *writes = scan->writes;
+    size_t write_count = scan->write_count;
+    if (write_count > 0) {
+        // Reuse the latency buffer for the card's time per write
+        size_t n = (write_count < MAX_LATENCIES) ? write_count : MAX_LATENCIES;
+        for (size_t i = 0; i < n; i++) {
+            latencies[i] = writes[i].done_us - writes[i].start_us;
+        }
+        qsort(latencies, n, sizeof(latencies[0]), compare_i64);
+        result->card_writes = write_count;
+        result->card_p50_us = latencies[n / 2];
+        result->card_p99_us = latencies[n * 99 / 100];
+        result->card_max_us = latencies[n - 1];
+
+        uint64_t bytes = 0;
+        int64_t busy_us = 0;
+        for (size_t i = 0; i < write_count; i++) {
+            bytes += writes[i].len;
+            busy_us += writes[i].done_us - writes[i].start_us;
+        }
+        result->card_kib_s = (busy_us > 0) ? (uint32_t)(bytes * 1000000 / 1024 / busy_us) : 0;
+    }
+    result->ok = true;
+
+out:
+    for (int i = 0; i < LOG_MAX_SENSORS; i++) {
+        free(scan->lists[i].samples);
+    }
+    free(scan->block);
+    free(scan->latencies);
+    free(scan->writes);
+    free(scan);
+}
+
+// --- Runs ----------------------------------------------------------------------
+
+static void app_task(void *arg)
+{
+    app_main();
+}
+
+static void remove_tree(const char *dir)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Could not remove %s\n", dir);
+    }
+}
+
+static bool make_card_dir(const BenchOptions_t *opt, char *dir, size_t len)
+{
+    snprintf(dir, len, "%s/starpi-sim-XXXXXX", opt->disk_base);
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Cannot create a card directory in %s\n", opt->disk_base);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Boot the firmware on the card in dir, in a child process
+ */
+static void boot_child(const BenchOptions_t *opt, double speed, const char *dir)
+{
+    if (!opt->verbose) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            perror("freopen");
+        }
+    }
+
+    sim_clock_init(speed);
+    sim_fs_init(dir, &opt->disk);
+    if (opt->no_baro) {
+        sim_sensors_unplug_baro();
+    }
+    sim_sensors_start(CONFIG_SENSOR_IMU_DRDY_GPIO, CONFIG_SENSOR_MAG_DRDY_GPIO);
+    xTaskCreate(app_task, "main", 8192, NULL, 1, NULL);
+}
+
+/**
+ * Body of the child process: boot, acquire for the given time, let the
+ * logger flush, then read the log back
+ */
+static void run_child(const BenchOptions_t *opt, double speed, const char *dir, double seconds,
+                      RunResult_t *result)
+{
+    if (opt->launch_s >= 0) {
+        sim_sensors_fly((int64_t)(opt->launch_s * 1000000), &result->flight);
+        result->flown = true;
+    }
+    boot_child(opt, speed, dir);
+
+    sim_sleep_until_us((int64_t)(seconds * 1000000));
+    sim_stop();
+
+    // A partial block goes out at the latest one flush latency after it
+    // opened, and the header records it at the next checkpoint
+    sim_sleep_us((CONFIG_LOGGER_FLUSH_LATENCY_MS + CONFIG_LOGGER_CHECKPOINT_MS + 500) * 1000LL +
+                 opt->disk.stall_ms * 1000LL);
+
+    analyze_log(result);
+    sim_fs_get_bus(&result->bus_width, &result->bus_khz);
+}
+
+/**
+ * Run run_child() in a child process and collect its result
+ */
+static bool run_forked(const BenchOptions_t *opt, double speed, const char *dir, double seconds,
+                       RunResult_t *result)
+{
+    int fds[2];
+    memset(result, 0, sizeof(*result));
+    fflush(stdout);
+
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_child(opt, speed, dir, seconds, result);
+        ssize_t n = write(fds[1], result, sizeof(*result));
+        _exit(n == sizeof(*result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    if (n != sizeof(*result)) {
+        if (WIFSIGNALED(status)) {
+            snprintf(result->error, sizeof(result->error), "run crashed (%s)", strsignal(WTERMSIG(status)));
+        } else {
+            snprintf(result->error, sizeof(result->error), "run crashed (exit status %d)", WEXITSTATUS(status));
+        }
+        result->ok = false;
+    }
+    return result->ok;
+}
+
+/**
+ * Acquire on a fresh card
+ */
+static bool run_once(const BenchOptions_t *opt, double speed, RunResult_t *result)
+{
+    char dir[256];
+    if (!make_card_dir(opt, dir, sizeof(dir))) {
+        memset(result, 0, sizeof(*result));
+        snprintf(result->error, sizeof(result->error), "no card directory");
+        return false;
+    }
+    bool ok = run_forked(opt, speed, dir, opt->seconds, result);
+    remove_tree(dir);
+    return ok;
+}
+
+/**
+ * Cut the power at cut_us into a run on a fresh card, then boot again on
+ * it and read back what the log kept
+ */
+static bool run_power_cut(const BenchOptions_t *opt, int64_t cut_us, RunResult_t *result)
+{
+    char dir[256];
+    memset(result, 0, sizeof(*result));
+    if (!make_card_dir(opt, dir, sizeof(dir))) {
+        snprintf(result->error, sizeof(result->error), "no card directory");
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        remove_tree(dir);
+        return false;
+    }
+    if (pid == 0) {
+        boot_child(opt, opt->speed, dir);
+        sim_fs_power_cut_at(cut_us);
+        sim_sleep_until_us(cut_us + 1000000);
+        _exit(1);   // The power cut never came
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != SIM_POWER_CUT_EXIT) {
+        snprintf(result->error, sizeof(result->error), "run before the cut failed (status %d)", status);
+    } else {
+        run_forked(opt, opt->speed, dir, REBOOT_SECONDS, result);
+    }
+    remove_tree(dir);
+    return result->ok;
+}
+
+static bool within_ms(int64_t logged_us, int64_t true_us, int64_t tolerance_ms)
+{
+    return logged_us >= 0 && llabs(logged_us - true_us) <= tolerance_ms * 1000;
+}
+
+/**
+ * Whether the log saw the flight: every state from launch on, each begun
+ * close to when the flight passed it, and with the launch trigger the pre-trigger window,
+ * which ends when launch was detected, and the arming, however long before
+ * it came. Without the barometer only boost
+ * and coast can be seen.
+ */
+static bool flight_detected(const BenchOptions_t *opt, const RunResult_t *result)
+{
+    const int64_t *state_us = result->state_us;
+    const SimFlight_t *flight = &result->flight;
+    bool ok = within_ms(state_us[LOG_FLIGHT_BOOST], flight->launch_us, LAUNCH_TOLERANCE_MS) &&
+              within_ms(state_us[LOG_FLIGHT_COAST], flight->burnout_us, LAUNCH_TOLERANCE_MS);
+    if (!opt->no_baro) {
+        ok = ok && within_ms(state_us[LOG_FLIGHT_DESCENT], flight->apogee_us, APOGEE_TOLERANCE_MS) &&
+             within_ms(state_us[LOG_FLIGHT_LANDED], flight->landing_us, LANDED_TOLERANCE_MS);
+    }
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+    ok = ok && state_us[LOG_FLIGHT_ARMED] >= 0 && state_us[LOG_FLIGHT_ARMED] < state_us[LOG_FLIGHT_BOOST] &&
+         within_ms(result->first_sample_us,
+                         state_us[LOG_FLIGHT_BOOST] - (CONFIG_FLIGHT_PRETRIGGER_MS - CONFIG_FLIGHT_LAUNCH_MS) * 1000LL,
+                         PRETRIGGER_SLACK_MS);
+#endif
+    return ok;
+}
+
+/**
+ * Whether the pipeline kept up. Host threads now and then wake tens of
+ * milliseconds late, which the device never does, so a small loss rate is
+ * tolerated, but only if every lost sample is in a gap record.
+ */
+static bool sustained(const BenchOptions_t *opt, const RunResult_t *result)
+{
+    uint32_t records = 0, missing = 0, silent = 0;
+    for (int i = 0; i < result->sensor_count; i++) {
+        records += result->sensors[i].records;
+        missing += result->sensors[i].missing;
+        silent += unreported(&result->sensors[i]);
+    }
+    return result->ok && result->index_errors == 0 && records > 0 && silent == 0 &&
+           missing * 100.0 <= opt->max_loss_pct * (records + missing) &&
+           (!result->flown || flight_detected(opt, result));
+}
+
+static uint32_t nominal_rate_hz(const RunResult_t *result)
+{
+    uint32_t rate = 0;
+    for (int i = 0; i < result->sensor_count; i++) {
+        rate += result->sensors[i].rate_hz;
+    }
+    return rate;
+}
+
+static void print_result(const BenchOptions_t *opt, double speed, const RunResult_t *result)
+{
+    if (!result->ok) {
+        if (opt->csv) {
+            printf("%s,%g,,,,,,,,,,,,,,,\n", SIM_CONFIG_NAME, speed);
+        } else {
+            printf("%-14s x%-6g error: %s\n", SIM_CONFIG_NAME, speed, result->error);
+        }
+        return;
+    }
+
+    for (int i = 0; i < result->sensor_count; i++) {
+        const SensorResult_t *s = &result->sensors[i];
+        if (opt->csv) {
+            printf("%s,%g,%s,%s,%u,%u,%u,%u,%lld,%lld,%lld,%lld,%lld,%lld,%d,%u,%u\n", SIM_CONFIG_NAME, speed,
+                   s->name, s->driver, s->rate_hz, s->records, s->missing, s->reported,
+                   (long long)result->latency_p50_us, (long long)result->latency_p99_us,
+                   (long long)result->latency_max_us, (long long)result->card_p50_us,
+                   (long long)result->card_p99_us, (long long)result->card_max_us,
+                   result->bus_width, result->bus_khz, result->card_kib_s);
+        } else {
+            printf("%-14s x%-6g %-8s %-12s %5u Hz %8u records %6u missing (%u in gap records)%s\n",
+                   SIM_CONFIG_NAME, speed, s->name, s->driver, s->rate_hz, s->records, s->missing,
+                   s->reported, unreported(s) > 0 ? ", unaccounted for" : "");
+        }
+    }
+    if (!opt->csv) {
+        printf("%-14s x%-6g %u blocks (%u bad) in %u segments (%u index errors), "
+               "write latency p50 %lld / p99 %lld / max %lld us\n",
+               SIM_CONFIG_NAME, speed, result->blocks, result->bad_blocks, result->segments, result->index_errors,
+               (long long)result->latency_p50_us, (long long)result->latency_p99_us,
+               (long long)result->latency_max_us);
+        printf("%-14s x%-6g %u card writes, card time p50 %lld / p99 %lld / max %lld us\n",
+               SIM_CONFIG_NAME, speed, result->card_writes, (long long)result->card_p50_us,
+               (long long)result->card_p99_us, (long long)result->card_max_us);
+        printf("%-14s x%-6g %d-bit bus at %u kHz, %u KiB/s while writing\n",
+               SIM_CONFIG_NAME, speed, result->bus_width, result->bus_khz, result->card_kib_s);
+    }
+    if (!opt->csv && result->flown) {
+        const int64_t *state_us = result->state_us;
+        const int64_t truth_us[] = { result->flight.launch_us, result->flight.burnout_us,
+                                     result->flight.apogee_us, result->flight.landing_us };
+        printf("%-14s x%-6g flight to %.0f m:", SIM_CONFIG_NAME, speed, result->flight.apogee_m);
+        for (int i = LOG_FLIGHT_BOOST; i <= LOG_FLIGHT_LANDED; i++) {
+            if (state_us[i] < 0) {
+                printf(" %s not detected,", flight_state_name(i));
+            } else {
+                printf(" %s %+lld ms,", flight_state_name(i),
+                       (long long)((state_us[i] - truth_us[i - LOG_FLIGHT_BOOST]) / 1000));
+            }
+        }
+        if (state_us[LOG_FLIGHT_BOOST] >= 0 && result->first_sample_us >= 0) {
+            printf(" %lld ms logged before launch%s\n",
+                   (long long)((state_us[LOG_FLIGHT_BOOST] - result->first_sample_us) / 1000),
+                   flight_detected(opt, result) ? "" : "  FAILED");
+        } else {
+            printf(" FAILED\n");
+        }
+    }
+}
+
+/**
+ * Run the power-cut iterations, each at a random time past the first
+ * second. Fails if a log has bad blocks, a segment was left unclosed or
+ * unindexed, logging did not resume after the reboot, or more samples were lost than a flush latency plus a checkpoint
+ * interval.
+ */
+static bool power_cut_runs(const BenchOptions_t *opt)
+{
+    const int64_t bound_us = (CONFIG_LOGGER_FLUSH_LATENCY_MS + CONFIG_LOGGER_CHECKPOINT_MS + CUT_SLACK_MS) * 1000LL +
+                             opt->disk.stall_ms * 1000LL;
+    unsigned seed = opt->seed;
+    int passed = 0;
+    int64_t worst_us = 0;
+
+    if (opt->csv) {
+        printf("config,cut,cut_us,blocks,bad_blocks,earlier_blocks,segments,index_errors,loss_us,bound_us,ok\n");
+    }
+    for (int i = 0; i < opt->power_cuts; i++) {
+        int64_t span_us = (int64_t)((opt->seconds - 1) * 1000000);
+        int64_t cut_us = 1000000 + (span_us > 0 ? (int64_t)rand_r(&seed) % span_us : 0);
+        RunResult_t result;
+        run_power_cut(opt, cut_us, &result);
+
+        int64_t loss_us = cut_us - ((result.earlier_last_us >= 0) ? result.earlier_last_us : 0);
+        bool ok = result.ok && result.bad_blocks == 0 && result.index_errors == 0 && result.blocks > result.earlier_blocks &&
+                  loss_us <= bound_us;
+        passed += ok;
+        if (result.ok && loss_us > worst_us) {
+            worst_us = loss_us;
+        }
+
+        if (opt->csv) {
+            printf("%s,%d,%lld,%u,%u,%u,%u,%u,%lld,%lld,%d\n", SIM_CONFIG_NAME, i, (long long)cut_us, result.blocks,
+                   result.bad_blocks, result.earlier_blocks, result.segments, result.index_errors, (long long)loss_us, (long long)bound_us, ok);
+        } else if (!result.ok) {
+            printf("%-14s cut %d at %.3f s: error: %s\n", SIM_CONFIG_NAME, i, cut_us / 1e6, result.error);
+        } else {
+            printf("%-14s cut %d at %.3f s: %u blocks kept, %u after reboot (%u bad), "
+                   "%u segments (%u index errors), %lld ms of samples lost%s\n",
+                   SIM_CONFIG_NAME, i, cut_us / 1e6, result.earlier_blocks, result.blocks - result.earlier_blocks,
+                   result.bad_blocks, result.segments, result.index_errors, (long long)(loss_us / 1000), ok ? "" : "  FAILED");
+        }
+        fflush(stdout);
+    }
+
+    if (!opt->csv) {
+        printf("%-14s %d of %d power cuts recovered, worst loss %lld ms (bound %lld ms)\n", SIM_CONFIG_NAME,
+               passed, opt->power_cuts, (long long)(worst_us / 1000), (long long)(bound_us / 1000));
+    }
+    return passed == opt->power_cuts;
+}
+
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+#define DEFAULT_SECONDS     25.0    // A whole flight, landing detected with time to spare
+#define DEFAULT_LAUNCH_S    3.0     // Armed, and the pre-trigger window full
+#else
+#define DEFAULT_SECONDS     5.0
+#define DEFAULT_LAUNCH_S    -1.0
+#endif
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --seconds S         simulated acquisition time per run (default %g)\n"
+            "  --speed X           simulated clock speed (default 1)\n"
+            "  --sweep             search for the highest speed that keeps up\n"
+            "  --max-speed X       upper bound for --sweep (default 64)\n"
+            "  --max-loss PCT      samples a run may lose, all in gap records, and still keep up (default 0.5)\n"
+            "  --launch S          fly the sensors, launching at S seconds (default %s)\n"
+            "  --no-baro           run without the barometer\n"
+            "  --power-cuts N      cut the power N times at random and check what was kept\n"
+            "  --seed N            seed for the power-cut times (default 1)\n"
+            "  --disk DIR          directory holding the simulated card (default /dev/shm)\n"
+            "  --write-us N        card programming time per KiB written (default 60)\n"
+            "  --alloc-us N        FAT update time per cluster a file grows by (default 2000)\n"
+            "  --fs-us N           file system time per file write (default 300)\n"
+            "  --stall-ms N        length of a card stall (default 0)\n"
+            "  --stall-every-ms N  interval between card stalls (default 0, never)\n"
+            "  --write-errors N    fail every Nth block written through the file system (default 0, never)\n"
+            "  --csv               machine-readable output\n"
+            "  --verbose           show the firmware log\n", prog, DEFAULT_SECONDS,
+            CONFIG_FLIGHT_LAUNCH_TRIGGER ? "3" : "stay on the pad");
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions_t opt = {
+        .seconds = DEFAULT_SECONDS,
+        .launch_s = DEFAULT_LAUNCH_S,
+        .speed = 1,
+        .max_speed = 64,
+        .max_loss_pct = 0.5,
+        .seed = 1,
+        .disk_base = (access("/dev/shm", W_OK) == 0) ? "/dev/shm" : "/tmp",
+        .disk = { .write_us_per_kib = 60, .alloc_us = 2000, .fs_us = 300 },
+    };
+    static const struct option options[] = {
+        { "seconds", required_argument, NULL, 's' },
+        { "speed", required_argument, NULL, 'x' },
+        { "sweep", no_argument, NULL, 'S' },
+        { "max-speed", required_argument, NULL, 'm' },
+        { "max-loss", required_argument, NULL, 'L' },
+        { "launch", required_argument, NULL, 'T' },
+        { "no-baro", no_argument, NULL, 'B' },
+        { "power-cuts", required_argument, NULL, 'P' },
+        { "seed", required_argument, NULL, 'R' },
+        { "disk", required_argument, NULL, 'd' },
+        { "write-us", required_argument, NULL, 'w' },
+        { "alloc-us", required_argument, NULL, 'a' },
+        { "fs-us", required_argument, NULL, 'f' },
+        { "stall-ms", required_argument, NULL, 'l' },
+        { "stall-every-ms", required_argument, NULL, 'e' },
+        { "write-errors", required_argument, NULL, 'E' },
+        { "csv", no_argument, NULL, 'c' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (c) {
+        case 's': opt.seconds = atof(optarg); break;
+        case 'x': opt.speed = atof(optarg); break;
+        case 'S': opt.sweep = true; break;
+        case 'm': opt.max_speed = atof(optarg); break;
+        case 'L': opt.max_loss_pct = atof(optarg); break;
+        case 'T': opt.launch_s = atof(optarg); break;
+        case 'B': opt.no_baro = true; break;
+        case 'P': opt.power_cuts = atoi(optarg); break;
+        case 'R': opt.seed = strtoul(optarg, NULL, 0); break;
+        case 'd': opt.disk_base = optarg; break;
+        case 'w': opt.disk.write_us_per_kib = atoi(optarg); break;
+        case 'a': opt.disk.alloc_us = atoi(optarg); break;
+        case 'f': opt.disk.fs_us = atoi(optarg); break;
+        case 'l': opt.disk.stall_ms = atoi(optarg); break;
+        case 'e': opt.disk.stall_every_ms = atoi(optarg); break;
+        case 'E': opt.disk.fail_every = atoi(optarg); break;
+        case 'c': opt.csv = true; break;
+        case 'v': opt.verbose = true; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 2;
+        }
+    }
+    if (opt.seconds <= 0 || opt.speed <= 0 || opt.power_cuts < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opt.power_cuts > 0) {
+        return power_cut_runs(&opt) ? 0 : 1;
+    }
+
+    if (opt.csv) {
+        printf("config,speed,sensor,driver,rate_hz,records,missing,reported,latency_p50_us,latency_p99_us,latency_max_us,"
+               "card_p50_us,card_p99_us,card_max_us,bus_width,bus_khz,card_kib_s\n");
+    }
+
+    RunResult_t result;
+    if (!opt.sweep) {
+        run_once(&opt, opt.speed, &result);
+        print_result(&opt, opt.speed, &result);
+        return sustained(&opt, &result) ? 0 : 1;
+    }
+
+    // Sweep: halve the speed until a run keeps up, then double it until one
+    // does not. The last speed that kept up is what this pipeline sustains.
+    double best = 0;
+    uint32_t nominal = 0;
+    double speed = opt.speed;
+    while (speed >= MIN_SWEEP_SPEED && speed <= opt.max_speed) {
+        run_once(&opt, speed, &result);
+        print_result(&opt, speed, &result);
+        if (sustained(&opt, &result)) {
+            best = speed;
+            nominal = nominal_rate_hz(&result);
+            if (speed < opt.speed) {
+                break;      // Twice this speed already failed
+            }
+            speed *= 2;
+        } else if (best == 0) {
+            speed /= 2;
+        } else {
+            break;
+        }
+    }
+
+    if (!opt.csv) {
+        if (best > 0) {
+            printf("%-14s max sustainable: %.0f samples/s (x%g of %u samples/s nominal)\n",
+                   SIM_CONFIG_NAME, best * nominal, best, nominal);
+        } else {
+            printf("%-14s loses samples even at x%g\n", SIM_CONFIG_NAME, MIN_SWEEP_SPEED);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include "sim.h"
+
+static double speed = 1.0;
+static int64_t start_ns;
+static atomic_bool stopped;
+
+static int64_t real_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void to_timespec(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+void sim_clock_init(double sim_speed)
+{
+    speed = (sim_speed > 0) ? sim_speed : 1.0;
+    start_ns = real_ns();
+    atomic_store(&stopped, false);
+}
+
+double sim_speed(void)
+{
+    return speed;
+}
+
+int64_t sim_now_us(void)
+{
+    return (int64_t)((real_ns() - start_ns) * speed / 1000);
+}
+
+void sim_deadline(struct timespec *ts, int64_t sim_us)
+{
+    to_timespec(real_ns() + (int64_t)(sim_us * 1000 / speed), ts);
+}
+
+void sim_sleep_until_us(int64_t sim_time_us)
+{
+    struct timespec ts;
+    to_timespec(start_ns + (int64_t)(sim_time_us * 1000 / speed), &ts);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+void sim_sleep_us(int64_t sim_us)
+{
+    if (sim_us > 0) {
+        sim_sleep_until_us(sim_now_us() + sim_us);
+    }
+}
+
+void sim_stop(void)
+{
+    atomic_store(&stopped, true);
+}
+
+bool sim_stopped(void)
+{
+    return atomic_load(&stopped);
+}
@@ -0,0 +1,657 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sim.h"
+
+#define MAX_OPEN_FILES  16
+#define MAX_CARD_FILES  16
+#define MAX_EXTENTS     16
+#define MAX_IN_FLIGHT   8
+#define MAX_PATH_LEN    256
+
+typedef struct {
+    int fd;                     // Host descriptor, -1 = free
+    char path[MAX_PATH_LEN];    // Host path
+} OpenFile_t;
+
+typedef struct {
+    char path[MAX_PATH_LEN];    // Host path
+    long committed;             // Size in the directory entry on the card
+} CardFile_t;
+
+typedef struct {
+    bool active;
+    char path[MAX_PATH_LEN];    // Host path
+    long offset;
+    size_t len;
+    uint8_t *old;               // What the card held there, with a power cut pending
+    size_t old_len;             // Part of the range that existed before
+} InFlight_t;
+
+typedef struct {
+    char path[MAX_PATH_LEN];
+    SimWrite_t write;
+} WriteEntry_t;
+
+typedef struct {
+    char path[MAX_PATH_LEN];    // Host path
+    uint32_t first_sector;
+    uint32_t sectors;
+} Extent_t;
+
+static char root_dir[MAX_PATH_LEN];
+static bool have_root = false;
+static SimDiskConfig_t disk;
+static int bus_width = 1;
+static uint32_t bus_khz = 20000;
+static int64_t last_stall_us;
+static uint32_t block_writes;       // Writes past a file's header, for disk.fail_every
+
+static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER;
+static OpenFile_t open_files[MAX_OPEN_FILES];
+static CardFile_t card_files[MAX_CARD_FILES];
+static size_t card_file_count;
+static InFlight_t in_flight[MAX_IN_FLIGHT];
+static int64_t power_cut_us = -1;
+static WriteEntry_t *writes;
+static size_t write_count;
+static size_t write_capacity;
+static Extent_t extents[MAX_EXTENTS];
+static size_t extent_count;
+static uint32_t next_sector;
+
+void sim_fs_init(const char *root, const SimDiskConfig_t *config)
+{
+    pthread_mutex_lock(&fs_lock);
+    snprintf(root_dir, sizeof(root_dir), "%s", root);
+    have_root = true;
+    disk = *config;
+    last_stall_us = 0;
+    block_writes = 0;
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        open_files[i].fd = -1;
+    }
+    write_count = 0;
+    card_file_count = 0;
+    extent_count = 0;
+    next_sector = SIM_DATA_SECTOR;
+    pthread_mutex_unlock(&fs_lock);
+}
+
+void sim_fs_set_bus(int width, uint32_t freq_khz)
+{
+    pthread_mutex_lock(&fs_lock);
+    bus_width = width;
+    bus_khz = freq_khz;
+    pthread_mutex_unlock(&fs_lock);
+}
+
+void sim_fs_get_bus(int *width, uint32_t *freq_khz)
+{
+    pthread_mutex_lock(&fs_lock);
+    *width = bus_width;
+    *freq_khz = bus_khz;
+    pthread_mutex_unlock(&fs_lock);
+}
+
+const char *sim_fs_root(void)
+{
+    return have_root ? root_dir : NULL;
+}
+
+const char *sim_fs_path(const char *path, char *buf, size_t len)
+{
+    size_t mount_len = strlen(SIM_MOUNT_POINT);
+
+    if (!have_root || strncmp(path, SIM_MOUNT_POINT, mount_len) != 0 ||
+        (path[mount_len] != '/' && path[mount_len] != '\0')) {
+        return path;
+    }
+    snprintf(buf, len, "%s%s", root_dir, path + mount_len);
+    return buf;
+}
+
+/**
+ * Entry of the card file at host_path, added with its current size as the
+ * committed one. NULL if the table is full. Caller holds fs_lock.
+ */
+static CardFile_t *card_file(const char *host_path)
+{
+    for (size_t i = 0; i < card_file_count; i++) {
+        if (strcmp(card_files[i].path, host_path) == 0) {
+            return &card_files[i];
+        }
+    }
+    if (card_file_count == MAX_CARD_FILES) {
+        return NULL;
+    }
+    struct stat st;
+    CardFile_t *file = &card_files[card_file_count++];
+    snprintf(file->path, MAX_PATH_LEN, "%s", host_path);
+    file->committed = (stat(host_path, &st) == 0) ? (long)st.st_size : 0;
+    return file;
+}
+
+/**
+ * Record the current size of host_path as written back to its directory
+ * entry. Caller holds fs_lock.
+ */
+static void commit_size(const char *host_path)
+{
+    struct stat st;
+    CardFile_t *file = card_file(host_path);
+    if (file != NULL && stat(host_path, &st) == 0) {
+        file->committed = st.st_size;
+    }
+}
+
+void sim_fs_commit(const char *path)
+{
+    char buf[MAX_PATH_LEN];
+    pthread_mutex_lock(&fs_lock);
+    commit_size(sim_fs_path(path, buf, sizeof(buf)));
+    pthread_mutex_unlock(&fs_lock);
+}
+
+/**
+ * Remember which card file fd is so its writes can be timed and logged.
+ * host_path is NULL for a file off the card.
+ */
+static void track_fd(int fd, const char *host_path)
+{
+    pthread_mutex_lock(&fs_lock);
+    int slot = -1;
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_files[i].fd == fd || (slot < 0 && open_files[i].fd < 0)) {
+            slot = i;
+        }
+    }
+    if (host_path == NULL) {
+        // Entries of closed files are never cleared; this one's fd was reused
+        if (slot >= 0 && open_files[slot].fd == fd) {
+            open_files[slot].fd = -1;
+        }
+    } else {
+        if (slot < 0) {
+            slot = 0;
+        }
+        open_files[slot].fd = fd;
+        snprintf(open_files[slot].path, MAX_PATH_LEN, "%s", host_path);
+        // A file first seen is as long as its directory entry says
+        card_file(host_path);
+    }
+    pthread_mutex_unlock(&fs_lock);
+}
+
+/**
+ * Slot of the card file open on fd, -1 if there is none
+ */
+static int find_fd(int fd)
+{
+    int file = -1;
+    pthread_mutex_lock(&fs_lock);
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_files[i].fd == fd) {
+            file = i;
+        }
+    }
+    pthread_mutex_unlock(&fs_lock);
+    return file;
+}
+
+FILE *sim_fopen(const char *path, const char *mode)
+{
+    char buf[MAX_PATH_LEN];
+    const char *host_path = sim_fs_path(path, buf, sizeof(buf));
+
+    FILE *f = fopen(host_path, mode);
+    if (f != NULL) {
+        track_fd(fileno(f), (host_path == path) ? NULL : host_path);
+    }
+    return f;
+}
+
+int sim_open(const char *path, int flags, ...)
+{
+    char buf[MAX_PATH_LEN];
+    const char *host_path = sim_fs_path(path, buf, sizeof(buf));
+    mode_t mode = 0;
+
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+    int fd = open(host_path, flags, mode);
+    if (fd >= 0) {
+        track_fd(fd, (host_path == path) ? NULL : host_path);
+    }
+    return fd;
+}
+
+int sim_unlink(const char *path)
+{
+    char buf[MAX_PATH_LEN];
+    return unlink(sim_fs_path(path, buf, sizeof(buf)));
+}
+
+DIR *sim_opendir(const char *path)
+{
+    char buf[MAX_PATH_LEN];
+    return opendir(sim_fs_path(path, buf, sizeof(buf)));
+}
+
+int sim_stat(const char *path, struct stat *st)
+{
+    char buf[MAX_PATH_LEN];
+    return stat(sim_fs_path(path, buf, sizeof(buf)), st);
+}
+
+/**
+ * Time the bus takes to move len bytes. Caller holds fs_lock.
+ */
+static int64_t transfer_us(size_t len)
+{
+    return (int64_t)len * 8 * 1000 / ((int64_t)bus_width * bus_khz);
+}
+
+/**
+ * Card latency for one write: transfer time (the slower of the bus and the
+ * card's programming), the FAT updates for every cluster it adds to the
+ * file and, once per stall interval, a stall like the ones caused by wear
+ * levelling
+ */
+static int64_t write_latency_us(size_t len, long old_size, long new_size, int64_t now_us)
+{
+    int64_t bus_us = transfer_us(len);
+    int64_t latency = (int64_t)disk.write_us_per_kib * len / 1024;
+    if (bus_us > latency) {
+        latency = bus_us;
+    }
+    long old_clusters = (old_size + SIM_CLUSTER_SIZE - 1) / SIM_CLUSTER_SIZE;
+    long new_clusters = (new_size + SIM_CLUSTER_SIZE - 1) / SIM_CLUSTER_SIZE;
+    if (new_clusters > old_clusters) {
+        latency += (int64_t)disk.alloc_us * (new_clusters - old_clusters);
+    }
+    if (disk.stall_every_ms > 0 && now_us - last_stall_us >= (int64_t)disk.stall_every_ms * 1000) {
+        latency += (int64_t)disk.stall_ms * 1000;
+        last_stall_us = now_us;
+    }
+    return latency;
+}
+
+/**
+ * Register a write of len bytes at offset of path as in progress. With a
+ * power cut pending, what the card holds there is saved first, so the cut
+ * can put back the sectors the write had not reached. Caller holds fs_lock.
+ */
+static InFlight_t *begin_write(const char *path, long offset, size_t len)
+{
+    InFlight_t *write = NULL;
+    for (int i = 0; i < MAX_IN_FLIGHT && write == NULL; i++) {
+        if (!in_flight[i].active) {
+            write = &in_flight[i];
+        }
+    }
+    if (write == NULL) {
+        return NULL;
+    }
+    *write = (InFlight_t){ .active = true, .offset = offset, .len = len };
+    snprintf(write->path, MAX_PATH_LEN, "%s", path);
+    if (power_cut_us >= 0) {
+        int fd = open(path, O_RDONLY);
+        write->old = malloc(len);
+        ssize_t got = (fd >= 0 && write->old != NULL) ? pread(fd, write->old, len, offset) : 0;
+        write->old_len = (got > 0) ? got : 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return write;
+}
+
+/**
+ * The write returned. Caller holds fs_lock.
+ */
+static void end_write(InFlight_t *write)
+{
+    if (write != NULL) {
+        free(write->old);
+        write->old = NULL;
+        write->active = false;
+    }
+}
+
+/**
+ * Append a finished write to the log. Caller holds fs_lock.
+ */
+static void log_write(const char *path, long offset, size_t len, int64_t start_us)
+{
+    if (write_count == write_capacity) {
+        write_capacity = write_capacity ? write_capacity * 2 : 1024;
+        writes = realloc(writes, write_capacity * sizeof(*writes));
+    }
+    WriteEntry_t *entry = &writes[write_count++];
+    snprintf(entry->path, MAX_PATH_LEN, "%s", path);
+    entry->write = (SimWrite_t){
+        .offset = offset,
+        .len = len,
+        .start_us = start_us,
+        .done_us = sim_now_us(),
+    };
+}
+
+/**
+ * Offset a write on fd at position pos goes to. Caller holds fs_lock.
+ */
+static long write_offset(int fd, long pos, long size)
+{
+    return (fcntl(fd, F_GETFL) & O_APPEND) ? size : pos;
+}
+
+/**
+ * Charge a file write that ended at file offset end and log it
+ */
+static void file_write_done(int file, InFlight_t *flight, long old_size, long end, size_t len, int64_t start_us)
+{
+    pthread_mutex_lock(&fs_lock);
+    int64_t latency = disk.fs_us + write_latency_us(len, old_size, end > old_size ? end : old_size, sim_now_us());
+    pthread_mutex_unlock(&fs_lock);
+    sim_sleep_us(latency);
+
+    pthread_mutex_lock(&fs_lock);
+    end_write(flight);
+    log_write(open_files[file].path, end - (long)len, len, start_us);
+    pthread_mutex_unlock(&fs_lock);
+}
+
+size_t sim_fwrite(const void *data, size_t size, size_t count, FILE *f)
+{
+    int file = find_fd(fileno(f));
+    if (file < 0) {
+        return fwrite(data, size, count, f);
+    }
+
+    int64_t start_us = sim_now_us();
+    struct stat st;
+    pthread_mutex_lock(&fs_lock);
+    long old_size = (fstat(fileno(f), &st) == 0) ? (long)st.st_size : 0;
+    long offset = write_offset(fileno(f), ftell(f), old_size);
+    InFlight_t *flight = begin_write(open_files[file].path, offset, size * count);
+    // A failed write takes its time but stores nothing and leaves the
+    // position where it was
+    bool fail = disk.fail_every > 0 && offset > 0 && ++block_writes % disk.fail_every == 0;
+    size_t written = fail ? 0 : fwrite(data, size, count, f);
+    fflush(f);
+    long end = ftell(f);
+    pthread_mutex_unlock(&fs_lock);
+    file_write_done(file, flight, old_size, end, written * size, start_us);
+    return written;
+}
+
+ssize_t sim_write(int fd, const void *data, size_t len)
+{
+    int file = find_fd(fd);
+    if (file < 0) {
+        return write(fd, data, len);
+    }
+
+    int64_t start_us = sim_now_us();
+    struct stat st;
+    pthread_mutex_lock(&fs_lock);
+    long old_size = (fstat(fd, &st) == 0) ? (long)st.st_size : 0;
+    long offset = write_offset(fd, lseek(fd, 0, SEEK_CUR), old_size);
+    InFlight_t *flight = begin_write(open_files[file].path, offset, len);
+    ssize_t written = write(fd, data, len);
+    long end = lseek(fd, 0, SEEK_CUR);
+    pthread_mutex_unlock(&fs_lock);
+    if (written <= 0) {
+        pthread_mutex_lock(&fs_lock);
+        end_write(flight);
+        pthread_mutex_unlock(&fs_lock);
+        return written;
+    }
+    file_write_done(file, flight, old_size, end, written, start_us);
+    return written;
+}
+
+/**
+ * Charge a file read of len bytes: the file system's share and the
+ * transfer. The card has no programming time to add.
+ */
+static void file_read_done(size_t len)
+{
+    pthread_mutex_lock(&fs_lock);
+    int64_t latency = disk.fs_us + transfer_us(len);
+    pthread_mutex_unlock(&fs_lock);
+    sim_sleep_us(latency);
+}
+
+size_t sim_fread(void *data, size_t size, size_t count, FILE *f)
+{
+    size_t got = fread(data, size, count, f);
+    if (find_fd(fileno(f)) >= 0) {
+        file_read_done(got * size);
+    }
+    return got;
+}
+
+ssize_t sim_read(int fd, void *data, size_t len)
+{
+    ssize_t got = read(fd, data, len);
+    if (find_fd(fd) >= 0) {
+        file_read_done(got > 0 ? got : 0);
+    }
+    return got;
+}
+
+int sim_fsync(int fd)
+{
+    int file = find_fd(fd);
+    if (file < 0) {
+        return fsync(fd);
+    }
+    // FATFS writes back the directory entry and the FAT sector in use; the
+    // host file itself need not reach the disk
+    pthread_mutex_lock(&fs_lock);
+    int64_t latency = disk.fs_us + write_latency_us(2 * SIM_SECTOR_SIZE, 0, 0, sim_now_us());
+    pthread_mutex_unlock(&fs_lock);
+    sim_sleep_us(latency);
+
+    pthread_mutex_lock(&fs_lock);
+    commit_size(open_files[file].path);
+    pthread_mutex_unlock(&fs_lock);
+    return 0;
+}
+
+esp_err_t sim_fs_extent(const char *path, uint32_t *first_sector, uint64_t *size)
+{
+    char buf[MAX_PATH_LEN];
+    const char *host_path = sim_fs_path(path, buf, sizeof(buf));
+    struct stat st;
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&fs_lock);
+    size_t i;
+    for (i = 0; i < extent_count && strcmp(extents[i].path, host_path) != 0; i++) {
+    }
+    if (i == extent_count) {
+        if (extent_count == MAX_EXTENTS || stat(host_path, &st) != 0) {
+            ret = ESP_ERR_NOT_FOUND;
+            goto out;
+        }
+        // Whole clusters, like the chain FATFS would have allocated
+        const uint32_t cluster_sectors = SIM_CLUSTER_SIZE / SIM_SECTOR_SIZE;
+        Extent_t *extent = &extents[extent_count++];
+        snprintf(extent->path, MAX_PATH_LEN, "%s", host_path);
+        extent->first_sector = next_sector;
+        extent->sectors = (st.st_size + SIM_SECTOR_SIZE - 1) / SIM_SECTOR_SIZE;
+        next_sector += (extent->sectors + cluster_sectors - 1) / cluster_sectors * cluster_sectors;
+    }
+    *first_sector = extents[i].first_sector;
+    *size = (uint64_t)extents[i].sectors * SIM_SECTOR_SIZE;
+out:
+    pthread_mutex_unlock(&fs_lock);
+    return ret;
+}
+
+/**
+ * Host file and offset of count sectors from sector, NULL unless they all
+ * lie in one extent. Caller holds fs_lock.
+ */
+static const char *sector_path(uint32_t sector, size_t count, long *offset)
+{
+    for (size_t i = 0; i < extent_count; i++) {
+        const Extent_t *extent = &extents[i];
+        if (sector >= extent->first_sector && sector + count <= extent->first_sector + extent->sectors) {
+            *offset = (long)(sector - extent->first_sector) * SIM_SECTOR_SIZE;
+            return extent->path;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t sim_fs_write_sectors(uint32_t sector, const void *data, size_t count)
+{
+    char path[MAX_PATH_LEN];
+    long offset;
+    size_t len = count * SIM_SECTOR_SIZE;
+
+    pthread_mutex_lock(&fs_lock);
+    const char *extent_path = sector_path(sector, count, &offset);
+    if (extent_path != NULL) {
+        snprintf(path, sizeof(path), "%s", extent_path);
+    }
+    pthread_mutex_unlock(&fs_lock);
+    if (extent_path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start_us = sim_now_us();
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    pthread_mutex_lock(&fs_lock);
+    InFlight_t *flight = begin_write(path, offset, len);
+    ssize_t written = pwrite(fd, data, len, offset);
+    int64_t latency = write_latency_us(len, 0, 0, sim_now_us());
+    pthread_mutex_unlock(&fs_lock);
+    close(fd);
+    if (written == (ssize_t)len) {
+        sim_sleep_us(latency);
+    }
+
+    pthread_mutex_lock(&fs_lock);
+    end_write(flight);
+    if (written == (ssize_t)len) {
+        log_write(path, offset, len, start_us);
+    }
+    pthread_mutex_unlock(&fs_lock);
+    return (written == (ssize_t)len) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sim_fs_read_sectors(uint32_t sector, void *data, size_t count)
+{
+    char path[MAX_PATH_LEN];
+    long offset;
+    size_t len = count * SIM_SECTOR_SIZE;
+
+    pthread_mutex_lock(&fs_lock);
+    const char *extent_path = sector_path(sector, count, &offset);
+    if (extent_path != NULL) {
+        snprintf(path, sizeof(path), "%s", extent_path);
+    }
+    pthread_mutex_unlock(&fs_lock);
+    if (extent_path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    ssize_t got = pread(fd, data, len, offset);
+    close(fd);
+    if (got < 0) {
+        return ESP_FAIL;
+    }
+    // Past the end of a truncated file the card still has whatever it had
+    memset((uint8_t *)data + got, 0, len - got);
+    return ESP_OK;
+}
+
+size_t sim_fs_writes(const char *path, SimWrite_t *out, size_t max)
+{
+    char buf[MAX_PATH_LEN];
+    const char *host_path = sim_fs_path(path, buf, sizeof(buf));
+    size_t n = 0;
+
+    pthread_mutex_lock(&fs_lock);
+    for (size_t i = 0; i < write_count && n < max; i++) {
+        if (strcmp(writes[i].path, host_path) == 0) {
+            out[n++] = writes[i].write;
+        }
+    }
+    pthread_mutex_unlock(&fs_lock);
+    return n;
+}
+
+/**
+ * Undo the part of a write the card had not programmed when power went:
+ * it got through a random number of whole sectors, never all of them.
+ * Caller holds fs_lock.
+ */
+static void tear_write(const InFlight_t *write, unsigned *seed)
+{
+    size_t sectors = (write->len + SIM_SECTOR_SIZE - 1) / SIM_SECTOR_SIZE;
+    size_t done = (size_t)rand_r(seed) % sectors;
+    size_t from = done * SIM_SECTOR_SIZE;
+    int fd = open(write->path, O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (from < write->old_len && pwrite(fd, write->old + from, write->old_len - from, write->offset + from) < 0) {
+        perror("tear_write");
+    }
+    close(fd);
+}
+
+static void *power_cut_task(void *arg)
+{
+    sim_sleep_until_us(power_cut_us);
+
+    // Everything else stops here: no thread gets the lock back
+    pthread_mutex_lock(&fs_lock);
+    unsigned seed = (unsigned)power_cut_us;
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        if (in_flight[i].active && in_flight[i].old != NULL) {
+            tear_write(&in_flight[i], &seed);
+        }
+    }
+    // Clusters a file grew by since its last sync are lost with it
+    for (size_t i = 0; i < card_file_count; i++) {
+        struct stat st;
+        if (stat(card_files[i].path, &st) == 0 && st.st_size > card_files[i].committed &&
+            truncate(card_files[i].path, card_files[i].committed) != 0) {
+            perror("power_cut");
+        }
+    }
+    fflush(stdout);
+    _exit(SIM_POWER_CUT_EXIT);
+    return NULL;
+}
+
+void sim_fs_power_cut_at(int64_t cut_us)
+{
+    pthread_t thread;
+    pthread_mutex_lock(&fs_lock);
+    power_cut_us = cut_us;
+    pthread_mutex_unlock(&fs_lock);
+    pthread_create(&thread, NULL, power_cut_task, NULL);
+    pthread_detach(thread);
+}
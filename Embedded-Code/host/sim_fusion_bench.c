@@ -0,0 +1,401 @@
+/**
+ * Fusion benchmark on the host
+ *
+ * Feeds the firmware's fusion (../main/fusion.c) a synthetic flight at the
+ * sensor table's rates: three seconds on the pad, a boost, coasting to
+ * apogee while spinning about the vertical, falling until the parachute
+ * holds the descent rate, a landing shock, and three seconds on the
+ * ground again. Every change of velocity shows on the accelerometer, so
+ * the vertical filter can follow the truth. Readings carry noise and a
+ * gyro bias.
+ *
+ * The first pass checks the output against the true trajectory. Every
+ * later pass times each call on its own with the cycle counter, which on
+ * x86 hosts is the time-stamp counter, and reports the cycles per update
+ * of each kernel. The device logs the same count for its own updates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include "esp_cpu.h"
+#include "fusion.h"
+
+#define STANDARD_GRAVITY    9.80665
+#define DEG_TO_RAD          (M_PI / 180)
+
+// Rates of the sensor table in main.c
+#define IMU_HZ              1000
+#define BARO_HZ             50
+#define MAG_HZ              50
+#define OUTPUT_HZ           100     // CONFIG_FUSION_RATE_HZ
+
+// The boost and descent rate sim_sensors.c flies, plus a spin
+#define PAD_S               3.0
+#define BOOST_S             0.5
+#define BOOST_ACCEL         (10 * STANDARD_GRAVITY)
+#define DESCENT_MPS         20.0
+#define LANDING_S           0.2     // Stopping from the descent rate
+#define SPIN_DPS            180.0   // From launch to apogee
+#define HEADING_DEG         30.0    // On the pad, from magnetic north
+#define FIELD_UT            50.0
+#define DIP_DEG             60.0
+
+#define ACCEL_NOISE         0.05    // m/s2
+#define GYRO_NOISE          0.002   // rad/s
+#define GYRO_BIAS           0.01
+#define MAG_NOISE           0.5     // uT
+#define BARO_NOISE          0.3     // m
+
+typedef enum {
+    KERNEL_IMU,
+    KERNEL_MAG,
+    KERNEL_ALTITUDE,
+    KERNEL_OUTPUT,
+    KERNEL_COUNT,
+} Kernel_t;
+
+static const char *const kernel_names[KERNEL_COUNT] = {
+    "fusion_imu", "fusion_mag", "fusion_altitude", "fusion_output",
+};
+
+typedef struct {
+    int64_t t_us;
+    Kernel_t kernel;
+    float v[3];                 // Acceleration, or field, or v[0] altitude
+    float gyro[3];
+} Reading_t;
+
+typedef struct {
+    int64_t t_us;
+    double altitude_m;
+    double velocity_mps;
+    double yaw_deg;
+} Truth_t;
+
+typedef struct {
+    Reading_t *readings;
+    Truth_t *truth;             // Per reading
+    size_t count;
+    double apogee_m;
+} Trace_t;
+
+/**
+ * Phase ends in seconds after launch
+ */
+typedef struct {
+    double burnout_s;
+    double apogee_s;
+    double descent_s;           // Parachute holding the descent rate
+    double touchdown_s;
+    double landing_s;
+    double apogee_m;
+} Profile_t;
+
+static unsigned rng_state;
+
+static double gaussian(void)
+{
+    double u1 = (rand_r(&rng_state) + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand_r(&rng_state) + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static void init_profile(Profile_t *profile)
+{
+    double burnout_mps = BOOST_ACCEL * BOOST_S;
+    double fall_s = DESCENT_MPS / STANDARD_GRAVITY;
+    double landing_m = DESCENT_MPS * LANDING_S / 2;
+
+    profile->burnout_s = BOOST_S;
+    profile->apogee_s = BOOST_S + burnout_mps / STANDARD_GRAVITY;
+    profile->apogee_m = burnout_mps * profile->apogee_s / 2;
+    profile->descent_s = profile->apogee_s + fall_s;
+    double descent_m = profile->apogee_m - DESCENT_MPS * fall_s / 2;
+    profile->touchdown_s = profile->descent_s + (descent_m - landing_m) / DESCENT_MPS;
+    profile->landing_s = profile->touchdown_s + LANDING_S;
+}
+
+/**
+ * Height, vertical velocity and upward specific force t seconds after launch
+ */
+static void flight_at(const Profile_t *profile, double t, double *height, double *velocity, double *force)
+{
+    double accel;
+    *height = *velocity = 0;
+    *force = STANDARD_GRAVITY;
+    if (t < 0 || t >= profile->landing_s) {
+        return;
+    }
+    if (t < profile->burnout_s) {
+        accel = BOOST_ACCEL;
+        *height = accel * t * t / 2;
+        *velocity = accel * t;
+    } else if (t < profile->descent_s) {
+        // Coasting up, then falling freely until the parachute holds
+        double s = t - profile->apogee_s;
+        accel = -STANDARD_GRAVITY;
+        *height = profile->apogee_m + accel * s * s / 2;
+        *velocity = accel * s;
+    } else if (t < profile->touchdown_s) {
+        accel = 0;
+        *height = DESCENT_MPS * LANDING_S / 2 + DESCENT_MPS * (profile->touchdown_s - t);
+        *velocity = -DESCENT_MPS;
+    } else {
+        double s = profile->landing_s - t;
+        accel = DESCENT_MPS / LANDING_S;
+        *height = accel * s * s / 2;
+        *velocity = -accel * s;
+    }
+    *force = accel + STANDARD_GRAVITY;
+}
+
+static void add_reading(Trace_t *trace, size_t *capacity, const Reading_t *reading, const Truth_t *truth)
+{
+    if (trace->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4096;
+        trace->readings = realloc(trace->readings, *capacity * sizeof(Reading_t));
+        trace->truth = realloc(trace->truth, *capacity * sizeof(Truth_t));
+    }
+    trace->readings[trace->count] = *reading;
+    trace->truth[trace->count] = *truth;
+    trace->count++;
+}
+
+/**
+ * Generate every reading of the flight, in time order
+ */
+static void build_trace(Trace_t *trace, unsigned seed)
+{
+    Profile_t profile;
+    init_profile(&profile);
+    double end_s = PAD_S + profile.landing_s + 3.0;
+    const double bias[3] = { GYRO_BIAS, -GYRO_BIAS, GYRO_BIAS / 2 };
+    size_t capacity = 0;
+
+    memset(trace, 0, sizeof(*trace));
+    trace->apogee_m = profile.apogee_m;
+    rng_state = seed;
+
+    // One step per IMU sample, the other rates dividing it
+    const int64_t step_us = 1000000 / IMU_HZ;
+    for (int64_t t_us = 0; t_us < (int64_t)(end_s * 1e6); t_us += step_us) {
+        double t = t_us / 1e6 - PAD_S;
+        double height, velocity, force;
+        flight_at(&profile, t, &height, &velocity, &force);
+        double spin = (t >= 0 && t < profile.apogee_s) ? SPIN_DPS : 0;
+        double spun = (t <= 0) ? 0 : SPIN_DPS * fmin(t, profile.apogee_s);
+        double yaw = fmod(HEADING_DEG + spun, 360.0);
+        Truth_t truth = { t_us, height, velocity, (yaw > 180) ? yaw - 360 : yaw };
+
+        // Vertical flight: the body's z axis stays up, turning about it
+        Reading_t imu = { .t_us = t_us, .kernel = KERNEL_IMU };
+        imu.v[0] = ACCEL_NOISE * gaussian();
+        imu.v[1] = ACCEL_NOISE * gaussian();
+        imu.v[2] = force + ACCEL_NOISE * gaussian();
+        imu.gyro[0] = bias[0] + GYRO_NOISE * gaussian();
+        imu.gyro[1] = bias[1] + GYRO_NOISE * gaussian();
+        imu.gyro[2] = spin * DEG_TO_RAD + bias[2] + GYRO_NOISE * gaussian();
+        add_reading(trace, &capacity, &imu, &truth);
+
+        if (t_us % (1000000 / MAG_HZ) == 0) {
+            double north = FIELD_UT * cos(DIP_DEG * DEG_TO_RAD);
+            double psi = yaw * DEG_TO_RAD;
+            Reading_t mag = { .t_us = t_us, .kernel = KERNEL_MAG };
+            mag.v[0] = north * cos(psi) + MAG_NOISE * gaussian();
+            mag.v[1] = -north * sin(psi) + MAG_NOISE * gaussian();
+            mag.v[2] = -FIELD_UT * sin(DIP_DEG * DEG_TO_RAD) + MAG_NOISE * gaussian();
+            add_reading(trace, &capacity, &mag, &truth);
+        }
+        if (t_us % (1000000 / BARO_HZ) == 0) {
+            Reading_t baro = { .t_us = t_us, .kernel = KERNEL_ALTITUDE };
+            baro.v[0] = height + BARO_NOISE * gaussian();
+            add_reading(trace, &capacity, &baro, &truth);
+        }
+        if (t_us % (1000000 / OUTPUT_HZ) == 0) {
+            Reading_t output = { .t_us = t_us, .kernel = KERNEL_OUTPUT };
+            add_reading(trace, &capacity, &output, &truth);
+        }
+    }
+}
+
+static void feed(Fusion_t *fusion, const Reading_t *reading, FusionOutput_t *output)
+{
+    switch (reading->kernel) {
+    case KERNEL_IMU:
+        fusion_imu(fusion, reading->t_us, reading->v, reading->gyro);
+        break;
+    case KERNEL_MAG:
+        fusion_mag(fusion, reading->v);
+        break;
+    case KERNEL_ALTITUDE:
+        fusion_altitude(fusion, reading->v[0]);
+        break;
+    default:
+        fusion_output(fusion, output);
+        break;
+    }
+}
+
+typedef struct {
+    double altitude_rms_m;
+    double velocity_rms_mps;
+    double yaw_rms_deg;
+    double tilt_max_deg;
+    double apogee_m;            // Highest fused altitude
+} Accuracy_t;
+
+/**
+ * Run the trace once, comparing each output with the truth from the end of
+ * the attitude's settling time on
+ */
+static void check_accuracy(const Trace_t *trace, Accuracy_t *acc)
+{
+    Fusion_t fusion;
+    FusionOutput_t out;
+    double alt_sq = 0, vel_sq = 0, yaw_sq = 0;
+    size_t n = 0;
+
+    memset(acc, 0, sizeof(*acc));
+    fusion_init(&fusion);
+    for (size_t i = 0; i < trace->count; i++) {
+        const Reading_t *reading = &trace->readings[i];
+        feed(&fusion, reading, &out);
+        if (reading->kernel != KERNEL_OUTPUT || reading->t_us < FUSION_SETTLE_MS * 1000LL || !out.vertical_valid) {
+            continue;
+        }
+        const Truth_t *truth = &trace->truth[i];
+        double yaw_err = fmod(out.yaw_deg - truth->yaw_deg + 540.0, 360.0) - 180.0;
+        double tilt = fmax(fabs(out.pitch_deg), fabs(out.roll_deg));
+        alt_sq += pow(out.altitude_m - truth->altitude_m, 2);
+        vel_sq += pow(out.velocity_mps - truth->velocity_mps, 2);
+        yaw_sq += yaw_err * yaw_err;
+        acc->tilt_max_deg = fmax(acc->tilt_max_deg, tilt);
+        acc->apogee_m = fmax(acc->apogee_m, out.altitude_m);
+        n++;
+    }
+    if (n > 0) {
+        acc->altitude_rms_m = sqrt(alt_sq / n);
+        acc->velocity_rms_mps = sqrt(vel_sq / n);
+        acc->yaw_rms_deg = sqrt(yaw_sq / n);
+    }
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * What reading the cycle counter twice costs, taken off every measurement
+ */
+static uint32_t counter_overhead(void)
+{
+    uint32_t samples[1001];
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        samples[i] = esp_cpu_get_cycle_count() - start;
+    }
+    qsort(samples, sizeof(samples) / sizeof(samples[0]), sizeof(samples[0]), compare_u32);
+    return samples[500];
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --repeat N          timed passes over the flight (default 20)\n"
+            "  --seed N            seed for the sensor noise (default 1)\n"
+            "  --csv               machine-readable output\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int repeat = 20;
+    unsigned seed = 1;
+    bool csv = false;
+    static const struct option options[] = {
+        { "repeat", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 'R' },
+        { "csv", no_argument, NULL, 'c' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (c) {
+        case 'r': repeat = atoi(optarg); break;
+        case 'R': seed = strtoul(optarg, NULL, 0); break;
+        case 'c': csv = true; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 2;
+        }
+    }
+    if (repeat <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Trace_t trace;
+    build_trace(&trace, seed);
+    Accuracy_t acc;
+    check_accuracy(&trace, &acc);
+
+    // Per-call cycles of every timed pass, grouped by kernel
+    size_t per_kernel[KERNEL_COUNT] = { 0 };
+    for (size_t i = 0; i < trace.count; i++) {
+        per_kernel[trace.readings[i].kernel]++;
+    }
+    uint32_t *cycles[KERNEL_COUNT];
+    size_t counts[KERNEL_COUNT] = { 0 };
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        cycles[k] = malloc(per_kernel[k] * repeat * sizeof(uint32_t));
+    }
+
+    uint32_t overhead = counter_overhead();
+    for (int r = 0; r < repeat; r++) {
+        Fusion_t fusion;
+        FusionOutput_t out;
+        fusion_init(&fusion);
+        for (size_t i = 0; i < trace.count; i++) {
+            const Reading_t *reading = &trace.readings[i];
+            esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+            feed(&fusion, reading, &out);
+            uint32_t spent = esp_cpu_get_cycle_count() - start;
+            cycles[reading->kernel][counts[reading->kernel]++] = (spent > overhead) ? spent - overhead : 0;
+        }
+    }
+
+    if (csv) {
+        printf("kernel,updates,avg_cycles,p50_cycles,p99_cycles,max_cycles\n");
+    }
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        size_t n = counts[k];
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += cycles[k][i];
+        }
+        qsort(cycles[k], n, sizeof(uint32_t), compare_u32);
+        if (csv) {
+            printf("%s,%zu,%llu,%u,%u,%u\n", kernel_names[k], n, (unsigned long long)(sum / n), cycles[k][n / 2],
+                   cycles[k][n * 99 / 100], cycles[k][n - 1]);
+        } else {
+            printf("%-16s %8zu updates, cycles avg %4llu / p50 %4u / p99 %5u / max %6u\n", kernel_names[k], n,
+                   (unsigned long long)(sum / n), cycles[k][n / 2], cycles[k][n * 99 / 100], cycles[k][n - 1]);
+        }
+        free(cycles[k]);
+    }
+    if (!csv) {
+        printf("accuracy: altitude rms %.2f m (apogee %.1f of %.1f m), vertical velocity rms %.2f m/s, "
+               "yaw rms %.2f deg, tilt max %.2f deg\n", acc.altitude_rms_m, acc.apogee_m, trace.apogee_m,
+               acc.velocity_rms_mps, acc.yaw_rms_deg, acc.tilt_max_deg);
+    }
+
+    free(trace.readings);
+    free(trace.truth);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * SD write benchmark on the host simulation
+ *
+ * Runs the firmware's sd_bench sweep (../main/sd_bench.c) against the fake
+ * card, so its numbers show what the card model charges for each access
+ * path, pattern and block size. The same sweep runs on the device from
+ * sd_card_test.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "sim.h"
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+#include "driver/sdmmc_host.h"
+#include "sd_bench.h"
+
+static void remove_tree(const char *dir)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Could not remove %s\n", dir);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --min-block N       smallest block size in bytes (default 512)\n"
+            "  --max-block N       largest block size in bytes (default 65536)\n"
+            "  --run-kib N         data written per run (default 1024)\n"
+            "  --bus-width N       SD bus width, 1 or 4 (default 1)\n"
+            "  --freq-khz N        SD bus clock (default 40000)\n"
+            "  --disk DIR          directory holding the simulated card (default /dev/shm)\n"
+            "  --write-us N        card programming time per KiB written (default 60)\n"
+            "  --alloc-us N        FAT update time per cluster a file grows by (default 2000)\n"
+            "  --fs-us N           file system time per file write (default 300)\n"
+            "  --stall-ms N        length of a card stall (default 0)\n"
+            "  --stall-every-ms N  interval between card stalls (default 0, never)\n"
+            "  --csv               machine-readable output\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    SdBenchConfig_t config = SD_BENCH_CONFIG_DEFAULT();
+    SimDiskConfig_t disk = { .write_us_per_kib = 60, .alloc_us = 2000, .fs_us = 300 };
+    const char *disk_base = (access("/dev/shm", W_OK) == 0) ? "/dev/shm" : "/tmp";
+    int bus_width = 1;
+    int freq_khz = 40000;
+    bool csv = false;
+    static const struct option options[] = {
+        { "min-block", required_argument, NULL, 'b' },
+        { "max-block", required_argument, NULL, 'B' },
+        { "run-kib", required_argument, NULL, 'r' },
+        { "bus-width", required_argument, NULL, 'W' },
+        { "freq-khz", required_argument, NULL, 'F' },
+        { "disk", required_argument, NULL, 'd' },
+        { "write-us", required_argument, NULL, 'w' },
+        { "alloc-us", required_argument, NULL, 'a' },
+        { "fs-us", required_argument, NULL, 'f' },
+        { "stall-ms", required_argument, NULL, 'l' },
+        { "stall-every-ms", required_argument, NULL, 'e' },
+        { "csv", no_argument, NULL, 'c' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (c) {
+        case 'b': config.min_block = strtoul(optarg, NULL, 0); break;
+        case 'B': config.max_block = strtoul(optarg, NULL, 0); break;
+        case 'r': config.run_bytes = strtoul(optarg, NULL, 0) * 1024; break;
+        case 'W': bus_width = atoi(optarg); break;
+        case 'F': freq_khz = atoi(optarg); break;
+        case 'd': disk_base = optarg; break;
+        case 'w': disk.write_us_per_kib = atoi(optarg); break;
+        case 'a': disk.alloc_us = atoi(optarg); break;
+        case 'f': disk.fs_us = atoi(optarg); break;
+        case 'l': disk.stall_ms = atoi(optarg); break;
+        case 'e': disk.stall_every_ms = atoi(optarg); break;
+        case 'c': csv = true; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 2;
+        }
+    }
+    if ((bus_width != 1 && bus_width != 4) || freq_khz <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s/starpi-sdbench-XXXXXX", disk_base);
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Cannot create a card directory in %s\n", disk_base);
+        return 1;
+    }
+    if (csv) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+    }
+
+    sim_clock_init(1);
+    sim_fs_init(dir, &disk);
+
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = { .max_files = 5, .allocation_unit_size = SIM_CLUSTER_SIZE };
+    host.max_freq_khz = freq_khz;
+    slot_config.width = bus_width;
+    esp_err_t ret = esp_vfs_fat_sdmmc_mount(SIM_MOUNT_POINT, &host, &slot_config, &mount_config, &config.card);
+    if (ret == ESP_OK) {
+        config.mount_point = SIM_MOUNT_POINT;
+        ret = sd_bench_run(&config, csv ? stdout : NULL);
+        esp_vfs_fat_sdcard_unmount(SIM_MOUNT_POINT, config.card);
+    }
+    remove_tree(dir);
+
+    if (ret != ESP_OK) {
+        fprintf(stderr, "Benchmark failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,510 @@
+/**
+ * Register-level fakes of the sensors on the Star PI I2C bus
+ *
+ * Each device keeps a register file behind an auto-incrementing register
+ * pointer, like the real parts. Measurements are pure functions of
+ * simulated time, so a record can be checked against the time it claims.
+ * The board lies flat on the pad unless it is flown (sim_sensors_fly()).
+ */
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "sim.h"
+
+#define MPU_ADDR                0x68
+#define BME_ADDR                0x76
+#define HMC_ADDR                0x1E
+
+#define MPU_FIFO_SIZE           1024        // MPU6050, as WHO_AM_I reports
+#define MPU_FRAME_LEN           12
+
+typedef struct SimDevice {
+    uint16_t address;
+    uint8_t regs[256];
+    uint8_t pointer;
+    void (*reset)(struct SimDevice *dev);
+    void (*write)(struct SimDevice *dev, uint8_t reg, uint8_t value);
+    uint8_t (*read)(struct SimDevice *dev, uint8_t reg);
+    bool (*increment)(struct SimDevice *dev, uint8_t reg);  // Pointer advances after reading reg
+    bool unplugged;             // Does not answer on the bus
+} SimDevice_t;
+
+static pthread_mutex_t sensors_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline double seconds(int64_t t_us)
+{
+    return t_us / 1e6;
+}
+
+static inline void put_be16(uint8_t *p, int32_t v)
+{
+    if (v > INT16_MAX) v = INT16_MAX;
+    if (v < INT16_MIN) v = INT16_MIN;
+    p[0] = (uint16_t)v >> 8;
+    p[1] = (uint16_t)v & 0xFF;
+}
+
+static inline void put_le16(uint8_t *p, int32_t v)
+{
+    p[0] = (uint16_t)v & 0xFF;
+    p[1] = (uint16_t)v >> 8;
+}
+
+// --- Flight --------------------------------------------------------------------
+
+#define STANDARD_GRAVITY        9.80665
+#define BOOST_S                 0.5                         // Motor burn
+#define BOOST_ACCEL             (10 * STANDARD_GRAVITY)     // Net of gravity
+#define DESCENT_MPS             20.0                        // Under the parachute
+
+static bool flying = false;
+static SimFlight_t flight;
+
+void sim_sensors_fly(int64_t launch_us, SimFlight_t *out)
+{
+    double burnout_mps = BOOST_ACCEL * BOOST_S;
+    double coast_s = burnout_mps / STANDARD_GRAVITY;
+
+    pthread_mutex_lock(&sensors_lock);
+    flight.launch_us = launch_us;
+    flight.burnout_us = launch_us + llround(BOOST_S * 1e6);
+    flight.apogee_us = flight.burnout_us + llround(coast_s * 1e6);
+    flight.apogee_m = BOOST_ACCEL * BOOST_S * BOOST_S / 2 + burnout_mps * coast_s / 2;
+    flight.landing_us = flight.apogee_us + llround(flight.apogee_m / DESCENT_MPS * 1e6);
+    flying = true;
+    *out = flight;
+    pthread_mutex_unlock(&sensors_lock);
+}
+
+/**
+ * Height above the pad at t_us, and the specific force along the vertical
+ * that the accelerometer feels: gravity on the ground and under the
+ * parachute, thrust on top of it during boost, nothing while coasting
+ */
+static void flight_at(int64_t t_us, double *height_m, double *force)
+{
+    *height_m = 0;
+    *force = STANDARD_GRAVITY;
+    if (!flying || t_us < flight.launch_us || t_us >= flight.landing_us) {
+        return;
+    }
+
+    double t = seconds(t_us - flight.launch_us);
+    if (t_us < flight.burnout_us) {
+        *height_m = BOOST_ACCEL * t * t / 2;
+        *force = BOOST_ACCEL + STANDARD_GRAVITY;
+    } else if (t_us < flight.apogee_us) {
+        double c = t - BOOST_S;
+        *height_m = BOOST_ACCEL * BOOST_S * BOOST_S / 2 + BOOST_ACCEL * BOOST_S * c - STANDARD_GRAVITY * c * c / 2;
+        *force = 0;
+    } else {
+        *height_m = flight.apogee_m - DESCENT_MPS * seconds(t_us - flight.apogee_us);
+    }
+}
+
+// --- MPU6050 -------------------------------------------------------------------
+
+#define MPU_REG_SMPLRT_DIV      0x19
+#define MPU_REG_ACCEL_CONFIG    0x1C
+#define MPU_REG_GYRO_CONFIG     0x1B
+#define MPU_REG_INT_ENABLE      0x38
+#define MPU_REG_ACCEL_XOUT_H    0x3B
+#define MPU_REG_USER_CTRL       0x6A
+#define MPU_REG_PWR_MGMT_1      0x6B
+#define MPU_REG_FIFO_COUNT_H    0x72
+#define MPU_REG_FIFO_COUNT_L    0x73
+#define MPU_REG_FIFO_R_W        0x74
+#define MPU_REG_WHO_AM_I        0x75
+
+static int64_t fifo_start_us;
+static uint64_t fifo_consumed;      // Bytes read out since the last reset
+static uint8_t mpu_snapshot[14];    // Latched on a read of ACCEL_XOUT_H
+
+static int64_t mpu_period_us(const SimDevice_t *dev)
+{
+    return 1000 * (1 + dev->regs[MPU_REG_SMPLRT_DIV]);
+}
+
+/**
+ * Accel, temperature and gyro registers of the sample taken at t_us: the
+ * board lies flat with a slow wobble, Z up
+ */
+static void mpu_sample(const SimDevice_t *dev, int64_t t_us, uint8_t *out)
+{
+    double accel_lsb = 16384 >> ((dev->regs[MPU_REG_ACCEL_CONFIG] >> 3) & 3);
+    double gyro_lsb = 131.0 / (1 << ((dev->regs[MPU_REG_GYRO_CONFIG] >> 3) & 3));
+    double t = seconds(t_us);
+    double height_m, force;
+    flight_at(t_us, &height_m, &force);
+
+    put_be16(out + 0, lround(0.02 * sin(2 * M_PI * t) * accel_lsb));
+    put_be16(out + 2, lround(0.01 * cos(2 * M_PI * t) * accel_lsb));
+    put_be16(out + 4, lround(force / STANDARD_GRAVITY * accel_lsb));
+    put_be16(out + 6, lround((25.0 - 36.53) * 340));
+    put_be16(out + 8, lround(10 * sin(M_PI * t) * gyro_lsb));
+    put_be16(out + 10, lround(-5 * cos(M_PI * t) * gyro_lsb));
+    put_be16(out + 12, lround(2 * gyro_lsb));
+}
+
+static void mpu_reset(SimDevice_t *dev)
+{
+    memset(dev->regs, 0, sizeof(dev->regs));
+    dev->regs[MPU_REG_PWR_MGMT_1] = 0x40;
+    dev->regs[MPU_REG_WHO_AM_I] = 0x68;
+    fifo_start_us = sim_now_us();
+    fifo_consumed = 0;
+}
+
+/**
+ * Bytes waiting in the FIFO. Once it is full the oldest frames are
+ * overwritten, leaving the read position mid-frame.
+ */
+static uint32_t fifo_pending(const SimDevice_t *dev)
+{
+    if ((dev->regs[MPU_REG_USER_CTRL] & 0x40) == 0) {
+        return 0;
+    }
+    uint64_t produced = (uint64_t)((sim_now_us() - fifo_start_us) / mpu_period_us(dev)) * MPU_FRAME_LEN;
+    if (produced - fifo_consumed > MPU_FIFO_SIZE) {
+        fifo_consumed = produced - MPU_FIFO_SIZE;
+    }
+    return produced - fifo_consumed;
+}
+
+static void mpu_write(SimDevice_t *dev, uint8_t reg, uint8_t value)
+{
+    if (reg == MPU_REG_PWR_MGMT_1 && (value & 0x80)) {
+        mpu_reset(dev);
+        return;
+    }
+    if (reg == MPU_REG_USER_CTRL && (value & 0x04)) {
+        fifo_start_us = sim_now_us();
+        fifo_consumed = 0;
+        value &= ~0x04;
+    }
+    dev->regs[reg] = value;
+}
+
+static uint8_t mpu_read(SimDevice_t *dev, uint8_t reg)
+{
+    if (reg >= MPU_REG_ACCEL_XOUT_H && reg < MPU_REG_ACCEL_XOUT_H + 14) {
+        // Burst reads see one consistent sample
+        if (reg == MPU_REG_ACCEL_XOUT_H) {
+            int64_t period = mpu_period_us(dev);
+            mpu_sample(dev, sim_now_us() / period * period, mpu_snapshot);
+        }
+        return mpu_snapshot[reg - MPU_REG_ACCEL_XOUT_H];
+    }
+    if (reg == MPU_REG_FIFO_COUNT_H) {
+        return fifo_pending(dev) >> 8;
+    }
+    if (reg == MPU_REG_FIFO_COUNT_L) {
+        return fifo_pending(dev) & 0xFF;
+    }
+    if (reg == MPU_REG_FIFO_R_W) {
+        if (fifo_pending(dev) == 0) {
+            return 0xFF;
+        }
+        uint8_t sample[14];
+        uint64_t frame = fifo_consumed / MPU_FRAME_LEN;
+        size_t byte = fifo_consumed % MPU_FRAME_LEN;
+        fifo_consumed++;
+
+        // Frames hold accel then gyro; the temperature is not stored
+        mpu_sample(dev, fifo_start_us + (int64_t)(frame + 1) * mpu_period_us(dev), sample);
+        return (byte < 6) ? sample[byte] : sample[byte + 2];
+    }
+    return dev->regs[reg];
+}
+
+static bool mpu_increment(SimDevice_t *dev, uint8_t reg)
+{
+    return reg != MPU_REG_FIFO_R_W;
+}
+
+// --- BME280 ------------------------------------------------------------------
+
+#define BME_REG_CALIB_TP        0x88
+#define BME_REG_CHIP_ID         0xD0
+#define BME_REG_CALIB_H         0xE1
+#define BME_REG_PRESS_MSB       0xF7
+
+// Trimming of the datasheet example, which gives 25.08 degC / 100653 Pa
+static const int32_t bme_trim_tp[] = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+};
+
+static void bme_reset(SimDevice_t *dev)
+{
+    memset(dev->regs, 0, sizeof(dev->regs));
+    dev->regs[BME_REG_CHIP_ID] = 0x60;
+
+    for (size_t i = 0; i < sizeof(bme_trim_tp) / sizeof(bme_trim_tp[0]); i++) {
+        put_le16(&dev->regs[BME_REG_CALIB_TP + 2 * i], bme_trim_tp[i]);
+    }
+    dev->regs[0xA1] = 75;                               // H1
+    put_le16(&dev->regs[BME_REG_CALIB_H], 362);         // H2
+    dev->regs[BME_REG_CALIB_H + 2] = 0;                 // H3
+    dev->regs[BME_REG_CALIB_H + 3] = 313 >> 4;          // H4[11:4]
+    dev->regs[BME_REG_CALIB_H + 4] = (313 & 0x0F) | ((50 & 0x0F) << 4);
+    dev->regs[BME_REG_CALIB_H + 5] = 50 >> 4;           // H5[11:4]
+    dev->regs[BME_REG_CALIB_H + 6] = 30;                // H6
+}
+
+/**
+ * Pressure in Pa the compensation makes of adc_p, in the double precision
+ * form of the datasheet
+ */
+static double bme_pressure(int32_t adc_p, int32_t adc_t)
+{
+    const int32_t *c = bme_trim_tp;     // T1-T3, then P1-P9
+    double v1 = (adc_t / 16384.0 - c[0] / 1024.0) * c[1];
+    double v2 = (adc_t / 131072.0 - c[0] / 8192.0) * (adc_t / 131072.0 - c[0] / 8192.0) * c[2];
+    double t_fine = v1 + v2;
+
+    v1 = t_fine / 2.0 - 64000.0;
+    v2 = v1 * v1 * c[8] / 32768.0;
+    v2 = v2 + v1 * c[7] * 2.0;
+    v2 = v2 / 4.0 + c[6] * 65536.0;
+    v1 = (c[5] * v1 * v1 / 524288.0 + c[4] * v1) / 524288.0;
+    v1 = (1.0 + v1 / 32768.0) * c[3];
+    double p = (1048576.0 - adc_p - v2 / 4096.0) * 6250.0 / v1;
+    v1 = c[11] * p * p / 2147483648.0;
+    v2 = p * c[10] / 32768.0;
+    return p + (v1 + v2 + c[9]) / 16.0;
+}
+
+/**
+ * Raw pressure that compensates to pressure_pa; it falls as adc_p rises
+ */
+static int32_t bme_adc_for(double pressure_pa, int32_t adc_t)
+{
+    int32_t lo = 0, hi = (1 << 20) - 1;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (bme_pressure(mid, adc_t) > pressure_pa) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void bme_write(SimDevice_t *dev, uint8_t reg, uint8_t value)
+{
+    if (reg == 0xE0) {
+        if (value == 0xB6) {
+            bme_reset(dev);
+        }
+        return;
+    }
+    dev->regs[reg] = value;
+}
+
+static uint8_t bme_read(SimDevice_t *dev, uint8_t reg)
+{
+    if (reg >= BME_REG_PRESS_MSB && reg < BME_REG_PRESS_MSB + 8) {
+        // Slow drift around the datasheet example readings, and the
+        // standard atmosphere above the pad in flight
+        double t = seconds(sim_now_us());
+        int32_t adc_p = 415148 + lround(200 * sin(0.1 * t));
+        int32_t adc_t = 519888 + lround(100 * sin(0.05 * t));
+        int32_t adc_h = 30000;
+        double height_m, force;
+        flight_at(sim_now_us(), &height_m, &force);
+        if (height_m > 0) {
+            adc_p = bme_adc_for(bme_pressure(adc_p, adc_t) * pow(1 - height_m / 44330, 5.255), adc_t);
+        }
+        uint8_t data[8] = {
+            adc_p >> 12, (adc_p >> 4) & 0xFF, (adc_p & 0x0F) << 4,
+            adc_t >> 12, (adc_t >> 4) & 0xFF, (adc_t & 0x0F) << 4,
+            adc_h >> 8, adc_h & 0xFF,
+        };
+        return data[reg - BME_REG_PRESS_MSB];
+    }
+    return dev->regs[reg];
+}
+
+// --- HMC5883L ----------------------------------------------------------------
+
+#define HMC_REG_CRA             0x00
+#define HMC_REG_CRB             0x01
+#define HMC_REG_MODE            0x02
+#define HMC_REG_DATA_X_MSB      0x03
+#define HMC_REG_ID_A            0x0A
+
+static const uint16_t hmc_lsb_per_ga[] = { 1370, 1090, 820, 660, 440, 390, 330, 230 };
+static const double hmc_rates_hz[] = { 0.75, 1.5, 3, 7.5, 15, 30, 75, 75 };
+
+static void hmc_reset(SimDevice_t *dev)
+{
+    memset(dev->regs, 0, sizeof(dev->regs));
+    dev->regs[HMC_REG_CRA] = 0x10;
+    dev->regs[HMC_REG_CRB] = 0x20;
+    dev->regs[HMC_REG_MODE] = 0x01;
+    memcpy(&dev->regs[HMC_REG_ID_A], "H43", 3);
+}
+
+static void hmc_write(SimDevice_t *dev, uint8_t reg, uint8_t value)
+{
+    if (reg <= HMC_REG_MODE) {
+        dev->regs[reg] = value;
+    }
+}
+
+static uint8_t hmc_read(SimDevice_t *dev, uint8_t reg)
+{
+    if (reg >= HMC_REG_DATA_X_MSB && reg < HMC_REG_DATA_X_MSB + 6) {
+        double lsb = hmc_lsb_per_ga[dev->regs[HMC_REG_CRB] >> 5];
+        double t = seconds(sim_now_us());
+        double x = 0.2 + 0.02 * sin(0.5 * t), y = 0.05, z = -0.45;
+        if (dev->regs[HMC_REG_CRA] & 0x03) {
+            x = y = z = 1.16;   // Self test bias strap
+        }
+        uint8_t data[6];
+        put_be16(data + 0, lround(x * lsb));
+        put_be16(data + 2, lround(z * lsb));
+        put_be16(data + 4, lround(y * lsb));
+        return data[reg - HMC_REG_DATA_X_MSB];
+    }
+    return dev->regs[reg];
+}
+
+static bool always_increment(SimDevice_t *dev, uint8_t reg)
+{
+    return true;
+}
+
+// --- Bus -----------------------------------------------------------------------
+
+static SimDevice_t devices[] = {
+    { .address = MPU_ADDR, .reset = mpu_reset, .write = mpu_write, .read = mpu_read, .increment = mpu_increment },
+    { .address = BME_ADDR, .reset = bme_reset, .write = bme_write, .read = bme_read, .increment = always_increment },
+    { .address = HMC_ADDR, .reset = hmc_reset, .write = hmc_write, .read = hmc_read, .increment = always_increment },
+};
+
+#define NUM_DEVICES (sizeof(devices) / sizeof(devices[0]))
+
+static SimDevice_t *find_device(uint16_t address)
+{
+    for (size_t i = 0; i < NUM_DEVICES; i++) {
+        if (devices[i].address == address && !devices[i].unplugged) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+void sim_sensors_unplug_baro(void)
+{
+    pthread_mutex_lock(&sensors_lock);
+    find_device(BME_ADDR)->unplugged = true;
+    pthread_mutex_unlock(&sensors_lock);
+}
+
+bool sim_i2c_present(uint16_t address)
+{
+    return find_device(address) != NULL;
+}
+
+esp_err_t sim_i2c_transfer(uint16_t address, const uint8_t *write, size_t write_len,
+                           uint8_t *read, size_t read_len)
+{
+    SimDevice_t *dev = find_device(address);
+    if (dev == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&sensors_lock);
+    if (write_len > 0) {
+        dev->pointer = write[0];
+        for (size_t i = 1; i < write_len; i++) {
+            dev->write(dev, dev->pointer++, write[i]);
+        }
+    }
+    for (size_t i = 0; i < read_len; i++) {
+        read[i] = dev->read(dev, dev->pointer);
+        if (dev->increment(dev, dev->pointer)) {
+            dev->pointer++;
+        }
+    }
+    pthread_mutex_unlock(&sensors_lock);
+    return ESP_OK;
+}
+
+// --- Data-ready outputs --------------------------------------------------------
+
+typedef struct {
+    int pin;
+    SimDevice_t *dev;
+    int64_t (*period_us)(SimDevice_t *dev);    // 0 while the output is off
+} DrdyLine_t;
+
+static int64_t mpu_drdy_period_us(SimDevice_t *dev)
+{
+    return (dev->regs[MPU_REG_INT_ENABLE] & 0x01) ? mpu_period_us(dev) : 0;
+}
+
+static int64_t hmc_drdy_period_us(SimDevice_t *dev)
+{
+    if ((dev->regs[HMC_REG_MODE] & 0x03) != 0) {
+        return 0;
+    }
+    return llround(1e6 / hmc_rates_hz[(dev->regs[HMC_REG_CRA] >> 2) & 7]);
+}
+
+static DrdyLine_t drdy_lines[2];
+
+/**
+ * Pulses one data-ready pin on the device's sample clock until the
+ * simulation stops
+ */
+static void *drdy_thread(void *arg)
+{
+    DrdyLine_t *line = arg;
+    int64_t next_us = sim_now_us();
+
+    while (!sim_stopped()) {
+        pthread_mutex_lock(&sensors_lock);
+        int64_t period = line->period_us(line->dev);
+        pthread_mutex_unlock(&sensors_lock);
+
+        if (period == 0) {
+            sim_sleep_us(1000);
+            next_us = sim_now_us();
+            continue;
+        }
+        next_us = (next_us / period + 1) * period;
+        sim_sleep_until_us(next_us);
+        if (!sim_stopped()) {
+            sim_gpio_fire(line->pin);
+        }
+    }
+    return NULL;
+}
+
+static void start_drdy(DrdyLine_t *line, int pin, SimDevice_t *dev, int64_t (*period_us)(SimDevice_t *))
+{
+    pthread_t thread;
+
+    *line = (DrdyLine_t){ .pin = pin, .dev = dev, .period_us = period_us };
+    pthread_create(&thread, NULL, drdy_thread, line);
+    pthread_detach(thread);
+}
+
+void sim_sensors_start(int imu_drdy_gpio, int mag_drdy_gpio)
+{
+    pthread_mutex_lock(&sensors_lock);
+    for (size_t i = 0; i < NUM_DEVICES; i++) {
+        devices[i].reset(&devices[i]);
+    }
+    pthread_mutex_unlock(&sensors_lock);
+
+    if (imu_drdy_gpio >= 0) {
+        start_drdy(&drdy_lines[0], imu_drdy_gpio, find_device(MPU_ADDR), mpu_drdy_period_us);
+    }
+    if (mag_drdy_gpio >= 0) {
+        start_drdy(&drdy_lines[1], mag_drdy_gpio, find_device(HMC_ADDR), hmc_drdy_period_us);
+    }
+}
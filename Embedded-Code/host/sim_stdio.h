@@ -0,0 +1,24 @@
+/**
+ * Force-included into the firmware sources so file access under the SD
+ * mount point lands in the simulated card. The system headers are pulled in
+ * first so their declarations are not touched by the macros.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include "sim.h"
+
+#define fopen(path, mode)               sim_fopen(path, mode)
+#define stat(path, st)                  sim_stat(path, st)
+#define fwrite(data, size, count, f)    sim_fwrite(data, size, count, f)
+#define fread(data, size, count, f)     sim_fread(data, size, count, f)
+#define open(path, ...)                 sim_open(path, __VA_ARGS__)
+#define write(fd, data, len)            sim_write(fd, data, len)
+#define read(fd, data, len)             sim_read(fd, data, len)
+#define fsync(fd)                       sim_fsync(fd)
+#define unlink(path)                    sim_unlink(path)
+#define opendir(path)                   sim_opendir(path)
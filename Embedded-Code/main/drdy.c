@@ -0,0 +1,77 @@
+#include "drdy.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "drdy";
+
+static TaskHandle_t drdy_task[DRDY_MAX_SOURCES];
+static volatile int64_t edge_us[DRDY_MAX_SOURCES];
+static volatile uint32_t edge_count[DRDY_MAX_SOURCES];
+static uint32_t taken_count[DRDY_MAX_SOURCES];
+static portMUX_TYPE edge_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool isr_service_installed = false;
+
+/**
+ * GPIO interrupt - stamps and counts the conversion and wakes the
+ * acquisition task
+ */
+static void IRAM_ATTR drdy_isr(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    BaseType_t woken = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&edge_lock);
+    edge_us[id] = esp_timer_get_time();
+    edge_count[id]++;
+    portEXIT_CRITICAL_ISR(&edge_lock);
+    xTaskNotifyFromISR(drdy_task[id], DRDY_EVENT(id), eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+esp_err_t drdy_add(int id, gpio_num_t pin, bool active_low, TaskHandle_t task)
+{
+    if (id < 0 || id >= DRDY_MAX_SOURCES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = active_low ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = active_low ? GPIO_PULLDOWN_DISABLE : GPIO_PULLDOWN_ENABLE,
+        .intr_type = active_low ? GPIO_INTR_NEGEDGE : GPIO_INTR_POSEDGE,
+    };
+    esp_err_t ret = gpio_config(&io_conf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (!isr_service_installed) {
+        ret = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            return ret;
+        }
+        isr_service_installed = true;
+    }
+
+    drdy_task[id] = task;
+    ret = gpio_isr_handler_add(pin, drdy_isr, (void *)(intptr_t)id);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Source %d on GPIO %d (%s edge)", id, pin, active_low ? "falling" : "rising");
+    return ESP_OK;
+}
+
+int64_t drdy_take(int id, uint32_t *missed)
+{
+    portENTER_CRITICAL(&edge_lock);
+    int64_t edge = edge_us[id];
+    uint32_t edges = edge_count[id] - taken_count[id];
+    taken_count[id] = edge_count[id];
+    portEXIT_CRITICAL(&edge_lock);
+
+    *missed = edges > 1 ? edges - 1 : 0;
+    return edge;
+}
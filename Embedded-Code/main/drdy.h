@@ -0,0 +1,34 @@
+/**
+ * Data-ready interrupt acquisition
+ *
+ * Sensors with a DRDY/INT pin wired to a GPIO are read once per conversion
+ * instead of being polled on the sampler tick. The GPIO ISR records and
+ * counts the edges and sets notification bit (1 << id) on the acquisition
+ * task, next to the sampler's own SAMPLER_EVENT_TICK.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+#define DRDY_MAX_SOURCES        8
+
+#define DRDY_EVENT(id)          (1UL << (id))
+#define DRDY_EVENT_MASK         ((1UL << DRDY_MAX_SOURCES) - 1)
+
+/**
+ * Route the data-ready pin of source id to task. active_low selects the
+ * falling edge instead of the rising edge.
+ */
+esp_err_t drdy_add(int id, gpio_num_t pin, bool active_low, TaskHandle_t task);
+
+/**
+ * esp_timer time of the most recent data-ready edge of source id. *missed
+ * is set to the edges that came before it since the previous call, whose
+ * conversions were overwritten before the task got to read them.
+ */
+int64_t drdy_take(int id, uint32_t *missed);
@@ -0,0 +1,200 @@
+#include <math.h>
+#include <string.h>
+#include "flight_state.h"
+
+#define STANDARD_GRAVITY        9.80665f
+#define ALTITUDE_SMOOTHING      0.2f        // Weight of a new altitude reading
+#define GROUND_TRACKING         (1.0f / 256) // Weight of a pad reading in the ground pressure
+
+static void enter(FlightTracker_t *tracker, FlightState_t state, int64_t t_us)
+{
+    tracker->state = state;
+    tracker->entered_us = t_us;
+    tracker->since_us = -1;
+}
+
+void flight_state_init(FlightTracker_t *tracker, const FlightConfig_t *config)
+{
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->config = *config;
+    tracker->ground_start_us = -1;
+    tracker->accel_start_us = -1;
+    enter(tracker, FLIGHT_STANDBY, 0);
+}
+
+float flight_state_altitude(const FlightTracker_t *tracker, float pressure_pa)
+{
+    if (tracker->state == FLIGHT_STANDBY || tracker->ground_pa <= 0) {
+        return NAN;
+    }
+    // International standard atmosphere
+    return 44330.0f * (1.0f - powf(pressure_pa / tracker->ground_pa, 0.190295f));
+}
+
+/**
+ * Whether a condition has held for at least duration_us, counted from the
+ * first reading it held for
+ */
+static bool held(FlightTracker_t *tracker, bool condition, int64_t t_us, int64_t duration_us)
+{
+    if (!condition) {
+        tracker->since_us = -1;
+        return false;
+    }
+    if (tracker->since_us < 0) {
+        tracker->since_us = t_us;
+    }
+    return t_us - tracker->since_us >= duration_us;
+}
+
+/**
+ * Arm with the up axis from the pad readings, and the ground pressure
+ * from them if the barometer gave any
+ */
+static bool arm(FlightTracker_t *tracker, int64_t t_us)
+{
+    float norm = sqrtf(tracker->accel_sum[0] * tracker->accel_sum[0] +
+                       tracker->accel_sum[1] * tracker->accel_sum[1] +
+                       tracker->accel_sum[2] * tracker->accel_sum[2]);
+    if (norm <= 0) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        tracker->up[i] = tracker->accel_sum[i] / norm;
+    }
+    if (tracker->pressure_count > 0) {
+        tracker->ground_pa = (float)(tracker->pressure_sum / tracker->pressure_count);
+    }
+    tracker->altitude_m = 0;
+    enter(tracker, FLIGHT_ARMED, t_us);
+    return true;
+}
+
+bool flight_state_accel(FlightTracker_t *tracker, int64_t t_us, float ax, float ay, float az)
+{
+    switch (tracker->state) {
+    case FLIGHT_STANDBY:
+        tracker->accel_sum[0] += ax;
+        tracker->accel_sum[1] += ay;
+        tracker->accel_sum[2] += az;
+        tracker->accel_count++;
+        if (tracker->accel_start_us < 0) {
+            tracker->accel_start_us = t_us;
+        }
+        // A barometer that is missing or has gone quiet does not keep the
+        // tracker from arming
+        if (t_us - tracker->accel_start_us >= FLIGHT_GROUND_MS * 1000LL &&
+            (tracker->pressure_count == 0 || t_us - tracker->pressure_us >= FLIGHT_GROUND_MS * 1000LL)) {
+            return arm(tracker, t_us);
+        }
+        return false;
+
+    case FLIGHT_ARMED: {
+        // Compared squared, so the pad never pays for a square root
+        float limit = tracker->config.launch_mg * (STANDARD_GRAVITY / 1000);
+        if (held(tracker, ax * ax + ay * ay + az * az >= limit * limit, t_us,
+                 tracker->config.launch_ms * 1000LL)) {
+            enter(tracker, FLIGHT_BOOST, tracker->since_us);
+            tracker->peak_m = tracker->altitude_m;
+            tracker->peak_us = t_us;
+            return true;
+        }
+        return false;
+    }
+
+    case FLIGHT_BOOST: {
+        float up = ax * tracker->up[0] + ay * tracker->up[1] + az * tracker->up[2];
+        if (held(tracker, up < FLIGHT_BURNOUT_MG * (STANDARD_GRAVITY / 1000), t_us,
+                 FLIGHT_BURNOUT_MS * 1000LL)) {
+            enter(tracker, FLIGHT_COAST, tracker->since_us);
+            return true;
+        }
+        return false;
+    }
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * Take the ground pressure and the up axis from the pad readings
+ */
+static bool take_ground_reference(FlightTracker_t *tracker, int64_t t_us, float pressure_pa)
+{
+    if (tracker->ground_start_us < 0) {
+        tracker->ground_start_us = t_us;
+    }
+    tracker->pressure_us = t_us;
+    tracker->pressure_sum += pressure_pa;
+    tracker->pressure_count++;
+    if (t_us - tracker->ground_start_us < FLIGHT_GROUND_MS * 1000LL || tracker->accel_count == 0) {
+        return false;
+    }
+    return arm(tracker, t_us);
+}
+
+bool flight_state_pressure(FlightTracker_t *tracker, int64_t t_us, float pressure_pa)
+{
+    if (tracker->state == FLIGHT_STANDBY) {
+        return take_ground_reference(tracker, t_us, pressure_pa);
+    }
+    if (tracker->ground_pa <= 0) {
+        // Armed without a barometer: it only counts from the pad
+        if (tracker->state == FLIGHT_ARMED) {
+            tracker->ground_pa = pressure_pa;
+        }
+        return false;
+    }
+
+    float altitude = flight_state_altitude(tracker, pressure_pa);
+    tracker->altitude_m += (altitude - tracker->altitude_m) * ALTITUDE_SMOOTHING;
+    if (tracker->altitude_m > tracker->peak_m) {
+        tracker->peak_m = tracker->altitude_m;
+        tracker->peak_us = t_us;
+    }
+
+    switch (tracker->state) {
+    case FLIGHT_ARMED:
+        if (tracker->altitude_m > tracker->config.launch_altitude_m) {
+            enter(tracker, FLIGHT_BOOST, t_us);
+            return true;
+        }
+        // Follow the weather while nothing is happening
+        if (fabsf(tracker->altitude_m) < tracker->config.launch_altitude_m / 2.0f) {
+            tracker->ground_pa += (pressure_pa - tracker->ground_pa) * GROUND_TRACKING;
+        }
+        tracker->peak_m = tracker->altitude_m;
+        return false;
+
+    case FLIGHT_BOOST:
+    case FLIGHT_COAST:
+        // A missed burnout does not hold up apogee
+        if (tracker->altitude_m < tracker->peak_m - FLIGHT_APOGEE_DROP_M) {
+            enter(tracker, FLIGHT_DESCENT, tracker->peak_us);
+            tracker->still_m = tracker->altitude_m;
+            return true;
+        }
+        return false;
+
+    case FLIGHT_DESCENT:
+        if (fabsf(tracker->altitude_m - tracker->still_m) > FLIGHT_LANDED_M) {
+            tracker->still_m = tracker->altitude_m;
+            tracker->since_us = -1;
+        }
+        if (held(tracker, true, t_us, FLIGHT_LANDED_MS * 1000LL)) {
+            enter(tracker, FLIGHT_LANDED, tracker->since_us);
+            return true;
+        }
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+const char *flight_state_name(FlightState_t state)
+{
+    static const char *const names[] = { "standby", "armed", "boost", "coast", "descent", "landed" };
+    return (state <= FLIGHT_LANDED) ? names[state] : "unknown";
+}
@@ -0,0 +1,107 @@
+/**
+ * Flight state machine
+ *
+ * Follows a flight from the IMU's accelerometer and the barometer:
+ *
+ *   STANDBY  on the pad, averaging the ground pressure and the direction
+ *            of gravity for FLIGHT_GROUND_MS. Without barometer readings
+ *            for as long it arms on the accelerometer alone, and the
+ *            first pressure reading after that is the ground reference.
+ *   ARMED    waiting for launch: acceleration above the launch threshold
+ *            for the launch time, or pressure altitude above the launch
+ *            altitude should the IMU miss it
+ *   BOOST    until the acceleration along the pad's up axis falls below
+ *            FLIGHT_BURNOUT_MG: the motor is out
+ *   COAST    until the altitude is FLIGHT_APOGEE_DROP_M below its peak
+ *   DESCENT  until the altitude stays within FLIGHT_LANDED_M for
+ *            FLIGHT_LANDED_MS
+ *   LANDED   for good
+ *
+ * Each state is timed from when the evidence for it began, not from when
+ * there was enough of it: launch from the first reading above the
+ * threshold, apogee from the peak altitude.
+ *
+ * Plain C on decoded readings, single precision, no ESP-IDF, so the host
+ * simulation runs it unchanged.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "log_format.h"
+
+#define FLIGHT_GROUND_MS        2000        // Pad readings averaged before arming
+#define FLIGHT_BURNOUT_MG       500         // Up-axis acceleration of a spent motor
+#define FLIGHT_BURNOUT_MS       50
+#define FLIGHT_APOGEE_DROP_M    5.0f
+#define FLIGHT_LANDED_M         2.0f
+#define FLIGHT_LANDED_MS        3000
+
+typedef enum {
+    FLIGHT_STANDBY = LOG_FLIGHT_STANDBY,
+    FLIGHT_ARMED = LOG_FLIGHT_ARMED,
+    FLIGHT_BOOST = LOG_FLIGHT_BOOST,
+    FLIGHT_COAST = LOG_FLIGHT_COAST,
+    FLIGHT_DESCENT = LOG_FLIGHT_DESCENT,
+    FLIGHT_LANDED = LOG_FLIGHT_LANDED,
+} FlightState_t;
+
+typedef struct {
+    uint32_t launch_mg;         // Acceleration magnitude that means launch...
+    uint32_t launch_ms;         // ...once it has lasted this long
+    uint32_t launch_altitude_m; // Launch even without the IMU above this
+} FlightConfig_t;
+
+typedef struct {
+    FlightConfig_t config;
+    FlightState_t state;
+    int64_t entered_us;         // When the current state began
+    float altitude_m;           // Smoothed, above the ground reference
+
+    // Ground reference
+    int64_t ground_start_us;
+    int64_t accel_start_us;
+    int64_t pressure_us;        // Last pressure reading
+    double pressure_sum;
+    uint32_t pressure_count;
+    float accel_sum[3];
+    uint32_t accel_count;
+    float ground_pa;            // 0 = no barometer so far
+    float up[3];                // Unit vector against gravity, in sensor axes
+
+    // Evidence for the next state
+    int64_t since_us;           // -1 = none so far
+    float peak_m;
+    int64_t peak_us;
+    float still_m;              // Altitude the landed check holds to
+} FlightTracker_t;
+
+void flight_state_init(FlightTracker_t *tracker, const FlightConfig_t *config);
+
+/**
+ * Feed one accelerometer reading in m/s2, sensor axes. Returns true if it
+ * moved the tracker to a new state.
+ */
+bool flight_state_accel(FlightTracker_t *tracker, int64_t t_us, float ax, float ay, float az);
+
+/**
+ * Feed one pressure reading in Pa. Returns true if it moved the tracker to
+ * a new state.
+ */
+bool flight_state_pressure(FlightTracker_t *tracker, int64_t t_us, float pressure_pa);
+
+/**
+ * Pressure altitude in m above the ground reference, NAN while there is
+ * none yet (standby, or armed without a barometer)
+ */
+float flight_state_altitude(const FlightTracker_t *tracker, float pressure_pa);
+
+/**
+ * Whether the tracker is between launch and landing
+ */
+static inline bool flight_state_flying(const FlightTracker_t *tracker)
+{
+    return tracker->state >= FLIGHT_BOOST && tracker->state < FLIGHT_LANDED;
+}
+
+const char *flight_state_name(FlightState_t state);
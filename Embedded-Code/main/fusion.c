@@ -0,0 +1,183 @@
+#include <math.h>
+#include <string.h>
+#include "fusion.h"
+
+#define STANDARD_GRAVITY        9.80665f
+#define RAD_TO_DEG              (180.0f / (float)M_PI)
+
+void fusion_init(Fusion_t *fusion)
+{
+    memset(fusion, 0, sizeof(*fusion));
+    fusion->q[0] = 1.0f;
+}
+
+/**
+ * Start from the tilt the accelerometer shows, heading north until the
+ * magnetometer corrects it
+ */
+static void init_attitude(Fusion_t *fusion, int64_t t_us, const float accel[3])
+{
+    float roll = atan2f(accel[1], accel[2]);
+    float pitch = atan2f(-accel[0], sqrtf(accel[1] * accel[1] + accel[2] * accel[2]));
+    float cr = cosf(roll / 2), sr = sinf(roll / 2);
+    float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+
+    fusion->q[0] = cr * cp;
+    fusion->q[1] = sr * cp;
+    fusion->q[2] = cr * sp;
+    fusion->q[3] = -sr * sp;
+    fusion->attitude_valid = true;
+    fusion->start_us = t_us;
+    fusion->imu_us = t_us;
+}
+
+/**
+ * Half the correction the accelerometer and magnetometer ask for, as a
+ * rotation rate direction in body axes
+ */
+static void attitude_error(const Fusion_t *fusion, const float accel[3], float e[3])
+{
+    const float q0 = fusion->q[0], q1 = fusion->q[1], q2 = fusion->q[2], q3 = fusion->q[3];
+    e[0] = e[1] = e[2] = 0;
+
+    // Gravity only while nothing else accelerates the board
+    float norm = accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2];
+    const float low = (1 - FUSION_GRAVITY_GATE) * STANDARD_GRAVITY, high = (1 + FUSION_GRAVITY_GATE) * STANDARD_GRAVITY;
+    if (norm >= low * low && norm <= high * high) {
+        float inv = 1.0f / sqrtf(norm);
+        float ax = accel[0] * inv, ay = accel[1] * inv, az = accel[2] * inv;
+
+        // Up as the attitude sees it, halved
+        float vx = q1 * q3 - q0 * q2;
+        float vy = q0 * q1 + q2 * q3;
+        float vz = q0 * q0 - 0.5f + q3 * q3;
+        e[0] += ay * vz - az * vy;
+        e[1] += az * vx - ax * vz;
+        e[2] += ax * vy - ay * vx;
+    }
+
+    if (fusion->mag[0] != 0 || fusion->mag[1] != 0 || fusion->mag[2] != 0) {
+        float mx = fusion->mag[0], my = fusion->mag[1], mz = fusion->mag[2];
+
+        // Field in the earth frame, turned into the x-z plane, and back
+        float hx = 2 * (mx * (0.5f - q2 * q2 - q3 * q3) + my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+        float hy = 2 * (mx * (q1 * q2 + q0 * q3) + my * (0.5f - q1 * q1 - q3 * q3) + mz * (q2 * q3 - q0 * q1));
+        float bx = sqrtf(hx * hx + hy * hy);
+        float bz = 2 * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1) + mz * (0.5f - q1 * q1 - q2 * q2));
+        float wx = bx * (0.5f - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2);
+        float wy = bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3);
+        float wz = bx * (q0 * q2 + q1 * q3) + bz * (0.5f - q1 * q1 - q2 * q2);
+        e[0] += my * wz - mz * wy;
+        e[1] += mz * wx - mx * wz;
+        e[2] += mx * wy - my * wx;
+    }
+}
+
+static void predict_vertical(Fusion_t *fusion, const float accel[3], float dt)
+{
+    const float q0 = fusion->q[0], q1 = fusion->q[1], q2 = fusion->q[2], q3 = fusion->q[3];
+    float up = 2 * (q1 * q3 - q0 * q2) * accel[0] + 2 * (q0 * q1 + q2 * q3) * accel[1] +
+               (1 - 2 * (q1 * q1 + q2 * q2)) * accel[2];
+    float a = up - STANDARD_GRAVITY;
+
+    fusion->altitude_m += fusion->velocity_mps * dt + 0.5f * a * dt * dt;
+    fusion->velocity_mps += a * dt;
+
+    // Acceleration noise as a random walk in velocity
+    float (*p)[2] = fusion->p;
+    p[0][0] += dt * (2 * p[0][1] + dt * p[1][1]);
+    p[0][1] += dt * p[1][1];
+    p[1][0] = p[0][1];
+    p[1][1] += FUSION_ACCEL_NOISE * FUSION_ACCEL_NOISE * dt;
+}
+
+void fusion_imu(Fusion_t *fusion, int64_t t_us, const float accel[3], const float gyro[3])
+{
+    if (!fusion->attitude_valid) {
+        init_attitude(fusion, t_us, accel);
+        return;
+    }
+    int64_t dt_us = t_us - fusion->imu_us;
+    fusion->imu_us = t_us;
+    if (dt_us <= 0 || dt_us > FUSION_MAX_DT_US) {
+        return;
+    }
+    float dt = dt_us * 1e-6f;
+
+    float e[3];
+    attitude_error(fusion, accel, e);
+    bool settling = t_us - fusion->start_us < FUSION_SETTLE_MS * 1000LL;
+    float kp = settling ? FUSION_KP_SETTLE : FUSION_KP;
+    float g[3];
+    for (int i = 0; i < 3; i++) {
+        if (!settling) {
+            fusion->bias[i] += 2 * FUSION_KI * e[i] * dt;
+        }
+        g[i] = (gyro[i] + 2 * kp * e[i] + fusion->bias[i]) * (0.5f * dt);
+    }
+
+    const float *q = fusion->q;
+    float q0 = q[0] - q[1] * g[0] - q[2] * g[1] - q[3] * g[2];
+    float q1 = q[1] + q[0] * g[0] + q[2] * g[2] - q[3] * g[1];
+    float q2 = q[2] + q[0] * g[1] - q[1] * g[2] + q[3] * g[0];
+    float q3 = q[3] + q[0] * g[2] + q[1] * g[1] - q[2] * g[0];
+    float inv = 1.0f / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    fusion->q[0] = q0 * inv;
+    fusion->q[1] = q1 * inv;
+    fusion->q[2] = q2 * inv;
+    fusion->q[3] = q3 * inv;
+
+    if (fusion->vertical_valid) {
+        predict_vertical(fusion, accel, dt);
+    }
+}
+
+void fusion_mag(Fusion_t *fusion, const float mag[3])
+{
+    float norm = sqrtf(mag[0] * mag[0] + mag[1] * mag[1] + mag[2] * mag[2]);
+    if (norm > 0) {
+        for (int i = 0; i < 3; i++) {
+            fusion->mag[i] = mag[i] / norm;
+        }
+    }
+}
+
+void fusion_altitude(Fusion_t *fusion, float altitude_m)
+{
+    float (*p)[2] = fusion->p;
+    if (!fusion->vertical_valid) {
+        fusion->altitude_m = altitude_m;
+        fusion->velocity_mps = 0;
+        p[0][0] = FUSION_BARO_NOISE * FUSION_BARO_NOISE;
+        p[0][1] = p[1][0] = 0;
+        p[1][1] = 1.0f;
+        fusion->vertical_valid = true;
+        return;
+    }
+
+    float s = p[0][0] + FUSION_BARO_NOISE * FUSION_BARO_NOISE;
+    float k0 = p[0][0] / s, k1 = p[0][1] / s;
+    float y = altitude_m - fusion->altitude_m;
+    fusion->altitude_m += k0 * y;
+    fusion->velocity_mps += k1 * y;
+
+    p[1][1] -= k1 * p[0][1];
+    p[0][1] -= k0 * p[0][1];
+    p[1][0] = p[0][1];
+    p[0][0] -= k0 * p[0][0];
+}
+
+void fusion_output(const Fusion_t *fusion, FusionOutput_t *out)
+{
+    const float q0 = fusion->q[0], q1 = fusion->q[1], q2 = fusion->q[2], q3 = fusion->q[3];
+    float sin_pitch = 2 * (q0 * q2 - q3 * q1);
+    sin_pitch = fminf(fmaxf(sin_pitch, -1.0f), 1.0f);
+
+    out->roll_deg = atan2f(2 * (q0 * q1 + q2 * q3), 1 - 2 * (q1 * q1 + q2 * q2)) * RAD_TO_DEG;
+    out->pitch_deg = asinf(sin_pitch) * RAD_TO_DEG;
+    out->yaw_deg = atan2f(2 * (q0 * q3 + q1 * q2), 1 - 2 * (q2 * q2 + q3 * q3)) * RAD_TO_DEG;
+    out->altitude_m = fusion->altitude_m;
+    out->velocity_mps = fusion->velocity_mps;
+    out->attitude_valid = fusion->attitude_valid;
+    out->vertical_valid = fusion->vertical_valid;
+}
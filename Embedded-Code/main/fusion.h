@@ -0,0 +1,84 @@
+/**
+ * On-board sensor fusion
+ *
+ * Two filters on decoded readings, run by the sensor task as they arrive:
+ *
+ *   Attitude   Mahony complementary filter: the gyro is integrated into a
+ *              quaternion, and the accelerometer's gravity direction and
+ *              the magnetometer's horizontal field pull it back with a
+ *              proportional-integral correction, the integral absorbing
+ *              gyro bias. Gravity is trusted only while the acceleration
+ *              is close to 1 g, so boost and coast run on the gyro alone.
+ *   Vertical   Kalman filter on altitude and vertical velocity: predicted
+ *              from the acceleration rotated into the earth frame less
+ *              gravity, corrected by barometric altitude.
+ *
+ * The earth frame has x towards magnetic north and z up; the magnetometer
+ * is taken to be mounted with its axes along the IMU's. Euler angles are
+ * roll about x, then pitch about y, then yaw about z.
+ *
+ * Plain C, single precision, no ESP-IDF, so the host simulation and the
+ * benchmark run it unchanged. The ESP32's FPU does single precision in
+ * hardware; only sqrtf, divisions and the Euler angles' trigonometry are
+ * library calls, and the per-IMU-sample path has none of the trigonometry.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FUSION_SETTLE_MS        2000        // High attitude gain after the first reading
+#define FUSION_KP               1.0f        // Attitude correction gains, 1/s
+#define FUSION_KP_SETTLE        10.0f
+#define FUSION_KI               0.05f
+#define FUSION_GRAVITY_GATE     0.15f       // Accelerometer trusted within this fraction of 1 g
+#define FUSION_ACCEL_NOISE      0.5f        // Vertical acceleration noise, m/s2 per sqrt(Hz)
+#define FUSION_BARO_NOISE       0.5f        // Barometric altitude noise, m
+#define FUSION_MAX_DT_US        100000      // Longer gaps restart the integration
+
+typedef struct {
+    // Attitude
+    float q[4];                 // Body to earth rotation, w x y z
+    float bias[3];              // Integral correction, rad/s
+    float mag[3];               // Newest unit field vector, body axes, 0 = none yet
+    bool attitude_valid;
+    int64_t start_us;
+    int64_t imu_us;             // Last IMU update
+
+    // Vertical
+    float altitude_m;
+    float velocity_mps;         // Up
+    float p[2][2];              // Covariance of altitude and velocity
+    bool vertical_valid;        // Has had a barometric altitude
+} Fusion_t;
+
+typedef struct {
+    float altitude_m;
+    float velocity_mps;
+    float pitch_deg;
+    float roll_deg;
+    float yaw_deg;
+    bool attitude_valid;
+    bool vertical_valid;
+} FusionOutput_t;
+
+void fusion_init(Fusion_t *fusion);
+
+/**
+ * Feed one IMU reading: acceleration in m/s2 and rotation rate in rad/s,
+ * sensor axes. Updates the attitude and predicts the vertical state.
+ */
+void fusion_imu(Fusion_t *fusion, int64_t t_us, const float accel[3], const float gyro[3]);
+
+/**
+ * Feed one magnetometer reading, any unit. The IMU updates correct the
+ * heading with it until the next one arrives.
+ */
+void fusion_mag(Fusion_t *fusion, const float mag[3]);
+
+/**
+ * Correct the vertical state with a barometric altitude in m
+ */
+void fusion_altitude(Fusion_t *fusion, float altitude_m);
+
+void fusion_output(const Fusion_t *fusion, FusionOutput_t *out);
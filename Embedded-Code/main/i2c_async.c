@@ -0,0 +1,213 @@
+#include <string.h>
+#include "i2c_async.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "i2c_async";
+
+typedef struct {
+    i2c_master_dev_handle_t dev;
+    int64_t submit_us;
+} AsyncDevice_t;
+
+static AsyncDevice_t devices[I2C_ASYNC_MAX_DEVICES];
+static QueueHandle_t completions;
+static uint32_t xfer_timeout_ms;
+static uint32_t outstanding;        // Queued reads whose completion is not collected yet
+
+// Bus accounting, updated from the completion callback
+static I2cBusStats_t stats;
+static int64_t last_done_us;
+static int64_t window_start_us;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Account for one finished transaction. Queued transactions only start once
+ * the previous one is done, so busy time runs from whichever came later.
+ */
+static inline void account_transaction(AsyncDevice_t *device, int64_t done_us, bool ok)
+{
+    int64_t start_us = (device->submit_us > last_done_us) ? device->submit_us : last_done_us;
+
+    stats.transactions++;
+    stats.busy_us += done_us - start_us;
+    if (!ok) {
+        stats.errors++;
+    }
+    last_done_us = done_us;
+}
+
+#if CONFIG_SENSOR_I2C_ASYNC
+/**
+ * Driver callback - runs in ISR context
+ */
+static bool IRAM_ATTR on_trans_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *evt, void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    I2cCompletion_t done = {
+        .id = id,
+        .status = (evt->event == I2C_EVENT_DONE) ? ESP_OK : ESP_FAIL,
+        .done_us = esp_timer_get_time(),
+    };
+
+    portENTER_CRITICAL_ISR(&stats_lock);
+    account_transaction(&devices[id], done.done_us, done.status == ESP_OK);
+    portEXIT_CRITICAL_ISR(&stats_lock);
+
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(completions, &done, &woken);
+    return woken == pdTRUE;
+}
+#endif
+
+esp_err_t i2c_async_init(uint32_t timeout_ms)
+{
+    completions = xQueueCreate(I2C_ASYNC_MAX_DEVICES, sizeof(I2cCompletion_t));
+    if (completions == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xfer_timeout_ms = timeout_ms;
+    outstanding = 0;
+    memset(&stats, 0, sizeof(stats));
+    last_done_us = esp_timer_get_time();
+    window_start_us = last_done_us;
+
+#if CONFIG_SENSOR_I2C_ASYNC
+    ESP_LOGI(TAG, "I2C reads run asynchronously (queue depth %d)", I2C_ASYNC_QUEUE_DEPTH);
+#else
+    ESP_LOGI(TAG, "I2C reads run synchronously");
+#endif
+    return ESP_OK;
+}
+
+esp_err_t i2c_async_add_device(int id, i2c_master_dev_handle_t dev)
+{
+    if (id < 0 || id >= I2C_ASYNC_MAX_DEVICES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    devices[id].dev = dev;
+
+#if CONFIG_SENSOR_I2C_ASYNC
+    const i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = on_trans_done,
+    };
+    return i2c_master_register_event_callbacks(dev, &cbs, (void *)(intptr_t)id);
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t i2c_async_read(int id, const uint8_t *reg, uint8_t *data, size_t len)
+{
+    AsyncDevice_t *device = &devices[id];
+    device->submit_us = esp_timer_get_time();
+
+#if CONFIG_SENSOR_I2C_ASYNC
+    // Returns once queued; on_trans_done reports the outcome
+    esp_err_t ret = i2c_master_transmit_receive(device->dev, reg, 1, data, len, xfer_timeout_ms);
+    if (ret == ESP_OK) {
+        outstanding++;
+    }
+    return ret;
+#else
+    esp_err_t ret = i2c_master_transmit_receive(device->dev, reg, 1, data, len, xfer_timeout_ms);
+    I2cCompletion_t done = {
+        .id = id,
+        .status = ret,
+        .done_us = esp_timer_get_time(),
+    };
+
+    portENTER_CRITICAL(&stats_lock);
+    account_transaction(device, done.done_us, ret == ESP_OK);
+    portEXIT_CRITICAL(&stats_lock);
+
+    xQueueSend(completions, &done, 0);
+    outstanding++;
+    return ESP_OK;
+#endif
+}
+
+esp_err_t i2c_async_transfer(int id, const uint8_t *write, size_t write_len,
+                             uint8_t *read, size_t read_len, int64_t *done_us)
+{
+    AsyncDevice_t *device = &devices[id];
+
+    // A completion left over from an abandoned read would be taken for ours
+    i2c_async_drain();
+    device->submit_us = esp_timer_get_time();
+
+    esp_err_t ret;
+    if (read_len > 0) {
+        ret = i2c_master_transmit_receive(device->dev, write, write_len, read, read_len, xfer_timeout_ms);
+    } else {
+        ret = i2c_master_transmit(device->dev, write, write_len, xfer_timeout_ms);
+    }
+
+#if CONFIG_SENSOR_I2C_ASYNC
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Until the completion arrives the driver may still write into read, so
+    // never hand the caller's buffer back early. Every queued transaction
+    // completes: the driver times it out once it reaches the bus.
+    I2cCompletion_t done;
+    outstanding++;
+    if (i2c_async_wait(&done, pdMS_TO_TICKS(xfer_timeout_ms) + 1) != ESP_OK) {
+        ESP_LOGW(TAG, "Transfer on device %d is late", id);
+        i2c_async_wait(&done, portMAX_DELAY);
+    }
+    if (done_us != NULL) {
+        *done_us = done.done_us;
+    }
+    return done.status;
+#else
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    account_transaction(device, now, ret == ESP_OK);
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (done_us != NULL) {
+        *done_us = now;
+    }
+    return ret;
+#endif
+}
+
+esp_err_t i2c_async_wait(I2cCompletion_t *done, TickType_t timeout)
+{
+    if (xQueueReceive(completions, done, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (outstanding > 0) {
+        outstanding--;
+    }
+    return ESP_OK;
+}
+
+void i2c_async_drain(void)
+{
+    // Every queued transaction completes: the driver times it out once it
+    // reaches the bus
+    I2cCompletion_t done;
+    while (outstanding > 0) {
+        i2c_async_wait(&done, portMAX_DELAY);
+    }
+}
+
+void i2c_async_get_stats(I2cBusStats_t *out, bool reset)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    out->window_us = now - window_start_us;
+    if (reset) {
+        memset(&stats, 0, sizeof(stats));
+        window_start_us = now;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
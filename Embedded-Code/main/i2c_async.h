@@ -0,0 +1,83 @@
+/**
+ * Asynchronous I2C acquisition engine
+ *
+ * Register reads are queued on the I2C master driver and return straight
+ * away; the driver's on_trans_done callback timestamps each completion and
+ * posts it to a completion queue. The caller is free to do other work while
+ * transfers are on the bus and collects the results with i2c_async_wait().
+ *
+ * With CONFIG_SENSOR_I2C_ASYNC disabled the same API runs every read
+ * synchronously, so callers need only one code path.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_ASYNC_MAX_DEVICES       8
+
+// Depth of the driver's transaction queue when running asynchronously
+#if CONFIG_SENSOR_I2C_ASYNC
+#define I2C_ASYNC_QUEUE_DEPTH       I2C_ASYNC_MAX_DEVICES
+#else
+#define I2C_ASYNC_QUEUE_DEPTH       0
+#endif
+
+typedef struct {
+    int id;                     // Device id given to i2c_async_add_device()
+    esp_err_t status;
+    int64_t done_us;            // esp_timer time the transaction completed
+} I2cCompletion_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t errors;
+    int64_t busy_us;            // Time the bus spent on our transactions
+    int64_t window_us;          // Length of the measurement window
+} I2cBusStats_t;
+
+/**
+ * Set up the completion queue. timeout_ms bounds every single transaction.
+ */
+esp_err_t i2c_async_init(uint32_t timeout_ms);
+
+/**
+ * Attach a device added with i2c_master_bus_add_device() under the given id
+ */
+esp_err_t i2c_async_add_device(int id, i2c_master_dev_handle_t dev);
+
+/**
+ * Queue a read of len bytes from register *reg into data. Both buffers must
+ * stay valid until the completion for this id has been collected, and only
+ * one read per device may be outstanding.
+ */
+esp_err_t i2c_async_read(int id, const uint8_t *reg, uint8_t *data, size_t len);
+
+/**
+ * Run a single write (and optional read) to completion and return its
+ * status. Used for register setup and multi-step reads; reads still
+ * outstanding are drained first.
+ */
+esp_err_t i2c_async_transfer(int id, const uint8_t *write, size_t write_len,
+                             uint8_t *read, size_t read_len, int64_t *done_us);
+
+/**
+ * Wait for the next completion
+ */
+esp_err_t i2c_async_wait(I2cCompletion_t *done, TickType_t timeout);
+
+/**
+ * Wait for every outstanding read and discard its completion. After a
+ * timeout this is what makes the read buffers safe to reuse.
+ */
+void i2c_async_drain(void);
+
+/**
+ * Snapshot bus statistics, optionally starting a new window
+ */
+void i2c_async_get_stats(I2cBusStats_t *stats, bool reset);
@@ -0,0 +1,149 @@
+#include <string.h>
+#include "log_format.h"
+
+// Nibble-wise CRC32 table for the reflected 0xEDB88320 polynomial
+static const uint32_t crc32_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t log_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+size_t log_format_build_header(uint8_t *buf, size_t buf_len,
+                               const log_sensor_desc_t *sensors, uint8_t sensor_count,
+                               const log_channel_desc_t *channels, size_t channel_count,
+                               uint16_t max_record_len)
+{
+    size_t sensors_len = sensor_count * sizeof(log_sensor_desc_t);
+    size_t len = sizeof(log_file_header_t) + sensors_len + channel_count * sizeof(log_channel_desc_t);
+    if (sensor_count > LOG_MAX_SENSORS || buf_len < len || buf_len > UINT16_MAX) {
+        return 0;
+    }
+
+    log_file_header_t header = {
+        .magic = LOG_FILE_MAGIC,
+        .version = LOG_FORMAT_VERSION,
+        .header_len = buf_len,
+        .max_record_len = max_record_len,
+        .sensor_count = sensor_count,
+    };
+
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), sensors, sensors_len);
+    memcpy(buf + sizeof(header) + sensors_len, channels, channel_count * sizeof(log_channel_desc_t));
+    memset(buf + len, 0, buf_len - len);
+
+    return len;
+}
+
+uint32_t log_format_get_data_end(const uint8_t *header)
+{
+    uint32_t data_end;
+    memcpy(&data_end, header + offsetof(log_file_header_t, data_end), sizeof(data_end));
+    return data_end;
+}
+
+void log_format_set_data_end(uint8_t *header, uint32_t data_end)
+{
+    memcpy(header + offsetof(log_file_header_t, data_end), &data_end, sizeof(data_end));
+}
+
+uint32_t log_format_get_file_id(const uint8_t *header)
+{
+    uint32_t file_id;
+    memcpy(&file_id, header + offsetof(log_file_header_t, file_id), sizeof(file_id));
+    return file_id;
+}
+
+void log_format_set_file_id(uint8_t *header, uint32_t file_id)
+{
+    memcpy(header + offsetof(log_file_header_t, file_id), &file_id, sizeof(file_id));
+}
+
+uint8_t log_format_get_flags(const uint8_t *header)
+{
+    return header[offsetof(log_file_header_t, flags)];
+}
+
+void log_format_set_flags(uint8_t *header, uint8_t flags)
+{
+    header[offsetof(log_file_header_t, flags)] = flags;
+}
+
+void log_format_get_segment(const uint8_t *header, log_segment_t *segment)
+{
+    memcpy(segment, header + offsetof(log_file_header_t, segment), sizeof(*segment));
+}
+
+void log_format_set_segment(uint8_t *header, const log_segment_t *segment)
+{
+    memcpy(header + offsetof(log_file_header_t, segment), segment, sizeof(*segment));
+}
+
+static uint32_t block_crc(uint32_t file_id, const uint8_t *payload, size_t len)
+{
+    return log_crc32(log_crc32(0, &file_id, sizeof(file_id)), payload, len);
+}
+
+void log_format_seal_block(uint8_t *block, size_t frame_len, uint32_t file_id, uint32_t seq,
+                           uint16_t payload_len, uint16_t record_count)
+{
+    size_t used = sizeof(log_block_header_t) + payload_len;
+    memset(block + used, 0, frame_len - used);
+
+    log_block_header_t header = {
+        .magic = LOG_BLOCK_MAGIC,
+        .seq = seq,
+        .frame_len = frame_len,
+        .payload_len = payload_len,
+        .record_count = record_count,
+        .crc32 = block_crc(file_id, block + sizeof(log_block_header_t), payload_len),
+    };
+
+    memcpy(block, &header, sizeof(header));
+}
+
+bool log_format_check_block(const uint8_t *block, size_t frame_len, uint32_t file_id,
+                            log_block_header_t *header)
+{
+    memcpy(header, block, sizeof(*header));
+    return header->magic == LOG_BLOCK_MAGIC && header->frame_len == frame_len &&
+           header->payload_len <= frame_len - sizeof(*header) &&
+           header->crc32 == block_crc(file_id, block + sizeof(*header), header->payload_len);
+}
+
+void log_format_count_block(const uint8_t *block, log_segment_t *segment)
+{
+    log_block_header_t header;
+    memcpy(&header, block, sizeof(header));
+    const uint8_t *payload = block + sizeof(header);
+
+    for (size_t pos = 0; pos + sizeof(log_record_header_t) <= header.payload_len;) {
+        log_record_header_t rec;
+        memcpy(&rec, payload + pos, sizeof(rec));
+        if (rec.len < sizeof(rec) || pos + rec.len > header.payload_len) {
+            break;
+        }
+        if (rec.type == LOG_RECORD_SAMPLE) {
+            if (segment->samples == 0) {
+                segment->first_us = rec.timestamp_us;
+            }
+            segment->last_us = rec.timestamp_us;
+            segment->samples++;
+        }
+        pos += rec.len;
+    }
+}
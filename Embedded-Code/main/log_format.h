@@ -0,0 +1,240 @@
+/**
+ * Star PI binary log format
+ *
+ * File layout (all fields little-endian):
+ *
+ *   [log_file_header_t]
+ *   [log_sensor_desc_t x sensor_count]
+ *   [log_channel_desc_t x channel_count of each sensor, in sensor order]
+ *   (zero padding up to header_len)
+ *   [log_block_header_t][record][record]...(zero padding up to frame_len)
+ *   ...repeated until end of file
+ *
+ * The firmware pads the header and every block to LOG_BLOCK_SIZE so each
+ * write lands on a whole FAT sector. Readers must rely on header_len and
+ * frame_len rather than assuming that size.
+ *
+ * The log is its own journal. data_end in the header marks where the blocks
+ * stop as of the last checkpoint, when the firmware synced the file and
+ * then rewrote the header; 0 means they run to the end of the file. Blocks
+ * are numbered by position, (offset - header_len) / frame_len, so the ones
+ * written since the checkpoint still belong to the log as long as each is
+ * valid and carries the number of its position. The first one that does
+ * not ends the log: a torn write, or whatever the card held before in a
+ * pre-allocated file. Every block CRC also covers the file's random
+ * file_id, so blocks of an older log in the same clusters never pass.
+ *
+ * Each boot starts a flight, logged as a series of segment files that
+ * rotate by size or age. The header names the flight and segment and, as of
+ * data_end, how many sample records the segment holds and the timestamps
+ * of the first and last. A segment is closed once nothing more is written
+ * to it: blocks recovered, reserved space handed back, LOG_FILE_CLOSED set.
+ *
+ * Each record starts with a log_record_header_t. Sample records are followed
+ * by one slot per sensor whose bit is set in sensor_mask, in sensor table
+ * order, so sensors running at different rates share one stream:
+ *   [log_sensor_slot_t][int32_t x channel_count]
+ *
+ * Every sample record the firmware acquires takes the next sequence number,
+ * whether it reaches the card or not, and so does every sample the sensor
+ * task missed while it was behind or discarded with a reset sensor FIFO.
+ * Records lost that way or to a full buffer are accounted for by gap
+ * records:
+ *   [log_gap_t][uint32_t lost samples x sensors set in sensor_mask]
+ * A gap covers seq through last_seq; records lost by thinning may be
+ * reported after surviving records from inside that range.
+ *
+ * Event records mark the flight states the firmware detects:
+ *   [log_flight_event_t]
+ * Their timestamp is when the state began, which can be earlier than the
+ * records around them as detection needs some evidence first.
+ *
+ * Channel values are decoded on the device by the sensor drivers; the
+ * physical value is value / scale in the channel's unit. A channel holding
+ * LOG_CHANNEL_INVALID could not be read.
+ *
+ * Blocks carry a CRC32 over their payload so a torn write only costs the
+ * block it happened in. The host-side decoder lives in SD-Parser/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define LOG_FILE_MAGIC          0x474C5053  // "SPLG"
+#define LOG_BLOCK_MAGIC         0x4B4C4253  // "SBLK"
+#define LOG_FORMAT_VERSION      9
+
+#define LOG_BLOCK_SIZE          4096        // Matches CONFIG_FATFS_SECTOR_4096
+
+#define LOG_SENSOR_NAME_LEN     12
+#define LOG_MAX_SENSORS         8
+#define LOG_DRIVER_NAME_LEN     12
+#define LOG_CHANNEL_NAME_LEN    8
+#define LOG_CHANNEL_UNIT_LEN    8
+#define LOG_MAX_CHANNELS        8           // Per sensor
+
+#define LOG_CHANNEL_INVALID     INT32_MIN
+
+// Where a segment belongs and what it holds
+typedef struct __attribute__((packed)) {
+    uint16_t flight;            // Boot the segment was written in, from 1
+    uint16_t segment;           // Position in the flight, from 0
+    uint32_t samples;           // Sample records up to data_end
+    int64_t  first_us;          // Timestamp of the first of them
+    int64_t  last_us;           // Timestamp of the last of them
+} log_segment_t;
+
+// Fixed file header, followed by sensor_count sensor descriptors and then
+// their channel descriptors
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // LOG_FILE_MAGIC
+    uint16_t version;           // LOG_FORMAT_VERSION
+    uint16_t header_len;        // Bytes from start of file to the first block
+    uint16_t max_record_len;    // Largest record the writer can produce
+    uint8_t  sensor_count;
+    uint8_t  flags;             // LOG_FILE_* bits
+    uint32_t data_end;          // Bytes from start of file to the end of the
+                                // last checkpointed block, 0 = up to the end
+                                // of the file
+    uint32_t file_id;           // Random, chosen when the file is created
+    log_segment_t segment;
+} log_file_header_t;
+
+// File header flags
+#define LOG_FILE_PREALLOCATED   0x01        // Space up to the end of the file is reserved for blocks
+#define LOG_FILE_CLOSED         0x02        // The segment is complete up to data_end
+
+// Describes one sensor and how many channels it contributes per sample
+typedef struct __attribute__((packed)) {
+    char     name[LOG_SENSOR_NAME_LEN];
+    char     driver[LOG_DRIVER_NAME_LEN];
+    uint8_t  address;
+    uint8_t  channel_count;
+    uint16_t rate_hz;           // Nominal sample rate
+} log_sensor_desc_t;
+
+// Name and fixed-point scaling of one decoded channel
+typedef struct __attribute__((packed)) {
+    char     name[LOG_CHANNEL_NAME_LEN];
+    char     unit[LOG_CHANNEL_UNIT_LEN];
+    int32_t  scale;             // Value units per physical unit
+} log_channel_desc_t;
+
+// Precedes every block of records
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // LOG_BLOCK_MAGIC
+    uint32_t seq;               // (offset - header_len) / frame_len
+    uint32_t frame_len;         // Bytes from this header to the next one
+    uint16_t payload_len;       // Record bytes following this header
+    uint16_t record_count;
+    uint32_t crc32;             // CRC32 of file_id, then the payload
+} log_block_header_t;
+
+// Record types
+#define LOG_RECORD_SAMPLE       1
+#define LOG_RECORD_GAP          2
+#define LOG_RECORD_EVENT        3
+
+// Precedes every record inside a block
+typedef struct __attribute__((packed)) {
+    uint16_t len;               // Whole record including this header
+    uint8_t  type;              // LOG_RECORD_*
+    uint8_t  sensor_mask;       // Bit i set: a slot for sensor i follows
+    uint32_t seq;               // Sample record sequence number; for a gap,
+                                // the first one lost; for an event, the next
+    uint32_t sample_num;        // Sampler tick the record belongs to (for FIFO
+                                // batches, the tick they were drained on)
+    int64_t  timestamp_us;      // esp_timer time the tick was serviced
+} log_record_header_t;
+
+// Why records were lost, LOG_GAP_* bits
+#define LOG_GAP_DROPPED         0x01        // No room in the buffer for a new record
+#define LOG_GAP_OVERWRITTEN     0x02        // Oldest records discarded to make room
+#define LOG_GAP_DECIMATED       0x04        // Thinned out while the buffer was filling
+#define LOG_GAP_STANDBY         0x08        // Sampled on the pad before the pre-trigger window
+#define LOG_GAP_OVERRUN         0x10        // Never read: a skipped tick or data-ready edge
+#define LOG_GAP_FIFO_RESET      0x20        // Discarded with a sensor FIFO that had to be reset
+#define LOG_GAP_WRITE_FAILED    0x40        // In a block the card did not take, or with no file open
+
+// Follows the header of a gap record, whose sensor_mask has a bit for every
+// sensor that lost samples
+typedef struct __attribute__((packed)) {
+    uint32_t last_seq;          // Last sequence number the gap covers
+    int64_t  last_timestamp_us;
+    uint32_t records;           // Sample records lost between seq and last_seq
+    uint8_t  reason;            // LOG_GAP_* bits
+    uint8_t  reserved[3];
+} log_gap_t;
+
+// Flight states
+#define LOG_FLIGHT_STANDBY      0           // On the pad, taking the ground reference
+#define LOG_FLIGHT_ARMED        1           // Waiting for launch
+#define LOG_FLIGHT_BOOST        2
+#define LOG_FLIGHT_COAST        3
+#define LOG_FLIGHT_DESCENT      4
+#define LOG_FLIGHT_LANDED       5
+
+// Follows the header of an event record, whose sensor_mask is 0
+typedef struct __attribute__((packed)) {
+    uint8_t  state;             // LOG_FLIGHT_* entered
+    uint8_t  previous;          // LOG_FLIGHT_* left
+    uint8_t  reserved[2];
+    int32_t  altitude_cm;       // Above the ground reference, by pressure
+} log_flight_event_t;
+
+// Precedes each sensor's data in a sample record
+typedef struct __attribute__((packed)) {
+    uint32_t offset_us;         // Transaction completion, relative to timestamp_us
+} log_sensor_slot_t;
+
+/**
+ * CRC32 (IEEE 802.3, same as zlib.crc32). Pass 0 to start a new checksum.
+ */
+uint32_t log_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * Build the file header, sensor table and channel table into buf, zero
+ * padded to buf_len. channels holds the channels of every sensor in sensor
+ * order. Returns the length of the header proper (without padding), or 0 if
+ * buf is too small.
+ */
+size_t log_format_build_header(uint8_t *buf, size_t buf_len,
+                               const log_sensor_desc_t *sensors, uint8_t sensor_count,
+                               const log_channel_desc_t *channels, size_t channel_count,
+                               uint16_t max_record_len);
+
+/**
+ * Read or update the fields that differ between files with the same sensor
+ * table, in a header built by log_format_build_header()
+ */
+uint32_t log_format_get_data_end(const uint8_t *header);
+void log_format_set_data_end(uint8_t *header, uint32_t data_end);
+uint32_t log_format_get_file_id(const uint8_t *header);
+void log_format_set_file_id(uint8_t *header, uint32_t file_id);
+uint8_t log_format_get_flags(const uint8_t *header);
+void log_format_set_flags(uint8_t *header, uint8_t flags);
+void log_format_get_segment(const uint8_t *header, log_segment_t *segment);
+void log_format_set_segment(uint8_t *header, const log_segment_t *segment);
+
+/**
+ * Fill in the block header at the start of a frame_len byte block for
+ * payload_len bytes of records that already sit right after it, and zero
+ * the unused tail of the frame.
+ */
+void log_format_seal_block(uint8_t *block, size_t frame_len, uint32_t file_id, uint32_t seq,
+                           uint16_t payload_len, uint16_t record_count);
+
+/**
+ * Whether the frame_len bytes at block hold a valid block of file file_id:
+ * magic, lengths and CRC. Its header is copied to *header either way.
+ */
+bool log_format_check_block(const uint8_t *block, size_t frame_len, uint32_t file_id,
+                            log_block_header_t *header);
+
+/**
+ * Add the sample records of a valid block to the segment's count and
+ * time span
+ */
+void log_format_count_block(const uint8_t *block, log_segment_t *segment);
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/unistd.h>
+#include "log_index.h"
+#include "esp_log.h"
+
+static const char *TAG = "log_index";
+
+void log_index_segment_name(char *name, uint16_t flight, uint16_t segment)
+{
+    // Callers keep to the limits; reducing the numbers proves the 8.3 name fits
+    snprintf(name, LOG_SEGMENT_NAME_LEN, "F%04u_%03u.BIN",
+             (unsigned)(flight % (LOG_MAX_FLIGHT + 1)), (unsigned)(segment % (LOG_MAX_SEGMENT + 1)));
+}
+
+/**
+ * Flight and segment of a segment file name, false for any other name
+ */
+static bool parse_segment_name(const char *name, uint16_t *flight, uint16_t *segment)
+{
+    if (strlen(name) != LOG_SEGMENT_NAME_LEN - 1 || toupper((unsigned char)name[0]) != 'F' ||
+        name[5] != '_' || strcasecmp(name + 9, ".BIN") != 0) {
+        return false;
+    }
+    unsigned f = 0, s = 0;
+    for (int i = 1; i < 9; i++) {
+        if (i == 5) {
+            continue;
+        }
+        if (!isdigit((unsigned char)name[i])) {
+            return false;
+        }
+        if (i < 5) {
+            f = f * 10 + (name[i] - '0');
+        } else {
+            s = s * 10 + (name[i] - '0');
+        }
+    }
+    *flight = f;
+    *segment = s;
+    return true;
+}
+
+esp_err_t log_index_find_last(const char *dir, uint16_t *flight, uint16_t *segment)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        ESP_LOGE(TAG, "Cannot list %s", dir);
+        return ESP_FAIL;
+    }
+
+    bool found = false;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        uint16_t f, s;
+        if (!parse_segment_name(entry->d_name, &f, &s)) {
+            continue;
+        }
+        if (!found || f > *flight || (f == *flight && s > *segment)) {
+            *flight = f;
+            *segment = s;
+            found = true;
+        }
+    }
+    closedir(d);
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t log_index_append(const char *dir, const log_segment_t *segment, uint32_t bytes)
+{
+    char path[64];
+    char name[LOG_SEGMENT_NAME_LEN];
+    snprintf(path, sizeof(path), "%s/%s", dir, LOG_INDEX_FILE_NAME);
+    log_index_segment_name(name, segment->flight, segment->segment);
+
+    FILE *f = fopen(path, "a");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+    // A new index starts with its column names
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "file,flight,segment,first_us,last_us,samples,bytes\n");
+    }
+    fprintf(f, "%s,%u,%u,%lld,%lld,%lu,%lu\n", name, segment->flight, segment->segment,
+            (long long)segment->first_us, (long long)segment->last_us,
+            (unsigned long)segment->samples, (unsigned long)bytes);
+
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to update %s", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+/**
+ * Flight segments and their index on the card
+ *
+ * Every boot logs a new flight into segment files with 8.3 names, as the
+ * card is mounted without long file names: F<flight>_<segment>.BIN, e.g.
+ * F0001_000.BIN. Whenever a segment is closed, a line is appended to
+ * INDEX.CSV in the card's root:
+ *
+ *   file,flight,segment,first_us,last_us,samples,bytes
+ *
+ * so one flight can be picked out without opening every segment. Times are
+ * esp_timer microseconds since the flight's boot, samples counts sample
+ * records and bytes is the file's length. A segment closed again after a
+ * power cut may be listed twice; the later line counts.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "log_format.h"
+#include "esp_err.h"
+
+#define LOG_INDEX_FILE_NAME     "INDEX.CSV"
+#define LOG_SEGMENT_NAME_LEN    14          // "F0001_000.BIN" and its terminator
+#define LOG_MAX_FLIGHT          9999
+#define LOG_MAX_SEGMENT         999
+
+/**
+ * File name of a segment, into a buffer of LOG_SEGMENT_NAME_LEN bytes
+ */
+void log_index_segment_name(char *name, uint16_t flight, uint16_t segment);
+
+/**
+ * Newest segment in dir: the highest one of the highest flight.
+ * ESP_ERR_NOT_FOUND if dir holds none.
+ */
+esp_err_t log_index_find_last(const char *dir, uint16_t *flight, uint16_t *segment);
+
+/**
+ * List a closed segment, bytes long, in dir's index and sync it
+ */
+esp_err_t log_index_append(const char *dir, const log_segment_t *segment, uint32_t bytes);
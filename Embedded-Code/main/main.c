@@ -1,10 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
 #include "esp_vfs_fat.h"
@@ -12,17 +16,93 @@
 #include "driver/sdmmc_host.h"
 #include "esp_log.h"
 #include <stdatomic.h>
+#include "log_format.h"
+#include "log_index.h"
+#include "flight_state.h"
+#include "fusion.h"
+#include "ring_buffer.h"
+#include "sampler.h"
+#include "i2c_async.h"
+#include "mpu_fifo.h"
+#include "drdy.h"
+#include "sensor_driver.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_random.h"
+#include "esp_cpu.h"
+#include "sd_raw.h"
 
 static const char *TAG = "main";
 
 // SD Card Configuration
 #define MOUNT_POINT "/sdcard"
-#define DATA_FILE   MOUNT_POINT "/sensor_data.csv"
 static sdmmc_card_t *sd_card = NULL;
 static FILE *data_file = NULL;
 
-#define BUFFER_SIZE     4096    // Increased for multiple sensors
+// Flight segments, see LOGGER_SEGMENT_MB and LOGGER_SEGMENT_SECONDS
+#define LOG_SEGMENT_BYTES   ((uint32_t)CONFIG_LOGGER_SEGMENT_MB * 1024 * 1024)
+#define LOG_SEGMENT_SECONDS CONFIG_LOGGER_SEGMENT_SECONDS
+static log_segment_t segment;       // The one being written, counted up to data_end
+static char segment_name[LOG_SEGMENT_NAME_LEN];
+static char segment_path[sizeof(MOUNT_POINT) + LOG_SEGMENT_NAME_LEN];
+static TickType_t segment_started = 0;    // When its first block was written
+
+// SD bus, see LOGGER_SD_BUS_WIDTH and LOGGER_SD_FREQ_KHZ
+#if CONFIG_LOGGER_SD_BUS_WIDTH_4
+#define SD_BUS_WIDTH    4
+#else
+#define SD_BUS_WIDTH    1
+#endif
+#define SD_FREQ_KHZ     CONFIG_LOGGER_SD_FREQ_KHZ
+
+// SDMMC slot 1 pins; fixed by the IO MUX on the ESP32, routed through the
+// GPIO matrix on chips that have one
+#define SD_PIN_CLK      14
+#define SD_PIN_CMD      15
+#define SD_PIN_D0       2           // Conflicts with the LED on most boards
+#define SD_PIN_D1       4
+#define SD_PIN_D2       12          // Strapping pin, see LOGGER_SD_BUS_WIDTH_4
+#define SD_PIN_D3       13
+
+// Pre-allocated segments, see LOGGER_PREALLOC_MB
+#define LOG_PREALLOC_BYTES  ((uint64_t)CONFIG_LOGGER_PREALLOC_MB * 1024 * 1024)
+static DMA_ATTR uint8_t log_header[LOG_BLOCK_SIZE];
+static uint32_t data_end = 0;       // File offset past the last block written
+static uint32_t prealloc_end = 0;   // End of the space reserved for blocks
+static uint32_t file_id = 0;        // Folded into every block CRC
+
+// Checkpoints, see LOGGER_CHECKPOINT_MS
+#define LOG_CHECKPOINT_MS       CONFIG_LOGGER_CHECKPOINT_MS
+static uint32_t header_end = 0;     // data_end as of the last checkpoint
+static TickType_t checkpoint_ticks = 0;
+
+// Blocks written straight into the pre-allocated clusters, see LOGGER_RAW_SECTORS
+static SdRawExtent_t raw_extent;
+static bool raw_writes = false;
+
 #define SAMPLE_SIZE     64      // Increased to hold data from all sensors
+#define LOG_NUM_BLOCKS  2       // Double buffered: one fills while the other is written
+#define LOG_FLUSH_LATENCY_MS    CONFIG_LOGGER_FLUSH_LATENCY_MS
+
+// Sample buffer capacity and heap region, see LOGGER_RING_BUFFER_KB
+#define RING_BUFFER_SIZE        (CONFIG_LOGGER_RING_BUFFER_KB * 1024)
+#define RING_BUFFER_MIN_SIZE    4096
+#define RING_INTERNAL_CAPS      (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#if CONFIG_LOGGER_RING_PSRAM
+#define RING_BUFFER_CAPS        (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#elif CONFIG_LOGGER_RING_DMA
+#define RING_BUFFER_CAPS        (MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL)
+#else
+#define RING_BUFFER_CAPS        RING_INTERNAL_CAPS
+#endif
+#define SD_WORST_STALL_MS       500     // Card busy time seen during wear leveling
+
+// Buffer overflow handling, see LOGGER_OVERFLOW_POLICY
+#define OVERWRITE_KEEP_BYTES    (ring_buffer.size / 2)  // Buffered data kept while no block is free
+#define OVERWRITE_POLL_TICKS    1                   // Discard check interval while waiting for a block
+#define GAP_HOLD_RECORDS        64                  // Decimation losses batched into one gap record
+#define GAP_RECORD_MAX_LEN      (sizeof(log_record_header_t) + sizeof(log_gap_t) + NUM_LOG_SENSORS * sizeof(uint32_t))
 
 // I2C Configuration
 #define I2C_MASTER_SCL_IO           22          // GPIO for I2C clock
@@ -34,129 +114,497 @@ static FILE *data_file = NULL;
 // Number of sensors
 #define NUM_SENSORS                 3
 
+// Base tick of the sampling scheduler; every sensor rate divides into it
+#define SAMPLER_RATE_HZ             CONFIG_SAMPLER_BASE_RATE_HZ
+
 // Sensor addresses (modify these for your actual sensors)
 #define SENSOR_1_ADDR               0x68        // e.g., MPU6050/MPU9250
 #define SENSOR_2_ADDR               0x76        // e.g., BME280/BMP280
 #define SENSOR_3_ADDR               0x1E        // e.g., HMC5883L magnetometer
 
-// Common registers (adjust per sensor type)
-#define DATA_REG_ADDR               0x3B        // Starting register for data read
-#define DATA_READ_LEN               6           // Bytes to read per sensor
+// IMU FIFO: frames are drained in bursts instead of polled per sample
+#if CONFIG_SENSOR_IMU_FIFO
+#define IMU_FIFO_DRAIN_HZ           CONFIG_SENSOR_IMU_FIFO_DRAIN_HZ
+#else
+#define IMU_FIFO_DRAIN_HZ           0
+#endif
+#define IMU_FIFO_MAX_FRAMES         32          // Frames moved per drain
+
+// Data-ready pins; -1 leaves the sensor on the sampler tick
+#define IMU_DRDY_GPIO               CONFIG_SENSOR_IMU_DRDY_GPIO
+#define MAG_DRDY_GPIO               CONFIG_SENSOR_MAG_DRDY_GPIO
+
+// Flight detection, see flight_state.h: the IMU's first three channels are
+// its acceleration, and the barometer's pressure is channel 1
+#define FLIGHT_IMU_SENSOR           0
+#define FLIGHT_BARO_SENSOR          1
+#define FLIGHT_BARO_CHANNEL         1
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+#define PAD_RATE_DIVIDER            CONFIG_FLIGHT_PAD_RATE_DIVIDER
+#define PRETRIGGER_MS               CONFIG_FLIGHT_PRETRIGGER_MS
+#else
+#define PAD_RATE_DIVIDER            1
+#endif
+
+// On-board fusion, see fusion.h. It is logged as one more sensor after the
+// physical ones, its slot riding on the IMU record it was updated with.
+#define FUSION_RATE_HZ              CONFIG_FUSION_RATE_HZ
+#define FUSION_SENSOR               NUM_SENSORS
+#define FUSION_MAG_SENSOR           2
+#define FUSION_CHANNELS             5
+#define FUSION_SLOT_LEN             (sizeof(log_sensor_slot_t) + FUSION_CHANNELS * sizeof(int32_t))
+#define FUSION_BUDGET_CYCLES        4800        // Per update: 2% of a 1 kHz IMU period at 240 MHz
+#define NUM_LOG_SENSORS             (NUM_SENSORS + (FUSION_RATE_HZ > 0))
+
+#if SD_BUS_WIDTH == 4 && (IMU_DRDY_GPIO == SD_PIN_D1 || IMU_DRDY_GPIO == SD_PIN_D2 || IMU_DRDY_GPIO == SD_PIN_D3 || \
+                          MAG_DRDY_GPIO == SD_PIN_D1 || MAG_DRDY_GPIO == SD_PIN_D2 || MAG_DRDY_GPIO == SD_PIN_D3)
+#error "A data-ready pin is one of the SD card's D1-D3 lines in 4-bit mode"
+#endif
 
 // Sensor configuration structure
 typedef struct {
     uint8_t address;
-    uint8_t data_reg;
-    uint8_t data_len;
+    const SensorDriver_t *driver;   // Registers, channels and bring-up, see sensor_driver.h
+    uint16_t rate_hz;               // Requested sample rate
+    uint32_t divider;               // Read on every Nth sampler tick
+    int drdy_gpio;                  // Read on data-ready edges instead of ticks, -1 = none
+    SensorDevice_t dev;
     i2c_master_dev_handle_t dev_handle;
     const char *name;
 } SensorConfig_t;
 
 // Global sensor array
 static SensorConfig_t sensors[NUM_SENSORS] = {
-    { .address = SENSOR_1_ADDR, .data_reg = 0x3B, .data_len = 6, .name = "Sensor1" },
-    { .address = SENSOR_2_ADDR, .data_reg = 0xF7, .data_len = 6, .name = "Sensor2" },
-    { .address = SENSOR_3_ADDR, .data_reg = 0x03, .data_len = 6, .name = "Sensor3" },
+#if CONFIG_SENSOR_IMU_FIFO
+    { .address = SENSOR_1_ADDR, .driver = &mpu6050_fifo_driver, .rate_hz = 1000, .drdy_gpio = -1,            .name = "Sensor1" },
+#else
+    { .address = SENSOR_1_ADDR, .driver = &mpu6050_driver,      .rate_hz = 1000, .drdy_gpio = IMU_DRDY_GPIO, .name = "Sensor1" },
+#endif
+    { .address = SENSOR_2_ADDR, .driver = &bme280_driver,       .rate_hz = 50,   .drdy_gpio = -1,            .name = "Sensor2" },
+#if MAG_DRDY_GPIO >= 0
+    { .address = SENSOR_3_ADDR, .driver = &hmc5883l_driver,     .rate_hz = 75,   .drdy_gpio = MAG_DRDY_GPIO, .name = "Sensor3" },
+#else
+    { .address = SENSOR_3_ADDR, .driver = &hmc5883l_driver,     .rate_hz = 50,   .drdy_gpio = -1,            .name = "Sensor3" },
+#endif
+};
+
+// Channels of the fusion's log sensor, in FusionOutput_t order
+static const SensorChannel_t fusion_channels[FUSION_CHANNELS] = {
+    { "alt", "m", 1000 },
+    { "vz", "m/s", 1000 },
+    { "pitch", "deg", 100 },
+    { "roll", "deg", 100 },
+    { "yaw", "deg", 100 },
 };
 
+/**
+ * Bytes a sensor contributes to a record after its slot header
+ */
+static inline size_t sensor_data_len(int sensor_idx)
+{
+    return sensors[sensor_idx].driver->channel_count * sizeof(int32_t);
+}
+
 static i2c_master_bus_handle_t i2c_bus_handle;
 
-// Lock-free ring buffer structure
-typedef struct {
-    uint8_t data[BUFFER_SIZE];
-    atomic_size_t write_index;      // Only sensor task writes this
-    atomic_size_t read_index;       // Only SD task writes this
-    SemaphoreHandle_t data_available;  // Optional: for blocking wait
-} RingBuffer_t;
+// Largest record: header plus a slot for every sensor
+static size_t max_record_len = 0;
 
+// Lock-free SPSC ring buffer between the sensor task and the SD task,
+// allocated at boot from the region picked in Kconfig
 static RingBuffer_t ring_buffer;
+static SemaphoreHandle_t data_available;   // Given once per committed sample
+
+// Sector-sized write block, handed between the drain and flush tasks. data
+// comes first so it inherits the DMA alignment of the pool.
+typedef struct {
+    uint8_t data[LOG_BLOCK_SIZE];
+    size_t payload_len;
+    uint16_t records;
+} LogBlock_t;
+
+// In DMA-capable RAM and word aligned, so the SDMMC driver transfers blocks
+// straight from them instead of bouncing every sector through its own buffer
+static DMA_ATTR LogBlock_t log_blocks[LOG_NUM_BLOCKS];
+static QueueHandle_t free_blocks;   // Empty blocks ready to be filled
+static QueueHandle_t full_blocks;   // Filled blocks waiting to be written
+
+// Sample records lost since the last gap record was written
+typedef struct {
+    uint32_t records;               // 0 = nothing pending
+    uint32_t first_seq;
+    uint32_t last_seq;
+    uint32_t first_tick;
+    int64_t first_us;
+    int64_t last_us;
+    uint8_t reason;                 // LOG_GAP_* bits
+    uint32_t lost[NUM_LOG_SENSORS]; // Lost samples per sensor
+} PendingGap_t;
+
+// Buffer telemetry, collected over one stats window
+typedef struct {
+    size_t high_water;              // Most bytes buffered at once
+    uint32_t dropped;               // Records lost, by reason
+    uint32_t overwritten;
+    uint32_t decimated;
+    uint32_t overrun;
+    uint32_t fifo_reset;
+    uint32_t write_failed;
+    uint32_t gaps;                  // Gap records written
+} BufferStats_t;
+
+static portMUX_TYPE buffer_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static BufferStats_t buffer_stats;
+
+static uint32_t record_seq = 0;     // Next sample record number, sensor task only
+static PendingGap_t sensor_gap;     // Records the sensor task could not buffer
+static PendingGap_t writer_gap;     // Records the SD task discarded
+static PendingGap_t flush_gap;      // Records the flush task could not write, handed to the SD task
+static portMUX_TYPE flush_gap_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static FlightTracker_t flight;      // Sensor task only
+static atomic_bool pretrigger_hold; // Nothing goes to the card until launch
+static uint8_t held_event[sizeof(log_record_header_t) + sizeof(log_flight_event_t)];
+static size_t held_event_len;       // Newest pad event the hold released, SD task only
+
+static Fusion_t fusion;             // Sensor task only
+static int fusion_gyro_channel = -1;    // The IMU's gx, followed by gy and gz
+
+// Fusion cost, collected over one stats window
+typedef struct {
+    uint32_t updates;
+    uint64_t cycles;
+    uint32_t max_cycles;
+} FusionStats_t;
+
+static portMUX_TYPE fusion_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static FusionStats_t fusion_stats;
 
 static TaskHandle_t task_core0_handle = NULL;
+static TaskHandle_t task_flush_handle = NULL;
 static TaskHandle_t task_core1_handle = NULL;
 
+static const char *ring_region_name(uint32_t caps)
+{
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return "PSRAM";
+    }
+    return (caps & MALLOC_CAP_DMA) ? "DMA-capable RAM" : "internal RAM";
+}
+
 /**
- * Initialize the ring buffer
+ * Allocate and initialize the ring buffer. The configured size is rounded
+ * down to a power of two and halved until the configured region can hold
+ * it; if it cannot even hold the minimum, internal RAM is used instead.
+ * Reports how long the buffer bridges a card stall at the sensor rates.
  */
-static void init_ring_buffer(void)
+static esp_err_t init_ring_buffer(void)
 {
-    memset(ring_buffer.data, 0, BUFFER_SIZE);
-    atomic_store(&ring_buffer.write_index, 0);
-    atomic_store(&ring_buffer.read_index, 0);
-    ring_buffer.data_available = xSemaphoreCreateCounting(BUFFER_SIZE / SAMPLE_SIZE, 0);
-    
-    ESP_LOGI(TAG, "Lock-free ring buffer initialized (%d bytes)", BUFFER_SIZE);
+    size_t size = RING_BUFFER_MIN_SIZE;
+    while (size * 2 <= RING_BUFFER_SIZE) {
+        size *= 2;
+    }
+
+    uint32_t caps = RING_BUFFER_CAPS;
+    uint8_t *storage = heap_caps_malloc(size, caps);
+    while (storage == NULL && size > RING_BUFFER_MIN_SIZE) {
+        size /= 2;
+        storage = heap_caps_malloc(size, caps);
+    }
+    if (storage == NULL && caps != RING_INTERNAL_CAPS) {
+        caps = RING_INTERNAL_CAPS;
+        storage = heap_caps_malloc(size, caps);
+    }
+    if (storage == NULL) {
+        ESP_LOGE(TAG, "No memory for a %u byte ring buffer", (unsigned)size);
+        return ESP_ERR_NO_MEM;
+    }
+    if (size != RING_BUFFER_SIZE || caps != RING_BUFFER_CAPS) {
+        ESP_LOGW(TAG, "Ring buffer is %u KiB in %s instead of the configured %d KiB in %s",
+                 (unsigned)(size / 1024), ring_region_name(caps), CONFIG_LOGGER_RING_BUFFER_KB,
+                 ring_region_name(RING_BUFFER_CAPS));
+    }
+
+    memset(storage, 0, size);
+    ring_buffer_init(&ring_buffer, storage, size);
+    data_available = xSemaphoreCreateCounting(size / SAMPLE_SIZE, 0);
+
+    // Worst case: every sensor in records of its own at its nominal rate
+    size_t bytes_per_s = 0;
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        bytes_per_s += sensors[i].rate_hz *
+                       (sizeof(log_record_header_t) + sizeof(log_sensor_slot_t) + sensor_data_len(i));
+    }
+    bytes_per_s += FUSION_RATE_HZ * FUSION_SLOT_LEN;
+    uint32_t headroom_ms = (uint32_t)((uint64_t)size * 1000 / bytes_per_s);
+
+    ESP_LOGI(TAG, "Lock-free ring buffer: %u KiB in %s, %u bytes/s at nominal rates, %lu ms of headroom",
+             (unsigned)(size / 1024), ring_region_name(caps), (unsigned)bytes_per_s, (unsigned long)headroom_ms);
+    if (headroom_ms < SD_WORST_STALL_MS) {
+        ESP_LOGW(TAG, "Ring buffer bridges less than a %d ms card stall, raise LOGGER_RING_BUFFER_KB",
+                 SD_WORST_STALL_MS);
+    }
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+    uint32_t pretrigger_ms = (uint32_t)((uint64_t)size / 2 * 1000 * PAD_RATE_DIVIDER / bytes_per_s);
+    if (pretrigger_ms < PRETRIGGER_MS) {
+        ESP_LOGW(TAG, "Half the ring buffer holds only %lu ms before launch at pad rates, not %d ms",
+                 (unsigned long)pretrigger_ms, PRETRIGGER_MS);
+    }
+#endif
+    return ESP_OK;
+}
+
+/**
+ * Fold other into gap. Ranges are combined rather than chained because
+ * thinning losses can be reported after records from inside their range.
+ */
+static void gap_merge(PendingGap_t *gap, const PendingGap_t *other)
+{
+    if (other->records == 0) {
+        return;
+    }
+    if (gap->records == 0) {
+        *gap = *other;
+        return;
+    }
+    if (other->first_seq < gap->first_seq) {
+        gap->first_seq = other->first_seq;
+        gap->first_tick = other->first_tick;
+    }
+    if (other->last_seq > gap->last_seq) {
+        gap->last_seq = other->last_seq;
+    }
+    if (other->first_us < gap->first_us) {
+        gap->first_us = other->first_us;
+    }
+    if (other->last_us > gap->last_us) {
+        gap->last_us = other->last_us;
+    }
+    gap->records += other->records;
+    gap->reason |= other->reason;
+    for (int i = 0; i < NUM_LOG_SENSORS; i++) {
+        gap->lost[i] += other->lost[i];
+    }
 }
 
 /**
- * Get available space for writing
+ * Account for one lost sample record
  */
-static inline size_t ring_buffer_free_space(void)
+static void gap_add(PendingGap_t *gap, uint32_t seq, uint32_t mask, uint32_t tick,
+                    int64_t timestamp, uint8_t reason)
 {
-    size_t w = atomic_load(&ring_buffer.write_index);
-    size_t r = atomic_load(&ring_buffer.read_index);
-    return BUFFER_SIZE - (w - r);
+    PendingGap_t one = {
+        .records = 1,
+        .first_seq = seq,
+        .last_seq = seq,
+        .first_tick = tick,
+        .first_us = timestamp,
+        .last_us = timestamp,
+        .reason = reason,
+    };
+    for (int i = 0; i < NUM_LOG_SENSORS; i++) {
+        one.lost[i] = (mask >> i) & 1;
+    }
+    gap_merge(gap, &one);
+
+    portENTER_CRITICAL(&buffer_stats_lock);
+    if (reason == LOG_GAP_DROPPED) {
+        buffer_stats.dropped++;
+    } else if (reason == LOG_GAP_OVERWRITTEN) {
+        buffer_stats.overwritten++;
+    } else if (reason == LOG_GAP_DECIMATED) {
+        buffer_stats.decimated++;
+    } else if (reason == LOG_GAP_OVERRUN) {
+        buffer_stats.overrun++;
+    } else if (reason == LOG_GAP_FIFO_RESET) {
+        buffer_stats.fifo_reset++;
+    } else if (reason == LOG_GAP_WRITE_FAILED) {
+        buffer_stats.write_failed++;
+    }
+    portEXIT_CRITICAL(&buffer_stats_lock);
 }
 
 /**
- * Get available data for reading
+ * Serialize a pending gap as a gap record into buf, which must hold
+ * GAP_RECORD_MAX_LEN bytes. Returns the record length.
  */
-static inline size_t ring_buffer_available(void)
+static size_t gap_encode(const PendingGap_t *gap, uint8_t *buf)
 {
-    size_t w = atomic_load(&ring_buffer.write_index);
-    size_t r = atomic_load(&ring_buffer.read_index);
-    return w - r;
+    log_record_header_t header = {
+        .len = sizeof(log_record_header_t) + sizeof(log_gap_t),
+        .type = LOG_RECORD_GAP,
+        .seq = gap->first_seq,
+        .sample_num = gap->first_tick,
+        .timestamp_us = gap->first_us,
+    };
+    log_gap_t body = {
+        .last_seq = gap->last_seq,
+        .last_timestamp_us = gap->last_us,
+        .records = gap->records,
+        .reason = gap->reason,
+    };
+
+    size_t len = sizeof(header) + sizeof(body);
+    for (int i = 0; i < NUM_LOG_SENSORS; i++) {
+        if (gap->lost[i] > 0) {
+            header.sensor_mask |= 1 << i;
+            memcpy(buf + len, &gap->lost[i], sizeof(uint32_t));
+            len += sizeof(uint32_t);
+        }
+    }
+    header.len = len;
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), &body, sizeof(body));
+    return len;
 }
 
 /**
- * Write data to ring buffer (sensor task only)
- * NO MUTEX NEEDED - only this task modifies write_index
+ * Read back the gap record at offset in span
  */
-static size_t ring_buffer_write(const uint8_t *data, size_t len)
+static void gap_decode(const RingSpan_t *span, size_t offset, PendingGap_t *gap)
 {
-    if (ring_buffer_free_space() < len) {
-        ESP_LOGW(TAG, "Buffer full! Dropping data");
-        return 0;
+    log_record_header_t header;
+    log_gap_t body;
+    ring_span_read(span, offset, &header, sizeof(header));
+    ring_span_read(span, offset + sizeof(header), &body, sizeof(body));
+    offset += sizeof(header) + sizeof(body);
+
+    memset(gap, 0, sizeof(*gap));
+    gap->records = body.records;
+    gap->first_seq = header.seq;
+    gap->last_seq = body.last_seq;
+    gap->first_tick = header.sample_num;
+    gap->first_us = header.timestamp_us;
+    gap->last_us = body.last_timestamp_us;
+    gap->reason = body.reason;
+    for (int i = 0; i < NUM_LOG_SENSORS; i++) {
+        if (header.sensor_mask & (1 << i)) {
+            ring_span_read(span, offset, &gap->lost[i], sizeof(uint32_t));
+            offset += sizeof(uint32_t);
+        }
     }
-    
-    size_t w = atomic_load(&ring_buffer.write_index);
-    
-    // Write data (can happen while SD is reading different part)
-    for (size_t i = 0; i < len; i++) {
-        ring_buffer.data[(w + i) % BUFFER_SIZE] = data[i];
+}
+
+/**
+ * Report a gap record that just went out and start a new one
+ */
+static void gap_written(PendingGap_t *gap)
+{
+    if (gap->reason & (LOG_GAP_DROPPED | LOG_GAP_OVERWRITTEN)) {
+        ESP_LOGW(TAG, "Buffer overflow: lost %lu records (seq %lu-%lu, %lld ms)",
+                 (unsigned long)gap->records, (unsigned long)gap->first_seq,
+                 (unsigned long)gap->last_seq, (long long)((gap->last_us - gap->first_us) / 1000));
     }
-    
-    // Memory barrier ensures data is written before index update
-    atomic_store(&ring_buffer.write_index, w + len);
-    
-    // Signal data available
-    xSemaphoreGive(ring_buffer.data_available);
-    
-    return len;
+    portENTER_CRITICAL(&buffer_stats_lock);
+    buffer_stats.gaps++;
+    portEXIT_CRITICAL(&buffer_stats_lock);
+    memset(gap, 0, sizeof(*gap));
 }
 
 /**
- * Read data from ring buffer (SD task only)
- * NO MUTEX NEEDED - only this task modifies read_index
+ * Decimate-to-fit: keep every Nth sample, N doubling as the buffer passes
+ * 1/2, 3/4 and 7/8 full
  */
-static size_t ring_buffer_read(uint8_t *data, size_t max_len)
+static uint32_t decimation_factor(void)
 {
-    size_t available = ring_buffer_available();
-    if (available == 0) {
-        return 0;
+#if CONFIG_LOGGER_OVERFLOW_DECIMATE
+    size_t used = ring_buffer_available(&ring_buffer);
+    if (used >= ring_buffer.size * 7 / 8) {
+        return 8;
     }
-    
-    size_t to_read = (max_len < available) ? max_len : available;
-    size_t r = atomic_load(&ring_buffer.read_index);
-    
-    // Read data (can happen while sensor is writing to different part)
-    for (size_t i = 0; i < to_read; i++) {
-        data[i] = ring_buffer.data[(r + i) % BUFFER_SIZE];
+    if (used >= ring_buffer.size * 3 / 4) {
+        return 4;
     }
-    
-    // Memory barrier ensures data is read before index update
-    atomic_store(&ring_buffer.read_index, r + to_read);
-    
-    return to_read;
+    if (used >= ring_buffer.size / 2) {
+        return 2;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * Whether a record for the sensors in mask survives decimation. Each sensor
+ * is thinned on its own count so slow sensors are not starved.
+ */
+static bool decimate_keep(uint32_t mask)
+{
+    static uint32_t counts[NUM_SENSORS];
+    uint32_t factor = decimation_factor();
+    bool keep = false;
+
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if (mask & (1 << i)) {
+            keep |= (counts[i]++ % factor) == 0;
+        }
+    }
+    return keep;
+}
+
+/**
+ * Whether the sensor task's pending losses should be written now. Thinning
+ * losses are batched while decimation lasts, anything else goes out ahead
+ * of the next record.
+ */
+static bool gap_ready(const PendingGap_t *gap)
+{
+    if (gap->records == 0) {
+        return false;
+    }
+    if (gap->reason == LOG_GAP_DECIMATED && gap->records < GAP_HOLD_RECORDS) {
+        return decimation_factor() == 1;
+    }
+    return true;
+}
+
+/**
+ * Reserve len bytes of sample records in the ring, preceded by a gap record
+ * for anything lost before them. *offset is where the records start. Returns
+ * false when they do not fit; the caller accounts them as dropped.
+ */
+static bool reserve_records(size_t len, RingSpan_t *span, size_t *offset)
+{
+    uint8_t marker[GAP_RECORD_MAX_LEN];
+    size_t marker_len = gap_ready(&sensor_gap) ? gap_encode(&sensor_gap, marker) : 0;
+
+    if (!ring_buffer_reserve(&ring_buffer, marker_len + len, span)) {
+        return false;
+    }
+    if (marker_len > 0) {
+        ring_span_write(span, 0, marker, marker_len);
+        gap_written(&sensor_gap);
+    }
+    *offset = marker_len;
+    return true;
+}
+
+/**
+ * Publish len reserved bytes to the SD task
+ */
+static void commit_records(size_t len)
+{
+    ring_buffer_commit(&ring_buffer, len);
+
+    size_t used = ring_buffer_available(&ring_buffer);
+    portENTER_CRITICAL(&buffer_stats_lock);
+    if (used > buffer_stats.high_water) {
+        buffer_stats.high_water = used;
+    }
+    portEXIT_CRITICAL(&buffer_stats_lock);
+
+    xSemaphoreGive(data_available);
+}
+
+/**
+ * Copy the buffer telemetry, optionally starting a new window
+ */
+static void buffer_get_stats(BufferStats_t *out, bool reset)
+{
+    portENTER_CRITICAL(&buffer_stats_lock);
+    *out = buffer_stats;
+    if (reset) {
+        memset(&buffer_stats, 0, sizeof(buffer_stats));
+    }
+    portEXIT_CRITICAL(&buffer_stats_lock);
 }
 
 /**
@@ -171,6 +619,7 @@ static esp_err_t i2c_sensors_init(void)
         .scl_io_num = I2C_MASTER_SCL_IO,
         .clk_source = I2C_CLK_SRC_DEFAULT,
         .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2C_ASYNC_QUEUE_DEPTH,
         .flags.enable_internal_pullup = true,
     };
     
@@ -180,8 +629,14 @@ static esp_err_t i2c_sensors_init(void)
         return ret;
     }
     
+    ret = i2c_async_init(I2C_MASTER_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
     // Add each sensor to the bus
     for (int i = 0; i < NUM_SENSORS; i++) {
+        sensors[i].dev.id = i;
         i2c_device_config_t dev_config = {
             .dev_addr_length = I2C_ADDR_BIT_LEN_7,
             .device_address = sensors[i].address,
@@ -189,6 +644,9 @@ static esp_err_t i2c_sensors_init(void)
         };
         
         ret = i2c_master_bus_add_device(i2c_bus_handle, &dev_config, &sensors[i].dev_handle);
+        if (ret == ESP_OK) {
+            ret = i2c_async_add_device(i, sensors[i].dev_handle);
+        }
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Failed to add %s (0x%02X): %s", 
                      sensors[i].name, sensors[i].address, esp_err_to_name(ret));
@@ -202,7 +660,39 @@ static esp_err_t i2c_sensors_init(void)
 }
 
 /**
- * Read data from a specific sensor
+ * Identify, test and start every sensor through its driver. A sensor that
+ * fails is still read; its channels will simply come back invalid.
+ */
+static void sensors_init(void)
+{
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        SensorConfig_t *sensor = &sensors[i];
+        const SensorDriver_t *driver = sensor->driver;
+
+        esp_err_t ret = driver->init(&sensor->dev);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s (%s) not found: %s", sensor->name, driver->name, esp_err_to_name(ret));
+            continue;
+        }
+
+        ret = driver->self_test(&sensor->dev);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "%s (%s) self test failed: %s", sensor->name, driver->name, esp_err_to_name(ret));
+        }
+
+        ret = driver->configure(&sensor->dev, sensor->rate_hz, sensor->drdy_gpio >= 0);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s (%s) configuration failed: %s", sensor->name, driver->name, esp_err_to_name(ret));
+            continue;
+        }
+
+        ESP_LOGI(TAG, "%s is a %s with %d channels", sensor->name, driver->name, driver->channel_count);
+    }
+}
+
+/**
+ * Start reading data from a specific sensor; the result arrives through
+ * i2c_async_wait()
  */
 static esp_err_t sensor_read_data(int sensor_idx, uint8_t *data)
 {
@@ -210,14 +700,7 @@ static esp_err_t sensor_read_data(int sensor_idx, uint8_t *data)
     
     SensorConfig_t *sensor = &sensors[sensor_idx];
     
-    return i2c_master_transmit_receive(
-        sensor->dev_handle,
-        &sensor->data_reg,
-        1,
-        data,
-        sensor->data_len,
-        I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS
-    );
+    return i2c_async_read(sensor_idx, &sensor->driver->data_reg, data, sensor->driver->raw_len);
 }
 
 /**
@@ -234,18 +717,22 @@ static esp_err_t sd_card_init(void)
     };
     
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;  // 40MHz for speed
+    host.max_freq_khz = SD_FREQ_KHZ;
     
     sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-    slot_config.width = 1;  // 1-bit mode (use 4 for 4-bit if wired)
+    slot_config.width = SD_BUS_WIDTH;
     slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
     
-    // Set GPIO pins for SD card (adjust for your board)
-    // Default ESP32: CLK=14, CMD=15, D0=2 (conflicts with LED!)
-    // You may need to change these
-    slot_config.clk = GPIO_NUM_14;
-    slot_config.cmd = GPIO_NUM_15;
-    slot_config.d0 = GPIO_NUM_2;
+#ifdef CONFIG_SOC_SDMMC_USE_GPIO_MATRIX
+    slot_config.clk = SD_PIN_CLK;
+    slot_config.cmd = SD_PIN_CMD;
+    slot_config.d0 = SD_PIN_D0;
+#if SD_BUS_WIDTH == 4
+    slot_config.d1 = SD_PIN_D1;
+    slot_config.d2 = SD_PIN_D2;
+    slot_config.d3 = SD_PIN_D3;
+#endif
+#endif
     
     esp_err_t ret = esp_vfs_fat_sdmmc_mount(MOUNT_POINT, &host, &slot_config, &mount_config, &sd_card);
     
@@ -256,204 +743,1327 @@ static esp_err_t sd_card_init(void)
     
     ESP_LOGI(TAG, "SD card mounted successfully");
     sdmmc_card_print_info(stdout, sd_card);
+
+    // The card may not support high speed, or the host may have fallen back
+    // to fewer data lines
+    int width = 1 << sd_card->log_bus_width;
+    ESP_LOGI(TAG, "SD bus: %d-bit at %d kHz", width, sd_card->real_freq_khz);
+    if (width != SD_BUS_WIDTH || sd_card->real_freq_khz < SD_FREQ_KHZ) {
+        ESP_LOGW(TAG, "SD bus runs below the configured %d-bit at %d kHz", SD_BUS_WIDTH, SD_FREQ_KHZ);
+    }
     
     return ESP_OK;
 }
 
 /**
- * Open data file and write CSV header
+ * Fill in one sensor's entry and append its channels
  */
-static esp_err_t open_data_file(void)
+static void describe_sensor(log_sensor_desc_t *desc, log_channel_desc_t *channels, size_t *channel_count,
+                            const char *name, const char *driver, uint8_t address, uint16_t rate_hz,
+                            const SensorChannel_t *sensor_channels, uint8_t count)
 {
-    // Check if file exists to decide whether to write header
-    struct stat st;
-    bool file_exists = (stat(DATA_FILE, &st) == 0);
-    
-    data_file = fopen(DATA_FILE, "a");  // Append mode
-    if (data_file == NULL) {
-        ESP_LOGE(TAG, "Failed to open data file");
-        return ESP_FAIL;
-    }
-    
-    // Write CSV header if new file
-    if (!file_exists) {
-        fprintf(data_file, "timestamp_ms,sample_num,");
-        for (int i = 0; i < NUM_SENSORS; i++) {
-            for (int j = 0; j < sensors[i].data_len; j++) {
-                fprintf(data_file, "%s_byte%d", sensors[i].name, j);
-                if (i < NUM_SENSORS - 1 || j < sensors[i].data_len - 1) {
-                    fprintf(data_file, ",");
-                }
-            }
-        }
-        fprintf(data_file, "\n");
-        fflush(data_file);
-        ESP_LOGI(TAG, "Created new data file with header: %s", DATA_FILE);
-    } else {
-        ESP_LOGI(TAG, "Appending to existing file: %s", DATA_FILE);
+    strncpy(desc->name, name, LOG_SENSOR_NAME_LEN - 1);
+    strncpy(desc->driver, driver, LOG_DRIVER_NAME_LEN - 1);
+    desc->address = address;
+    desc->channel_count = count;
+    desc->rate_hz = rate_hz;
+
+    for (int c = 0; c < count; c++) {
+        log_channel_desc_t *ch = &channels[(*channel_count)++];
+        strncpy(ch->name, sensor_channels[c].name, LOG_CHANNEL_NAME_LEN - 1);
+        strncpy(ch->unit, sensor_channels[c].unit, LOG_CHANNEL_UNIT_LEN - 1);
+        ch->scale = sensor_channels[c].scale;
     }
-    
-    return ESP_OK;
 }
 
 /**
- * Task running on Core 0 - SD card writing
+ * Describe the sensor table, and the fusion after it, in the on-disk format
  */
-static void task_sd_write(void *pvParameters)
+static size_t build_log_header(uint8_t *buf, size_t buf_len)
 {
-    ESP_LOGI(TAG, "SD Write task started on Core 0");
-    
-    uint8_t read_buffer[SAMPLE_SIZE];
-    uint32_t lines_written = 0;
-    
-    while (1) {
-        // Wait for data
-        if (xSemaphoreTake(ring_buffer.data_available, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            size_t bytes_read = ring_buffer_read(read_buffer, SAMPLE_SIZE);
-            
-            if (bytes_read > 0 && data_file != NULL) {
-                // Parse the buffer: [timestamp (4)] [sample_num (4)] [sensor1 data] [sensor2 data] [sensor3 data]
-                uint32_t timestamp, sample_num;
-                memcpy(&timestamp, read_buffer, sizeof(timestamp));
-                memcpy(&sample_num, read_buffer + 4, sizeof(sample_num));
-                
-                // Write CSV line: timestamp, sample_num, then all sensor bytes
-                fprintf(data_file, "%lu,%lu", (unsigned long)timestamp, (unsigned long)sample_num);
-                
-                // Write sensor data bytes
-                size_t offset = 8;  // After timestamp and sample_num
-                for (int i = 0; i < NUM_SENSORS; i++) {
-                    for (int j = 0; j < sensors[i].data_len; j++) {
-                        fprintf(data_file, ",%d", read_buffer[offset + j]);
-                    }
-                    offset += sensors[i].data_len;
-                }
-                fprintf(data_file, "\n");
-                
-                lines_written++;
-                
-                // Flush every 100 lines to ensure data is saved
-                if (lines_written % 100 == 0) {
-                    fflush(data_file);
-                    ESP_LOGI(TAG, "SD: Written %lu lines", (unsigned long)lines_written);
-                }
-            }
-        }
+    static log_channel_desc_t channels[NUM_LOG_SENSORS * LOG_MAX_CHANNELS];
+    log_sensor_desc_t desc[NUM_LOG_SENSORS];
+    size_t channel_count = 0;
+    memset(desc, 0, sizeof(desc));
+    memset(channels, 0, sizeof(channels));
+
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        const SensorDriver_t *driver = sensors[i].driver;
+        describe_sensor(&desc[i], channels, &channel_count, sensors[i].name, driver->name, sensors[i].address,
+                        sensors[i].rate_hz, driver->channels, driver->channel_count);
     }
+#if FUSION_RATE_HZ > 0
+    describe_sensor(&desc[FUSION_SENSOR], channels, &channel_count, "Fusion", "fusion", 0, FUSION_RATE_HZ,
+                    fusion_channels, FUSION_CHANNELS);
+#endif
+
+    return log_format_build_header(buf, buf_len, desc, NUM_LOG_SENSORS, channels, channel_count, max_record_len);
 }
 
 /**
- * Task running on Core 1 - Sensor reading
- * Reads all sensors sequentially as fast as possible
+ * Sync f, then rewrite its header: FATFS writes back the file size and the
+ * FAT on fsync, and only then may the header claim the blocks
  */
-static void task_sensor_read(void *pvParameters)
+static esp_err_t sync_header(FILE *f, const uint8_t *header)
 {
-    ESP_LOGI(TAG, "Sensor Read task started on Core 1");
-    
-    uint32_t sample_count = 0;
-    uint8_t sensor_data[DATA_READ_LEN];
-    
-    // Buffer to hold combined data from all sensors + timestamp
-    // Format: [timestamp (4 bytes)] [sensor1 data] [sensor2 data] [sensor3 data]
-    uint8_t combined_data[SAMPLE_SIZE];
-    
-    while (1) {
-        uint32_t start_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        size_t offset = 0;
-        
-        // Add timestamp at the beginning
-        memcpy(combined_data, &start_time, sizeof(start_time));
-        offset += sizeof(start_time);
-        
-        // Add sample counter
-        memcpy(combined_data + offset, &sample_count, sizeof(sample_count));
-        offset += sizeof(sample_count);
-        
-        // Read all sensors sequentially (as fast as possible)
-        for (int i = 0; i < NUM_SENSORS; i++) {
-            esp_err_t ret = sensor_read_data(i, sensor_data);
-            
-            if (ret == ESP_OK) {
-                // Copy sensor data to combined buffer
-                memcpy(combined_data + offset, sensor_data, sensors[i].data_len);
-            } else {
-                // Fill with zeros on error (or could use error marker)
-                memset(combined_data + offset, 0xFF, sensors[i].data_len);
-                ESP_LOGW(TAG, "Failed to read %s: %s", sensors[i].name, esp_err_to_name(ret));
-            }
-            offset += sensors[i].data_len;
-        }
-        
-        // Write combined data to ring buffer
-        size_t written = ring_buffer_write(combined_data, offset);
-        
-        if (written > 0) {
-            sample_count++;
-            // Only log occasionally to not slow down
-            if (sample_count % 100 == 0) {
-                uint32_t elapsed = (xTaskGetTickCount() * portTICK_PERIOD_MS) - start_time;
-                ESP_LOGI(TAG, "Sample %lu: %d bytes in %lu ms", sample_count, written, elapsed);
-            }
-        }
-        
-        // Minimal delay - just yield to other tasks
-        // Remove or reduce this for maximum speed
-        vTaskDelay(pdMS_TO_TICKS(10));  // 100 Hz sampling rate
+    esp_err_t ret = ESP_OK;
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+        ESP_LOGE(TAG, "Failed to sync the log");
+        ret = ESP_FAIL;
+    }
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(header, 1, LOG_BLOCK_SIZE, f) != LOG_BLOCK_SIZE) {
+        ESP_LOGE(TAG, "Failed to update the log header");
+        ret = ESP_FAIL;
     }
+    return ret;
 }
 
+/**
+ * Make everything up to data_end durable, then record data_end and the
+ * segment's counts in the header. Runs once per checkpoint interval unless
+ * forced; a power cut in between loses what the card had not stored yet,
+ * recovery at the next boot finds the rest.
+ */
+static void checkpoint(bool force)
+{
+    if (data_file == NULL) {
+        return;
+    }
+    if (!force && (data_end == header_end ||
+                   xTaskGetTickCount() - checkpoint_ticks < pdMS_TO_TICKS(LOG_CHECKPOINT_MS))) {
+        return;
+    }
+
+    // The header goes through the same handle as the blocks, so no stale
+    // file size can be written back over the one just synced
+    log_format_set_data_end(log_header, data_end);
+    log_format_set_flags(log_header, (data_end < prealloc_end) ? LOG_FILE_PREALLOCATED : 0);
+    log_format_set_segment(log_header, &segment);
+    sync_header(data_file, log_header);
+    fseek(data_file, data_end, SEEK_SET);
 
+    if (header_end < prealloc_end && data_end >= prealloc_end) {
+        ESP_LOGW(TAG, "No pre-allocated space left, %s grows as it is written", segment_path);
+    }
+    header_end = data_end;
+    checkpoint_ticks = xTaskGetTickCount();
+}
 
 /**
- * Cleanup on shutdown
+ * Reserve contiguous clusters for a new segment, LOG_PREALLOC_BYTES but no
+ * more than it may grow to, so FATFS never has to extend the cluster chain
+ * while logging
  */
-static void cleanup(void)
+static void preallocate_segment(void)
 {
-    if (data_file != NULL) {
-        fflush(data_file);
-        fclose(data_file);
-        data_file = NULL;
-        ESP_LOGI(TAG, "Data file closed");
+    uint32_t size = (LOG_PREALLOC_BYTES < LOG_SEGMENT_BYTES) ? (uint32_t)LOG_PREALLOC_BYTES : LOG_SEGMENT_BYTES;
+    if (size == 0) {
+        return;
     }
-    
-    if (sd_card != NULL) {
-        esp_vfs_fat_sdcard_unmount(MOUNT_POINT, sd_card);
-        sd_card = NULL;
-        ESP_LOGI(TAG, "SD card unmounted");
+    esp_err_t ret = esp_vfs_fat_create_contiguous_file(MOUNT_POINT, segment_path, size, true);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Could not pre-allocate %lu MiB (%s), the file grows as it is written",
+                 (unsigned long)(size / (1024 * 1024)), esp_err_to_name(ret));
+        return;
     }
+    prealloc_end = size;
+    ESP_LOGI(TAG, "Pre-allocated %lu MiB for %s", (unsigned long)(size / (1024 * 1024)), segment_path);
 }
 
-void app_main(void)
+/**
+ * Number of the block at file offset: blocks are numbered by position
+ */
+static inline uint32_t block_seq_at(uint32_t offset)
 {
-    ESP_LOGI(TAG, "=== Star PI Payload Main ===");
-    
-    // Initialize SD card FIRST
-    esp_err_t ret = sd_card_init();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "SD card init failed! Continuing without logging...");
-    } else {
-        // Open data file for writing
-        ret = open_data_file();
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to open data file!");
-        }
+    return (offset - LOG_BLOCK_SIZE) / LOG_BLOCK_SIZE;
+}
+
+/**
+ * Close the newest segment on the card if the device went down while
+ * writing it: adopt the blocks after its last checkpoint that are valid and
+ * carry the number of their position, count their samples, cut off the
+ * rest and list the segment in the index. Returns the flight it belongs
+ * to, 0 if the card holds none.
+ */
+static uint16_t recover_last_segment(void)
+{
+    uint16_t flight, seg;
+    if (log_index_find_last(MOUNT_POINT, &flight, &seg) != ESP_OK) {
+        return 0;
     }
-    
-    // Initialize I2C and sensors
-    ESP_ERROR_CHECK(i2c_sensors_init());
-    
-    // Initialize ring buffer
-    init_ring_buffer();
 
-    // Create tasks with larger stack for file operations
-    xTaskCreatePinnedToCore(task_sd_write, "sd_write", 8192, NULL, 5, &task_core0_handle, 0);
-    xTaskCreatePinnedToCore(task_sensor_read, "sensor_read", 4096, NULL, 6, &task_core1_handle, 1);
-    
-    ESP_LOGI(TAG, "Both tasks created and running!");
-    ESP_LOGI(TAG, "Data will be saved to: %s", DATA_FILE);
-    
-    while (1) {
-        ESP_LOGI(TAG, "Main: buffer has %d bytes", ring_buffer_available());
+    char path[sizeof(segment_path)];
+    char name[LOG_SEGMENT_NAME_LEN];
+    log_index_segment_name(name, flight, seg);
+    snprintf(path, sizeof(path), MOUNT_POINT "/%s", name);
+
+    uint8_t *header = malloc(LOG_BLOCK_SIZE);
+    uint8_t *block = malloc(LOG_BLOCK_SIZE);
+    FILE *f = fopen(path, "r+b");
+    struct stat st;
+    log_file_header_t fh = { 0 };
+    if (header == NULL || block == NULL || f == NULL || fstat(fileno(f), &st) != 0) {
+        ESP_LOGE(TAG, "Cannot read %s", path);
+        goto out;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+    if (fread(header, 1, LOG_BLOCK_SIZE, f) == LOG_BLOCK_SIZE) {
+        memcpy(&fh, header, sizeof(fh));
+    }
+    if (fh.magic != LOG_FILE_MAGIC || fh.version != LOG_FORMAT_VERSION || fh.header_len != LOG_BLOCK_SIZE) {
+        // A header that never reached the card leaves nothing to recover
+        ESP_LOGW(TAG, "%s has no usable log header, leaving it as it is", path);
+        goto out;
+    }
+    if (fh.flags & LOG_FILE_CLOSED) {
+        goto out;
+    }
+
+    uint32_t end = fh.data_end;
+    if (end < LOG_BLOCK_SIZE || end > st.st_size || end % LOG_BLOCK_SIZE != 0) {
+        end = LOG_BLOCK_SIZE;
+        fh.segment.samples = 0;
+    }
+
+    log_block_header_t bh;
+    uint32_t recovered = 0;
+    fseek(f, end, SEEK_SET);
+    while (end + LOG_BLOCK_SIZE <= st.st_size && fread(block, 1, LOG_BLOCK_SIZE, f) == LOG_BLOCK_SIZE &&
+           log_format_check_block(block, LOG_BLOCK_SIZE, fh.file_id, &bh) && bh.seq == block_seq_at(end)) {
+        log_format_count_block(block, &fh.segment);
+        end += LOG_BLOCK_SIZE;
+        recovered++;
+    }
+
+    // Reserved space and any torn block go; the index lists the segment
+    // before it is marked closed, so a power cut in between lists it twice
+    // rather than never
+    if (st.st_size != end && ftruncate(fileno(f), end) != 0) {
+        ESP_LOGW(TAG, "Failed to truncate %s", path);
+    }
+    log_format_set_data_end(header, end);
+    log_format_set_flags(header, 0);
+    log_format_set_segment(header, &fh.segment);
+    if (sync_header(f, header) == ESP_OK && log_index_append(MOUNT_POINT, &fh.segment, end) == ESP_OK) {
+        log_format_set_flags(header, LOG_FILE_CLOSED);
+        sync_header(f, header);
+    }
+    ESP_LOGW(TAG, "Closed %s of an interrupted flight: %lu blocks recovered, %lu samples in all", path,
+             (unsigned long)recovered, (unsigned long)fh.segment.samples);
+
+out:
+    if (f != NULL) {
+        fclose(f);
+    }
+    free(block);
+    free(header);
+    return flight;
+}
+
+/**
+ * Start segment seg of a flight: a new file, pre-allocated when configured,
+ * whose header is synced before any block goes in
+ */
+static esp_err_t open_segment(uint16_t flight, uint16_t seg)
+{
+    log_index_segment_name(segment_name, flight, seg);
+    snprintf(segment_path, sizeof(segment_path), MOUNT_POINT "/%s", segment_name);
+
+    prealloc_end = 0;
+    preallocate_segment();
+
+    // Blocks are written in place rather than appended, the file may be
+    // longer than its data
+    data_file = fopen(segment_path, (prealloc_end > 0) ? "r+b" : "w+b");
+    if (data_file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", segment_path);
+        return ESP_FAIL;
+    }
+
+    // Blocks are already sector sized, stdio buffering would only add a copy
+    setvbuf(data_file, NULL, _IONBF, 0);
+
+    file_id = esp_random();
+    data_end = LOG_BLOCK_SIZE;
+    header_end = 0;
+    segment = (log_segment_t){ .flight = flight, .segment = seg };
+    log_format_set_file_id(log_header, file_id);
+    checkpoint(true);
+    ESP_LOGI(TAG, "Logging to %s", segment_path);
+
+#if CONFIG_LOGGER_RAW_SECTORS
+    // Only clusters reserved in one go are known to be contiguous
+    raw_writes = false;
+    if (prealloc_end > 0) {
+        raw_writes = (sd_raw_open(&raw_extent, sd_card, segment_name) == ESP_OK);
+        if (raw_writes) {
+            ESP_LOGI(TAG, "Writing blocks straight to card sectors");
+        } else {
+            ESP_LOGW(TAG, "Cannot locate %s on the card, writing through the file system", segment_path);
+        }
+    }
+#endif
+
+    return ESP_OK;
+}
+
+/**
+ * Finish the segment being written: hand back its unused reservation, list
+ * it in the index, then mark it closed
+ */
+static void close_segment(void)
+{
+    if (data_file == NULL) {
+        return;
+    }
+    if (prealloc_end > data_end) {
+        if (ftruncate(fileno(data_file), data_end) != 0) {
+            ESP_LOGW(TAG, "Failed to truncate %s", segment_path);
+        }
+        prealloc_end = data_end;
+    }
+    checkpoint(true);
+    if (log_index_append(MOUNT_POINT, &segment, data_end) == ESP_OK) {
+        log_format_set_flags(log_header, LOG_FILE_CLOSED);
+        sync_header(data_file, log_header);
+    }
+    fclose(data_file);
+    data_file = NULL;
+    raw_writes = false;
+    ESP_LOGI(TAG, "Closed %s: %lu samples, %lu KiB", segment_path, (unsigned long)segment.samples,
+             (unsigned long)(data_end / 1024));
+}
+
+/**
+ * Whether the next block belongs in a new segment: this one is full or its
+ * first block is LOGGER_SEGMENT_SECONDS old. The last segment name a flight has
+ * grows on instead.
+ */
+static bool segment_due(void)
+{
+    if (segment.segment >= LOG_MAX_SEGMENT || data_end == LOG_BLOCK_SIZE) {
+        return false;
+    }
+    return data_end + LOG_BLOCK_SIZE > LOG_SEGMENT_BYTES ||
+           (LOG_SEGMENT_SECONDS > 0 &&
+            xTaskGetTickCount() - segment_started >= pdMS_TO_TICKS(LOG_SEGMENT_SECONDS * 1000ULL));
+}
+
+/**
+ * Start this boot's flight after the newest one on the card, closing that
+ * one first if it was cut short
+ */
+static esp_err_t open_flight(void)
+{
+    // Header is padded to a full sector so every block after it stays aligned
+    build_log_header(log_header, sizeof(log_header));
+
+    uint16_t flight = recover_last_segment() + 1;
+    if (flight > LOG_MAX_FLIGHT) {
+        ESP_LOGE(TAG, "The card holds flight %d already, no number left", LOG_MAX_FLIGHT);
+        return ESP_ERR_INVALID_STATE;
+    }
+    return open_segment(flight, 0);
+}
+
+/**
+ * Create the block pool shared by the drain and flush tasks
+ */
+static void init_log_blocks(void)
+{
+    free_blocks = xQueueCreate(LOG_NUM_BLOCKS, sizeof(LogBlock_t *));
+    full_blocks = xQueueCreate(LOG_NUM_BLOCKS, sizeof(LogBlock_t *));
+
+    for (int i = 0; i < LOG_NUM_BLOCKS; i++) {
+        LogBlock_t *block = &log_blocks[i];
+        xQueueSend(free_blocks, &block, 0);
+    }
+}
+
+/**
+ * Write one block at data_end, as a single multi-sector command while the
+ * raw extent lasts and through the file system after that
+ */
+static esp_err_t write_block(const uint8_t *data)
+{
+    if (raw_writes && data_end + LOG_BLOCK_SIZE <= raw_extent.size) {
+        return sd_raw_write(&raw_extent, data_end, data, LOG_BLOCK_SIZE);
+    }
+    // The stdio position is wherever the header or a failed write left it
+    raw_writes = false;
+    if (fseek(data_file, data_end, SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    return (fwrite(data, 1, LOG_BLOCK_SIZE, data_file) == LOG_BLOCK_SIZE) ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Account for a block that never reached the card: its sample records are
+ * lost, the gap records it carried are folded in with them. The SD task
+ * writes the result ahead of its next block.
+ */
+static void give_up_block(const LogBlock_t *block)
+{
+    RingSpan_t span = {
+        .ptr = { (uint8_t *)block->data + sizeof(log_block_header_t), NULL },
+        .len = { block->payload_len, 0 },
+    };
+    PendingGap_t lost = { 0 };
+    size_t pos = 0;
+
+    while (pos + sizeof(log_record_header_t) <= block->payload_len) {
+        log_record_header_t header;
+        ring_span_read(&span, pos, &header, sizeof(header));
+        if (header.type == LOG_RECORD_GAP) {
+            PendingGap_t gap;
+            gap_decode(&span, pos, &gap);
+            gap_merge(&lost, &gap);
+        } else if (header.type == LOG_RECORD_SAMPLE) {
+            gap_add(&lost, header.seq, header.sensor_mask, header.sample_num,
+                    header.timestamp_us, LOG_GAP_WRITE_FAILED);
+        }
+        pos += header.len;
+    }
+
+    portENTER_CRITICAL(&flush_gap_lock);
+    gap_merge(&flush_gap, &lost);
+    portEXIT_CRITICAL(&flush_gap_lock);
+}
+
+/**
+ * Task running on Core 0 - writes full blocks to the SD card
+ * Every write is exactly one sector, so FATFS never has to read-modify-write
+ */
+static void task_sd_flush(void *pvParameters)
+{
+    const TickType_t interval = pdMS_TO_TICKS(LOG_CHECKPOINT_MS);
+    uint32_t blocks_written = 0;
+    uint32_t records_written = 0;
+    bool reopen = false;            // The next segment has yet to be opened
+    LogBlock_t *block;
+
+    while (1) {
+        // Wake up in time to checkpoint once blocks stop coming
+        TickType_t wait = portMAX_DELAY;
+        if (data_file != NULL && data_end != header_end) {
+            TickType_t age = xTaskGetTickCount() - checkpoint_ticks;
+            wait = (age < interval) ? interval - age : 0;
+        }
+        if (xQueueReceive(full_blocks, &block, wait) != pdTRUE) {
+            checkpoint(false);
+            continue;
+        }
+
+        if (data_file != NULL && segment_due()) {
+            close_segment();
+            reopen = true;
+        }
+        // segment still names the one closed; until the next opens, blocks
+        // are lost with a gap record
+        if (reopen && open_segment(segment.flight, segment.segment + 1) == ESP_OK) {
+            reopen = false;
+        }
+
+        if (data_file == NULL) {
+            give_up_block(block);
+        } else {
+            if (data_end == LOG_BLOCK_SIZE) {
+                segment_started = xTaskGetTickCount();
+            }
+            uint32_t seq = block_seq_at(data_end);
+            log_format_seal_block(block->data, LOG_BLOCK_SIZE, file_id, seq,
+                                  block->payload_len, block->records);
+            esp_err_t ret = write_block(block->data);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "SD: Failed to write block %lu: %s", (unsigned long)seq, esp_err_to_name(ret));
+                give_up_block(block);
+            } else {
+                log_format_count_block(block->data, &segment);
+            }
+            // A failed block keeps its place, so the next one still carries
+            // the number of its position
+            data_end += LOG_BLOCK_SIZE;
+            checkpoint(false);
+            blocks_written++;
+            records_written += block->records;
+
+            if (blocks_written % 10 == 0) {
+                ESP_LOGI(TAG, "SD: Written %lu records", (unsigned long)records_written);
+            }
+        }
+
+        xQueueSend(free_blocks, &block, portMAX_DELAY);
+    }
+}
+
+/**
+ * Overwrite-oldest: only the SD task may move the read index, so it discards
+ * the oldest records itself while the card holds every block, keeping room
+ * for new samples. Gap records it discards are folded into its own.
+ */
+static void discard_oldest(void)
+{
+    RingSpan_t span;
+    size_t available = ring_buffer_peek(&ring_buffer, &span);
+    size_t len = 0;
+
+    while (available - len > OVERWRITE_KEEP_BYTES) {
+        log_record_header_t header;
+        ring_span_read(&span, len, &header, sizeof(header));
+        if (header.type == LOG_RECORD_GAP) {
+            PendingGap_t gap;
+            gap_decode(&span, len, &gap);
+            gap_merge(&writer_gap, &gap);
+        } else if (header.type == LOG_RECORD_SAMPLE) {
+            gap_add(&writer_gap, header.seq, header.sensor_mask, header.sample_num,
+                    header.timestamp_us, LOG_GAP_OVERWRITTEN);
+        }
+        len += header.len;
+    }
+
+    if (len > 0) {
+        ring_buffer_release(&ring_buffer, len);
+    }
+}
+
+/**
+ * Until launch nothing goes to the card. The ring keeps the newest
+ * PRETRIGGER_MS of records, but never more than half of itself so it can
+ * still bridge a card stall right after launch. Older sample records are
+ * folded into the gap record that will lead the log, and the newest pad
+ * event among them is kept to follow it, so the log still says when the
+ * tracker armed.
+ */
+static void hold_pretrigger(void)
+{
+#if CONFIG_FLIGHT_LAUNCH_TRIGGER
+    const int64_t oldest_us = esp_timer_get_time() - PRETRIGGER_MS * 1000LL;
+    RingSpan_t span;
+    size_t available = ring_buffer_peek(&ring_buffer, &span);
+    size_t len = 0;
+
+    while (available - len >= sizeof(log_record_header_t)) {
+        log_record_header_t header;
+        ring_span_read(&span, len, &header, sizeof(header));
+        if (header.type == LOG_RECORD_GAP) {
+            PendingGap_t gap;
+            gap_decode(&span, len, &gap);
+            gap_merge(&writer_gap, &gap);
+        } else if (header.timestamp_us >= oldest_us && available - len <= ring_buffer.size / 2) {
+            break;
+        } else if (header.type == LOG_RECORD_SAMPLE) {
+            gap_add(&writer_gap, header.seq, header.sensor_mask, header.sample_num,
+                    header.timestamp_us, LOG_GAP_STANDBY);
+        } else if (header.type == LOG_RECORD_EVENT && header.len <= sizeof(held_event)) {
+            ring_span_read(&span, len, held_event, header.len);
+            held_event_len = header.len;
+        }
+        len += header.len;
+    }
+
+    if (len > 0) {
+        ring_buffer_release(&ring_buffer, len);
+    }
+#endif
+}
+
+/**
+ * Take an empty block, opened with the gap record for whatever was
+ * discarded while waiting for it, and any pad event the pre-trigger hold
+ * carried
+ */
+static LogBlock_t *take_free_block(void)
+{
+#if CONFIG_LOGGER_OVERFLOW_OVERWRITE_OLDEST
+    const TickType_t wait = OVERWRITE_POLL_TICKS;
+#else
+    const TickType_t wait = portMAX_DELAY;
+#endif
+    LogBlock_t *block;
+    while (xQueueReceive(free_blocks, &block, wait) != pdTRUE) {
+        discard_oldest();
+    }
+    block->payload_len = 0;
+    block->records = 0;
+
+    portENTER_CRITICAL(&flush_gap_lock);
+    gap_merge(&writer_gap, &flush_gap);
+    memset(&flush_gap, 0, sizeof(flush_gap));
+    portEXIT_CRITICAL(&flush_gap_lock);
+
+    if (writer_gap.records > 0) {
+        block->payload_len = gap_encode(&writer_gap, block->data + sizeof(log_block_header_t));
+        block->records = 1;
+        gap_written(&writer_gap);
+    }
+    if (held_event_len > 0) {
+        memcpy(block->data + sizeof(log_block_header_t) + block->payload_len, held_event, held_event_len);
+        block->payload_len += held_event_len;
+        block->records++;
+        held_event_len = 0;
+    }
+    return block;
+}
+
+/**
+ * Task running on Core 0 - drains the ring buffer into write blocks
+ * Samples are copied verbatim; no formatting on this core. A partially
+ * filled block is sent anyway once it is LOG_FLUSH_LATENCY_MS old, which
+ * bounds how much data a crash can take with it.
+ */
+static void task_sd_write(void *pvParameters)
+{
+    ESP_LOGI(TAG, "SD Write task started on Core 0");
+
+    const TickType_t max_latency = pdMS_TO_TICKS(LOG_FLUSH_LATENCY_MS);
+    LogBlock_t *block = NULL;
+    TickType_t block_opened = 0;
+
+    while (1) {
+        // Wait for data, but never past the current block's flush deadline
+        TickType_t wait = pdMS_TO_TICKS(1000);
+        if (block != NULL) {
+            TickType_t age = xTaskGetTickCount() - block_opened;
+            wait = (age < max_latency) ? max_latency - age : 0;
+        }
+        xSemaphoreTake(data_available, wait);
+
+        if (atomic_load(&pretrigger_hold)) {
+            hold_pretrigger();
+            continue;
+        }
+
+        // Drain everything that is available, not just one record
+        RingSpan_t span;
+        size_t available;
+        while ((available = ring_buffer_peek(&ring_buffer, &span)) >= sizeof(log_record_header_t)) {
+            if (block == NULL) {
+                block = take_free_block();
+                block_opened = xTaskGetTickCount();
+                continue;   // Records may have been discarded while waiting
+            }
+
+            // Walk the record lengths to find the whole records that fit
+            size_t room = LOG_BLOCK_SIZE - sizeof(log_block_header_t) - block->payload_len;
+            size_t len = 0;
+            uint16_t count = 0;
+            uint16_t next_len = 0;
+            while (len + sizeof(next_len) <= available) {
+                ring_span_read(&span, len, &next_len, sizeof(next_len));
+                if (len + next_len > available || len + next_len > room) {
+                    break;
+                }
+                len += next_len;
+                count++;
+            }
+
+            // Move them straight out of ring memory
+            ring_span_read(&span, 0, block->data + sizeof(log_block_header_t) + block->payload_len, len);
+            ring_buffer_release(&ring_buffer, len);
+            block->payload_len += len;
+            block->records += count;
+
+            // Hand the block over once the next record would no longer fit
+            if (room - len < max_record_len) {
+                xQueueSend(full_blocks, &block, portMAX_DELAY);
+                block = NULL;
+            } else if (count == 0) {
+                break;  // Only a partial record so far
+            }
+        }
+
+        if (block != NULL && xTaskGetTickCount() - block_opened >= max_latency) {
+            xQueueSend(full_blocks, &block, portMAX_DELAY);
+            block = NULL;
+        }
+    }
+}
+
+/**
+ * On the pad and after landing sensors are read at 1/PAD_RATE_DIVIDER of
+ * their rate. The samples in between are never taken, so they get no
+ * sequence number and no gap record.
+ */
+static bool pad_skip(int sensor_idx)
+{
+    static uint32_t counts[NUM_SENSORS];
+    if (PAD_RATE_DIVIDER == 1 || flight_state_flying(&flight)) {
+        return false;
+    }
+    return counts[sensor_idx]++ % PAD_RATE_DIVIDER != 0;
+}
+
+/**
+ * Log the state the flight tracker just entered, stamped when it began.
+ * Entering boost ends the pre-trigger hold.
+ */
+static void log_flight_event(FlightState_t previous, uint32_t tick)
+{
+    log_record_header_t header = {
+        .len = sizeof(log_record_header_t) + sizeof(log_flight_event_t),
+        .type = LOG_RECORD_EVENT,
+        .seq = record_seq,
+        .sample_num = tick,
+        .timestamp_us = flight.entered_us,
+    };
+    log_flight_event_t event = {
+        .state = flight.state,
+        .previous = previous,
+        .altitude_cm = (int32_t)(flight.altitude_m * 100),
+    };
+    ESP_LOGI(TAG, "Flight: %s at %.1f m", flight_state_name(flight.state), flight.altitude_m);
+
+    RingSpan_t span;
+    size_t offset;
+    if (reserve_records(header.len, &span, &offset)) {
+        ring_span_write(&span, offset, &header, sizeof(header));
+        ring_span_write(&span, offset + sizeof(header), &event, sizeof(event));
+        commit_records(offset + header.len);
+    } else {
+        ESP_LOGW(TAG, "No room to log the %s event", flight_state_name(flight.state));
+    }
+
+    if (flight.state == FLIGHT_BOOST) {
+        atomic_store(&pretrigger_hold, false);
+    }
+}
+
+/**
+ * Feed a decoded reading to the flight tracker if it is one it follows
+ */
+static void track_flight(int sensor_idx, const int32_t *values, int64_t t_us, uint32_t tick)
+{
+    const SensorChannel_t *channels = sensors[sensor_idx].driver->channels;
+    FlightState_t previous = flight.state;
+    bool changed;
+
+    if (sensor_idx == FLIGHT_IMU_SENSOR) {
+        changed = flight_state_accel(&flight, t_us, values[0] / (float)channels[0].scale,
+                                     values[1] / (float)channels[1].scale, values[2] / (float)channels[2].scale);
+    } else if (sensor_idx == FLIGHT_BARO_SENSOR && values[FLIGHT_BARO_CHANNEL] != SENSOR_VALUE_INVALID) {
+        changed = flight_state_pressure(&flight, t_us,
+                                        values[FLIGHT_BARO_CHANNEL] / (float)channels[FLIGHT_BARO_CHANNEL].scale);
+    } else {
+        return;
+    }
+    if (changed) {
+        log_flight_event(previous, tick);
+    }
+}
+
+/**
+ * Feed a decoded reading to the fusion if it is one it uses, counting the
+ * cycles the update took
+ */
+static void fuse_reading(int sensor_idx, const int32_t *values, int64_t t_us)
+{
+#if FUSION_RATE_HZ > 0
+    const SensorChannel_t *channels = sensors[sensor_idx].driver->channels;
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+
+    if (sensor_idx == FLIGHT_IMU_SENSOR && fusion_gyro_channel >= 0) {
+        float accel[3], gyro[3];
+        for (int c = 0; c < 3; c++) {
+            int g = fusion_gyro_channel + c;
+            if (values[c] == SENSOR_VALUE_INVALID || values[g] == SENSOR_VALUE_INVALID) {
+                return;
+            }
+            accel[c] = values[c] / (float)channels[c].scale;
+            gyro[c] = values[g] / (float)channels[g].scale * ((float)M_PI / 180);
+        }
+        fusion_imu(&fusion, t_us, accel, gyro);
+    } else if (sensor_idx == FLIGHT_BARO_SENSOR && values[FLIGHT_BARO_CHANNEL] != SENSOR_VALUE_INVALID) {
+        float altitude = flight_state_altitude(&flight, values[FLIGHT_BARO_CHANNEL] /
+                                                        (float)channels[FLIGHT_BARO_CHANNEL].scale);
+        if (isnan(altitude)) {
+            return;
+        }
+        fusion_altitude(&fusion, altitude);
+    } else if (sensor_idx == FUSION_MAG_SENSOR) {
+        float mag[3];
+        for (int c = 0; c < 3; c++) {
+            if (values[c] == SENSOR_VALUE_INVALID) {
+                return;
+            }
+            mag[c] = values[c] / (float)channels[c].scale;
+        }
+        fusion_mag(&fusion, mag);
+    } else {
+        return;
+    }
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    portENTER_CRITICAL(&fusion_stats_lock);
+    fusion_stats.updates++;
+    fusion_stats.cycles += cycles;
+    if (cycles > fusion_stats.max_cycles) {
+        fusion_stats.max_cycles = cycles;
+    }
+    portEXIT_CRITICAL(&fusion_stats_lock);
+#endif
+}
+
+/**
+ * Copy the fusion cost, optionally starting a new window
+ */
+static void fusion_get_stats(FusionStats_t *out, bool reset)
+{
+    portENTER_CRITICAL(&fusion_stats_lock);
+    *out = fusion_stats;
+    if (reset) {
+        memset(&fusion_stats, 0, sizeof(fusion_stats));
+    }
+    portEXIT_CRITICAL(&fusion_stats_lock);
+}
+
+/**
+ * Whether the IMU record of a reading at t_us carries a fusion slot: one
+ * per fusion period, whatever rate the IMU runs at
+ */
+static bool fusion_due(int64_t t_us)
+{
+#if FUSION_RATE_HZ > 0
+    static int64_t next_us = 0;
+    const int64_t period_us = 1000000 / FUSION_RATE_HZ;
+    if (t_us < next_us) {
+        return false;
+    }
+    next_us = (t_us - next_us < period_us) ? next_us + period_us : t_us + period_us;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * mask of a lost record, with the fusion slot an IMU reading at t_us would
+ * have carried
+ */
+static uint32_t with_fusion_slot(uint32_t mask, int64_t t_us)
+{
+    if ((mask & (1 << FLIGHT_IMU_SENSOR)) && fusion_due(t_us)) {
+        mask |= 1 << FUSION_SENSOR;
+    }
+    return mask;
+}
+
+/**
+ * The fusion's output as channel values
+ */
+static void fusion_values(int32_t *out)
+{
+    FusionOutput_t output;
+    fusion_output(&fusion, &output);
+    const float values[FUSION_CHANNELS] = {
+        output.altitude_m, output.velocity_mps, output.pitch_deg, output.roll_deg, output.yaw_deg,
+    };
+    const bool valid[FUSION_CHANNELS] = {
+        output.vertical_valid, output.vertical_valid,
+        output.attitude_valid, output.attitude_valid, output.attitude_valid,
+    };
+    for (int c = 0; c < FUSION_CHANNELS; c++) {
+        out[c] = valid[c] ? (int32_t)lroundf(values[c] * fusion_channels[c].scale) : SENSOR_VALUE_INVALID;
+    }
+}
+
+/**
+ * Hand a decoded reading to the flight tracker and the fusion
+ */
+static void use_reading(int sensor_idx, const int32_t *values, int64_t t_us, uint32_t tick)
+{
+    track_flight(sensor_idx, values, t_us, tick);
+    fuse_reading(sensor_idx, values, t_us);
+}
+
+/**
+ * Burst-read a FIFO sensor and push every frame as one batch of decoded
+ * records. Frame times are interpolated back from the newest frame at the
+ * FIFO's output data rate.
+ */
+static void drain_sensor_fifo(int sensor_idx, uint32_t tick)
+{
+    static uint8_t frames[IMU_FIFO_MAX_FRAMES * MPU_FIFO_FRAME_LEN];
+    static int32_t values[IMU_FIFO_MAX_FRAMES][SENSOR_MAX_CHANNELS];
+    static int32_t fused[IMU_FIFO_MAX_FRAMES][FUSION_CHANNELS];
+    static uint32_t drain_errors = 0;
+    const SensorConfig_t *sensor = &sensors[sensor_idx];
+    size_t count;
+    int64_t newest_us;
+    
+    esp_err_t ret = mpu_fifo_drain(sensor_idx, frames, IMU_FIFO_MAX_FRAMES, &count, &newest_us);
+    const uint32_t period_us = mpu_fifo_period_us();
+    if (ret != ESP_OK) {
+        if (drain_errors++ % 100 == 0) {
+            ESP_LOGW(TAG, "Failed to drain %s: %s", sensor->name, esp_err_to_name(ret));
+        }
+        // Frames discarded with a reset FIFO are numbered and lost like any
+        // other record, except those the pad rate would have skipped
+        for (size_t k = 0; k < count; k++) {
+            if (!pad_skip(sensor_idx)) {
+                int64_t t_us = newest_us - (int64_t)(count - 1 - k) * period_us;
+                gap_add(&sensor_gap, record_seq++, with_fusion_slot(1 << sensor_idx, t_us), tick,
+                        t_us, LOG_GAP_FIFO_RESET);
+            }
+        }
+        return;
+    }
+    
+    // Decode the frames that count as taken first: flight detection and
+    // the fusion need them whether or not there is room to log them
+    int64_t times[IMU_FIFO_MAX_FRAMES];
+    uint32_t masks[IMU_FIFO_MAX_FRAMES];
+    size_t taken = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (pad_skip(sensor_idx)) {
+            continue;
+        }
+        times[taken] = newest_us - (int64_t)(count - 1 - k) * period_us;
+        sensor->driver->decode(&sensor->dev, frames + k * MPU_FIFO_FRAME_LEN, values[taken]);
+        use_reading(sensor_idx, values[taken], times[taken], tick);
+        masks[taken] = 1 << sensor_idx;
+        if (sensor_idx == FLIGHT_IMU_SENSOR && fusion_due(times[taken])) {
+            fusion_values(fused[taken]);
+            masks[taken] |= 1 << FUSION_SENSOR;
+        }
+        taken++;
+    }
+    if (taken == 0) {
+        return;
+    }
+    
+    const size_t data_len = sensor_data_len(sensor_idx);
+    const size_t rec_len = sizeof(log_record_header_t) + sizeof(log_sensor_slot_t) + data_len;
+    const uint32_t first_seq = record_seq;
+    record_seq += taken;
+    
+    // Every frame is numbered; thin them out before reserving room for the rest
+    bool keep[IMU_FIFO_MAX_FRAMES];
+    size_t kept_len = 0;
+    for (size_t k = 0; k < taken; k++) {
+        keep[k] = decimate_keep(masks[k]);
+        if (keep[k]) {
+            kept_len += rec_len + ((masks[k] >> FUSION_SENSOR) & 1) * FUSION_SLOT_LEN;
+        } else {
+            gap_add(&sensor_gap, first_seq + k, masks[k], tick, times[k], LOG_GAP_DECIMATED);
+        }
+    }
+    if (kept_len == 0) {
+        return;
+    }
+    
+    RingSpan_t span;
+    size_t offset;
+    if (!reserve_records(kept_len, &span, &offset)) {
+        for (size_t k = 0; k < taken; k++) {
+            if (keep[k]) {
+                gap_add(&sensor_gap, first_seq + k, masks[k], tick, times[k], LOG_GAP_DROPPED);
+            }
+        }
+        return;
+    }
+    
+    for (size_t k = 0; k < taken; k++) {
+        if (!keep[k]) {
+            continue;
+        }
+        log_record_header_t header = {
+            .len = rec_len,
+            .type = LOG_RECORD_SAMPLE,
+            .sensor_mask = masks[k],
+            .seq = first_seq + k,
+            .sample_num = tick,
+            .timestamp_us = times[k],
+        };
+        log_sensor_slot_t slot = { .offset_us = 0 };
+        if (masks[k] & (1 << FUSION_SENSOR)) {
+            header.len += FUSION_SLOT_LEN;
+        }
+        
+        ring_span_write(&span, offset, &header, sizeof(header));
+        ring_span_write(&span, offset + sizeof(header), &slot, sizeof(slot));
+        ring_span_write(&span, offset + sizeof(header) + sizeof(slot), values[k], data_len);
+        if (masks[k] & (1 << FUSION_SENSOR)) {
+            size_t fusion_at = offset + rec_len;
+            ring_span_write(&span, fusion_at, &slot, sizeof(slot));
+            ring_span_write(&span, fusion_at + sizeof(slot), fused[k], FUSION_SLOT_LEN - sizeof(slot));
+        }
+        offset += header.len;
+    }
+    
+    commit_records(offset);
+}
+
+/**
+ * Read the sensors in mask as one record stamped at timestamp
+ */
+static void acquire_record(uint32_t mask, int64_t timestamp, uint32_t tick)
+{
+    static uint8_t raw[NUM_SENSORS][SENSOR_MAX_RAW_LEN];
+    
+    // A thinned out record costs no bus time, only its sequence number
+    uint32_t seq = record_seq++;
+    if (!decimate_keep(mask)) {
+        gap_add(&sensor_gap, seq, with_fusion_slot(mask, timestamp), tick, timestamp, LOG_GAP_DECIMATED);
+        return;
+    }
+    
+    log_record_header_t header = {
+        .len = sizeof(log_record_header_t),
+        .type = LOG_RECORD_SAMPLE,
+        .sensor_mask = mask,
+        .seq = seq,
+        .sample_num = tick,
+        .timestamp_us = timestamp,
+    };
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if (mask & (1 << i)) {
+            header.len += sizeof(log_sensor_slot_t) + sensor_data_len(i);
+        }
+    }
+    
+    // Queue every due read; they run back to back on the bus
+    bool valid[NUM_SENSORS] = { false };
+    int pending = 0;
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if ((mask & (1 << i)) == 0) {
+            continue;
+        }
+        esp_err_t ret = sensor_read_data(i, raw[i]);
+        if (ret == ESP_OK) {
+            pending++;
+        } else {
+            ESP_LOGW(TAG, "Failed to queue %s: %s", sensors[i].name, esp_err_to_name(ret));
+        }
+    }
+    
+    // Collect completions, stamped when each transaction finished
+    int64_t done_us[NUM_SENSORS];
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        done_us[i] = esp_timer_get_time();
+    }
+    while (pending > 0) {
+        I2cCompletion_t done;
+        if (i2c_async_wait(&done, pdMS_TO_TICKS(I2C_MASTER_TIMEOUT_MS * NUM_SENSORS)) != ESP_OK) {
+            // Nothing may still be writing into raw once we decode it, and
+            // late completions must not be taken for the next record's
+            i2c_async_drain();
+            ESP_LOGW(TAG, "I2C completions timed out");
+            break;
+        }
+        pending--;
+        done_us[done.id] = done.done_us;
+        valid[done.id] = (done.status == ESP_OK);
+        if (done.status != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to read %s: %s", sensors[done.id].name, esp_err_to_name(done.status));
+        }
+    }
+    
+    // Decode before reserving, so flight detection and the fusion see
+    // every reading
+    int32_t values[NUM_SENSORS][SENSOR_MAX_CHANNELS];
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if ((mask & (1 << i)) == 0) {
+            continue;
+        }
+        if (valid[i]) {
+            sensors[i].driver->decode(&sensors[i].dev, raw[i], values[i]);
+            use_reading(i, values[i], done_us[i], tick);
+        } else {
+            for (int c = 0; c < sensors[i].driver->channel_count; c++) {
+                values[i][c] = SENSOR_VALUE_INVALID;
+            }
+        }
+    }
+    
+    // The fusion's slot rides on the IMU reading it was just updated with.
+    // A failed read leaves the output as it was, but still due.
+    int32_t fused[FUSION_CHANNELS];
+    if ((mask & (1 << FLIGHT_IMU_SENSOR)) && fusion_due(done_us[FLIGHT_IMU_SENSOR])) {
+        fusion_values(fused);
+        header.sensor_mask |= 1 << FUSION_SENSOR;
+        header.len += FUSION_SLOT_LEN;
+    }
+    
+    // Records are assembled directly in ring memory:
+    // [log_record_header_t] then per sensor in sensor_mask [log_sensor_slot_t] [channels]
+    RingSpan_t span;
+    size_t offset;
+    if (!reserve_records(header.len, &span, &offset)) {
+        gap_add(&sensor_gap, seq, header.sensor_mask, tick, timestamp, LOG_GAP_DROPPED);
+        return;
+    }
+    
+    ring_span_write(&span, offset, &header, sizeof(header));
+    offset += sizeof(header);
+    
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if ((mask & (1 << i)) == 0) {
+            continue;
+        }
+        log_sensor_slot_t slot = {
+            .offset_us = (uint32_t)(done_us[i] - timestamp),
+        };
+        
+        ring_span_write(&span, offset, &slot, sizeof(slot));
+        ring_span_write(&span, offset + sizeof(slot), values[i], sensor_data_len(i));
+        offset += sizeof(slot) + sensor_data_len(i);
+    }
+    if (header.sensor_mask & (1 << FUSION_SENSOR)) {
+        log_sensor_slot_t slot = {
+            .offset_us = (uint32_t)(done_us[FLIGHT_IMU_SENSOR] - timestamp),
+        };
+        ring_span_write(&span, offset, &slot, sizeof(slot));
+        ring_span_write(&span, offset + sizeof(slot), fused, sizeof(fused));
+        offset += FUSION_SLOT_LEN;
+    }
+    
+    commit_records(offset);
+}
+
+/**
+ * Account for the polled sensors that were due on ticks the sampler
+ * skipped before tick. Those samples were never read; each tick's gets
+ * the sequence number its record would have had and goes in a gap record.
+ */
+static void account_missed_ticks(uint32_t tick, uint32_t missed)
+{
+    const int64_t period_us = 1000000 / SAMPLER_RATE_HZ;
+    const int64_t now = esp_timer_get_time();
+    
+    for (uint32_t t = tick - missed; t != tick; t++) {
+        uint32_t mask = 0;
+        for (int i = 0; i < NUM_SENSORS; i++) {
+            if (sensors[i].drdy_gpio < 0 && !sensors[i].driver->fifo &&
+                t % sensors[i].divider == 0 && !pad_skip(i)) {
+                mask |= 1 << i;
+            }
+        }
+        if (mask != 0) {
+            int64_t t_us = now - (int64_t)(tick - t) * period_us;
+            gap_add(&sensor_gap, record_seq++, with_fusion_slot(mask, t_us), t, t_us, LOG_GAP_OVERRUN);
+        }
+    }
+}
+
+/**
+ * Read a data-ready sensor on its latest edge. Conversions whose edges came
+ * in while the task was busy were never read and go in a gap record, spread
+ * evenly since the previous edge read.
+ */
+static void acquire_drdy_sensor(int sensor_idx, uint32_t tick)
+{
+    static int64_t last_edge_us[NUM_SENSORS];
+    uint32_t missed;
+    int64_t edge_us = drdy_take(sensor_idx, &missed);
+    int64_t since = last_edge_us[sensor_idx] != 0 ? last_edge_us[sensor_idx] : edge_us;
+    
+    for (uint32_t k = 1; k <= missed; k++) {
+        if (!pad_skip(sensor_idx)) {
+            int64_t t_us = since + (edge_us - since) * k / (missed + 1);
+            gap_add(&sensor_gap, record_seq++, with_fusion_slot(1 << sensor_idx, t_us), tick,
+                    t_us, LOG_GAP_OVERRUN);
+        }
+    }
+    last_edge_us[sensor_idx] = edge_us;
+    
+    if (!pad_skip(sensor_idx)) {
+        acquire_record(1 << sensor_idx, edge_us, tick);
+    }
+}
+
+/**
+ * Bring up the data-ready interrupt of every sensor that has one wired.
+ * A sensor whose setup fails stays on the sampler tick.
+ */
+static void sensors_drdy_init(TaskHandle_t task)
+{
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        SensorConfig_t *sensor = &sensors[i];
+        if (sensor->drdy_gpio < 0) {
+            continue;
+        }
+        
+        esp_err_t ret = drdy_add(i, sensor->drdy_gpio, sensor->driver->drdy_active_low, task);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s data-ready setup failed (%s), polling instead",
+                     sensor->name, esp_err_to_name(ret));
+            sensor->drdy_gpio = -1;
+        }
+    }
+}
+
+/**
+ * Task running on Core 1 - Sensor reading
+ * Woken by the sampler on every base tick, which reads the polled sensors
+ * that are due and drains FIFO sensors, and by data-ready interrupts, which
+ * read their sensor alone stamped with the interrupt edge time. Every
+ * reading also goes through the flight tracker, whose state sets the rates,
+ * and the fusion.
+ */
+static void task_sensor_read(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Sensor Read task started on Core 1");
+    
+    sensors_drdy_init(xTaskGetCurrentTaskHandle());
+    ESP_ERROR_CHECK(sampler_start(SAMPLER_RATE_HZ, xTaskGetCurrentTaskHandle()));
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        if (sensors[i].drdy_gpio >= 0) {
+            ESP_LOGI(TAG, "%s on data-ready GPIO %d", sensors[i].name, sensors[i].drdy_gpio);
+            continue;
+        }
+        // FIFO sensors sample on their own clock; the tick only paces draining
+        sensors[i].divider = sampler_divider(sensors[i].driver->fifo ? IMU_FIFO_DRAIN_HZ : sensors[i].rate_hz);
+        if (sensors[i].driver->fifo) {
+            mpu_fifo_start(i);
+        }
+        ESP_LOGI(TAG, "%s every %lu tick(s) (%lu Hz)", sensors[i].name,
+                 (unsigned long)sensors[i].divider, (unsigned long)(SAMPLER_RATE_HZ / sensors[i].divider));
+    }
+    
+    uint32_t tick = 0;
+    while (1) {
+        uint32_t missed;
+        uint32_t events = sampler_wait(&tick, &missed);
+        
+        if (events & SAMPLER_EVENT_TICK) {
+            account_missed_ticks(tick, missed);
+            
+            // Burst-drain FIFO sensors before polling the rest
+            uint32_t due = 0;
+            for (int i = 0; i < NUM_SENSORS; i++) {
+                if (sensors[i].drdy_gpio >= 0 || tick % sensors[i].divider != 0) {
+                    continue;
+                }
+                if (sensors[i].driver->fifo) {
+                    drain_sensor_fifo(i, tick);
+                } else if (!pad_skip(i)) {
+                    due |= 1 << i;
+                }
+            }
+            if (due != 0) {
+                acquire_record(due, esp_timer_get_time(), tick);
+            }
+        }
+        
+        // Data-ready sensors carry the last tick so records still sort by it
+        for (int i = 0; i < NUM_SENSORS; i++) {
+            if (events & DRDY_EVENT(i)) {
+                acquire_drdy_sensor(i, tick);
+            }
+        }
+    }
+}
+
+/**
+ * Cleanup on shutdown
+ */
+static void cleanup(void)
+{
+    close_segment();
+    
+    if (sd_card != NULL) {
+        esp_vfs_fat_sdcard_unmount(MOUNT_POINT, sd_card);
+        sd_card = NULL;
+        ESP_LOGI(TAG, "SD card unmounted");
+    }
+}
+
+void app_main(void)
+{
+    ESP_LOGI(TAG, "=== Star PI Payload Main ===");
+    
+    max_record_len = sizeof(log_record_header_t);
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        max_record_len += sizeof(log_sensor_slot_t) + sensor_data_len(i);
+    }
+    if (FUSION_RATE_HZ > 0) {
+        max_record_len += FUSION_SLOT_LEN;
+    }
+    if (max_record_len < GAP_RECORD_MAX_LEN) {
+        max_record_len = GAP_RECORD_MAX_LEN;
+    }
+
+    // Initialize SD card FIRST
+    esp_err_t ret = sd_card_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "SD card init failed! Continuing without logging...");
+    } else {
+        // Start this boot's flight
+        ret = open_flight();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open a log segment!");
+        }
+    }
+    
+    const FlightConfig_t flight_config = {
+        .launch_mg = CONFIG_FLIGHT_LAUNCH_MG,
+        .launch_ms = CONFIG_FLIGHT_LAUNCH_MS,
+        .launch_altitude_m = CONFIG_FLIGHT_LAUNCH_ALTITUDE_M,
+    };
+    flight_state_init(&flight, &flight_config);
+    atomic_store(&pretrigger_hold, CONFIG_FLIGHT_LAUNCH_TRIGGER);
+    fusion_init(&fusion);
+    fusion_gyro_channel = sensor_driver_channel(sensors[FLIGHT_IMU_SENSOR].driver, "gx");
+    if (FUSION_RATE_HZ > 0 && fusion_gyro_channel < 0) {
+        ESP_LOGW(TAG, "%s has no gyro channels, no attitude or vertical fusion", sensors[FLIGHT_IMU_SENSOR].name);
+    }
+    
+    // Initialize I2C and sensors
+    ESP_ERROR_CHECK(i2c_sensors_init());
+    sensors_init();
+    
+    // Initialize ring buffer
+    ESP_ERROR_CHECK(init_ring_buffer());
+    init_log_blocks();
+
+    // Create tasks with larger stack for file operations
+    xTaskCreatePinnedToCore(task_sd_write, "sd_write", 4096, NULL, 5, &task_core0_handle, 0);
+    xTaskCreatePinnedToCore(task_sd_flush, "sd_flush", 8192, NULL, 4, &task_flush_handle, 0);
+    xTaskCreatePinnedToCore(task_sensor_read, "sensor_read", 4096, NULL, 6, &task_core1_handle, 1);
+    
+    ESP_LOGI(TAG, "Both tasks created and running!");
+    
+    while (1) {
+        SamplerStats_t stats;
+        sampler_get_stats(&stats, true);
+        I2cBusStats_t bus;
+        i2c_async_get_stats(&bus, true);
+        BufferStats_t buffer;
+        buffer_get_stats(&buffer, true);
+        FusionStats_t fusion_cost;
+        fusion_get_stats(&fusion_cost, true);
+        
+        ESP_LOGI(TAG, "Buffer: %d bytes, high water %d of %d (%d%%)",
+                 (int)ring_buffer_available(&ring_buffer), (int)buffer.high_water, (int)ring_buffer.size,
+                 (int)(buffer.high_water * 100 / ring_buffer.size));
+        if (buffer.dropped + buffer.overwritten + buffer.decimated + buffer.overrun + buffer.fifo_reset +
+            buffer.write_failed > 0) {
+            ESP_LOGW(TAG, "Buffer: lost %lu dropped / %lu overwritten / %lu decimated / %lu overrun / "
+                     "%lu FIFO reset / %lu unwritten records, %lu gap records",
+                     (unsigned long)buffer.dropped, (unsigned long)buffer.overwritten,
+                     (unsigned long)buffer.decimated, (unsigned long)buffer.overrun,
+                     (unsigned long)buffer.fifo_reset, (unsigned long)buffer.write_failed,
+                     (unsigned long)buffer.gaps);
+        }
+        if (stats.ticks > 0) {
+            ESP_LOGI(TAG, "Sampler: %lu ticks, %lu overruns, jitter min %ld / avg %ld / max %ld us",
+                     (unsigned long)stats.ticks, (unsigned long)stats.overruns,
+                     (long)stats.jitter_min_us, (long)(stats.jitter_sum_us / stats.ticks),
+                     (long)stats.jitter_max_us);
+        }
+        if (bus.window_us > 0) {
+            ESP_LOGI(TAG, "I2C: %lu transactions, %lu errors, bus %d%% busy at %d Hz",
+                     (unsigned long)bus.transactions, (unsigned long)bus.errors,
+                     (int)(bus.busy_us * 100 / bus.window_us), I2C_MASTER_FREQ_HZ);
+        }
+        if (fusion_cost.updates > 0) {
+            uint32_t avg = (uint32_t)(fusion_cost.cycles / fusion_cost.updates);
+            ESP_LOGI(TAG, "Fusion: %lu updates, avg %lu / max %lu cycles", (unsigned long)fusion_cost.updates,
+                     (unsigned long)avg, (unsigned long)fusion_cost.max_cycles);
+            if (avg > FUSION_BUDGET_CYCLES) {
+                ESP_LOGW(TAG, "Fusion takes more than its %d cycle budget per update", FUSION_BUDGET_CYCLES);
+            }
+        }
         vTaskDelay(pdMS_TO_TICKS(5000));
     }
     
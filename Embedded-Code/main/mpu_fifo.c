@@ -0,0 +1,157 @@
+#include "mpu_fifo.h"
+#include "i2c_async.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "mpu_fifo";
+
+// Register map (MPU6050 / MPU9250)
+#define MPU_REG_SMPLRT_DIV      0x19
+#define MPU_REG_CONFIG          0x1A
+#define MPU_REG_FIFO_EN         0x23
+#define MPU_REG_USER_CTRL       0x6A
+#define MPU_REG_PWR_MGMT_1      0x6B
+#define MPU_REG_FIFO_COUNT_H    0x72
+#define MPU_REG_FIFO_R_W        0x74
+
+#define MPU_FIFO_EN_ACCEL_GYRO  0x78        // XG, YG, ZG and ACCEL
+#define MPU_USER_CTRL_FIFO_EN   0x40
+#define MPU_USER_CTRL_FIFO_RST  0x04
+
+#define MPU_FIFO_SLIP_PERIODS   3           // Beyond the timing error of two batch estimates
+#define MPU_PWR_CLK_PLL_X       0x01        // Awake, clocked from the gyro PLL
+#define MPU_CONFIG_DLPF_188HZ   0x01        // Gyro output rate 1 kHz
+
+static uint32_t period_us = 1000;
+static size_t fifo_size = MPU_FIFO_SIZE_MPU6500;
+static int64_t drained_us;          // Sample time of the last frame read, or of the last reset
+
+static esp_err_t write_reg(int id, uint8_t reg, uint8_t value)
+{
+    uint8_t buf[2] = { reg, value };
+    return i2c_async_transfer(id, buf, sizeof(buf), NULL, 0, NULL);
+}
+
+static esp_err_t reset_fifo(int id)
+{
+    esp_err_t ret = write_reg(id, MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_RST);
+    if (ret == ESP_OK) {
+        ret = write_reg(id, MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_EN);
+    }
+    drained_us = esp_timer_get_time();
+    return ret;
+}
+
+/**
+ * Reset a FIFO whose contents are lost. *lost receives every frame sampled
+ * since the last one read: those it held, at least fifo_frames, and those
+ * it overwrote or sampled until the reset.
+ */
+static void discard_fifo(int id, size_t fifo_frames, size_t *lost, int64_t *newest_us)
+{
+    int64_t since_us = drained_us;
+    reset_fifo(id);
+
+    // Rounded up: the FIFO starts over on its own sampling phase
+    size_t sampled = (size_t)((drained_us - since_us + period_us - 1) / period_us);
+    *lost = (sampled > fifo_frames) ? sampled : fifo_frames;
+    *newest_us = drained_us;
+}
+
+esp_err_t mpu_fifo_init(int id, uint32_t rate_hz, size_t size)
+{
+    if (rate_hz == 0 || rate_hz > 1000 || size < MPU_FIFO_FRAME_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    fifo_size = size;
+
+    uint8_t divider = (1000 / rate_hz) - 1;
+    period_us = 1000000 / (1000 / (divider + 1));
+
+    esp_err_t ret = write_reg(id, MPU_REG_PWR_MGMT_1, MPU_PWR_CLK_PLL_X);
+    if (ret == ESP_OK) ret = write_reg(id, MPU_REG_CONFIG, MPU_CONFIG_DLPF_188HZ);
+    if (ret == ESP_OK) ret = write_reg(id, MPU_REG_SMPLRT_DIV, divider);
+    if (ret == ESP_OK) ret = write_reg(id, MPU_REG_FIFO_EN, MPU_FIFO_EN_ACCEL_GYRO);
+    // Off until draining starts; nothing would empty it before then
+    if (ret == ESP_OK) ret = write_reg(id, MPU_REG_USER_CTRL, 0);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "IMU FIFO setup failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "IMU FIFO set up for %lu Hz, %u frames", (unsigned long)(1000000 / period_us),
+             (unsigned)(fifo_size / MPU_FIFO_FRAME_LEN));
+    return ESP_OK;
+}
+
+esp_err_t mpu_fifo_start(int id)
+{
+    esp_err_t ret = reset_fifo(id);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "IMU FIFO start failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t mpu_fifo_drain(int id, uint8_t *frames, size_t max_frames, size_t *count, int64_t *newest_us)
+{
+    static const uint8_t count_reg = MPU_REG_FIFO_COUNT_H;
+    static const uint8_t data_reg = MPU_REG_FIFO_R_W;
+    uint8_t raw_count[2];
+    int64_t count_us;
+
+    *count = 0;
+
+    esp_err_t ret = i2c_async_transfer(id, &count_reg, 1, raw_count, sizeof(raw_count), &count_us);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // A full FIFO has overwritten its oldest bytes, so the read position is
+    // no longer on a frame boundary; start over
+    size_t fifo_bytes = ((size_t)raw_count[0] << 8) | raw_count[1];
+    if (fifo_bytes >= fifo_size) {
+        ESP_LOGW(TAG, "IMU FIFO overflow (%u bytes), resetting", (unsigned)fifo_bytes);
+        discard_fifo(id, fifo_bytes / MPU_FIFO_FRAME_LEN, count, newest_us);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // A frame still being written is read on the next drain
+    size_t available = fifo_bytes / MPU_FIFO_FRAME_LEN;
+    size_t n = (available < max_frames) ? available : max_frames;
+    if (n == 0) {
+        return ESP_OK;
+    }
+
+    ret = i2c_async_transfer(id, &data_reg, 1, frames, n * MPU_FIFO_FRAME_LEN, NULL);
+    if (ret != ESP_OK) {
+        // How much of the burst left the FIFO is unknown
+        discard_fifo(id, available, count, newest_us);
+        return ret;
+    }
+
+    // The newest frame in the FIFO was sampled within one period before the
+    // count read; every frame left behind moves our last frame a period back
+    int64_t last_us = count_us - (int64_t)(available - n) * period_us - period_us / 2;
+
+    // Filling up between the count and the burst read overwrites frames
+    // unseen and leaves the read position mid-frame. Batches then stop
+    // following on from each other: the one after starts periods late.
+    int64_t first_us = last_us - (int64_t)(n - 1) * period_us;
+    if (first_us - drained_us > MPU_FIFO_SLIP_PERIODS * (int64_t)period_us) {
+        ESP_LOGW(TAG, "IMU FIFO slipped %lld us, resetting", (long long)(first_us - drained_us));
+        discard_fifo(id, available, count, newest_us);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    *count = n;
+    *newest_us = last_us;
+    drained_us = last_us;
+    return ESP_OK;
+}
+
+uint32_t mpu_fifo_period_us(void)
+{
+    return period_us;
+}
@@ -0,0 +1,53 @@
+/**
+ * MPU6050 / MPU9250 hardware FIFO support
+ *
+ * The IMU samples accelerometer and gyro into its on-chip FIFO at a fixed
+ * output data rate. Draining it with one burst read per call replaces one
+ * I2C transaction per sample. Each FIFO frame is 12 bytes:
+ *   [accel X][accel Y][accel Z][gyro X][gyro Y][gyro Z]  (int16, big-endian)
+ *
+ * All transfers go through the i2c_async engine and must not overlap with
+ * other outstanding reads.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define MPU_FIFO_FRAME_LEN      12
+
+#define MPU_FIFO_SIZE_MPU6050   1024
+#define MPU_FIFO_SIZE_MPU6500   512         // Also the MPU9250/9255 default
+
+/**
+ * Wake the IMU, set its output data rate and route accelerometer and gyro
+ * into the FIFO, which stays off until mpu_fifo_start(). id is the device
+ * id registered with i2c_async_add_device(); size is the part's FIFO in
+ * bytes, MPU_FIFO_SIZE_*.
+ */
+esp_err_t mpu_fifo_init(int id, uint32_t rate_hz, size_t size);
+
+/**
+ * Empty the FIFO and start filling it. Call when draining starts: the FIFO
+ * holds size / MPU_FIFO_FRAME_LEN frames, and overflows if nothing drains
+ * it for longer.
+ */
+esp_err_t mpu_fifo_start(int id);
+
+/**
+ * Read up to max_frames whole frames into frames. *count receives the
+ * number read and *newest_us the estimated sample time of the last one.
+ * A frame still being written is left for the next call.
+ *
+ * A FIFO overflow, a batch that does not follow on from the last one, or
+ * a failed burst read, resets the FIFO. It then returns
+ * ESP_ERR_INVALID_SIZE or the read's error, *count receives the number of
+ * frames lost with it and *newest_us the time of the last of them.
+ */
+esp_err_t mpu_fifo_drain(int id, uint8_t *frames, size_t max_frames, size_t *count, int64_t *newest_us);
+
+/**
+ * Sample period matching the configured output data rate
+ */
+uint32_t mpu_fifo_period_us(void);
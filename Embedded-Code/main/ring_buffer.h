@@ -0,0 +1,227 @@
+/**
+ * Lock-free single-producer / single-consumer byte ring buffer
+ *
+ * Exactly one task may produce (write / reserve / commit) and exactly one
+ * task may consume (read / peek / release); no mutex is needed between them.
+ * Indices run freely and are reduced with a mask, so the capacity must be a
+ * power of two.
+ *
+ * Besides the copying read/write calls there is a zero-copy API: reserve()
+ * and peek() hand out the ring memory itself as at most two contiguous spans
+ * (two only when the region wraps around the end of the storage).
+ *
+ * Header only and free of ESP-IDF dependencies so it also builds on the host.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+typedef struct {
+    uint8_t *data;
+    size_t size;                    // Capacity in bytes, power of two
+    size_t mask;                    // size - 1
+    atomic_size_t write_index;      // Only the producer writes this
+    atomic_size_t read_index;       // Only the consumer writes this
+} RingBuffer_t;
+
+// A region of ring memory, split in two where it wraps
+typedef struct {
+    uint8_t *ptr[2];
+    size_t len[2];
+} RingSpan_t;
+
+/**
+ * Initialize the ring buffer over caller-provided storage.
+ * Returns false if size is not a power of two.
+ */
+static inline bool ring_buffer_init(RingBuffer_t *rb, uint8_t *storage, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+
+    rb->data = storage;
+    rb->size = size;
+    rb->mask = size - 1;
+    atomic_store(&rb->write_index, 0);
+    atomic_store(&rb->read_index, 0);
+    return true;
+}
+
+/**
+ * Get available space for writing (producer side)
+ */
+static inline size_t ring_buffer_free_space(RingBuffer_t *rb)
+{
+    size_t w = atomic_load_explicit(&rb->write_index, memory_order_relaxed);
+    size_t r = atomic_load_explicit(&rb->read_index, memory_order_acquire);
+    return rb->size - (w - r);
+}
+
+/**
+ * Get available data for reading (consumer side)
+ */
+static inline size_t ring_buffer_available(RingBuffer_t *rb)
+{
+    size_t w = atomic_load_explicit(&rb->write_index, memory_order_acquire);
+    size_t r = atomic_load_explicit(&rb->read_index, memory_order_relaxed);
+    return w - r;
+}
+
+/**
+ * Describe len bytes of ring memory starting at a free-running index
+ */
+static inline void ring_buffer_span(RingBuffer_t *rb, size_t index, size_t len, RingSpan_t *span)
+{
+    size_t start = index & rb->mask;
+    size_t first = rb->size - start;
+
+    if (first > len) {
+        first = len;
+    }
+    span->ptr[0] = rb->data + start;
+    span->len[0] = first;
+    span->ptr[1] = rb->data;
+    span->len[1] = len - first;
+}
+
+/**
+ * Reserve len contiguous-in-order bytes for the producer to fill in place.
+ * Returns false (and leaves span untouched) if there is not enough room.
+ * Nothing is visible to the consumer until ring_buffer_commit().
+ */
+static inline bool ring_buffer_reserve(RingBuffer_t *rb, size_t len, RingSpan_t *span)
+{
+    if (ring_buffer_free_space(rb) < len) {
+        return false;
+    }
+
+    ring_buffer_span(rb, atomic_load_explicit(&rb->write_index, memory_order_relaxed), len, span);
+    return true;
+}
+
+/**
+ * Publish len bytes previously obtained with ring_buffer_reserve()
+ */
+static inline void ring_buffer_commit(RingBuffer_t *rb, size_t len)
+{
+    size_t w = atomic_load_explicit(&rb->write_index, memory_order_relaxed);
+
+    // Release ordering makes the filled bytes visible before the new index
+    atomic_store_explicit(&rb->write_index, w + len, memory_order_release);
+}
+
+/**
+ * Expose everything currently readable without copying it.
+ * Returns the total number of bytes described by span.
+ */
+static inline size_t ring_buffer_peek(RingBuffer_t *rb, RingSpan_t *span)
+{
+    size_t available = ring_buffer_available(rb);
+
+    ring_buffer_span(rb, atomic_load_explicit(&rb->read_index, memory_order_relaxed), available, span);
+    return available;
+}
+
+/**
+ * Hand len bytes obtained with ring_buffer_peek() back to the producer
+ */
+static inline void ring_buffer_release(RingBuffer_t *rb, size_t len)
+{
+    size_t r = atomic_load_explicit(&rb->read_index, memory_order_relaxed);
+
+    // Release ordering makes sure the bytes were consumed before reuse
+    atomic_store_explicit(&rb->read_index, r + len, memory_order_release);
+}
+
+/**
+ * Copy len bytes into a span at offset
+ */
+static inline void ring_span_write(const RingSpan_t *span, size_t offset, const void *src, size_t len)
+{
+    const uint8_t *s = src;
+
+    if (offset < span->len[0]) {
+        size_t n = span->len[0] - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(span->ptr[0] + offset, s, n);
+        s += n;
+        len -= n;
+        offset = 0;
+    } else {
+        offset -= span->len[0];
+    }
+    memcpy(span->ptr[1] + offset, s, len);
+}
+
+/**
+ * Copy len bytes out of a span starting at offset
+ */
+static inline void ring_span_read(const RingSpan_t *span, size_t offset, void *dst, size_t len)
+{
+    uint8_t *d = dst;
+
+    if (offset < span->len[0]) {
+        size_t n = span->len[0] - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(d, span->ptr[0] + offset, n);
+        d += n;
+        len -= n;
+        offset = 0;
+    } else {
+        offset -= span->len[0];
+    }
+    memcpy(d, span->ptr[1] + offset, len);
+}
+
+/**
+ * Return a pointer to len contiguous bytes at offset in span, or NULL if
+ * that range straddles the wrap point.
+ */
+static inline uint8_t *ring_span_contiguous(const RingSpan_t *span, size_t offset, size_t len)
+{
+    if (offset + len <= span->len[0]) {
+        return span->ptr[0] + offset;
+    }
+    if (offset >= span->len[0]) {
+        return span->ptr[1] + (offset - span->len[0]);
+    }
+    return NULL;
+}
+
+/**
+ * Copying write (producer side). All or nothing: returns len or 0.
+ */
+static inline size_t ring_buffer_write(RingBuffer_t *rb, const void *data, size_t len)
+{
+    RingSpan_t span;
+
+    if (!ring_buffer_reserve(rb, len, &span)) {
+        return 0;
+    }
+    ring_span_write(&span, 0, data, len);
+    ring_buffer_commit(rb, len);
+    return len;
+}
+
+/**
+ * Copying read (consumer side). Returns the number of bytes read.
+ */
+static inline size_t ring_buffer_read(RingBuffer_t *rb, void *data, size_t max_len)
+{
+    RingSpan_t span;
+    size_t available = ring_buffer_peek(rb, &span);
+    size_t to_read = (max_len < available) ? max_len : available;
+
+    ring_span_read(&span, 0, data, to_read);
+    ring_buffer_release(rb, to_read);
+    return to_read;
+}
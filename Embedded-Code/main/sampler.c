@@ -0,0 +1,124 @@
+#include <string.h>
+#include "sampler.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "sampler";
+
+static esp_timer_handle_t tick_timer;
+static TaskHandle_t sampler_task;
+static uint32_t base_rate_hz;
+static int64_t period_us;
+static int64_t start_us;
+static uint32_t next_tick;
+
+static SamplerStats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Timer callback - runs in the esp_timer task
+ */
+static void sampler_tick(void *arg)
+{
+    xTaskNotify(sampler_task, SAMPLER_EVENT_TICK, eSetBits);
+}
+
+static void reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.jitter_min_us = INT32_MAX;
+    stats.jitter_max_us = INT32_MIN;
+}
+
+esp_err_t sampler_start(uint32_t rate_hz, TaskHandle_t task)
+{
+    if (rate_hz == 0 || rate_hz > 1000000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sampler_task = task;
+    base_rate_hz = rate_hz;
+    period_us = 1000000 / rate_hz;
+    next_tick = 0;
+    reset_stats();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sampler_tick,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sampler",
+    };
+
+    esp_err_t ret = esp_timer_create(&timer_args, &tick_timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // The first tick fires one period from now
+    start_us = esp_timer_get_time() + period_us;
+    ret = esp_timer_start_periodic(tick_timer, period_us);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Sampling at %lu Hz (%lld us period)", (unsigned long)rate_hz, (long long)period_us);
+    return ESP_OK;
+}
+
+uint32_t sampler_wait(uint32_t *tick, uint32_t *missed)
+{
+    uint32_t events = 0;
+    *missed = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+    if ((events & SAMPLER_EVENT_TICK) == 0) {
+        return events;
+    }
+
+    // The latest deadline that has passed; anything between the last one
+    // serviced and it was slept through
+    int64_t now = esp_timer_get_time();
+    uint32_t current = (now >= start_us) ? (uint32_t)((now - start_us) / period_us) : 0;
+    if (current < next_tick) {
+        current = next_tick;
+    }
+    uint32_t skipped = current - next_tick;
+    next_tick = current + 1;
+
+    int64_t deadline = start_us + (int64_t)current * period_us;
+    int32_t jitter = (int32_t)(now - deadline);
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.ticks++;
+    stats.overruns += skipped;
+    stats.jitter_sum_us += jitter;
+    if (jitter < stats.jitter_min_us) {
+        stats.jitter_min_us = jitter;
+    }
+    if (jitter > stats.jitter_max_us) {
+        stats.jitter_max_us = jitter;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    *tick = current;
+    *missed = skipped;
+    return events;
+}
+
+uint32_t sampler_divider(uint32_t rate_hz)
+{
+    if (rate_hz == 0 || rate_hz >= base_rate_hz) {
+        return 1;
+    }
+    return (base_rate_hz + rate_hz / 2) / rate_hz;
+}
+
+void sampler_get_stats(SamplerStats_t *out, bool reset)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    if (reset) {
+        reset_stats();
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
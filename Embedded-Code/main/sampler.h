@@ -0,0 +1,53 @@
+/**
+ * Timer-driven sampling scheduler
+ *
+ * A periodic esp_timer wakes the acquisition task at a fixed base rate.
+ * Deadlines are absolute (start + n * period), like vTaskDelayUntil(), so
+ * the schedule never drifts with the time spent reading sensors. Sensors
+ * that run slower than the base rate are read on every Nth tick.
+ *
+ * Wake-ups are delivered as task notification bits. SAMPLER_EVENT_TICK is
+ * reserved for the timer; the low bits are free for other event sources
+ * (see drdy.h) that want to wake the same task.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#define SAMPLER_EVENT_TICK      (1UL << 31)
+
+typedef struct {
+    uint32_t ticks;             // Deadlines serviced
+    uint32_t overruns;          // Deadlines skipped because the task was late
+    int32_t  jitter_min_us;     // Wake-up time relative to the deadline
+    int32_t  jitter_max_us;
+    int64_t  jitter_sum_us;
+} SamplerStats_t;
+
+/**
+ * Start the base tick timer. Ticks are delivered to task as notifications.
+ */
+esp_err_t sampler_start(uint32_t rate_hz, TaskHandle_t task);
+
+/**
+ * Block until the next deadline or any other notification bit. Returns the
+ * event bits that woke the task. When SAMPLER_EVENT_TICK is among them,
+ * *tick receives the tick number, which skips ahead when deadlines were
+ * missed so it always matches the absolute schedule, and *missed how many
+ * ticks were skipped before it. Otherwise *missed is 0.
+ */
+uint32_t sampler_wait(uint32_t *tick, uint32_t *missed);
+
+/**
+ * Convert a sensor rate into a tick divider (1 = every tick)
+ */
+uint32_t sampler_divider(uint32_t rate_hz);
+
+/**
+ * Snapshot the statistics, optionally starting a new window
+ */
+void sampler_get_stats(SamplerStats_t *stats, bool reset);
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/unistd.h>
+#include "sd_bench.h"
+#include "sd_raw.h"
+#include "esp_vfs_fat.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "sd_bench";
+
+// 8.3 name, the card is mounted without long file names
+#define RAW_FILE_NAME       "SDBRAW.BIN"
+
+// Log-linear latency histogram: exact below 8 us, then 8 buckets per power
+// of two, so a percentile is at most 12.5% above the true value
+#define HIST_SUB_BITS       3
+#define HIST_SUB            (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS        ((32 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint32_t counts[HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} LatencyHist_t;
+
+static LatencyHist_t hist;
+
+static const struct {
+    SdBenchApi_t api;
+    SdBenchPattern_t pattern;
+} sweep_runs[] = {
+    { SD_BENCH_STDIO, SD_BENCH_SEQUENTIAL },
+    { SD_BENCH_STDIO, SD_BENCH_APPEND_FSYNC },
+    { SD_BENCH_STDIO, SD_BENCH_SEQUENTIAL_READ },
+    { SD_BENCH_POSIX, SD_BENCH_SEQUENTIAL },
+    { SD_BENCH_POSIX, SD_BENCH_APPEND_FSYNC },
+    { SD_BENCH_POSIX, SD_BENCH_SEQUENTIAL_READ },
+    { SD_BENCH_RAW, SD_BENCH_SEQUENTIAL },
+};
+
+static int hist_bucket(uint32_t us)
+{
+    if (us < HIST_SUB) {
+        return us;
+    }
+    int exp = 31 - __builtin_clz(us);
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + ((us >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/**
+ * Largest value that lands in bucket
+ */
+static uint32_t hist_upper_us(int bucket)
+{
+    if (bucket < HIST_SUB) {
+        return bucket;
+    }
+    int shift = bucket / HIST_SUB - 1;
+    uint32_t low = (uint32_t)(HIST_SUB + bucket % HIST_SUB) << shift;
+    return low + ((1u << shift) - 1);
+}
+
+static void hist_add(int64_t us)
+{
+    uint32_t value = (us < 0) ? 0 : (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    hist.counts[hist_bucket(value)]++;
+    hist.count++;
+    if (value > hist.max_us) {
+        hist.max_us = value;
+    }
+}
+
+static uint32_t hist_percentile_us(uint32_t pct)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)hist.count * pct + 99) / 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist.counts[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = hist_upper_us(i);
+            return (upper < hist.max_us) ? upper : hist.max_us;
+        }
+    }
+    return hist.max_us;
+}
+
+const char *sd_bench_api_name(SdBenchApi_t api)
+{
+    switch (api) {
+    case SD_BENCH_STDIO:    return "stdio";
+    case SD_BENCH_POSIX:    return "posix";
+    case SD_BENCH_RAW:      return "raw";
+    default:                return "?";
+    }
+}
+
+const char *sd_bench_pattern_name(SdBenchPattern_t pattern)
+{
+    switch (pattern) {
+    case SD_BENCH_SEQUENTIAL:       return "sequential";
+    case SD_BENCH_APPEND_FSYNC:     return "append_fsync";
+    case SD_BENCH_SEQUENTIAL_READ:  return "sequential_read";
+    default:                        return "?";
+    }
+}
+
+/**
+ * Give every block a distinct first word, so no two writes carry the same data
+ */
+static inline void stamp_block(uint8_t *buf, uint32_t index)
+{
+    memcpy(buf, &index, sizeof(index));
+}
+
+static esp_err_t run_stdio(const char *path, SdBenchPattern_t pattern, uint8_t *buf, size_t block,
+                           uint32_t writes, SdBenchResult_t *result)
+{
+    FILE *f = fopen(path, (pattern == SD_BENCH_APPEND_FSYNC) ? "ab" : "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+
+    for (uint32_t i = 0; i < writes; i++) {
+        stamp_block(buf, i);
+        int64_t start_us = esp_timer_get_time();
+        bool ok = fwrite(buf, 1, block, f) == block;
+        if (pattern == SD_BENCH_APPEND_FSYNC) {
+            ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+        }
+        hist_add(esp_timer_get_time() - start_us);
+        result->errors += !ok;
+    }
+
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+    return ESP_OK;
+}
+
+static esp_err_t run_posix(const char *path, SdBenchPattern_t pattern, uint8_t *buf, size_t block,
+                           uint32_t writes, SdBenchResult_t *result)
+{
+    int flags = O_WRONLY | O_CREAT | ((pattern == SD_BENCH_APPEND_FSYNC) ? O_APPEND : O_TRUNC);
+    int fd = open(path, flags, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+
+    for (uint32_t i = 0; i < writes; i++) {
+        stamp_block(buf, i);
+        int64_t start_us = esp_timer_get_time();
+        bool ok = write(fd, buf, block) == (ssize_t)block;
+        if (pattern == SD_BENCH_APPEND_FSYNC) {
+            ok = fsync(fd) == 0 && ok;
+        }
+        hist_add(esp_timer_get_time() - start_us);
+        result->errors += !ok;
+    }
+
+    fsync(fd);
+    close(fd);
+    return ESP_OK;
+}
+
+static esp_err_t read_stdio(const char *path, uint8_t *buf, size_t block, uint32_t reads,
+                            SdBenchResult_t *result)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+
+    for (uint32_t i = 0; i < reads; i++) {
+        int64_t start_us = esp_timer_get_time();
+        bool ok = fread(buf, 1, block, f) == block;
+        hist_add(esp_timer_get_time() - start_us);
+        result->errors += !ok;
+    }
+
+    fclose(f);
+    return ESP_OK;
+}
+
+static esp_err_t read_posix(const char *path, uint8_t *buf, size_t block, uint32_t reads,
+                            SdBenchResult_t *result)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+
+    for (uint32_t i = 0; i < reads; i++) {
+        int64_t start_us = esp_timer_get_time();
+        bool ok = read(fd, buf, block) == (ssize_t)block;
+        hist_add(esp_timer_get_time() - start_us);
+        result->errors += !ok;
+    }
+
+    close(fd);
+    return ESP_OK;
+}
+
+/**
+ * Write the file a read run reads back, in the largest blocks it sweeps
+ */
+static esp_err_t fill_read_file(const SdBenchConfig_t *config, const char *path)
+{
+    uint8_t *buf = heap_caps_malloc(config->max_block, MALLOC_CAP_DMA);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(buf, 0x5A, config->max_block);
+
+    esp_err_t ret = ESP_OK;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        ret = ESP_FAIL;
+    }
+    for (size_t done = 0; ret == ESP_OK && done < config->run_bytes; done += config->max_block) {
+        size_t len = config->run_bytes - done;
+        len = (len < config->max_block) ? len : config->max_block;
+        stamp_block(buf, done / config->max_block);
+        if (write(fd, buf, len) != (ssize_t)len) {
+            ESP_LOGE(TAG, "Cannot write %s", path);
+            ret = ESP_FAIL;
+        }
+    }
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    heap_caps_free(buf);
+    return ret;
+}
+
+static esp_err_t run_raw(const SdRawExtent_t *extent, uint8_t *buf, size_t block, uint32_t writes,
+                         SdBenchResult_t *result)
+{
+    for (uint32_t i = 0; i < writes; i++) {
+        stamp_block(buf, i);
+        int64_t start_us = esp_timer_get_time();
+        bool ok = sd_raw_write(extent, (uint64_t)i * block, buf, block) == ESP_OK;
+        hist_add(esp_timer_get_time() - start_us);
+        result->errors += !ok;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Reserve the raw test file afresh, so its clusters are known to be contiguous
+ */
+static esp_err_t open_raw_file(const SdBenchConfig_t *config, const char *path, SdRawExtent_t *extent)
+{
+    unlink(path);
+    esp_err_t ret = esp_vfs_fat_create_contiguous_file(config->mount_point, path, config->run_bytes, true);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot reserve %s: %s", path, esp_err_to_name(ret));
+        return ret;
+    }
+    return sd_raw_open(extent, config->card, RAW_FILE_NAME);
+}
+
+esp_err_t sd_bench_run_one(const SdBenchConfig_t *config, SdBenchApi_t api, SdBenchPattern_t pattern,
+                           size_t block, SdBenchResult_t *result)
+{
+    if (block == 0 || config->run_bytes < block || config->file_name == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (api == SD_BENCH_RAW && (config->card == NULL || pattern != SD_BENCH_SEQUENTIAL ||
+                                block % config->card->csd.sector_size != 0)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", config->mount_point,
+             (api == SD_BENCH_RAW) ? RAW_FILE_NAME : config->file_name);
+
+    // Setup stays out of the timing: a stale test file, for raw writes
+    // reserving the clusters, and for reads writing the file
+    SdRawExtent_t extent;
+    esp_err_t ret = ESP_OK;
+    if (api == SD_BENCH_RAW) {
+        ret = open_raw_file(config, path, &extent);
+    } else if (pattern == SD_BENCH_SEQUENTIAL_READ) {
+        ret = fill_read_file(config, path);
+    } else {
+        unlink(path);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint8_t *buf = heap_caps_malloc(block, MALLOC_CAP_DMA);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < block; i++) {
+        buf[i] = (uint8_t)i;
+    }
+
+    memset(result, 0, sizeof(*result));
+    memset(&hist, 0, sizeof(hist));
+    result->api = api;
+    result->pattern = pattern;
+    result->block = block;
+    result->writes = config->run_bytes / block;
+
+    int64_t start_us = esp_timer_get_time();
+    switch (api) {
+    case SD_BENCH_STDIO:
+        ret = (pattern == SD_BENCH_SEQUENTIAL_READ) ? read_stdio(path, buf, block, result->writes, result) :
+              run_stdio(path, pattern, buf, block, result->writes, result);
+        break;
+    case SD_BENCH_POSIX:
+        ret = (pattern == SD_BENCH_SEQUENTIAL_READ) ? read_posix(path, buf, block, result->writes, result) :
+              run_posix(path, pattern, buf, block, result->writes, result);
+        break;
+    default:
+        ret = run_raw(&extent, buf, block, result->writes, result);
+        break;
+    }
+    result->total_us = esp_timer_get_time() - start_us;
+    heap_caps_free(buf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint64_t bytes = (uint64_t)result->writes * block;
+    result->kib_s = (result->total_us > 0) ? (uint32_t)(bytes * 1000000 / 1024 / result->total_us) : 0;
+    result->p50_us = hist_percentile_us(50);
+    result->p99_us = hist_percentile_us(99);
+    result->max_us = hist.max_us;
+    return ESP_OK;
+}
+
+esp_err_t sd_bench_run(const SdBenchConfig_t *config, FILE *csv)
+{
+    if (config->min_block == 0 || config->min_block > config->max_block || config->run_bytes < config->max_block) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (csv != NULL) {
+        fprintf(csv, "api,pattern,block,writes,errors,total_us,kib_s,p50_us,p99_us,max_us\n");
+    }
+
+    esp_err_t first_error = ESP_OK;
+    for (size_t r = 0; r < sizeof(sweep_runs) / sizeof(sweep_runs[0]); r++) {
+        SdBenchApi_t api = sweep_runs[r].api;
+        SdBenchPattern_t pattern = sweep_runs[r].pattern;
+        if (api == SD_BENCH_RAW && config->card == NULL) {
+            continue;
+        }
+
+        for (size_t block = config->min_block; block <= config->max_block; block *= 2) {
+            SdBenchResult_t result;
+            esp_err_t ret = sd_bench_run_one(config, api, pattern, block, &result);
+            if (ret == ESP_ERR_NOT_SUPPORTED) {
+                continue;
+            }
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "%s %s with %u byte blocks failed: %s", sd_bench_api_name(api),
+                         sd_bench_pattern_name(pattern), (unsigned)block, esp_err_to_name(ret));
+                if (first_error == ESP_OK) {
+                    first_error = ret;
+                }
+                continue;
+            }
+
+            ESP_LOGI(TAG, "%-5s %-15s %6u B: %6lu KiB/s, p50 %lu / p99 %lu / max %lu us (%lu errors)",
+                     sd_bench_api_name(api), sd_bench_pattern_name(pattern), (unsigned)block,
+                     (unsigned long)result.kib_s, (unsigned long)result.p50_us, (unsigned long)result.p99_us,
+                     (unsigned long)result.max_us, (unsigned long)result.errors);
+            if (csv != NULL) {
+                fprintf(csv, "%s,%s,%u,%lu,%lu,%lld,%lu,%lu,%lu,%lu\n", sd_bench_api_name(api),
+                        sd_bench_pattern_name(pattern), (unsigned)block, (unsigned long)result.writes,
+                        (unsigned long)result.errors, (long long)result.total_us, (unsigned long)result.kib_s,
+                        (unsigned long)result.p50_us, (unsigned long)result.p99_us, (unsigned long)result.max_us);
+                fflush(csv);
+            }
+        }
+    }
+
+    // Leave the card as it was found
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", config->mount_point, config->file_name);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s", config->mount_point, RAW_FILE_NAME);
+    unlink(path);
+    return first_error;
+}
@@ -0,0 +1,81 @@
+/**
+ * SD card write benchmark
+ *
+ * Writes a test file on the mounted card through each access path the
+ * logger can use - stdio, POSIX and raw sectors (sd_raw) - and in two
+ * patterns: one sequential stream, and appends that are each made durable
+ * with fsync(). The file paths also read the file back in one stream.
+ * Every combination is swept over power-of-two block sizes.
+ *
+ * Each write or read is timed on its own into a latency histogram, so the
+ * result carries p50/p99/max next to the throughput. Results go out as
+ * CSV, one line per run.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "sdmmc_cmd.h"
+#include "esp_err.h"
+
+typedef enum {
+    SD_BENCH_STDIO,
+    SD_BENCH_POSIX,
+    SD_BENCH_RAW,               // Contiguous file, written with sd_raw_write()
+} SdBenchApi_t;
+
+typedef enum {
+    SD_BENCH_SEQUENTIAL,        // One stream, synced once at the end
+    SD_BENCH_APPEND_FSYNC,      // Every write appended and synced
+    SD_BENCH_SEQUENTIAL_READ,   // The file, written untimed first, read in one stream
+} SdBenchPattern_t;
+
+typedef struct {
+    const char *mount_point;    // Where the card's file system is mounted
+    const char *file_name;      // Test file of the stdio and POSIX runs, 8.3
+    sdmmc_card_t *card;         // For raw sector writes, NULL skips them
+    size_t min_block;           // Block sizes swept, powers of two
+    size_t max_block;
+    size_t run_bytes;           // Written per run, at least max_block
+} SdBenchConfig_t;
+
+#define SD_BENCH_CONFIG_DEFAULT() { \
+        .mount_point = "/sdcard", \
+        .file_name = "SDBENCH.BIN", \
+        .card = NULL, \
+        .min_block = 512, \
+        .max_block = 64 * 1024, \
+        .run_bytes = 1024 * 1024, \
+    }
+
+typedef struct {
+    SdBenchApi_t api;
+    SdBenchPattern_t pattern;
+    size_t block;
+    uint32_t writes;            // Reads, for a read run
+    uint32_t errors;            // Failed or short writes or reads
+    int64_t total_us;           // Open to close
+    uint32_t kib_s;             // Over total_us
+    uint32_t p50_us;            // Per write or read, bucket upper bounds
+    uint32_t p99_us;
+    uint32_t max_us;            // Exact
+} SdBenchResult_t;
+
+/**
+ * Run one access path and pattern at one block size. Raw runs need
+ * config->card and block to be a multiple of the card's sector size, and
+ * are sequential writes only: a sector write is durable once it returns,
+ * and reads go through the file system anyway.
+ */
+esp_err_t sd_bench_run_one(const SdBenchConfig_t *config, SdBenchApi_t api, SdBenchPattern_t pattern,
+                           size_t block, SdBenchResult_t *result);
+
+/**
+ * Sweep every path, pattern and block size. With csv set, a header and one
+ * line per run are written there; every run is also logged.
+ */
+esp_err_t sd_bench_run(const SdBenchConfig_t *config, FILE *csv);
+
+const char *sd_bench_api_name(SdBenchApi_t api);
+const char *sd_bench_pattern_name(SdBenchPattern_t pattern);
@@ -16,7 +16,7 @@
 #include "driver/sdmmc_host.h"
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
-#include "esp_timer.h"
+#include "sd_bench.h"
 
 static const char *TAG = "sd_card_test";
 
@@ -34,13 +34,6 @@ static const char *TAG = "sd_card_test";
 
 static sdmmc_card_t *card = NULL;
 
-/**
- * Get current time in milliseconds (replacement for Arduino millis())
- */
-static uint32_t millis(void) {
-    return (uint32_t)(esp_timer_get_time() / 1000);
-}
-
 /**
  * List directory contents
  */
@@ -222,53 +215,21 @@ void delete_file(const char *path) {
 }
 
 /**
- * Test file I/O performance
+ * Benchmark card writes and reads on the file at path: stdio, POSIX and
+ * raw sectors, streamed and appended with fsync, then read back, over
+ * 512 B - 64 KiB blocks. One CSV line per run goes to the console, with
+ * per-write or per-read latency percentiles.
  */
 void test_file_io(const char *path) {
-    char full_path[256];
-    snprintf(full_path, sizeof(full_path), "%s%s", MOUNT_POINT, path);
-    
-    static uint8_t buf[512];
-    memset(buf, 0xAA, sizeof(buf));  // Fill buffer with test pattern
-    
-    // Test read performance
-    FILE *file = fopen(full_path, "r");
-    if (file) {
-        fseek(file, 0, SEEK_END);
-        size_t flen = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        
-        size_t len = flen;
-        uint32_t start = millis();
-        
-        while (len > 0) {
-            size_t to_read = (len > 512) ? 512 : len;
-            fread(buf, 1, to_read, file);
-            len -= to_read;
-        }
-        
-        uint32_t duration = millis() - start;
-        ESP_LOGI(TAG, "%u bytes read for %lu ms", (unsigned int)flen, (unsigned long)duration);
-        fclose(file);
-    } else {
-        ESP_LOGE(TAG, "Failed to open file for reading");
-    }
-    
-    // Test write performance
-    file = fopen(full_path, "w");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open file for writing");
-        return;
-    }
+    SdBenchConfig_t config = SD_BENCH_CONFIG_DEFAULT();
+    config.mount_point = MOUNT_POINT;
+    config.file_name = (path[0] == '/') ? path + 1 : path;
+    config.card = card;
     
-    uint32_t start = millis();
-    for (int i = 0; i < 2048; i++) {
-        fwrite(buf, 1, 512, file);
+    esp_err_t ret = sd_bench_run(&config, stdout);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Benchmark failed: %s", esp_err_to_name(ret));
     }
-    uint32_t duration = millis() - start;
-    
-    ESP_LOGI(TAG, "%u bytes written for %lu ms", 2048 * 512, (unsigned long)duration);
-    fclose(file);
 }
 
 /**
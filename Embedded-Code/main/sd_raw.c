@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <string.h>
+#include "sd_raw.h"
+#include "ff.h"
+#include "diskio_sdmmc.h"
+#include "esp_log.h"
+
+static const char *TAG = "sd_raw";
+
+esp_err_t sd_raw_open(SdRawExtent_t *extent, sdmmc_card_t *card, const char *name)
+{
+    BYTE pdrv = ff_diskio_get_pdrv_card(card);
+    if (pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "%d:/%s", pdrv, name);
+    FIL file;
+    FRESULT res = f_open(&file, path, FA_READ);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Cannot open %s (%d)", path, res);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Same mapping as FatFs' clst2sect(); database already includes the
+    // partition offset, so this is an absolute card sector
+    FATFS *fs = file.obj.fs;
+    DWORD cluster = file.obj.sclust;
+#if FF_MAX_SS != FF_MIN_SS
+    uint32_t sector_size = fs->ssize;
+#else
+    uint32_t sector_size = FF_MAX_SS;
+#endif
+    extent->card = card;
+    extent->sector_size = sector_size;
+    extent->size = file.obj.objsize;
+    extent->first_sector = (cluster >= 2) ? (uint32_t)(fs->database + (LBA_t)fs->csize * (cluster - 2)) : 0;
+    f_close(&file);
+
+    if (cluster < 2 || sector_size != card->csd.sector_size) {
+        ESP_LOGE(TAG, "%s has no usable extent", path);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ESP_LOGI(TAG, "%s: %llu KiB from sector %lu", path,
+             (unsigned long long)(extent->size / 1024), (unsigned long)extent->first_sector);
+    return ESP_OK;
+}
+
+esp_err_t sd_raw_write(const SdRawExtent_t *extent, uint64_t offset, const void *data, size_t len)
+{
+    if (offset % extent->sector_size != 0 || len % extent->sector_size != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset + len > extent->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return sdmmc_write_sectors(extent->card, data, extent->first_sector + offset / extent->sector_size,
+                               len / extent->sector_size);
+}
@@ -0,0 +1,38 @@
+/**
+ * Raw sector writes into a contiguous file
+ *
+ * A file whose clusters were reserved in one run (esp_vfs_fat_create_contiguous_file)
+ * occupies consecutive card sectors. Once its first sector is known, data can
+ * be written there with multi-sector SDMMC commands, bypassing VFS, stdio and
+ * FATFS, and still be read back as an ordinary file afterwards.
+ *
+ * Nothing in FATFS knows about these writes: the file must not be written
+ * through the file system at the same offsets while the extent is in use.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdmmc_cmd.h"
+#include "esp_err.h"
+
+typedef struct {
+    sdmmc_card_t *card;
+    uint32_t first_sector;      // Card sector holding file offset 0
+    uint32_t sector_size;
+    uint64_t size;              // Bytes of the file covered by the extent
+} SdRawExtent_t;
+
+/**
+ * Locate the contiguous file name (relative to the card's root) on card.
+ * The caller vouches that the file is contiguous, i.e. it was created with
+ * esp_vfs_fat_create_contiguous_file() and never grown since.
+ */
+esp_err_t sd_raw_open(SdRawExtent_t *extent, sdmmc_card_t *card, const char *name);
+
+/**
+ * Write len bytes at file offset, both multiples of the sector size, in one
+ * multi-sector command. data should be DMA-capable and word aligned, or the
+ * driver falls back to bouncing single sectors through its own buffer.
+ */
+esp_err_t sd_raw_write(const SdRawExtent_t *extent, uint64_t offset, const void *data, size_t len);
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sensor_driver.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "bmx280";
+
+// Register map (BME280 / BMP280)
+#define BMX_REG_CALIB_TP        0x88        // dig_T1 .. dig_P9, then dig_H1 at 0xA1
+#define BMX_REG_CHIP_ID         0xD0
+#define BMX_REG_RESET           0xE0
+#define BMX_REG_CALIB_H         0xE1        // dig_H2 .. dig_H6
+#define BMX_REG_CTRL_HUM        0xF2
+#define BMX_REG_CTRL_MEAS       0xF4
+#define BMX_REG_CONFIG          0xF5
+#define BMX_REG_PRESS_MSB       0xF7
+
+#define BMX_RESET_WORD          0xB6
+#define BMX_CHIP_ID_BMP280      0x58
+#define BMX_CHIP_ID_BME280      0x60
+
+#define BMX_OSRS_X1             1
+#define BMX_OSRS_X4             3
+#define BMX_MODE_NORMAL         3
+#define BMX_FILTER_4            (2 << 2)    // config register, t_sb = 0.5 ms
+
+// Factory trimming parameters, see the BME280 datasheet section 4.2.2
+typedef struct {
+    uint16_t T1;
+    int16_t  T2, T3;
+    uint16_t P1;
+    int16_t  P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t  H1, H3;
+    int16_t  H2, H4, H5;
+    int8_t   H6;
+} bmx_calib_t;
+
+_Static_assert(sizeof(bmx_calib_t) <= sizeof(((SensorDevice_t *)0)->calib), "BMx280 calibration too large");
+
+static const SensorChannel_t bme280_channels[] = {
+    { "temp", "degC", 100 },
+    { "press", "Pa", 256 },
+    { "hum", "%RH", 1024 },
+};
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static esp_err_t bmx_init(SensorDevice_t *dev, uint8_t chip_id, bool humidity)
+{
+    bmx_calib_t *calib = (bmx_calib_t *)dev->calib;
+    uint8_t id;
+    uint8_t tp[26];
+    uint8_t h[7];
+
+    esp_err_t ret = sensor_read_regs(dev, BMX_REG_CHIP_ID, &id, 1);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (id != chip_id) {
+        ESP_LOGE(TAG, "Chip id 0x%02X, expected 0x%02X", id, chip_id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ret = sensor_write_reg(dev, BMX_REG_RESET, BMX_RESET_WORD);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));  // Start-up time is 2 ms; NVM copy finishes well within
+
+    ret = sensor_read_regs(dev, BMX_REG_CALIB_TP, tp, sizeof(tp));
+    if (ret == ESP_OK && humidity) {
+        ret = sensor_read_regs(dev, BMX_REG_CALIB_H, h, sizeof(h));
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    memset(calib, 0, sizeof(*calib));
+    calib->T1 = le16(tp + 0);
+    calib->T2 = (int16_t)le16(tp + 2);
+    calib->T3 = (int16_t)le16(tp + 4);
+    calib->P1 = le16(tp + 6);
+    calib->P2 = (int16_t)le16(tp + 8);
+    calib->P3 = (int16_t)le16(tp + 10);
+    calib->P4 = (int16_t)le16(tp + 12);
+    calib->P5 = (int16_t)le16(tp + 14);
+    calib->P6 = (int16_t)le16(tp + 16);
+    calib->P7 = (int16_t)le16(tp + 18);
+    calib->P8 = (int16_t)le16(tp + 20);
+    calib->P9 = (int16_t)le16(tp + 22);
+    if (humidity) {
+        calib->H1 = tp[25];
+        calib->H2 = (int16_t)le16(h + 0);
+        calib->H3 = h[2];
+        calib->H4 = (int16_t)(((int8_t)h[3] * 16) | (h[4] & 0x0F));
+        calib->H5 = (int16_t)(((int8_t)h[5] * 16) | (h[4] >> 4));
+        calib->H6 = (int8_t)h[6];
+    }
+
+    // Blank NVM reads back as all zeros or all ones
+    if (calib->T1 == 0 || calib->T1 == 0xFFFF || calib->P1 == 0 || calib->P1 == 0xFFFF) {
+        ESP_LOGE(TAG, "Calibration data is blank");
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bme280_init(SensorDevice_t *dev)
+{
+    return bmx_init(dev, BMX_CHIP_ID_BME280, true);
+}
+
+static esp_err_t bmp280_init(SensorDevice_t *dev)
+{
+    return bmx_init(dev, BMX_CHIP_ID_BMP280, false);
+}
+
+/**
+ * Temperature in 0.01 degC. Also returns t_fine for the other channels.
+ */
+static int32_t compensate_temp(const bmx_calib_t *c, int32_t adc_T, int32_t *t_fine)
+{
+    int32_t var1 = ((((adc_T >> 3) - ((int32_t)c->T1 << 1))) * c->T2) >> 11;
+    int32_t var2 = (((((adc_T >> 4) - (int32_t)c->T1) * ((adc_T >> 4) - (int32_t)c->T1)) >> 12) * c->T3) >> 14;
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+/**
+ * Pressure in Pa as Q24.8
+ */
+static int32_t compensate_press(const bmx_calib_t *c, int32_t adc_P, int32_t t_fine)
+{
+    int64_t var1 = (int64_t)t_fine - 128000;
+    int64_t var2 = var1 * var1 * c->P6;
+    var2 = var2 + ((var1 * c->P5) << 17);
+    var2 = var2 + ((int64_t)c->P4 << 35);
+    var1 = ((var1 * var1 * c->P3) >> 8) + ((var1 * c->P2) << 12);
+    var1 = ((((int64_t)1 << 47) + var1) * c->P1) >> 33;
+    if (var1 == 0) {
+        return SENSOR_VALUE_INVALID;
+    }
+
+    int64_t p = 1048576 - adc_P;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = ((int64_t)c->P9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((int64_t)c->P8 * p) >> 19;
+    return (int32_t)(((p + var1 + var2) >> 8) + ((int64_t)c->P7 << 4));
+}
+
+/**
+ * Relative humidity in % as Q22.10
+ */
+static int32_t compensate_hum(const bmx_calib_t *c, int32_t adc_H, int32_t t_fine)
+{
+    int32_t v = t_fine - 76800;
+    v = (((((adc_H << 14) - ((int32_t)c->H4 << 20) - ((int32_t)c->H5 * v)) + 16384) >> 15) *
+         (((((((v * c->H6) >> 10) * (((v * (int32_t)c->H3) >> 11) + 32768)) >> 10) + 2097152) *
+           c->H2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)c->H1) >> 4);
+    v = (v < 0) ? 0 : v;
+    v = (v > 419430400) ? 419430400 : v;
+    return v >> 12;
+}
+
+static void bmx_decode(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out)
+{
+    const bmx_calib_t *calib = (const bmx_calib_t *)dev->calib;
+    int32_t adc_P = (raw[0] << 12) | (raw[1] << 4) | (raw[2] >> 4);
+    int32_t adc_T = (raw[3] << 12) | (raw[4] << 4) | (raw[5] >> 4);
+    int32_t t_fine;
+
+    out[0] = compensate_temp(calib, adc_T, &t_fine);
+    out[1] = compensate_press(calib, adc_P, t_fine);
+}
+
+static void bme280_decode(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out)
+{
+    const bmx_calib_t *calib = (const bmx_calib_t *)dev->calib;
+    int32_t adc_T = (raw[3] << 12) | (raw[4] << 4) | (raw[5] >> 4);
+    int32_t t_fine;
+
+    bmx_decode(dev, raw, out);
+    compensate_temp(calib, adc_T, &t_fine);
+    out[2] = compensate_hum(calib, (raw[6] << 8) | raw[7], t_fine);
+}
+
+/**
+ * A forced conversion must land inside the sensor's operating range
+ */
+static esp_err_t bmx_self_test(SensorDevice_t *dev, const SensorDriver_t *driver)
+{
+    uint8_t raw[8];
+    int32_t ch[3];
+
+    esp_err_t ret = ESP_OK;
+    if (driver->channel_count > 2) {
+        ret = sensor_write_reg(dev, BMX_REG_CTRL_HUM, BMX_OSRS_X1);
+    }
+    if (ret == ESP_OK) {
+        ret = sensor_write_reg(dev, BMX_REG_CTRL_MEAS, (BMX_OSRS_X1 << 5) | (BMX_OSRS_X1 << 2) | 1);
+    }
+    if (ret == ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        ret = sensor_read(driver, dev, raw);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    driver->decode(dev, raw, ch);
+    if (ch[0] < -4000 || ch[0] > 8500 || ch[1] < 30000 * 256 || ch[1] > 110000 * 256) {
+        ESP_LOGW(TAG, "Out of range: %ld.%02ld degC, %ld Pa",
+                 (long)(ch[0] / 100), (long)abs(ch[0] % 100), (long)(ch[1] / 256));
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bme280_self_test(SensorDevice_t *dev)
+{
+    return bmx_self_test(dev, &bme280_driver);
+}
+
+static esp_err_t bmp280_self_test(SensorDevice_t *dev)
+{
+    return bmx_self_test(dev, &bmp280_driver);
+}
+
+/**
+ * Normal mode with minimal standby. Pressure oversampling is traded for
+ * conversion time: x4 (about 60 Hz) up to 50 Hz, x1 (about 120 Hz) above.
+ */
+static esp_err_t bmx_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy, bool humidity)
+{
+    if (rate_hz == 0 || rate_hz > 120 || drdy) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t osrs_p = (rate_hz > 50) ? BMX_OSRS_X1 : BMX_OSRS_X4;
+
+    // ctrl_hum only takes effect after the following ctrl_meas write
+    esp_err_t ret = humidity ? sensor_write_reg(dev, BMX_REG_CTRL_HUM, BMX_OSRS_X1) : ESP_OK;
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, BMX_REG_CONFIG, BMX_FILTER_4);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, BMX_REG_CTRL_MEAS,
+                                              (BMX_OSRS_X1 << 5) | (osrs_p << 2) | BMX_MODE_NORMAL);
+    return ret;
+}
+
+static esp_err_t bme280_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy)
+{
+    return bmx_configure(dev, rate_hz, drdy, true);
+}
+
+static esp_err_t bmp280_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy)
+{
+    return bmx_configure(dev, rate_hz, drdy, false);
+}
+
+const SensorDriver_t bme280_driver = {
+    .name = "bme280",
+    .data_reg = BMX_REG_PRESS_MSB,
+    .raw_len = 8,
+    .channel_count = 3,
+    .channels = bme280_channels,
+    .init = bme280_init,
+    .self_test = bme280_self_test,
+    .configure = bme280_configure,
+    .decode = bme280_decode,
+};
+
+const SensorDriver_t bmp280_driver = {
+    .name = "bmp280",
+    .data_reg = BMX_REG_PRESS_MSB,
+    .raw_len = 6,
+    .channel_count = 2,
+    .channels = bme280_channels,
+    .init = bmp280_init,
+    .self_test = bmp280_self_test,
+    .configure = bmp280_configure,
+    .decode = bmx_decode,
+};
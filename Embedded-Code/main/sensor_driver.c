@@ -0,0 +1,48 @@
+#include <string.h>
+#include "sensor_driver.h"
+#include "i2c_async.h"
+
+// Every driver built into the firmware
+static const SensorDriver_t *const sensor_drivers[] = {
+    &mpu6050_driver,
+    &mpu6050_fifo_driver,
+    &bme280_driver,
+    &bmp280_driver,
+    &hmc5883l_driver,
+};
+
+const SensorDriver_t *sensor_driver_find(const char *name)
+{
+    for (size_t i = 0; i < sizeof(sensor_drivers) / sizeof(sensor_drivers[0]); i++) {
+        if (strcmp(sensor_drivers[i]->name, name) == 0) {
+            return sensor_drivers[i];
+        }
+    }
+    return NULL;
+}
+
+int sensor_driver_channel(const SensorDriver_t *driver, const char *name)
+{
+    for (int c = 0; c < driver->channel_count; c++) {
+        if (strcmp(driver->channels[c].name, name) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+esp_err_t sensor_read(const SensorDriver_t *driver, SensorDevice_t *dev, uint8_t *raw)
+{
+    return sensor_read_regs(dev, driver->data_reg, raw, driver->raw_len);
+}
+
+esp_err_t sensor_write_reg(SensorDevice_t *dev, uint8_t reg, uint8_t value)
+{
+    uint8_t buf[2] = { reg, value };
+    return i2c_async_transfer(dev->id, buf, sizeof(buf), NULL, 0, NULL);
+}
+
+esp_err_t sensor_read_regs(SensorDevice_t *dev, uint8_t reg, uint8_t *data, size_t len)
+{
+    return i2c_async_transfer(dev->id, &reg, 1, data, len, NULL);
+}
@@ -0,0 +1,87 @@
+/**
+ * Sensor driver interface
+ *
+ * Each supported part is described by a const SensorDriver_t: the register
+ * burst that reads one sample (or one FIFO frame), the channels it decodes
+ * into, and the operations that bring it up. The sensor table in main.c
+ * only picks a driver, an address and a rate per sensor.
+ *
+ * Bring-up order is init -> self_test -> configure. Drivers talk to their
+ * device through the i2c_async engine and keep their calibration in the
+ * SensorDevice_t, so decode() is a pure function of raw bytes.
+ *
+ * Decoded channels are int32 fixed point: value / scale in the channel's
+ * unit. They are logged as-is, see log_format.h.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define SENSOR_CALIB_WORDS      12          // Driver-private calibration storage
+#define SENSOR_MAX_RAW_LEN      14          // Largest sample burst of any driver
+#define SENSOR_MAX_CHANNELS     8
+
+#define SENSOR_VALUE_INVALID    INT32_MIN   // Channel could not be read or decoded
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    int32_t scale;              // Value units per unit
+} SensorChannel_t;
+
+typedef struct {
+    int id;                     // Device id registered with i2c_async
+    uint32_t calib[SENSOR_CALIB_WORDS];
+} SensorDevice_t;
+
+typedef struct {
+    const char *name;
+    uint8_t data_reg;           // First register of a sample burst
+    uint8_t raw_len;            // Bytes per sample (per frame when fifo)
+    uint8_t channel_count;
+    const SensorChannel_t *channels;
+    bool fifo;                  // Samples are drained from the hardware FIFO
+    bool drdy_active_low;       // Polarity of the data-ready pin
+
+    /** Identify the part, reset it and load its calibration */
+    esp_err_t (*init)(SensorDevice_t *dev);
+
+    /** Check that the part responds with plausible data */
+    esp_err_t (*self_test)(SensorDevice_t *dev);
+
+    /** Start continuous sampling at rate_hz, raising data-ready if drdy */
+    esp_err_t (*configure)(SensorDevice_t *dev, uint16_t rate_hz, bool drdy);
+
+    /** Convert raw_len bytes into channel_count channel values */
+    void (*decode)(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out);
+} SensorDriver_t;
+
+extern const SensorDriver_t mpu6050_driver;         // Also MPU6500/9250
+extern const SensorDriver_t mpu6050_fifo_driver;
+extern const SensorDriver_t bme280_driver;
+extern const SensorDriver_t bmp280_driver;
+extern const SensorDriver_t hmc5883l_driver;
+
+/**
+ * Look up a driver by name, NULL if there is none
+ */
+const SensorDriver_t *sensor_driver_find(const char *name);
+
+/**
+ * Index of the driver's channel called name, -1 if it has none
+ */
+int sensor_driver_channel(const SensorDriver_t *driver, const char *name);
+
+/**
+ * Read one sample burst with a blocking transfer
+ */
+esp_err_t sensor_read(const SensorDriver_t *driver, SensorDevice_t *dev, uint8_t *raw);
+
+/**
+ * Register helpers for drivers
+ */
+esp_err_t sensor_write_reg(SensorDevice_t *dev, uint8_t reg, uint8_t value);
+esp_err_t sensor_read_regs(SensorDevice_t *dev, uint8_t reg, uint8_t *data, size_t len);
@@ -0,0 +1,144 @@
+#include "sensor_driver.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "hmc5883l";
+
+// Register map
+#define HMC_REG_CRA             0x00
+#define HMC_REG_CRB             0x01
+#define HMC_REG_MODE            0x02
+#define HMC_REG_DATA_X_MSB      0x03        // X, Z, Y, big-endian
+#define HMC_REG_ID_A            0x0A        // "H43"
+
+#define HMC_CRA_AVG_1           (0 << 5)
+#define HMC_CRA_AVG_8           (3 << 5)
+#define HMC_CRA_BIAS_POS        0x01
+#define HMC_CRB_GAIN_1_3GA      (1 << 5)    // 1090 LSB/Ga
+#define HMC_CRB_GAIN_4_7GA      (5 << 5)    // 390 LSB/Ga
+#define HMC_MODE_CONTINUOUS     0x00
+#define HMC_MODE_SINGLE         0x01
+
+#define HMC_OVERFLOW            -4096
+#define HMC_LSB_PER_GA          1090
+
+// Output data rates selectable in CRA, index = DO2..DO0
+static const uint8_t hmc_rates_hz[] = { 1, 2, 3, 8, 15, 30, 75 };
+
+static const SensorChannel_t hmc_channels[] = {
+    { "mx", "uT", 1000 },
+    { "my", "uT", 1000 },
+    { "mz", "uT", 1000 },
+};
+
+static inline int32_t be16(const uint8_t *p)
+{
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+static esp_err_t hmc_init(SensorDevice_t *dev)
+{
+    uint8_t id[3];
+
+    esp_err_t ret = sensor_read_regs(dev, HMC_REG_ID_A, id, sizeof(id));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (id[0] != 'H' || id[1] != '4' || id[2] != '3') {
+        ESP_LOGE(TAG, "Unknown id %02X %02X %02X", id[0], id[1], id[2]);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+/**
+ * nT from one axis at 1.3 Ga full scale; 1 Ga = 100000 nT
+ */
+static inline int32_t axis_nt(int32_t raw)
+{
+    if (raw == HMC_OVERFLOW) {
+        return SENSOR_VALUE_INVALID;
+    }
+    return raw * 100000 / HMC_LSB_PER_GA;
+}
+
+static void hmc_decode(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out)
+{
+    out[0] = axis_nt(be16(raw + 0));
+    out[1] = axis_nt(be16(raw + 4));
+    out[2] = axis_nt(be16(raw + 2));
+}
+
+/**
+ * Built-in self test: the positive bias strap adds a known field of about
+ * 1.16 Ga per axis, which must read 243..575 counts at gain 5
+ */
+static esp_err_t hmc_self_test(SensorDevice_t *dev)
+{
+    uint8_t raw[6];
+
+    esp_err_t ret = sensor_write_reg(dev, HMC_REG_CRA, HMC_CRA_AVG_8 | (4 << 2) | HMC_CRA_BIAS_POS);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, HMC_REG_CRB, HMC_CRB_GAIN_4_7GA);
+
+    // The first measurement after a gain change still uses the old gain
+    for (int i = 0; i < 2 && ret == ESP_OK; i++) {
+        ret = sensor_write_reg(dev, HMC_REG_MODE, HMC_MODE_SINGLE);
+        if (ret == ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            ret = sensor_read_regs(dev, HMC_REG_DATA_X_MSB, raw, sizeof(raw));
+        }
+    }
+
+    // Always leave the bias strap off again
+    esp_err_t off = sensor_write_reg(dev, HMC_REG_CRA, HMC_CRA_AVG_8 | (4 << 2));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (off != ESP_OK) {
+        return off;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t value = be16(raw + axis * 2);
+        if (value < 243 || value > 575) {
+            ESP_LOGW(TAG, "Self test axis %d read %ld counts", axis, (long)value);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * Continuous mode at the slowest output rate that keeps up with rate_hz.
+ * DRDY pulses low on every new sample regardless, so drdy needs no setup.
+ */
+static esp_err_t hmc_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy)
+{
+    if (rate_hz == 0 || rate_hz > 75) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t rate = 0;
+    while (hmc_rates_hz[rate] < rate_hz) {
+        rate++;
+    }
+
+    esp_err_t ret = sensor_write_reg(dev, HMC_REG_CRA, HMC_CRA_AVG_1 | (rate << 2));
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, HMC_REG_CRB, HMC_CRB_GAIN_1_3GA);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, HMC_REG_MODE, HMC_MODE_CONTINUOUS);
+    return ret;
+}
+
+const SensorDriver_t hmc5883l_driver = {
+    .name = "hmc5883l",
+    .data_reg = HMC_REG_DATA_X_MSB,
+    .raw_len = 6,
+    .channel_count = sizeof(hmc_channels) / sizeof(hmc_channels[0]),
+    .channels = hmc_channels,
+    .drdy_active_low = true,
+    .init = hmc_init,
+    .self_test = hmc_self_test,
+    .configure = hmc_configure,
+    .decode = hmc_decode,
+};
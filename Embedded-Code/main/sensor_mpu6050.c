@@ -0,0 +1,220 @@
+#include <string.h>
+#include "sensor_driver.h"
+#include "mpu_fifo.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "mpu6050";
+
+// Register map (MPU6050 / MPU6500 / MPU9250)
+#define MPU_REG_SMPLRT_DIV      0x19
+#define MPU_REG_CONFIG          0x1A
+#define MPU_REG_GYRO_CONFIG     0x1B
+#define MPU_REG_ACCEL_CONFIG    0x1C
+#define MPU_REG_INT_PIN_CFG     0x37
+#define MPU_REG_INT_ENABLE      0x38
+#define MPU_REG_ACCEL_XOUT_H    0x3B
+#define MPU_REG_PWR_MGMT_1      0x6B
+#define MPU_REG_WHO_AM_I        0x75
+
+#define MPU_PWR_RESET           0x80
+#define MPU_PWR_CLK_PLL_X       0x01        // Awake, clocked from the gyro PLL
+#define MPU_CONFIG_DLPF_188HZ   0x01        // Gyro output rate 1 kHz
+#define MPU_GYRO_FS_2000DPS     0x18
+#define MPU_ACCEL_FS_16G        0x18
+#define MPU_INT_CLEAR_ON_READ   0x10        // Active high, push-pull, 50 us pulse
+#define MPU_INT_DATA_RDY        0x01
+
+#define MPU_WHO_AM_I_6050       0x68
+#define MPU_WHO_AM_I_6500       0x70
+#define MPU_WHO_AM_I_9250       0x71
+#define MPU_WHO_AM_I_9255       0x73
+
+// Full scale picked for flight: +-16 g, +-2000 dps
+#define MPU_ACCEL_LSB_PER_G     2048
+#define MPU_GYRO_LSB_X10_PER_DPS 164
+
+typedef struct {
+    uint8_t who_am_i;           // Selects the temperature formula and FIFO size
+} mpu_calib_t;
+
+_Static_assert(sizeof(mpu_calib_t) <= sizeof(((SensorDevice_t *)0)->calib), "MPU calibration too large");
+
+static const SensorChannel_t mpu_channels[] = {
+    { "ax", "m/s2", 1000 },
+    { "ay", "m/s2", 1000 },
+    { "az", "m/s2", 1000 },
+    { "temp", "degC", 100 },
+    { "gx", "dps", 1000 },
+    { "gy", "dps", 1000 },
+    { "gz", "dps", 1000 },
+};
+
+// FIFO frames carry no temperature
+static const SensorChannel_t mpu_fifo_channels[] = {
+    { "ax", "m/s2", 1000 },
+    { "ay", "m/s2", 1000 },
+    { "az", "m/s2", 1000 },
+    { "gx", "dps", 1000 },
+    { "gy", "dps", 1000 },
+    { "gz", "dps", 1000 },
+};
+
+static inline int32_t be16(const uint8_t *p)
+{
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+static inline int32_t accel_mm_s2(int32_t raw)
+{
+    return raw * 9807 / MPU_ACCEL_LSB_PER_G;
+}
+
+static inline int32_t gyro_mdps(int32_t raw)
+{
+    return raw * 10000 / MPU_GYRO_LSB_X10_PER_DPS;
+}
+
+static esp_err_t mpu_init(SensorDevice_t *dev)
+{
+    mpu_calib_t *calib = (mpu_calib_t *)dev->calib;
+
+    esp_err_t ret = sensor_write_reg(dev, MPU_REG_PWR_MGMT_1, MPU_PWR_RESET);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    ret = sensor_write_reg(dev, MPU_REG_PWR_MGMT_1, MPU_PWR_CLK_PLL_X);
+    if (ret == ESP_OK) {
+        ret = sensor_read_regs(dev, MPU_REG_WHO_AM_I, &calib->who_am_i, 1);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    switch (calib->who_am_i) {
+    case MPU_WHO_AM_I_6050:
+    case MPU_WHO_AM_I_6500:
+    case MPU_WHO_AM_I_9250:
+    case MPU_WHO_AM_I_9255:
+        return ESP_OK;
+    default:
+        ESP_LOGE(TAG, "Unknown WHO_AM_I 0x%02X", calib->who_am_i);
+        return ESP_ERR_NOT_FOUND;
+    }
+}
+
+static void mpu_decode(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out)
+{
+    const mpu_calib_t *calib = (const mpu_calib_t *)dev->calib;
+
+    out[0] = accel_mm_s2(be16(raw + 0));
+    out[1] = accel_mm_s2(be16(raw + 2));
+    out[2] = accel_mm_s2(be16(raw + 4));
+    if (calib->who_am_i == MPU_WHO_AM_I_6050) {
+        out[3] = be16(raw + 6) * 100 / 340 + 3653;          // T = raw / 340 + 36.53
+    } else {
+        out[3] = be16(raw + 6) * 10000 / 33387 + 2100;      // T = raw / 333.87 + 21
+    }
+    out[4] = gyro_mdps(be16(raw + 8));
+    out[5] = gyro_mdps(be16(raw + 10));
+    out[6] = gyro_mdps(be16(raw + 12));
+}
+
+static void mpu_fifo_decode(const SensorDevice_t *dev, const uint8_t *raw, int32_t *out)
+{
+    out[0] = accel_mm_s2(be16(raw + 0));
+    out[1] = accel_mm_s2(be16(raw + 2));
+    out[2] = accel_mm_s2(be16(raw + 4));
+    out[3] = gyro_mdps(be16(raw + 6));
+    out[4] = gyro_mdps(be16(raw + 8));
+    out[5] = gyro_mdps(be16(raw + 10));
+}
+
+/**
+ * At rest the accelerometer must see gravity and nothing else
+ */
+static esp_err_t mpu_self_test(SensorDevice_t *dev)
+{
+    uint8_t raw[14];
+    int32_t ch[7];
+
+    esp_err_t ret = sensor_write_reg(dev, MPU_REG_ACCEL_CONFIG, MPU_ACCEL_FS_16G);
+    if (ret == ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        ret = sensor_read(&mpu6050_driver, dev, raw);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    mpu_decode(dev, raw, ch);
+    int64_t g2 = (int64_t)ch[0] * ch[0] + (int64_t)ch[1] * ch[1] + (int64_t)ch[2] * ch[2];
+    if (g2 < 4903LL * 4903 || g2 > 14710LL * 14710) {
+        ESP_LOGW(TAG, "Accel reads %ld/%ld/%ld mm/s2 at rest", (long)ch[0], (long)ch[1], (long)ch[2]);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t set_full_scale(SensorDevice_t *dev)
+{
+    esp_err_t ret = sensor_write_reg(dev, MPU_REG_GYRO_CONFIG, MPU_GYRO_FS_2000DPS);
+    if (ret == ESP_OK) {
+        ret = sensor_write_reg(dev, MPU_REG_ACCEL_CONFIG, MPU_ACCEL_FS_16G);
+    }
+    return ret;
+}
+
+static esp_err_t mpu_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy)
+{
+    if (rate_hz == 0 || rate_hz > 1000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = set_full_scale(dev);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, MPU_REG_CONFIG, MPU_CONFIG_DLPF_188HZ);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, MPU_REG_SMPLRT_DIV, 1000 / rate_hz - 1);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, MPU_REG_INT_PIN_CFG, MPU_INT_CLEAR_ON_READ);
+    if (ret == ESP_OK) ret = sensor_write_reg(dev, MPU_REG_INT_ENABLE, drdy ? MPU_INT_DATA_RDY : 0);
+    return ret;
+}
+
+static esp_err_t mpu_fifo_configure(SensorDevice_t *dev, uint16_t rate_hz, bool drdy)
+{
+    const mpu_calib_t *calib = (const mpu_calib_t *)dev->calib;
+
+    esp_err_t ret = set_full_scale(dev);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return mpu_fifo_init(dev->id, rate_hz, (calib->who_am_i == MPU_WHO_AM_I_6050) ?
+                         MPU_FIFO_SIZE_MPU6050 : MPU_FIFO_SIZE_MPU6500);
+}
+
+const SensorDriver_t mpu6050_driver = {
+    .name = "mpu6050",
+    .data_reg = MPU_REG_ACCEL_XOUT_H,
+    .raw_len = 14,
+    .channel_count = sizeof(mpu_channels) / sizeof(mpu_channels[0]),
+    .channels = mpu_channels,
+    .init = mpu_init,
+    .self_test = mpu_self_test,
+    .configure = mpu_configure,
+    .decode = mpu_decode,
+};
+
+const SensorDriver_t mpu6050_fifo_driver = {
+    .name = "mpu6050fifo",
+    .data_reg = MPU_REG_ACCEL_XOUT_H,
+    .raw_len = MPU_FIFO_FRAME_LEN,
+    .channel_count = sizeof(mpu_fifo_channels) / sizeof(mpu_fifo_channels[0]),
+    .channels = mpu_fifo_channels,
+    .fifo = true,
+    .init = mpu_init,
+    .self_test = mpu_self_test,
+    .configure = mpu_fifo_configure,
+    .decode = mpu_fifo_decode,
+};
@@ -0,0 +1,90 @@
+"""
+Convert a Star PI binary log back into CSV.
+
+The input is either the card itself, holding the F<flight>_<segment>.BIN
+segment files, or segment files of one flight given in order.
+
+Usage:
+    python sd-parser.py /media/sdcard -o sensor_data.csv [--flight N] [--gaps gaps.csv]
+    python sd-parser.py /media/sdcard --list
+    python sd-parser.py F0003_000.BIN F0003_001.BIN -o sensor_data.csv
+"""
+
+import argparse
+import os
+import sys
+
+import starlog
+
+
+def list_flights(card_dir):
+    """Print what the card's index says about every segment on it"""
+    index = starlog.read_index(card_dir)
+    for flight, paths in sorted(starlog.find_segments(card_dir).items()):
+        for path in paths:
+            name = os.path.basename(path)
+            entry = index.get(name.upper())
+            if entry is None:
+                print(f"{name}  flight {flight}  not closed", file=sys.stderr)
+            else:
+                seconds = (entry['last_us'] - entry['first_us']) / 1e6
+                print(f"{name}  flight {flight}  {entry['samples']} samples, {seconds:.1f} s, "
+                      f"{entry['bytes']} bytes", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode a Star PI binary sensor log to CSV')
+    parser.add_argument('input', nargs='+', help='SD card directory, or segment files of one flight in order')
+    parser.add_argument('-o', '--output', help='Output CSV file (default: stdout)')
+    parser.add_argument('--flight', type=int, help='Flight to decode from a card directory (default: the last)')
+    parser.add_argument('--list', action='store_true', help='List the segments on a card directory')
+    parser.add_argument('--gaps', help='Also write the gap records to this CSV file')
+    args = parser.parse_args()
+
+    try:
+        if len(args.input) == 1 and os.path.isdir(args.input[0]):
+            card_dir = args.input[0]
+            if args.list:
+                list_flights(card_dir)
+                return 0
+            flights = starlog.find_segments(card_dir)
+            if not flights:
+                raise starlog.LogFormatError(f'No log segments in {card_dir}')
+            flight = args.flight if args.flight is not None else max(flights)
+            if flight not in flights:
+                raise starlog.LogFormatError(f'No flight {flight} in {card_dir}')
+            paths = flights[flight]
+        else:
+            paths = args.input
+        header, rows, stats = starlog.decode_flight(paths)
+    except (OSError, starlog.LogFormatError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    if args.output:
+        with open(args.output, 'w') as out:
+            starlog.write_csv(header, rows, out)
+    else:
+        starlog.write_csv(header, rows, sys.stdout)
+    if args.gaps:
+        with open(args.gaps, 'w') as out:
+            starlog.write_gaps_csv(header, stats.gaps, out)
+
+    for sensor in header.sensors:
+        channels = ', '.join(f"{ch.name} [{ch.unit}]" for ch in sensor.channels)
+        print(f"{sensor.name} ({sensor.driver}, {sensor.rate_hz} Hz): {channels}", file=sys.stderr)
+    print(f"Decoded flight {header.flight}: {stats.records} records from {stats.blocks} blocks "
+          f"in {len(paths)} segments ({stats.bad_blocks} bad blocks, {stats.skipped_bytes} bytes skipped)",
+          file=sys.stderr)
+    lost = stats.lost()
+    if lost:
+        lost = ', '.join(f"{name} {count}" for name, count in lost.items())
+        print(f"{len(stats.gaps)} gap records, samples lost: {lost}", file=sys.stderr)
+    for event in stats.events:
+        print(f"{event.timestamp_us / 1e6:10.3f} s  {event.state} (from {event.previous}) "
+              f"at {event.altitude_m:.1f} m", file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
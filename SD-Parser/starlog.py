@@ -0,0 +1,393 @@
+"""
+Decoder for the Star PI binary sensor log.
+
+The on-disk layout is defined in Embedded-Code/main/log_format.h:
+
+    [file header][sensor table] ... padding up to header_len
+    [block header][records...]  repeated up to data_end
+
+Blocks hold variable-length records, each starting with a record header.
+Sample records carry a slot (completion time + channels) for each sensor set
+in their sensor mask, so slow sensors only appear every few records.
+Every sample record is numbered when it is acquired; records the device had
+to give up when its buffer filled, or never read because it fell behind its
+schedule or reset a sensor FIFO, are reported by gap records carrying the
+lost sequence range and per-sensor counts. Event records mark the flight
+states the device detected, timed from when each began.
+
+Channels are decoded on the device into int32 fixed point; the header names
+each channel and gives its unit and scale (physical value = value / scale).
+
+Blocks whose CRC does not match are skipped and the reader resynchronises
+on the next block magic. The device writes data_end at each checkpoint;
+blocks are numbered by their position in the file, so the ones written
+after it are still read as long as each is valid and carries the number of
+its position. The first that does not ends the log: a torn write at power
+loss, or the stale card contents of a pre-allocated file. Block CRCs also
+cover the file's random file_id, so blocks of an older log never pass.
+
+Each boot logs a flight as segment files F<flight>_<segment>.BIN, e.g.
+F0001_000.BIN, and appends a line to INDEX.CSV for every segment it closes.
+A segment listed twice was closed again after a power cut; the later line
+counts.
+"""
+
+import csv
+import os
+import re
+import struct
+import zlib
+from dataclasses import dataclass, field
+
+FILE_MAGIC = 0x474C5053   # "SPLG"
+BLOCK_MAGIC = 0x4B4C4253  # "SBLK"
+FORMAT_VERSION = 9
+
+FILE_PREALLOCATED = 0x01
+FILE_CLOSED = 0x02
+
+INDEX_FILE_NAME = 'INDEX.CSV'
+SEGMENT_NAME = re.compile(r'F(\d{4})_(\d{3})\.BIN$', re.IGNORECASE)
+
+RECORD_SAMPLE = 1
+RECORD_GAP = 2
+RECORD_EVENT = 3
+
+GAP_DROPPED = 0x01
+GAP_OVERWRITTEN = 0x02
+GAP_DECIMATED = 0x04
+GAP_STANDBY = 0x08        # Pad samples before the pre-trigger window, not a loss
+GAP_OVERRUN = 0x10        # Due on sampler ticks the device slept through, never read
+GAP_FIFO_RESET = 0x20     # Discarded with an overflowed sensor FIFO
+GAP_WRITE_FAILED = 0x40   # In a block the card did not take
+GAP_REASONS = {GAP_DROPPED: 'dropped', GAP_OVERWRITTEN: 'overwritten', GAP_DECIMATED: 'decimated',
+               GAP_STANDBY: 'standby', GAP_OVERRUN: 'overrun', GAP_FIFO_RESET: 'fifo-reset',
+               GAP_WRITE_FAILED: 'write-failed'}
+
+FLIGHT_STATES = ['standby', 'armed', 'boost', 'coast', 'descent', 'landed']
+
+FILE_HEADER = struct.Struct('<IHHHBBIIHHIqq')
+FILE_ID = struct.Struct('<I')
+SENSOR_DESC = struct.Struct('<12s12sBBH')
+CHANNEL_DESC = struct.Struct('<8s8si')
+BLOCK_HEADER = struct.Struct('<IIIHHI')
+RECORD_HEADER = struct.Struct('<HBBIIq')
+GAP_BODY = struct.Struct('<IqIB3x')
+GAP_COUNT = struct.Struct('<I')
+FLIGHT_EVENT = struct.Struct('<BB2xi')
+SENSOR_SLOT = struct.Struct('<I')
+
+CHANNEL_INVALID = -0x80000000
+
+
+class LogFormatError(Exception):
+    pass
+
+
+@dataclass
+class ChannelDesc:
+    name: str
+    unit: str
+    scale: int
+
+
+@dataclass
+class SensorDesc:
+    name: str
+    driver: str
+    address: int
+    rate_hz: int
+    channels: list = field(default_factory=list)
+
+
+@dataclass
+class LogHeader:
+    version: int
+    header_len: int
+    max_record_len: int
+    data_end: int = 0           # 0 = blocks run to the end of the file
+    file_id: int = 0
+    flags: int = 0
+    flight: int = 0
+    segment: int = 0
+    samples: int = 0            # Sample records up to data_end
+    first_us: int = 0
+    last_us: int = 0
+    sensors: list = field(default_factory=list)
+
+    def csv_columns(self):
+        """CSV column names: one time column plus the channels per sensor"""
+        columns = ['timestamp_us', 'sample_num']
+        for sensor in self.sensors:
+            columns.append(f'{sensor.name}_t_us')
+            columns.extend(f'{sensor.name}_{ch.name}' for ch in sensor.channels)
+        return columns
+
+
+@dataclass
+class Gap:
+    """Sample records the device lost between first_seq and last_seq"""
+    first_seq: int
+    last_seq: int
+    first_us: int
+    last_us: int
+    records: int
+    reason: int
+    lost: dict = field(default_factory=dict)    # Sensor name -> samples lost
+
+    def reasons(self):
+        return '+'.join(name for bit, name in GAP_REASONS.items() if self.reason & bit)
+
+
+@dataclass
+class FlightEvent:
+    """The device detected a new flight state, which began at timestamp_us"""
+    timestamp_us: int
+    state: str
+    previous: str
+    altitude_m: float
+
+
+@dataclass
+class DecodeStats:
+    blocks: int = 0
+    records: int = 0
+    bad_blocks: int = 0
+    skipped_bytes: int = 0
+    gaps: list = field(default_factory=list)
+    events: list = field(default_factory=list)
+
+    def lost(self):
+        """Samples lost per sensor name, summed over all gaps but the pad's"""
+        total = {}
+        for gap in self.gaps:
+            if gap.reason == GAP_STANDBY:
+                continue
+            for name, count in gap.lost.items():
+                total[name] = total.get(name, 0) + count
+        return total
+
+
+def parse_header(data):
+    """Parse the file header, sensor table and channel table from the start of a log"""
+    if len(data) < FILE_HEADER.size:
+        raise LogFormatError('File too short for a log header')
+
+    (magic, version, header_len, max_record_len, sensor_count, flags, data_end, file_id,
+     flight, segment, samples, first_us, last_us) = FILE_HEADER.unpack_from(data, 0)
+    if magic != FILE_MAGIC:
+        raise LogFormatError(f'Bad file magic 0x{magic:08X}')
+    if version != FORMAT_VERSION:
+        raise LogFormatError(f'Unsupported log version {version}')
+
+    header = LogHeader(version=version, header_len=header_len, max_record_len=max_record_len,
+                       data_end=data_end, file_id=file_id, flags=flags, flight=flight,
+                       segment=segment, samples=samples, first_us=first_us, last_us=last_us)
+    offset = FILE_HEADER.size
+    channel_counts = []
+    for _ in range(sensor_count):
+        name, driver, address, channel_count, rate_hz = SENSOR_DESC.unpack_from(data, offset)
+        header.sensors.append(SensorDesc(
+            name=_cstr(name),
+            driver=_cstr(driver),
+            address=address,
+            rate_hz=rate_hz,
+        ))
+        channel_counts.append(channel_count)
+        offset += SENSOR_DESC.size
+
+    for sensor, channel_count in zip(header.sensors, channel_counts):
+        for _ in range(channel_count):
+            name, unit, scale = CHANNEL_DESC.unpack_from(data, offset)
+            sensor.channels.append(ChannelDesc(name=_cstr(name), unit=_cstr(unit), scale=scale))
+            offset += CHANNEL_DESC.size
+
+    return header
+
+
+def _cstr(raw):
+    return raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+
+
+def iter_blocks(data, start, stats=None, end=0, file_id=0):
+    """
+    Yield the payload of every block with a valid CRC. From end on (if
+    nonzero) only valid blocks carrying the number of their position are
+    read; the first one that does not ends the log.
+    """
+    stats = stats or DecodeStats()
+    magic_bytes = struct.pack('<I', BLOCK_MAGIC)
+    crc_seed = zlib.crc32(FILE_ID.pack(file_id))
+    offset = start
+
+    while offset + BLOCK_HEADER.size <= len(data):
+        magic, seq, frame_len, payload_len, record_count, crc = BLOCK_HEADER.unpack_from(data, offset)
+        payload_start = offset + BLOCK_HEADER.size
+        payload = data[payload_start:payload_start + payload_len]
+
+        valid = (magic == BLOCK_MAGIC and
+                 frame_len >= BLOCK_HEADER.size + payload_len and
+                 len(payload) == payload_len and
+                 zlib.crc32(payload, crc_seed) == crc)
+        if end and offset >= end and not (valid and seq * frame_len == offset - start):
+            break
+        if valid:
+            stats.blocks += 1
+            yield seq, record_count, payload
+            offset += frame_len
+            continue
+
+        # Zeros are space a write never reached; anything else is a torn or
+        # corrupt block. Either way resync on the next block magic.
+        next_offset = data.find(magic_bytes, offset + 1)
+        if next_offset < 0:
+            next_offset = len(data)
+        if magic != 0:
+            stats.bad_blocks += 1
+            stats.skipped_bytes += next_offset - offset
+        offset = next_offset
+
+
+def iter_records(data, stats=None, last=None):
+    """
+    Yield (header, row) for every sample record, row being the CSV column
+    values. Each sensor contributes the absolute time its transaction
+    completed followed by its channels in physical units. Sensors missing
+    from a record repeat their last reading (empty until they have been read
+    once); channels the device could not read are empty. Gap records are
+    collected in stats.gaps, event records in stats.events. Pass the same last list to carry those
+    readings on into the next segment of a flight.
+    """
+    stats = stats or DecodeStats()
+    header = parse_header(data)
+    if last is None:
+        last = []
+    if not last:
+        last.extend([''] * (1 + len(sensor.channels)) for sensor in header.sensors)
+    layouts = [struct.Struct(f'<{len(sensor.channels)}i') for sensor in header.sensors]
+
+    for _, _, payload in iter_blocks(data, header.header_len, stats, header.data_end, header.file_id):
+        offset = 0
+        while offset + RECORD_HEADER.size <= len(payload):
+            length, rtype, mask, seq, sample_num, timestamp = RECORD_HEADER.unpack_from(payload, offset)
+            if length < RECORD_HEADER.size:
+                break
+
+            if rtype == RECORD_SAMPLE:
+                pos = offset + RECORD_HEADER.size
+                for i, sensor in enumerate(header.sensors):
+                    if mask & (1 << i):
+                        offset_us, = SENSOR_SLOT.unpack_from(payload, pos)
+                        pos += SENSOR_SLOT.size
+                        values = layouts[i].unpack_from(payload, pos)
+                        last[i] = [timestamp + offset_us,
+                                   *(_scaled(v, ch.scale) for v, ch in zip(values, sensor.channels))]
+                        pos += layouts[i].size
+                stats.records += 1
+                yield header, [timestamp, sample_num, *(b for values in last for b in values)]
+            elif rtype == RECORD_GAP:
+                stats.gaps.append(_parse_gap(header, payload, offset, mask, seq, timestamp))
+            elif rtype == RECORD_EVENT:
+                state, previous, altitude_cm = FLIGHT_EVENT.unpack_from(payload, offset + RECORD_HEADER.size)
+                stats.events.append(FlightEvent(timestamp_us=timestamp, state=_state_name(state),
+                                                previous=_state_name(previous), altitude_m=altitude_cm / 100))
+
+            offset += length
+
+
+def _parse_gap(header, payload, offset, mask, first_seq, first_us):
+    last_seq, last_us, records, reason = GAP_BODY.unpack_from(payload, offset + RECORD_HEADER.size)
+    gap = Gap(first_seq=first_seq, last_seq=last_seq, first_us=first_us, last_us=last_us,
+              records=records, reason=reason)
+    pos = offset + RECORD_HEADER.size + GAP_BODY.size
+    for i, sensor in enumerate(header.sensors):
+        if mask & (1 << i):
+            gap.lost[sensor.name], = GAP_COUNT.unpack_from(payload, pos)
+            pos += GAP_COUNT.size
+    return gap
+
+
+def _state_name(state):
+    return FLIGHT_STATES[state] if state < len(FLIGHT_STATES) else f'state {state}'
+
+
+def _scaled(value, scale):
+    if value == CHANNEL_INVALID:
+        return ''
+    return round(value / scale, 6) if scale != 1 else value
+
+
+def decode_file(path):
+    """Decode a whole log file. Returns (header, rows, stats)."""
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    stats = DecodeStats()
+    header = parse_header(data)
+    rows = [row for _, row in iter_records(data, stats)]
+    return header, rows, stats
+
+
+def decode_flight(paths):
+    """
+    Decode the segment files of one flight, in order, as one log. Returns
+    the first segment's header, the rows of all and the combined stats.
+    """
+    stats = DecodeStats()
+    rows = []
+    last = []
+    header = None
+    for path in paths:
+        with open(path, 'rb') as f:
+            data = f.read()
+        segment_header = parse_header(data)
+        if header is None:
+            header = segment_header
+        elif segment_header.csv_columns() != header.csv_columns():
+            raise LogFormatError(f'{path} has a different sensor table')
+        rows.extend(row for _, row in iter_records(data, stats, last))
+    if header is None:
+        raise LogFormatError('No segments to decode')
+    return header, rows, stats
+
+
+def find_segments(card_dir):
+    """Segment files in card_dir as {flight: [paths in segment order]}"""
+    flights = {}
+    for name in os.listdir(card_dir):
+        match = SEGMENT_NAME.match(name)
+        if match:
+            flight, segment = int(match.group(1)), int(match.group(2))
+            flights.setdefault(flight, []).append((segment, os.path.join(card_dir, name)))
+    return {flight: [path for _, path in sorted(segments)] for flight, segments in flights.items()}
+
+
+def read_index(card_dir):
+    """The index lines in card_dir as {file name: row dict}, the later line winning"""
+    entries = {}
+    path = os.path.join(card_dir, INDEX_FILE_NAME)
+    if not os.path.exists(path):
+        return entries
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            entries[row['file'].upper()] = {key: (value if key == 'file' else int(value))
+                                            for key, value in row.items()}
+    return entries
+
+
+def write_gaps_csv(header, gaps, out):
+    """Write one line per gap record with the samples each sensor lost"""
+    names = [sensor.name for sensor in header.sensors]
+    out.write(','.join(['first_seq', 'last_seq', 'first_us', 'last_us', 'records', 'reason',
+                        *(f'{name}_lost' for name in names)]) + '\n')
+    for gap in gaps:
+        row = [gap.first_seq, gap.last_seq, gap.first_us, gap.last_us, gap.records, gap.reasons(),
+               *(gap.lost.get(name, 0) for name in names)]
+        out.write(','.join(str(v) for v in row) + '\n')
+
+
+def write_csv(header, rows, out):
+    """Write rows in the CSV layout the firmware used to produce"""
+    out.write(','.join(header.csv_columns()) + '\n')
+    for row in rows:
+        out.write(','.join(str(v) for v in row) + '\n')